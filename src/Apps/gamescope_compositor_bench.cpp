@@ -0,0 +1,648 @@
+// Synthetic client load for measuring gamescope's commit -> composite -> present path.
+//
+// Intended to be run nested in a headless gamescope, eg.
+//   gamescope --backend headless --expose-wayland -- gamescope_compositor_bench --rate 120 --duration 10
+// with VK_ICD_FILENAMES pointing at lavapipe to get GPU timings without real hardware.
+//
+// Commits shm buffers on a fixed clock, and reports commit -> presented latency
+// as seen by the client from wp_presentation, along with gamescope's own
+// frame_timing_stats.
+//
+// With --input-probe, every so often has gamescope pretend some input was
+// delivered just before a commit, and checks gamescope's InputToPresent
+// against what the client saw. Exits non-zero if they disagree.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+#include <xdg-shell-client-protocol.h>
+#include <presentation-time-client-protocol.h>
+#include <gamescope-private-client-protocol.h>
+
+// TODO: Consolidate
+#define WAYLAND_NULL() []<typename... Args> ( void *pData, Args... args ) { }
+#define WAYLAND_USERDATA_TO_THIS(type, name) []<typename... Args> ( void *pData, Args... args ) { type *pThing = (type *)pData; pThing->name( std::forward<Args>(args)... ); }
+
+namespace gamescope
+{
+    static uint64_t GetMonotonicNanos()
+    {
+        timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        return uint64_t( ts.tv_sec ) * 1'000'000'000ul + uint64_t( ts.tv_nsec );
+    }
+
+    struct BenchOptions_t
+    {
+        uint32_t uSurfaces = 1;
+        uint32_t uRate = 60;
+        uint32_t uDuration = 10;
+        uint32_t uWidth = 1280;
+        uint32_t uHeight = 720;
+        bool bComposite = true;
+        const char *pszTracePath = nullptr;
+        // Every this many commits, 0 for never.
+        uint32_t uInputProbeInterval = 0;
+    };
+
+    class CCompositorBench;
+
+    struct BenchBuffer_t
+    {
+        wl_buffer *pBuffer = nullptr;
+        uint32_t *pPixels = nullptr;
+        bool bBusy = false;
+    };
+
+    struct BenchSurface_t
+    {
+        CCompositorBench *pBench = nullptr;
+
+        wl_surface *pSurface = nullptr;
+        xdg_surface *pXdgSurface = nullptr;
+        xdg_toplevel *pXdgToplevel = nullptr;
+        bool bConfigured = false;
+
+        BenchBuffer_t Buffers[2];
+        uint32_t uFrame = 0;
+    };
+
+    struct BenchFeedback_t
+    {
+        CCompositorBench *pBench = nullptr;
+        uint64_t ulCommitTime = 0;
+        // Either side of gamescope marking the probe's input, 0 without one.
+        uint64_t ulProbeBegin = 0;
+        uint64_t ulProbeEnd = 0;
+    };
+
+    // Gamescope's InputToPresent has to land within the client's bounds,
+    // give or take this much for the retire thread's wakeup.
+    static constexpr uint64_t k_ulInputProbeSlack = 2'000'000;
+
+    class CCompositorBench
+    {
+    public:
+        CCompositorBench( const BenchOptions_t &options ) : m_Options{ options } {}
+        ~CCompositorBench();
+
+        bool Init();
+        bool Run();
+        // False if --input-probe found gamescope's numbers to be off.
+        bool PrintResults();
+
+        void OnPresented( BenchFeedback_t *pFeedback, uint64_t ulPresentTime );
+        void OnDiscarded( BenchFeedback_t *pFeedback );
+    private:
+        bool CreateSurface( BenchSurface_t *pSurface );
+        bool CommitSurface( BenchSurface_t *pSurface );
+        void Execute( const char *pszName, const char *pszValue );
+
+        BenchOptions_t m_Options;
+
+        wl_display *m_pDisplay = nullptr;
+        wl_compositor *m_pCompositor = nullptr;
+        wl_shm *m_pShm = nullptr;
+        xdg_wm_base *m_pXdgWmBase = nullptr;
+        wp_presentation *m_pPresentation = nullptr;
+        gamescope_private *m_pGamescopePrivate = nullptr;
+
+        int m_nShmFd = -1;
+        void *m_pShmData = nullptr;
+        size_t m_zShmSize = 0;
+        wl_shm_pool *m_pShmPool = nullptr;
+
+        std::vector<BenchSurface_t> m_Surfaces;
+
+        uint32_t m_uPresentationClock = CLOCK_MONOTONIC;
+        uint64_t m_ulCommits = 0;
+        uint64_t m_ulDiscarded = 0;
+        uint64_t m_ulSkippedBusy = 0;
+        std::vector<uint64_t> m_ulLatencies;
+
+        // Probe input -> presented, from after and before gamescope marked it.
+        std::vector<uint64_t> m_ulProbeLatenciesMin;
+        std::vector<uint64_t> m_ulProbeLatenciesMax;
+        // p50 as gamescope saw it, from frame_timing_stats.
+        double m_flInputToPresentP50 = -1.0;
+
+        void Wayland_Registry_Global( wl_registry *pRegistry, uint32_t uName, const char *pInterface, uint32_t uVersion );
+        static const wl_registry_listener s_RegistryListener;
+
+        void Wayland_Presentation_ClockId( wp_presentation *pPresentation, uint32_t uClockId );
+        static const wp_presentation_listener s_PresentationListener;
+
+        void Wayland_GamescopePrivate_Log( gamescope_private *pGamescopePrivate, const char *pText );
+        static const gamescope_private_listener s_GamescopePrivateListener;
+    };
+
+    static const xdg_wm_base_listener s_XdgWmBaseListener =
+    {
+        .ping = []( void *pData, xdg_wm_base *pXdgWmBase, uint32_t uSerial ) { xdg_wm_base_pong( pXdgWmBase, uSerial ); },
+    };
+
+    static const xdg_surface_listener s_XdgSurfaceListener =
+    {
+        .configure = []( void *pData, xdg_surface *pXdgSurface, uint32_t uSerial )
+        {
+            BenchSurface_t *pSurface = (BenchSurface_t *)pData;
+            xdg_surface_ack_configure( pXdgSurface, uSerial );
+            pSurface->bConfigured = true;
+        },
+    };
+
+    static const xdg_toplevel_listener s_XdgToplevelListener =
+    {
+        .configure = WAYLAND_NULL(),
+        .close = WAYLAND_NULL(),
+        .configure_bounds = WAYLAND_NULL(),
+        .wm_capabilities = WAYLAND_NULL(),
+    };
+
+    static const wl_buffer_listener s_BufferListener =
+    {
+        .release = []( void *pData, wl_buffer *pBuffer ) { ( (BenchBuffer_t *)pData )->bBusy = false; },
+    };
+
+    static const wp_presentation_feedback_listener s_FeedbackListener =
+    {
+        .sync_output = WAYLAND_NULL(),
+        .presented = []( void *pData, struct wp_presentation_feedback *pFeedback, uint32_t uSecHi, uint32_t uSecLo, uint32_t uNSec, uint32_t uRefresh, uint32_t uSeqHi, uint32_t uSeqLo, uint32_t uFlags )
+        {
+            BenchFeedback_t *pBenchFeedback = (BenchFeedback_t *)pData;
+            uint64_t ulSec = ( uint64_t( uSecHi ) << 32 ) | uSecLo;
+            pBenchFeedback->pBench->OnPresented( pBenchFeedback, ulSec * 1'000'000'000ul + uNSec );
+            wp_presentation_feedback_destroy( pFeedback );
+        },
+        .discarded = []( void *pData, struct wp_presentation_feedback *pFeedback )
+        {
+            BenchFeedback_t *pBenchFeedback = (BenchFeedback_t *)pData;
+            pBenchFeedback->pBench->OnDiscarded( pBenchFeedback );
+            wp_presentation_feedback_destroy( pFeedback );
+        },
+    };
+
+    CCompositorBench::~CCompositorBench()
+    {
+        for ( BenchSurface_t &surface : m_Surfaces )
+        {
+            for ( BenchBuffer_t &buffer : surface.Buffers )
+            {
+                if ( buffer.pBuffer )
+                    wl_buffer_destroy( buffer.pBuffer );
+            }
+            if ( surface.pXdgToplevel )
+                xdg_toplevel_destroy( surface.pXdgToplevel );
+            if ( surface.pXdgSurface )
+                xdg_surface_destroy( surface.pXdgSurface );
+            if ( surface.pSurface )
+                wl_surface_destroy( surface.pSurface );
+        }
+
+        if ( m_pShmPool )
+            wl_shm_pool_destroy( m_pShmPool );
+        if ( m_pShmData )
+            munmap( m_pShmData, m_zShmSize );
+        if ( m_nShmFd >= 0 )
+            close( m_nShmFd );
+
+        if ( m_pDisplay )
+            wl_display_disconnect( m_pDisplay );
+    }
+
+    bool CCompositorBench::Init()
+    {
+        const char *pDisplayName = getenv( "GAMESCOPE_WAYLAND_DISPLAY" );
+        if ( !pDisplayName || !*pDisplayName )
+            pDisplayName = "gamescope-0";
+
+        if ( !( m_pDisplay = wl_display_connect( pDisplayName ) ) )
+        {
+            fprintf( stderr, "Failed to open GAMESCOPE_WAYLAND_DISPLAY.\n" );
+            return false;
+        }
+
+        wl_registry *pRegistry = wl_display_get_registry( m_pDisplay );
+        wl_registry_add_listener( pRegistry, &s_RegistryListener, (void *)this );
+        wl_display_roundtrip( m_pDisplay );
+        wl_display_roundtrip( m_pDisplay );
+        wl_registry_destroy( pRegistry );
+
+        if ( !m_pCompositor || !m_pShm || !m_pXdgWmBase )
+        {
+            fprintf( stderr, "Missing wl_compositor/wl_shm/xdg_wm_base. Is gamescope running with --expose-wayland?\n" );
+            return false;
+        }
+
+        if ( !m_pPresentation )
+            fprintf( stderr, "No wp_presentation, latency will not be reported.\n" );
+
+        if ( m_pGamescopePrivate )
+        {
+            Execute( "headless_composite", m_Options.bComposite ? "1" : "0" );
+            Execute( "frame_timing", "1" );
+
+            // So that it retires frames when it says they were presented.
+            if ( m_Options.uInputProbeInterval )
+                Execute( "headless_scanout_latency", "0" );
+        }
+        else if ( m_Options.uInputProbeInterval )
+        {
+            fprintf( stderr, "No gamescope_private, can't --input-probe.\n" );
+            return false;
+        }
+
+        // Two buffers per surface out of one pool.
+        const size_t zStride = m_Options.uWidth * 4;
+        const size_t zBufferSize = zStride * m_Options.uHeight;
+        m_zShmSize = zBufferSize * 2 * m_Options.uSurfaces;
+
+        m_nShmFd = memfd_create( "gamescope-compositor-bench", MFD_CLOEXEC );
+        if ( m_nShmFd < 0 || ftruncate( m_nShmFd, m_zShmSize ) != 0 )
+        {
+            perror( "Failed to create shm" );
+            return false;
+        }
+
+        m_pShmData = mmap( nullptr, m_zShmSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_nShmFd, 0 );
+        if ( m_pShmData == MAP_FAILED )
+        {
+            m_pShmData = nullptr;
+            perror( "Failed to map shm" );
+            return false;
+        }
+
+        m_pShmPool = wl_shm_create_pool( m_pShm, m_nShmFd, m_zShmSize );
+
+        m_Surfaces.resize( m_Options.uSurfaces );
+        for ( uint32_t i = 0; i < m_Options.uSurfaces; i++ )
+        {
+            BenchSurface_t *pSurface = &m_Surfaces[i];
+            pSurface->pBench = this;
+
+            for ( uint32_t j = 0; j < 2; j++ )
+            {
+                const size_t zOffset = ( i * 2 + j ) * zBufferSize;
+
+                BenchBuffer_t *pBuffer = &pSurface->Buffers[j];
+                pBuffer->pPixels = (uint32_t *)( (uint8_t *)m_pShmData + zOffset );
+                pBuffer->pBuffer = wl_shm_pool_create_buffer( m_pShmPool, zOffset, m_Options.uWidth, m_Options.uHeight, zStride, WL_SHM_FORMAT_XRGB8888 );
+                wl_buffer_add_listener( pBuffer->pBuffer, &s_BufferListener, pBuffer );
+            }
+
+            if ( !CreateSurface( pSurface ) )
+                return false;
+        }
+
+        // Wait for everything to be configured before we start the clock.
+        wl_display_roundtrip( m_pDisplay );
+        for ( BenchSurface_t &surface : m_Surfaces )
+        {
+            while ( !surface.bConfigured )
+            {
+                if ( wl_display_dispatch( m_pDisplay ) < 0 )
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool CCompositorBench::CreateSurface( BenchSurface_t *pSurface )
+    {
+        pSurface->pSurface = wl_compositor_create_surface( m_pCompositor );
+        pSurface->pXdgSurface = xdg_wm_base_get_xdg_surface( m_pXdgWmBase, pSurface->pSurface );
+        xdg_surface_add_listener( pSurface->pXdgSurface, &s_XdgSurfaceListener, pSurface );
+        pSurface->pXdgToplevel = xdg_surface_get_toplevel( pSurface->pXdgSurface );
+        xdg_toplevel_add_listener( pSurface->pXdgToplevel, &s_XdgToplevelListener, pSurface );
+        xdg_toplevel_set_title( pSurface->pXdgToplevel, "gamescope_compositor_bench" );
+        wl_surface_commit( pSurface->pSurface );
+
+        return true;
+    }
+
+    bool CCompositorBench::CommitSurface( BenchSurface_t *pSurface )
+    {
+        BenchBuffer_t *pBuffer = &pSurface->Buffers[ pSurface->uFrame % 2 ];
+        if ( pBuffer->bBusy )
+        {
+            // Compositor is still holding it, like a game would we just drop this frame.
+            m_ulSkippedBusy++;
+            return true;
+        }
+
+        // Touch one row so the content really changes, without the client
+        // spending all of its time filling pixels.
+        const uint32_t uRow = pSurface->uFrame % m_Options.uHeight;
+        std::fill_n( pBuffer->pPixels + uRow * m_Options.uWidth, m_Options.uWidth, 0xff000000u | ( pSurface->uFrame * 0x010203u ) );
+
+        wl_surface_attach( pSurface->pSurface, pBuffer->pBuffer, 0, 0 );
+        wl_surface_damage_buffer( pSurface->pSurface, 0, 0, m_Options.uWidth, m_Options.uHeight );
+
+        uint64_t ulProbeBegin = 0;
+        uint64_t ulProbeEnd = 0;
+        if ( m_Options.uInputProbeInterval && pSurface->uFrame % m_Options.uInputProbeInterval == 0 )
+        {
+            ulProbeBegin = GetMonotonicNanos();
+            Execute( "input_latency_probe", "" );
+            ulProbeEnd = GetMonotonicNanos();
+        }
+
+        if ( m_pPresentation )
+        {
+            BenchFeedback_t *pFeedback = new BenchFeedback_t{ this, GetMonotonicNanos(), ulProbeBegin, ulProbeEnd };
+            struct wp_presentation_feedback *pPresentationFeedback = wp_presentation_feedback( m_pPresentation, pSurface->pSurface );
+            wp_presentation_feedback_add_listener( pPresentationFeedback, &s_FeedbackListener, pFeedback );
+        }
+
+        wl_surface_commit( pSurface->pSurface );
+        pBuffer->bBusy = true;
+        pSurface->uFrame++;
+        m_ulCommits++;
+
+        return true;
+    }
+
+    bool CCompositorBench::Run()
+    {
+        const uint64_t ulInterval = 1'000'000'000ul / std::max( m_Options.uRate, 1u );
+        const uint64_t ulStart = GetMonotonicNanos();
+        const uint64_t ulEnd = ulStart + uint64_t( m_Options.uDuration ) * 1'000'000'000ul;
+
+        uint64_t ulNextCommit = ulStart;
+        for ( ;; )
+        {
+            uint64_t ulNow = GetMonotonicNanos();
+            if ( ulNow >= ulEnd )
+                break;
+
+            if ( ulNow >= ulNextCommit )
+            {
+                for ( BenchSurface_t &surface : m_Surfaces )
+                    CommitSurface( &surface );
+
+                ulNextCommit += ulInterval;
+                // Don't try to catch up if we fell behind.
+                if ( ulNextCommit < ulNow )
+                    ulNextCommit = ulNow + ulInterval;
+            }
+
+            if ( wl_display_flush( m_pDisplay ) < 0 && errno != EAGAIN )
+                return false;
+
+            ulNow = GetMonotonicNanos();
+            int nTimeout = ulNextCommit > ulNow ? int( ( ulNextCommit - ulNow ) / 1'000'000ul ) : 0;
+
+            pollfd pollFd = { wl_display_get_fd( m_pDisplay ), POLLIN, 0 };
+            if ( poll( &pollFd, 1, nTimeout ) > 0 )
+            {
+                if ( wl_display_dispatch( m_pDisplay ) < 0 )
+                    return false;
+            }
+            else if ( wl_display_dispatch_pending( m_pDisplay ) < 0 )
+            {
+                return false;
+            }
+        }
+
+        // Collect the stragglers.
+        wl_display_roundtrip( m_pDisplay );
+
+        return true;
+    }
+
+    void CCompositorBench::OnPresented( BenchFeedback_t *pFeedback, uint64_t ulPresentTime )
+    {
+        if ( m_uPresentationClock == CLOCK_MONOTONIC && ulPresentTime >= pFeedback->ulCommitTime )
+            m_ulLatencies.push_back( ulPresentTime - pFeedback->ulCommitTime );
+
+        if ( m_uPresentationClock == CLOCK_MONOTONIC && pFeedback->ulProbeBegin && ulPresentTime >= pFeedback->ulProbeEnd )
+        {
+            m_ulProbeLatenciesMin.push_back( ulPresentTime - pFeedback->ulProbeEnd );
+            m_ulProbeLatenciesMax.push_back( ulPresentTime - pFeedback->ulProbeBegin );
+        }
+
+        delete pFeedback;
+    }
+
+    void CCompositorBench::OnDiscarded( BenchFeedback_t *pFeedback )
+    {
+        m_ulDiscarded++;
+
+        delete pFeedback;
+    }
+
+    static uint64_t GetPercentile( std::vector<uint64_t> &ulValues, float flPercentile )
+    {
+        if ( ulValues.empty() )
+            return 0;
+
+        size_t uIndex = std::min<size_t>( size_t( flPercentile * ulValues.size() ), ulValues.size() - 1 );
+        std::nth_element( ulValues.begin(), ulValues.begin() + uIndex, ulValues.end() );
+        return ulValues[ uIndex ];
+    }
+
+    bool CCompositorBench::PrintResults()
+    {
+        fprintf( stdout, "Surfaces: %u, Rate: %uHz, Duration: %us, Size: %ux%u, Composite: %s\n",
+            m_Options.uSurfaces, m_Options.uRate, m_Options.uDuration, m_Options.uWidth, m_Options.uHeight,
+            m_Options.bComposite ? "true" : "false" );
+        fprintf( stdout, "Commits: %lu, Presented: %zu, Discarded: %lu, Skipped (buffer busy): %lu\n",
+            m_ulCommits, m_ulLatencies.size(), m_ulDiscarded, m_ulSkippedBusy );
+
+        if ( m_uPresentationClock != CLOCK_MONOTONIC )
+            fprintf( stdout, "Presentation clock is not CLOCK_MONOTONIC, not reporting latency.\n" );
+        else
+            fprintf( stdout, "Client commit -> presented: p50: %.3fms p90: %.3fms p99: %.3fms\n",
+                GetPercentile( m_ulLatencies, 0.50f ) / 1'000'000.0,
+                GetPercentile( m_ulLatencies, 0.90f ) / 1'000'000.0,
+                GetPercentile( m_ulLatencies, 0.99f ) / 1'000'000.0 );
+
+        if ( m_pGamescopePrivate )
+        {
+            fprintf( stdout, "Gamescope frame timings:\n" );
+            Execute( "frame_timing_stats", "" );
+
+            if ( m_Options.pszTracePath )
+                Execute( "frame_timing_dump", m_Options.pszTracePath );
+        }
+
+        if ( !m_Options.uInputProbeInterval )
+            return true;
+
+        if ( m_ulProbeLatenciesMin.empty() )
+        {
+            fprintf( stdout, "Input probe: FAIL, none of the probed commits were presented.\n" );
+            return false;
+        }
+
+        const uint64_t ulMin = GetPercentile( m_ulProbeLatenciesMin, 0.50f );
+        const uint64_t ulMax = GetPercentile( m_ulProbeLatenciesMax, 0.50f );
+        fprintf( stdout, "Input probe -> presented p50, client: %.3fms - %.3fms, gamescope: %.3fms over %zu probes\n",
+            ulMin / 1'000'000.0, ulMax / 1'000'000.0, m_flInputToPresentP50, m_ulProbeLatenciesMin.size() );
+
+        // Each probe's real latency is between its min and max, so the p50s bound each other the same way.
+        const double flLow = ( ulMin > k_ulInputProbeSlack ? ulMin - k_ulInputProbeSlack : 0 ) / 1'000'000.0;
+        const double flHigh = ( ulMax + k_ulInputProbeSlack ) / 1'000'000.0;
+        if ( m_flInputToPresentP50 <= 0.0 || m_flInputToPresentP50 < flLow || m_flInputToPresentP50 > flHigh )
+        {
+            fprintf( stdout, "Input probe: FAIL, gamescope's InputToPresent is outside %.3fms - %.3fms\n", flLow, flHigh );
+            return false;
+        }
+
+        fprintf( stdout, "Input probe: OK\n" );
+        return true;
+    }
+
+    void CCompositorBench::Execute( const char *pszName, const char *pszValue )
+    {
+        gamescope_private_execute( m_pGamescopePrivate, pszName, pszValue );
+        wl_display_roundtrip( m_pDisplay );
+    }
+
+    void CCompositorBench::Wayland_Registry_Global( wl_registry *pRegistry, uint32_t uName, const char *pInterface, uint32_t uVersion )
+    {
+        if ( !strcmp( pInterface, wl_compositor_interface.name ) )
+        {
+            m_pCompositor = (wl_compositor *)wl_registry_bind( pRegistry, uName, &wl_compositor_interface, std::min( uVersion, 4u ) );
+        }
+        else if ( !strcmp( pInterface, wl_shm_interface.name ) )
+        {
+            m_pShm = (wl_shm *)wl_registry_bind( pRegistry, uName, &wl_shm_interface, 1u );
+        }
+        else if ( !strcmp( pInterface, xdg_wm_base_interface.name ) )
+        {
+            m_pXdgWmBase = (xdg_wm_base *)wl_registry_bind( pRegistry, uName, &xdg_wm_base_interface, 1u );
+            xdg_wm_base_add_listener( m_pXdgWmBase, &s_XdgWmBaseListener, this );
+        }
+        else if ( !strcmp( pInterface, wp_presentation_interface.name ) )
+        {
+            m_pPresentation = (wp_presentation *)wl_registry_bind( pRegistry, uName, &wp_presentation_interface, 1u );
+            wp_presentation_add_listener( m_pPresentation, &s_PresentationListener, this );
+        }
+        else if ( !strcmp( pInterface, gamescope_private_interface.name ) )
+        {
+            m_pGamescopePrivate = (gamescope_private *)wl_registry_bind( pRegistry, uName, &gamescope_private_interface, uVersion );
+            gamescope_private_add_listener( m_pGamescopePrivate, &s_GamescopePrivateListener, this );
+        }
+    }
+
+    const wl_registry_listener CCompositorBench::s_RegistryListener =
+    {
+        .global        = WAYLAND_USERDATA_TO_THIS( CCompositorBench, Wayland_Registry_Global ),
+        .global_remove = WAYLAND_NULL(),
+    };
+
+    void CCompositorBench::Wayland_Presentation_ClockId( wp_presentation *pPresentation, uint32_t uClockId )
+    {
+        m_uPresentationClock = uClockId;
+    }
+
+    const wp_presentation_listener CCompositorBench::s_PresentationListener =
+    {
+        .clock_id = WAYLAND_USERDATA_TO_THIS( CCompositorBench, Wayland_Presentation_ClockId ),
+    };
+
+    void CCompositorBench::Wayland_GamescopePrivate_Log( gamescope_private *pGamescopePrivate, const char *pText )
+    {
+        fprintf( stdout, "  %s\n", pText );
+
+        double flP50, flP99;
+        if ( sscanf( pText, "InputToPresent p50: %lfms p99: %lfms", &flP50, &flP99 ) == 2 )
+            m_flInputToPresentP50 = flP50;
+    }
+
+    const gamescope_private_listener CCompositorBench::s_GamescopePrivateListener =
+    {
+        .log              = WAYLAND_USERDATA_TO_THIS( CCompositorBench, Wayland_GamescopePrivate_Log ),
+        .command_executed = WAYLAND_NULL(),
+    };
+
+    static void PrintUsage()
+    {
+        fprintf( stderr,
+            "usage: gamescope_compositor_bench [options]\n"
+            "  --surfaces N    number of toplevels committing buffers (default 1)\n"
+            "                  gamescope only paints the focused one, the rest add commit load\n"
+            "  --rate N        commits per second per surface (default 60)\n"
+            "  --duration N    seconds to run for (default 10)\n"
+            "  --size WxH      buffer size (default 1280x720)\n"
+            "  --no-composite  leave headless_composite off, measure CPU paths only\n"
+            "  --trace PATH    ask gamescope to dump a frame timing trace to PATH\n"
+            "  --input-probe N every N commits, have gamescope mark some input just before,\n"
+            "                  and check its InputToPresent against the client's. Needs one\n"
+            "                  surface, and a gamescope that hasn't seen other input\n" );
+    }
+
+    static int RunCompositorBench( int argc, char *argv[] )
+    {
+        BenchOptions_t options;
+
+        for ( int i = 1; i < argc; i++ )
+        {
+            std::string_view svArg = argv[i];
+            const bool bHasValue = i + 1 < argc;
+
+            if ( svArg == "--surfaces" && bHasValue )
+                options.uSurfaces = std::max( atoi( argv[++i] ), 1 );
+            else if ( svArg == "--rate" && bHasValue )
+                options.uRate = std::max( atoi( argv[++i] ), 1 );
+            else if ( svArg == "--duration" && bHasValue )
+                options.uDuration = std::max( atoi( argv[++i] ), 1 );
+            else if ( svArg == "--size" && bHasValue )
+            {
+                if ( sscanf( argv[++i], "%ux%u", &options.uWidth, &options.uHeight ) != 2 || !options.uWidth || !options.uHeight )
+                {
+                    PrintUsage();
+                    return 1;
+                }
+            }
+            else if ( svArg == "--no-composite" )
+                options.bComposite = false;
+            else if ( svArg == "--trace" && bHasValue )
+                options.pszTracePath = argv[++i];
+            else if ( svArg == "--input-probe" && bHasValue )
+                options.uInputProbeInterval = std::max( atoi( argv[++i] ), 1 );
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+
+        // Which of several surfaces is focused, and so gets measured, is up to gamescope.
+        if ( options.uInputProbeInterval && options.uSurfaces != 1 )
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        CCompositorBench bench{ options };
+        if ( !bench.Init() )
+            return 1;
+
+        if ( !bench.Run() )
+        {
+            fprintf( stderr, "Lost connection to gamescope.\n" );
+            return 1;
+        }
+
+        return bench.PrintResults() ? 0 : 1;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    return gamescope::RunCompositorBench( argc, argv );
+}
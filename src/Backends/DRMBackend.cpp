@@ -42,6 +42,7 @@
 #include "vblankmanager.hpp"
 #include "wlserver.hpp"
 #include "refresh_rate.h"
+#include "FrameTiming.h"
 #include <sys/utsname.h>
 
 #include "wlr_begin.hpp"
@@ -541,6 +542,8 @@ extern bool g_bDebugLayers;
 struct DRMPresentCtx
 {
 	uint64_t ulPendingFlipCount = 0;
+	// The frame timing record of what this flip puts on screen.
+	uint64_t ulFrameId = 0;
 };
 
 extern gamescope::ConVar<bool> cv_composite_force;
@@ -749,6 +752,7 @@ static void page_flip_handler(int fd, unsigned int frame, unsigned int sec, unsi
 	// This is the last vblank time
 	uint64_t vblanktime = sec * 1'000'000'000lu + usec * 1'000lu;
 	GetVBlankTimer().MarkVBlank( vblanktime, true );
+	gamescope::CFrameTimingRecorder::Get().MarkPresented( pCtx->ulFrameId, vblanktime );
 
 	// TODO: get the fbids_queued instance from data if we ever have more than one in flight
 
@@ -3885,6 +3889,10 @@ namespace gamescope
 
 			defer( if ( drm->req != nullptr ) { drmModeAtomicFree( drm->req ); drm->req = nullptr; } );
 
+			// Planes scan our textures out directly, make sure any uploads to them,
+			// eg. a new cursor image, are done.
+			vulkan_wait_for_texture_uploads( pFrameInfo );
+
 			bool isPageFlip = drm->flags & DRM_MODE_PAGE_FLIP_EVENT;
 			uint32_t uNewPendingFlipCount = 0;
 
@@ -3905,6 +3913,7 @@ namespace gamescope
 			uint32_t uCurrentPresentCtx = m_uNextPresentCtx;
 			m_uNextPresentCtx = ( m_uNextPresentCtx + 1 ) % 3;
 			m_PresentCtxs[uCurrentPresentCtx].ulPendingFlipCount = GetCurrentConnector()->PresentationFeedback().m_uQueuedPresents;
+			m_PresentCtxs[uCurrentPresentCtx].ulFrameId = gamescope::CFrameTimingRecorder::Get().GetCurrentFrameId();
 
 			drm_log.debugf("flip commit %" PRIu64, (uint64_t)GetCurrentConnector()->PresentationFeedback().m_uQueuedPresents);
 			gpuvis_trace_printf( "flip commit %" PRIu64, (uint64_t)GetCurrentConnector()->PresentationFeedback().m_uQueuedPresents );
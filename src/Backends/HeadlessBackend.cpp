@@ -2,12 +2,26 @@
 #include "rendervulkan.hpp"
 #include "wlserver.hpp"
 #include "refresh_rate.h"
+#include "steamcompmgr.hpp"
+#include "FrameTiming.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 extern int g_nPreferredOutputWidth;
 extern int g_nPreferredOutputHeight;
 
+extern void mangoapp_output_update( uint64_t vblanktime );
+
 namespace gamescope
 {
+    ConVar<int> cv_headless_refresh( "headless_refresh", 0, "Refresh rate of the headless virtual display in Hz. 0 to use -r (or 60)." );
+    ConVar<int> cv_headless_scanout_latency( "headless_scanout_latency", 0, "Simulated time from vblank to the frame being retired on the headless backend, in microseconds." );
+    ConVar<bool> cv_headless_composite( "headless_composite", false, "Actually composite frames on the headless backend, for measuring GPU cost." );
+
     class CHeadlessConnector final : public CBaseBackendConnector
     {
     public:
@@ -16,6 +30,14 @@ namespace gamescope
         }
         virtual ~CHeadlessConnector()
         {
+            {
+                std::unique_lock lock( m_PendingPresentsMutex );
+                m_bQuit = true;
+            }
+            m_PendingPresentsCV.notify_all();
+
+            if ( m_RetireThread.joinable() )
+                m_RetireThread.join();
         }
 
         virtual gamescope::GamescopeScreenType GetScreenType() const override
@@ -85,13 +107,104 @@ namespace gamescope
             return "Virtual Display";
         }
 
-		virtual int Present( const FrameInfo_t *pFrameInfo, bool bAsync ) override
-		{
+        virtual int Present( const FrameInfo_t *pFrameInfo, bool bAsync ) override
+        {
+            const bool bComposite = cv_headless_composite && pFrameInfo->layerCount != 0;
+            uint64_t ulCompositeSeqNo = 0;
+            if ( bComposite )
+            {
+                // TODO: Resolve const crap
+                std::optional oCompositeResult = vulkan_composite( (FrameInfo_t *)pFrameInfo, nullptr, false );
+                if ( !oCompositeResult )
+                    return -EINVAL;
+
+                // Nothing scans this out, so the retire thread waits for it
+                // instead of us.
+                ulCompositeSeqNo = *oCompositeResult;
+            }
+
+            GetVBlankTimer().UpdateWasCompositing( bComposite );
+            if ( !bComposite )
+                GetVBlankTimer().UpdateLastDrawTime( get_time_in_nanos() - g_SteamCompMgrVBlankTime.ulWakeupTime );
+
+            // Pretend we flipped on the next virtual vblank.
+            HeadlessPendingPresent_t present =
+            {
+                .ulPresentCount   = ++m_PresentFeedback.m_uQueuedPresents,
+                .ulFrameId        = CFrameTimingRecorder::Get().GetCurrentFrameId(),
+                .ulVBlankTime     = GetVBlankTimer().GetNextVBlank( 0 ),
+                .ulCompositeSeqNo = ulCompositeSeqNo,
+                .ulWakeupTime     = g_SteamCompMgrVBlankTime.ulWakeupTime,
+            };
+
+            {
+                std::unique_lock lock( m_PendingPresentsMutex );
+                m_PendingPresents.push_back( present );
+
+                if ( !m_RetireThread.joinable() )
+                    m_RetireThread = std::thread( [this]() { this->RetireThread(); } );
+            }
+            m_PendingPresentsCV.notify_one();
+
             return 0;
-		}
+        }
 
     private:
+        struct HeadlessPendingPresent_t
+        {
+            uint64_t ulPresentCount;
+            uint64_t ulFrameId;
+            uint64_t ulVBlankTime;
+            // 0 if nothing was composited.
+            uint64_t ulCompositeSeqNo;
+            uint64_t ulWakeupTime;
+        };
+
+        // Stands in for the page flip handler of a real display.
+        void RetireThread()
+        {
+            pthread_setname_np( pthread_self(), "gamescope-headless" );
+
+            for ( ;; )
+            {
+                HeadlessPendingPresent_t present;
+                {
+                    std::unique_lock lock( m_PendingPresentsMutex );
+                    m_PendingPresentsCV.wait( lock, [this]() { return m_bQuit || !m_PendingPresents.empty(); } );
+                    if ( m_bQuit )
+                        return;
+                    present = m_PendingPresents.front();
+                    m_PendingPresents.pop_front();
+                }
+
+                if ( present.ulCompositeSeqNo )
+                {
+                    vulkan_wait_for_completion( present.ulCompositeSeqNo );
+                    GetVBlankTimer().UpdateLastDrawTime( get_time_in_nanos() - present.ulWakeupTime );
+                }
+
+                const uint64_t ulScanoutLatency = uint64_t( std::max( cv_headless_scanout_latency.Get(), 0 ) ) * 1'000ul;
+                sleep_until_nanos( present.ulVBlankTime + ulScanoutLatency );
+
+                m_PresentFeedback.m_uCompletedPresents = present.ulPresentCount;
+                GetVBlankTimer().MarkVBlank( present.ulVBlankTime, true );
+                CFrameTimingRecorder::Get().MarkPresented( present.ulFrameId, get_time_in_nanos() );
+
+                mangoapp_output_update( present.ulVBlankTime );
+
+                // Nudge so that steamcompmgr releases commits.
+                nudge_steamcompmgr();
+            }
+        }
+
         BackendConnectorHDRInfo m_HDRInfo{};
+
+        std::mutex m_PendingPresentsMutex;
+        std::condition_variable m_PendingPresentsCV;
+        std::deque<HeadlessPendingPresent_t> m_PendingPresents;
+        bool m_bQuit = false;
+        // Started by the first Present, joined when the connector goes away.
+        std::thread m_RetireThread;
     };
 
 	class CHeadlessBackend final : public CBaseBackend
@@ -122,8 +235,14 @@ namespace gamescope
 			}
 			if ( g_nOutputWidth == 0 )
 				g_nOutputWidth = g_nOutputHeight * 16 / 9;
+			if ( cv_headless_refresh > 0 )
+			{
+				g_nOutputRefresh = ConvertHztomHz( cv_headless_refresh );
+				g_nNestedRefresh = 0;
+			}
 			if ( g_nOutputRefresh == 0 )
 				g_nOutputRefresh = ConvertHztomHz( 60 );
+			m_nAppliedRefresh = cv_headless_refresh;
 
 			if ( !vulkan_init( vulkan_get_instance(), VK_NULL_HANDLE ) )
 			{
@@ -172,6 +291,19 @@ namespace gamescope
 
 		virtual bool PollState() override
 		{
+			// The vblank timer follows g_nNestedRefresh over g_nOutputRefresh,
+			// so a runtime change has to win over -r too.
+			if ( cv_headless_refresh != m_nAppliedRefresh )
+			{
+				m_nAppliedRefresh = cv_headless_refresh;
+				if ( m_nAppliedRefresh > 0 )
+				{
+					g_nOutputRefresh = ConvertHztomHz( m_nAppliedRefresh );
+					g_nNestedRefresh = 0;
+					return true;
+				}
+			}
+
 			return false;
 		}
 
@@ -264,6 +396,7 @@ namespace gamescope
 	private:
 
         CHeadlessConnector m_Connector;
+        int m_nAppliedRefresh = 0;
 	};
 
 	/////////////////////////
@@ -633,6 +633,7 @@ namespace gamescope
                 openvr_log.errorf( "Failed to create dummy black texture." );
                 return false;
             }
+            vulkan_wait_for_texture_upload( m_pBlackTexture.get() );
 
             return true;
 		}
@@ -1521,6 +1522,9 @@ namespace gamescope
 
         if ( !bNeedsFullComposite )
         {
+            // OpenVR reads our textures directly, make sure any uploads to them are done.
+            vulkan_wait_for_texture_uploads( pFrameInfo );
+
             bool bNeedsBacking = true;
             if ( pFrameInfo->layerCount >= 1 )
             {
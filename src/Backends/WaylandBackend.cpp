@@ -1086,6 +1086,9 @@ namespace gamescope
 
             if ( !bNeedsFullComposite )
             {
+                // The host reads our textures directly, make sure any uploads to them are done.
+                vulkan_wait_for_texture_uploads( pFrameInfo );
+
                 bool bNeedsBacking = true;
                 if ( pFrameInfo->layerCount >= 1 )
                 {
@@ -2106,6 +2109,7 @@ namespace gamescope
                 xdg_log.errorf( "Failed to create dummy black texture." );
                 return false;
             }
+            vulkan_wait_for_texture_upload( m_pBlackTexture.get() );
             m_BlackFb = static_cast<CWaylandFb *>( m_pBlackTexture->GetBackendFb() );
         }
 
@@ -39,36 +39,38 @@ namespace gamescope
     // CBufferMemoizer
     ///////////////////
 
+    CBufferMemoizer::~CBufferMemoizer()
+    {
+        m_BufferMemos.RemoveAll( []( wlr_buffer *pBuffer, CBufferMemo *pMemo )
+        {
+            delete pMemo;
+        });
+    }
+
     OwningRc<CVulkanTexture> CBufferMemoizer::LookupVulkanTexture( wlr_buffer *pBuffer ) const
     {
-        std::scoped_lock lock{ m_mutBufferMemos };
-        auto iter = m_BufferMemos.find( pBuffer );
-        if ( iter == m_BufferMemos.end() )
+        // Holds off UnmemoizeBuffer deleting the memo until we have our own reference.
+        CEpochPointerMap<wlr_buffer, CBufferMemo>::ReadGuard guard{ m_BufferMemos };
+
+        CBufferMemo *pMemo = m_BufferMemos.Lookup( pBuffer, guard );
+        if ( !pMemo )
             return nullptr;
 
-        return iter->second.GetVulkanTexture();
+        return pMemo->GetVulkanTexture();
     }
 
     void CBufferMemoizer::MemoizeBuffer( wlr_buffer *pBuffer, OwningRc<CVulkanTexture> pTexture )
     {
         memo_log.debugf( "Memoizing new buffer: wlr_buffer %p -> texture: %p", pBuffer, pTexture.get() );
 
-        // Can't hold m_mutBufferMemos while we finalize link from pMemo to buffer
-        // as we can't have wlserver_lock held otherwise we can deadlock when
-        // adding the wl_signal.
+        // Can't hold wlserver_lock while inserting, as removal happens under it
+        // and would have to wait for us.
         //
-        // This is fine as the lookups only happen on one thread, that calls this
-        // or LookupVulkanTexture.
-        CBufferMemo *pMemo = nullptr;
-        {
-            std::scoped_lock lock{ m_mutBufferMemos };
-            auto [ iter, bSuccess ] = m_BufferMemos.emplace( std::piecewise_construct,
-                std::forward_as_tuple( pBuffer ),
-                std::forward_as_tuple( this, pBuffer, std::move( pTexture ) ) );
-
-            assert( bSuccess );
-            pMemo = &iter->second;
-        }
+        // Finalizing after publishing the memo is fine as the buffer can't be
+        // destroyed before we link up to its destroy signal, it's the one the
+        // commit we're importing for holds on to.
+        CBufferMemo *pMemo = new CBufferMemo( this, pBuffer, std::move( pTexture ) );
+        m_BufferMemos.Insert( pBuffer, pMemo );
         pMemo->Finalize();
     }
 
@@ -76,9 +78,9 @@ namespace gamescope
     {
         memo_log.debugf( "Unmemoizing buffer: wlr_buffer %p", pBuffer );
 
-        std::scoped_lock lock{ m_mutBufferMemos };
-        auto iter = m_BufferMemos.find( pBuffer );
-        assert( iter != m_BufferMemos.end() );
-        m_BufferMemos.erase( iter );
+        // Waits for any lookups still looking at the memo.
+        CBufferMemo *pMemo = m_BufferMemos.Remove( pBuffer );
+        assert( pMemo );
+        delete pMemo;
     }
-}
\ No newline at end of file
+}
@@ -2,9 +2,7 @@
 
 #include "rc.h"
 #include "rendervulkan.hpp"
-
-#include <unordered_map>
-#include <mutex>
+#include "Utils/EpochPointerMap.h"
 
 struct wl_listener;
 struct wlr_buffer;
@@ -45,14 +43,16 @@ namespace gamescope
     class CBufferMemoizer
     {
     public:
-        // Must return an OwningRc for the locking to make sense and not deadlock.
+        ~CBufferMemoizer();
+
+        // Doesn't lock, safe to call from any number of threads.
+        // Must return an OwningRc so the texture outlives the buffer being unmemoized.
         OwningRc<CVulkanTexture> LookupVulkanTexture( wlr_buffer *pBuffer ) const;
 
         void MemoizeBuffer( wlr_buffer *pBuffer, OwningRc<CVulkanTexture> pTexture );
         void UnmemoizeBuffer( wlr_buffer *pBuffer );
     private:
-        mutable std::mutex m_mutBufferMemos;
-        std::unordered_map<wlr_buffer *, CBufferMemo> m_BufferMemos;
+        CEpochPointerMap<wlr_buffer, CBufferMemo> m_BufferMemos;
     };
 
 }
@@ -0,0 +1,336 @@
+#include "FrameTiming.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <vector>
+
+#include <unistd.h>
+
+#include "steamcompmgr.hpp"
+
+namespace gamescope
+{
+    static LogScope s_FrameTimingLog( "frametiming" );
+
+    ConVar<bool> cv_frame_timing( "frame_timing", true, "Record per-frame stage timings. See frame_timing_stats and frame_timing_dump." );
+
+    std::string_view FrameStageToString( FrameStage eStage )
+    {
+        switch ( eStage )
+        {
+            case FrameStages::CommitLatch:      return "CommitLatch";
+            case FrameStages::PaintAll:         return "PaintAll";
+            case FrameStages::CompositeRecord:  return "CompositeRecord";
+            case FrameStages::CompositeGPU:     return "CompositeGPU";
+            case FrameStages::Present:          return "Present";
+            case FrameStages::Capture:          return "Capture";
+            case FrameStages::PipewireSubmit:   return "PipewireSubmit";
+            default:                            return "Unknown";
+        }
+    }
+
+    CFrameTimingRecorder &CFrameTimingRecorder::Get()
+    {
+        static CFrameTimingRecorder s_Recorder;
+        return s_Recorder;
+    }
+
+    uint64_t CFrameTimingRecorder::BeginFrame()
+    {
+        std::unique_lock lock( m_mutRecords );
+
+        const uint64_t ulFrameId = ++m_ulCurrentFrameId;
+
+        FrameTimingRecord_t *pRecord = &m_Records[ ulFrameId % k_unHistoryLength ];
+        *pRecord = FrameTimingRecord_t{};
+        pRecord->ulFrameId = ulFrameId;
+
+        return ulFrameId;
+    }
+
+    FrameTimingRecord_t *CFrameTimingRecorder::GetRecordLocked( uint64_t ulFrameId )
+    {
+        FrameTimingRecord_t *pRecord = &m_Records[ ulFrameId % k_unHistoryLength ];
+
+        // Fell out of the history already.
+        if ( pRecord->ulFrameId != ulFrameId )
+            return nullptr;
+
+        return pRecord;
+    }
+
+    void CFrameTimingRecorder::MarkStage( FrameStage eStage, uint64_t ulBegin, uint64_t ulEnd )
+    {
+        MarkStageForFrame( m_ulCurrentFrameId, eStage, ulBegin, ulEnd - ulBegin );
+    }
+
+    void CFrameTimingRecorder::MarkStageForFrame( uint64_t ulFrameId, FrameStage eStage, uint64_t ulBegin, uint64_t ulDuration )
+    {
+        if ( !cv_frame_timing )
+            return;
+
+        std::unique_lock lock( m_mutRecords );
+
+        FrameTimingRecord_t *pRecord = GetRecordLocked( ulFrameId );
+        if ( !pRecord )
+            return;
+
+        FrameStageTiming_t &stage = pRecord->Stages[ eStage ];
+        if ( !stage.ulBegin )
+            stage.ulBegin = ulBegin;
+        stage.ulDuration += ulDuration;
+    }
+
+    void CFrameTimingRecorder::MarkComposited( bool bComposited )
+    {
+        std::unique_lock lock( m_mutRecords );
+
+        FrameTimingRecord_t *pRecord = GetRecordLocked( m_ulCurrentFrameId );
+        if ( pRecord )
+            pRecord->bComposited = bComposited;
+    }
+
+    void CFrameTimingRecorder::MarkCommitLatched( uint64_t ulReadyTime, uint64_t ulLatchTime )
+    {
+        if ( !cv_frame_timing || !ulReadyTime || ulLatchTime < ulReadyTime )
+            return;
+
+        std::unique_lock lock( m_mutRecords );
+
+        // Keep the latest one if a frame latches more than once.
+        FrameTimingRecord_t *pRecord = GetRecordLocked( m_ulCurrentFrameId );
+        if ( pRecord )
+        {
+            pRecord->ulCommitReadyTime = ulReadyTime;
+            pRecord->ulCommitToLatch = ulLatchTime - ulReadyTime;
+        }
+    }
+
+    void CFrameTimingRecorder::MarkInputLatched( uint64_t ulInputTime )
+    {
+        if ( !cv_frame_timing || !ulInputTime )
+            return;
+
+        std::unique_lock lock( m_mutRecords );
+
+        // Keep the earliest one if a frame latches more than once,
+        // the first input is still only showing now.
+        FrameTimingRecord_t *pRecord = GetRecordLocked( m_ulCurrentFrameId );
+        if ( pRecord && ( !pRecord->ulInputTime || ulInputTime < pRecord->ulInputTime ) )
+            pRecord->ulInputTime = ulInputTime;
+    }
+
+    void CFrameTimingRecorder::MarkPresented( uint64_t ulFrameId, uint64_t ulPresentTime )
+    {
+        if ( !cv_frame_timing )
+            return;
+
+        std::unique_lock lock( m_mutRecords );
+
+        FrameTimingRecord_t *pRecord = GetRecordLocked( ulFrameId );
+        if ( !pRecord )
+            return;
+
+        if ( pRecord->ulCommitReadyTime && ulPresentTime >= pRecord->ulCommitReadyTime )
+            pRecord->ulCommitToPresent = ulPresentTime - pRecord->ulCommitReadyTime;
+
+        if ( pRecord->ulInputTime && ulPresentTime >= pRecord->ulInputTime )
+            pRecord->ulInputToPresent = ulPresentTime - pRecord->ulInputTime;
+    }
+
+    void CFrameTimingRecorder::MarkCaptured( uint64_t ulCaptureTime )
+    {
+        if ( !cv_frame_timing )
+            return;
+
+        std::unique_lock lock( m_mutRecords );
+
+        FrameTimingRecord_t *pRecord = GetRecordLocked( m_ulCurrentFrameId );
+        if ( pRecord && pRecord->ulInputTime && ulCaptureTime >= pRecord->ulInputTime )
+            pRecord->ulInputToCapture = ulCaptureTime - pRecord->ulInputTime;
+    }
+
+    FrameTimingRecord_t CFrameTimingRecorder::GetLastRecord() const
+    {
+        std::unique_lock lock( m_mutRecords );
+
+        // The frame in flight is still being filled in.
+        if ( m_ulCurrentFrameId < 2 )
+            return FrameTimingRecord_t{};
+
+        const FrameTimingRecord_t &record = m_Records[ ( m_ulCurrentFrameId - 1 ) % k_unHistoryLength ];
+        return record;
+    }
+
+    uint64_t CFrameTimingRecorder::GetPercentile( FrameStage eStage, float flPercentile ) const
+    {
+        return GetPercentile( nullptr, eStage, flPercentile );
+    }
+
+    uint64_t CFrameTimingRecorder::GetCommitToLatchPercentile( float flPercentile ) const
+    {
+        return GetPercentile( &FrameTimingRecord_t::ulCommitToLatch, FrameStages::Count, flPercentile );
+    }
+
+    uint64_t CFrameTimingRecorder::GetCommitToPresentPercentile( float flPercentile ) const
+    {
+        return GetPercentile( &FrameTimingRecord_t::ulCommitToPresent, FrameStages::Count, flPercentile );
+    }
+
+    uint64_t CFrameTimingRecorder::GetInputToPresentPercentile( float flPercentile ) const
+    {
+        return GetPercentile( &FrameTimingRecord_t::ulInputToPresent, FrameStages::Count, flPercentile );
+    }
+
+    uint64_t CFrameTimingRecorder::GetInputToCapturePercentile( float flPercentile ) const
+    {
+        return GetPercentile( &FrameTimingRecord_t::ulInputToCapture, FrameStages::Count, flPercentile );
+    }
+
+    // Either a per-frame value if pulValue is set, or a stage duration.
+    uint64_t CFrameTimingRecorder::GetPercentile( uint64_t FrameTimingRecord_t::*pulValue, FrameStage eStage, float flPercentile ) const
+    {
+        std::vector<uint64_t> ulDurations;
+        ulDurations.reserve( k_unHistoryLength );
+
+        {
+            std::unique_lock lock( m_mutRecords );
+            for ( const FrameTimingRecord_t &record : m_Records )
+            {
+                if ( !record.ulFrameId )
+                    continue;
+
+                uint64_t ulValue = pulValue ? record.*pulValue : record.Stages[ eStage ].ulDuration;
+                if ( ulValue )
+                    ulDurations.push_back( ulValue );
+            }
+        }
+
+        if ( ulDurations.empty() )
+            return 0;
+
+        size_t uIndex = std::min<size_t>( size_t( flPercentile * ulDurations.size() ), ulDurations.size() - 1 );
+        std::nth_element( ulDurations.begin(), ulDurations.begin() + uIndex, ulDurations.end() );
+        return ulDurations[ uIndex ];
+    }
+
+    std::string CFrameTimingRecorder::ExportPerfettoJSON() const
+    {
+        std::vector<FrameTimingRecord_t> records;
+        {
+            std::unique_lock lock( m_mutRecords );
+            records.assign( m_Records.begin(), m_Records.end() );
+        }
+
+        std::sort( records.begin(), records.end(),
+            []( const FrameTimingRecord_t &a, const FrameTimingRecord_t &b )
+            {
+                return a.ulFrameId < b.ulFrameId;
+            });
+
+        const int nPid = getpid();
+
+        // Chrome JSON trace format, which Perfetto and chrome://tracing both load.
+        // Each stage gets its own track so overlapping stages (eg. GPU) are readable.
+        std::string sJSON = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool bFirst = true;
+
+        for ( uint32_t i = 0; i < FrameStages::Count; i++ )
+        {
+            sJSON += std::format( "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                bFirst ? "" : ",", nPid, i + 1, FrameStageToString( FrameStage( i ) ) );
+            bFirst = false;
+        }
+
+        for ( const FrameTimingRecord_t &record : records )
+        {
+            if ( !record.ulFrameId )
+                continue;
+
+            for ( uint32_t i = 0; i < FrameStages::Count; i++ )
+            {
+                const FrameStageTiming_t &stage = record.Stages[ i ];
+                if ( !stage.ulBegin )
+                    continue;
+
+                // Trace timestamps are in microseconds.
+                sJSON += std::format( ",{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":{},\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{\"frame\":{},\"composited\":{}}}}}",
+                    FrameStageToString( FrameStage( i ) ), nPid, i + 1,
+                    stage.ulBegin / 1'000.0, stage.ulDuration / 1'000.0,
+                    record.ulFrameId, record.bComposited );
+            }
+        }
+
+        sJSON += "]}";
+        return sJSON;
+    }
+
+    bool CFrameTimingRecorder::DumpPerfettoJSON( const char *pszPath ) const
+    {
+        std::string sJSON = ExportPerfettoJSON();
+
+        FILE *pFile = fopen( pszPath, "w" );
+        if ( !pFile )
+        {
+            s_FrameTimingLog.errorf_errno( "Failed to open %s for writing", pszPath );
+            return false;
+        }
+
+        fwrite( sJSON.data(), 1, sJSON.size(), pFile );
+        fclose( pFile );
+        return true;
+    }
+
+    CScopedFrameStage::CScopedFrameStage( FrameStage eStage )
+        : m_eStage{ eStage }
+        , m_ulBegin{ cv_frame_timing ? get_time_in_nanos() : 0 }
+    {
+    }
+
+    CScopedFrameStage::~CScopedFrameStage()
+    {
+        if ( m_ulBegin )
+            CFrameTimingRecorder::Get().MarkStage( m_eStage, m_ulBegin, get_time_in_nanos() );
+    }
+
+    static ConCommand cc_frame_timing_stats( "frame_timing_stats", "Print p50/p99 frame stage timings over the recorded history.",
+    []( std::span<std::string_view> args )
+    {
+        CFrameTimingRecorder &recorder = CFrameTimingRecorder::Get();
+        for ( uint32_t i = 0; i < FrameStages::Count; i++ )
+        {
+            std::string_view svName = FrameStageToString( FrameStage( i ) );
+            console_log.infof( "%-16.*s p50: %.3fms p99: %.3fms",
+                (int)svName.size(), svName.data(),
+                recorder.GetPercentile( FrameStage( i ), 0.50f ) / 1'000'000.0,
+                recorder.GetPercentile( FrameStage( i ), 0.99f ) / 1'000'000.0 );
+        }
+        console_log.infof( "%-16s p50: %.3fms p99: %.3fms", "CommitToLatch",
+            recorder.GetCommitToLatchPercentile( 0.50f ) / 1'000'000.0,
+            recorder.GetCommitToLatchPercentile( 0.99f ) / 1'000'000.0 );
+        console_log.infof( "%-16s p50: %.3fms p99: %.3fms", "CommitToPresent",
+            recorder.GetCommitToPresentPercentile( 0.50f ) / 1'000'000.0,
+            recorder.GetCommitToPresentPercentile( 0.99f ) / 1'000'000.0 );
+        console_log.infof( "%-16s p50: %.3fms p99: %.3fms", "InputToPresent",
+            recorder.GetInputToPresentPercentile( 0.50f ) / 1'000'000.0,
+            recorder.GetInputToPresentPercentile( 0.99f ) / 1'000'000.0 );
+        console_log.infof( "%-16s p50: %.3fms p99: %.3fms", "InputToCapture",
+            recorder.GetInputToCapturePercentile( 0.50f ) / 1'000'000.0,
+            recorder.GetInputToCapturePercentile( 0.99f ) / 1'000'000.0 );
+    });
+
+    static ConCommand cc_frame_timing_dump( "frame_timing_dump", "Dump the recorded frame stage timings as a Perfetto/Chrome JSON trace. Usage: frame_timing_dump <path>",
+    []( std::span<std::string_view> args )
+    {
+        if ( args.size() != 2 )
+        {
+            console_log.errorf( "Usage: frame_timing_dump <path>" );
+            return;
+        }
+
+        std::string sPath{ args[1] };
+        if ( CFrameTimingRecorder::Get().DumpPerfettoJSON( sPath.c_str() ) )
+            console_log.infof( "Wrote frame timings to %s", sPath.c_str() );
+    });
+}
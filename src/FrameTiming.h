@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "convar.h"
+
+namespace gamescope
+{
+    namespace FrameStages
+    {
+        enum FrameStage : uint32_t
+        {
+            // handle_done_commits_*: latching newly-ready client commits.
+            CommitLatch,
+            // paint_all, end to end on the CPU.
+            PaintAll,
+            // vulkan_composite, recording + submitting the command buffer.
+            CompositeRecord,
+            // The composite command buffer's execution on the GPU.
+            CompositeGPU,
+            // IBackendConnector::Present.
+            Present,
+            // paint_pipewire, rendering into the capture buffer.
+            Capture,
+            // pipewire_submit_buffer.
+            PipewireSubmit,
+
+            Count,
+        };
+    }
+    using FrameStage = FrameStages::FrameStage;
+
+    std::string_view FrameStageToString( FrameStage eStage );
+
+    extern ConVar<bool> cv_frame_timing;
+
+    struct FrameStageTiming_t
+    {
+        // CLOCK_MONOTONIC nanos.
+        uint64_t ulBegin = 0;
+        // Accumulated, a stage may run more than once in a frame.
+        uint64_t ulDuration = 0;
+    };
+
+    struct FrameTimingRecord_t
+    {
+        uint64_t ulFrameId = 0;
+        std::array<FrameStageTiming_t, FrameStages::Count> Stages{};
+
+        // Whether this frame went to the display through a composite
+        // rather than direct scanout.
+        bool bComposited = false;
+
+        // When the focused app's commit latched this frame became ready.
+        uint64_t ulCommitReadyTime = 0;
+        // Time from that commit becoming ready to it being latched
+        // for display. 0 if nothing was latched.
+        uint64_t ulCommitToLatch = 0;
+        // Time from that commit becoming ready to the frame being
+        // retired by the backend. 0 if unknown.
+        uint64_t ulCommitToPresent = 0;
+
+        // When the first input that the latched commit is the answer to
+        // was delivered, 0 if it isn't answering any.
+        uint64_t ulInputTime = 0;
+        // Time from that input to the frame being retired by the backend.
+        uint64_t ulInputToPresent = 0;
+        // Time from that input to the frame going out to pipewire.
+        uint64_t ulInputToCapture = 0;
+    };
+
+    //
+    // A fixed ring of per-frame stage timings for the last
+    // k_unHistoryLength frames.
+    //
+    // Stages are attributed to the frame that is being built
+    // on the compositor thread at the time, except for GPU timings,
+    // which resolve later and are attributed by frame id.
+    //
+    class CFrameTimingRecorder
+    {
+    public:
+        static constexpr size_t k_unHistoryLength = 1024;
+
+        static CFrameTimingRecorder &Get();
+
+        // Starts a new frame, returns its id.
+        uint64_t BeginFrame();
+        uint64_t GetCurrentFrameId() const { return m_ulCurrentFrameId; }
+
+        void MarkStage( FrameStage eStage, uint64_t ulBegin, uint64_t ulEnd );
+        void MarkStageForFrame( uint64_t ulFrameId, FrameStage eStage, uint64_t ulBegin, uint64_t ulDuration );
+        void MarkComposited( bool bComposited );
+        void MarkCommitLatched( uint64_t ulReadyTime, uint64_t ulLatchTime );
+        // The focused app's commit latched for this frame came after input at ulInputTime.
+        void MarkInputLatched( uint64_t ulInputTime );
+        // For backends that know when a frame actually left, eg. on flip completion.
+        void MarkPresented( uint64_t ulFrameId, uint64_t ulPresentTime );
+        // This frame was handed to pipewire.
+        void MarkCaptured( uint64_t ulCaptureTime );
+
+        // The last frame before the one currently being built.
+        FrameTimingRecord_t GetLastRecord() const;
+
+        uint64_t GetPercentile( FrameStage eStage, float flPercentile ) const;
+        uint64_t GetCommitToLatchPercentile( float flPercentile ) const;
+        uint64_t GetCommitToPresentPercentile( float flPercentile ) const;
+        uint64_t GetInputToPresentPercentile( float flPercentile ) const;
+        uint64_t GetInputToCapturePercentile( float flPercentile ) const;
+
+        std::string ExportPerfettoJSON() const;
+        bool DumpPerfettoJSON( const char *pszPath ) const;
+
+    private:
+        FrameTimingRecord_t *GetRecordLocked( uint64_t ulFrameId );
+        uint64_t GetPercentile( uint64_t FrameTimingRecord_t::*pulValue, FrameStage eStage, float flPercentile ) const;
+
+        mutable std::mutex m_mutRecords;
+        std::array<FrameTimingRecord_t, k_unHistoryLength> m_Records{};
+        std::atomic<uint64_t> m_ulCurrentFrameId = { 0 };
+    };
+
+    class CScopedFrameStage
+    {
+    public:
+        CScopedFrameStage( FrameStage eStage );
+        ~CScopedFrameStage();
+
+    private:
+        FrameStage m_eStage;
+        uint64_t m_ulBegin = 0;
+    };
+}
@@ -0,0 +1,430 @@
+#include "GamepadMirror.h"
+
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "log.hpp"
+
+namespace gamescope
+{
+    static LogScope log_gamepad_mirror( "GamepadMirror" );
+
+    static constexpr size_t k_uBitsPerLong = sizeof( unsigned long ) * CHAR_BIT;
+
+    template <size_t N>
+    struct EvdevBits_t
+    {
+        unsigned long ulBits[ ( N + k_uBitsPerLong - 1 ) / k_uBitsPerLong ]{};
+
+        bool Test( size_t i ) const { return ( ulBits[ i / k_uBitsPerLong ] >> ( i % k_uBitsPerLong ) ) & 1; }
+    };
+
+    static uint64_t GetMonotonicTimeNs()
+    {
+        timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        return uint64_t( ts.tv_sec ) * 1'000'000'000ull + uint64_t( ts.tv_nsec );
+    }
+
+    static uint64_t GetEventTimeNs( const input_event &event )
+    {
+        return uint64_t( event.input_event_sec ) * 1'000'000'000ull + uint64_t( event.input_event_usec ) * 1'000ull;
+    }
+
+    CGamepadMirror::CGamepadMirror()
+    {
+    }
+
+    CGamepadMirror::~CGamepadMirror()
+    {
+        Detach();
+
+        if ( m_nUInputFD >= 0 )
+        {
+            ioctl( m_nUInputFD, UI_DEV_DESTROY );
+            close( m_nUInputFD );
+            m_nUInputFD = -1;
+        }
+    }
+
+    bool CGamepadMirror::Attach( int nSourceFD, const char *pszPhys )
+    {
+        Detach();
+
+        // So we can compare against when it gets to us.
+        int nClock = CLOCK_MONOTONIC;
+        ioctl( nSourceFD, EVIOCSCLOCKID, &nClock );
+        fcntl( nSourceFD, F_SETFL, fcntl( nSourceFD, F_GETFL ) | O_NONBLOCK );
+
+        if ( m_nUInputFD < 0 && !CreateMirror( nSourceFD, pszPhys ) )
+        {
+            close( nSourceFD );
+            return false;
+        }
+
+        // The same as the mirror's, unless that's a placeholder.
+        m_bRescaleAbs = false;
+        for ( uint32_t uCode = 0; uCode < ABS_CNT; uCode++ )
+        {
+            input_absinfo absInfo{};
+            if ( ioctl( nSourceFD, EVIOCGABS( uCode ), &absInfo ) != 0 )
+                absInfo = input_absinfo{};
+
+            m_SourceAbs[ uCode ] = AbsRange_t{ absInfo.minimum, absInfo.maximum };
+            if ( m_SourceAbs[ uCode ].nMin != m_MirrorAbs[ uCode ].nMin || m_SourceAbs[ uCode ].nMax != m_MirrorAbs[ uCode ].nMax )
+                m_bRescaleAbs = true;
+        }
+
+        m_nSourceFD = nSourceFD;
+
+        std::scoped_lock lock{ m_mutStats };
+        m_Stats.uAttaches++;
+        return true;
+    }
+
+    void CGamepadMirror::Detach()
+    {
+        if ( m_nSourceFD < 0 )
+            return;
+
+        close( m_nSourceFD );
+        m_nSourceFD = -1;
+
+        // Don't leave buttons held down or sticks pushed over
+        // while it's away.
+        bool bAny = false;
+        for ( size_t i = 0; i < m_KeysDown.size(); i++ )
+        {
+            if ( m_KeysDown.test( i ) )
+            {
+                Write( EV_KEY, uint16_t( i ), 0 );
+                bAny = true;
+            }
+        }
+        m_KeysDown.reset();
+
+        for ( const AbsRest_t &rest : m_AbsRest )
+        {
+            Write( EV_ABS, rest.uCode, rest.nValue );
+            bAny = true;
+        }
+
+        if ( bAny )
+            Write( EV_SYN, SYN_REPORT, 0 );
+    }
+
+    bool CGamepadMirror::Forward()
+    {
+        if ( m_nSourceFD < 0 )
+            return false;
+
+        for ( ;; )
+        {
+            input_event events[64];
+            ssize_t nRead = read( m_nSourceFD, events, sizeof( events ) );
+            if ( nRead < 0 )
+            {
+                if ( errno == EINTR )
+                    continue;
+                return errno == EAGAIN;
+            }
+
+            if ( nRead == 0 )
+                return false;
+
+            size_t uCount = size_t( nRead ) / sizeof( input_event );
+            size_t uOut = 0;
+            for ( size_t i = 0; i < uCount; i++ )
+            {
+                const input_event &event = events[i];
+
+                // Ours to deal with, the mirror never drops anything.
+                if ( event.type == EV_SYN && event.code == SYN_DROPPED )
+                    continue;
+
+                if ( event.type == EV_KEY && event.code < KEY_CNT )
+                    m_KeysDown.set( event.code, event.value != 0 );
+
+                events[ uOut ] = event;
+                if ( m_bRescaleAbs && event.type == EV_ABS && event.code < ABS_CNT )
+                {
+                    const AbsRange_t &from = m_SourceAbs[ event.code ];
+                    const AbsRange_t &to = m_MirrorAbs[ event.code ];
+                    if ( from.nMax > from.nMin && to.nMax > to.nMin )
+                    {
+                        double flT = double( int64_t( event.value ) - from.nMin ) / double( int64_t( from.nMax ) - from.nMin );
+                        events[ uOut ].value = int32_t( std::lround( to.nMin + flT * ( double( to.nMax ) - to.nMin ) ) );
+                    }
+                }
+                uOut++;
+            }
+
+            // Keep reading, so one bad write doesn't leave the rest
+            // of what the pad does stuck behind it.
+            if ( uOut && !WriteEvents( events, uOut ) )
+                continue;
+
+            uint64_t ulNow = GetMonotonicTimeNs();
+
+            std::scoped_lock lock{ m_mutStats };
+            m_Stats.ulEvents += uOut;
+            for ( size_t i = 0; i < uOut; i++ )
+            {
+                if ( events[i].type == EV_SYN && events[i].code == SYN_REPORT )
+                {
+                    uint64_t ulEventTime = GetEventTimeNs( events[i] );
+                    m_Stats.Latency.Add( ulNow > ulEventTime ? ulNow - ulEventTime : 0 );
+                }
+            }
+        }
+    }
+
+    GamepadMirrorStats_t CGamepadMirror::GetStats()
+    {
+        std::scoped_lock lock{ m_mutStats };
+        return m_Stats;
+    }
+
+    void CGamepadMirror::ResetStats()
+    {
+        std::scoped_lock lock{ m_mutStats };
+        m_Stats.Latency = CLockStats::Histogram_t{};
+        m_Stats.ulEvents = 0;
+        m_Stats.ulWriteFailures = 0;
+        m_Stats.ulDroppedEvents = 0;
+    }
+
+    bool CGamepadMirror::CreateMirror( int nSourceFD, const char *pszPhys )
+    {
+        int nFD = open( "/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC );
+        if ( nFD < 0 )
+            return false;
+
+        uinput_setup setup{};
+        if ( ioctl( nSourceFD, EVIOCGID, &setup.id ) < 0 ||
+             ioctl( nSourceFD, EVIOCGNAME( sizeof( setup.name ) - 1 ), setup.name ) < 0 )
+        {
+            close( nFD );
+            return false;
+        }
+
+        EvdevBits_t<EV_CNT> evBits;
+        ioctl( nSourceFD, EVIOCGBIT( 0, sizeof( evBits.ulBits ) ), evBits.ulBits );
+
+        struct
+        {
+            uint16_t uType;
+            uint32_t uCodeCount;
+            unsigned long ulSetBit;
+        } const kTypes[] =
+        {
+            { EV_KEY, KEY_CNT, UI_SET_KEYBIT },
+            { EV_ABS, ABS_CNT, UI_SET_ABSBIT },
+            { EV_REL, REL_CNT, UI_SET_RELBIT },
+            { EV_MSC, MSC_CNT, UI_SET_MSCBIT },
+            { EV_SW,  SW_CNT,  UI_SET_SWBIT  },
+        };
+
+        for ( const auto &type : kTypes )
+        {
+            if ( !evBits.Test( type.uType ) )
+                continue;
+
+            ioctl( nFD, UI_SET_EVBIT, type.uType );
+
+            EvdevBits_t<KEY_CNT> codeBits;
+            ioctl( nSourceFD, EVIOCGBIT( type.uType, sizeof( codeBits.ulBits ) ), codeBits.ulBits );
+            for ( uint32_t uCode = 0; uCode < type.uCodeCount; uCode++ )
+            {
+                if ( !codeBits.Test( uCode ) )
+                    continue;
+
+                ioctl( nFD, type.ulSetBit, uCode );
+
+                if ( type.uType == EV_ABS )
+                {
+                    uinput_abs_setup absSetup{};
+                    absSetup.code = uCode;
+                    if ( ioctl( nSourceFD, EVIOCGABS( uCode ), &absSetup.absinfo ) == 0 )
+                    {
+                        ioctl( nFD, UI_ABS_SETUP, &absSetup );
+                        m_MirrorAbs[ uCode ] = AbsRange_t{ absSetup.absinfo.minimum, absSetup.absinfo.maximum };
+                        // Where it is now, having just been plugged in, is where it rests.
+                        m_AbsRest.push_back( AbsRest_t{ uint16_t( uCode ), absSetup.absinfo.value } );
+                    }
+                }
+            }
+        }
+
+        EvdevBits_t<INPUT_PROP_CNT> propBits;
+        ioctl( nSourceFD, EVIOCGPROP( sizeof( propBits.ulBits ) ), propBits.ulBits );
+        for ( uint32_t uProp = 0; uProp < INPUT_PROP_CNT; uProp++ )
+        {
+            if ( propBits.Test( uProp ) )
+                ioctl( nFD, UI_SET_PROPBIT, uProp );
+        }
+
+        return FinishMirror( nFD, setup, pszPhys );
+    }
+
+    bool CGamepadMirror::CreatePlaceholder( const char *pszPhys )
+    {
+        if ( m_nUInputFD >= 0 )
+            return true;
+
+        int nFD = open( "/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC );
+        if ( nFD < 0 )
+            return false;
+
+        // What SDL and friends can map without knowing the pad.
+        static constexpr uint16_t k_uButtons[] =
+        {
+            BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST,
+            BTN_TL, BTN_TR, BTN_TL2, BTN_TR2,
+            BTN_SELECT, BTN_START, BTN_MODE, BTN_THUMBL, BTN_THUMBR,
+            BTN_DPAD_UP, BTN_DPAD_DOWN, BTN_DPAD_LEFT, BTN_DPAD_RIGHT,
+        };
+
+        struct
+        {
+            uint16_t uCode;
+            input_absinfo absInfo;
+        } const kAxes[] =
+        {
+            { ABS_X,     { .minimum = -32768, .maximum = 32767, .fuzz = 16, .flat = 128 } },
+            { ABS_Y,     { .minimum = -32768, .maximum = 32767, .fuzz = 16, .flat = 128 } },
+            { ABS_RX,    { .minimum = -32768, .maximum = 32767, .fuzz = 16, .flat = 128 } },
+            { ABS_RY,    { .minimum = -32768, .maximum = 32767, .fuzz = 16, .flat = 128 } },
+            { ABS_Z,     { .minimum = 0,      .maximum = 255 } },
+            { ABS_RZ,    { .minimum = 0,      .maximum = 255 } },
+            { ABS_HAT0X, { .minimum = -1,     .maximum = 1 } },
+            { ABS_HAT0Y, { .minimum = -1,     .maximum = 1 } },
+        };
+
+        ioctl( nFD, UI_SET_EVBIT, EV_KEY );
+        for ( uint16_t uButton : k_uButtons )
+            ioctl( nFD, UI_SET_KEYBIT, uButton );
+
+        ioctl( nFD, UI_SET_EVBIT, EV_ABS );
+        for ( const auto &axis : kAxes )
+        {
+            ioctl( nFD, UI_SET_ABSBIT, axis.uCode );
+
+            uinput_abs_setup absSetup{};
+            absSetup.code = axis.uCode;
+            absSetup.absinfo = axis.absInfo;
+            ioctl( nFD, UI_ABS_SETUP, &absSetup );
+
+            m_MirrorAbs[ axis.uCode ] = AbsRange_t{ axis.absInfo.minimum, axis.absInfo.maximum };
+            m_AbsRest.push_back( AbsRest_t{ axis.uCode, axis.absInfo.value } );
+        }
+
+        uinput_setup setup{};
+        setup.id.bustype = BUS_VIRTUAL;
+        setup.id.version = 1;
+        snprintf( setup.name, sizeof( setup.name ), "Gamescope Gamepad" );
+
+        return FinishMirror( nFD, setup, pszPhys );
+    }
+
+    bool CGamepadMirror::FinishMirror( int nFD, const uinput_setup &setup, const char *pszPhys )
+    {
+        if ( pszPhys )
+            ioctl( nFD, UI_SET_PHYS, pszPhys );
+
+        if ( ioctl( nFD, UI_DEV_SETUP, &setup ) < 0 || ioctl( nFD, UI_DEV_CREATE ) < 0 )
+        {
+            int nErrno = errno;
+            close( nFD );
+            m_AbsRest.clear();
+            m_MirrorAbs.fill( AbsRange_t{} );
+            errno = nErrno;
+            return false;
+        }
+
+        m_nUInputFD = nFD;
+        m_sName = setup.name;
+        m_sDevNode = GetUInputDevNode( nFD );
+        return true;
+    }
+
+    void CGamepadMirror::Write( uint16_t uType, uint16_t uCode, int32_t nValue )
+    {
+        if ( m_nUInputFD < 0 )
+            return;
+
+        input_event event{};
+        event.type = uType;
+        event.code = uCode;
+        event.value = nValue;
+        WriteEvents( &event, 1 );
+    }
+
+    bool CGamepadMirror::WriteEvents( const input_event *pEvents, size_t uCount )
+    {
+        ssize_t nWritten;
+        do
+        {
+            nWritten = write( m_nUInputFD, pEvents, uCount * sizeof( input_event ) );
+        } while ( nWritten < 0 && errno == EINTR );
+
+        if ( nWritten == ssize_t( uCount * sizeof( input_event ) ) )
+        {
+            if ( m_bWriteFailing )
+                log_gamepad_mirror.infof( "Writing to mirror %s works again", m_sDevNode.c_str() );
+            m_bWriteFailing = false;
+            return true;
+        }
+
+        // uinput takes whole events, so a short write lost the rest.
+        size_t uDropped = nWritten > 0 ? uCount - size_t( nWritten ) / sizeof( input_event ) : uCount;
+        if ( !m_bWriteFailing )
+        {
+            if ( nWritten < 0 )
+                log_gamepad_mirror.errorf_errno( "Failed to write %zu event(s) to mirror %s", uCount, m_sDevNode.c_str() );
+            else
+                log_gamepad_mirror.errorf( "Only wrote %zu of %zu event(s) to mirror %s", uCount - uDropped, uCount, m_sDevNode.c_str() );
+        }
+        m_bWriteFailing = true;
+
+        std::scoped_lock lock{ m_mutStats };
+        m_Stats.ulWriteFailures++;
+        m_Stats.ulDroppedEvents += uDropped;
+        return false;
+    }
+
+    std::string CGamepadMirror::GetUInputDevNode( int nUInputFD )
+    {
+        char szSysName[64]{};
+        if ( ioctl( nUInputFD, UI_GET_SYSNAME( sizeof( szSysName ) ), szSysName ) < 0 )
+            return "";
+
+        // evdev makes its eventN under the uinput device, and devtmpfs the node
+        // for it, before UI_DEV_CREATE returns. udev only gets to it later.
+        std::string sInputDir = std::string( "/sys/devices/virtual/input/" ) + szSysName;
+        DIR *pDir = opendir( sInputDir.c_str() );
+        if ( !pDir )
+            return "";
+
+        std::string sDevNode;
+        while ( dirent *pEntry = readdir( pDir ) )
+        {
+            if ( strncmp( pEntry->d_name, "event", 5 ) == 0 )
+            {
+                sDevNode = std::string( "/dev/input/" ) + pEntry->d_name;
+                break;
+            }
+        }
+        closedir( pDir );
+
+        return sDevNode;
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "LockStats.h"
+#include "Utils/NonCopyable.h"
+
+namespace gamescope
+{
+    struct GamepadMirrorStats_t
+    {
+        // From the kernel timestamping the event on the real device
+        // to it having been written to the mirror, per SYN_REPORT.
+        CLockStats::Histogram_t Latency;
+        uint64_t ulEvents = 0;
+        // Writes to the mirror that failed, and the events lost with them.
+        uint64_t ulWriteFailures = 0;
+        uint64_t ulDroppedEvents = 0;
+        uint32_t uAttaches = 0;
+    };
+
+    //
+    // A uinput copy of an evdev device we have grabbed, so that only what
+    // we forward to it gets seen, and whoever is reading the copy never
+    // notices the real one going away and coming back.
+    //
+    // Made from the first device attached, later ones are assumed to be
+    // the same thing again. Or made up front as a generic gamepad, for one
+    // that isn't there yet, and whatever turns up is squeezed into that.
+    // Force feedback isn't forwarded.
+    //
+    class CGamepadMirror : public NonCopyable
+    {
+    public:
+        CGamepadMirror();
+        ~CGamepadMirror();
+
+        // Makes the mirror the first time, and starts forwarding from nSourceFD,
+        // which it takes ownership of, grabbed or not.
+        bool Attach( int nSourceFD, const char *pszPhys );
+        // Makes the mirror without anything to copy, with the buttons and axes
+        // of a generic gamepad, so it's there to point children at before the
+        // real one is. Axes of whatever is attached later are rescaled to fit.
+        bool CreatePlaceholder( const char *pszPhys );
+        // The real one went away. Lets go of anything still held down on the mirror.
+        void Detach();
+
+        // Forwards everything there is to read. False once the real one is gone.
+        bool Forward();
+
+        bool IsAttached() const { return m_nSourceFD >= 0; }
+        int GetSourceFD() const { return m_nSourceFD; }
+        // /dev/input/eventN of the mirror, empty before the first Attach.
+        const std::string &GetDevNode() const { return m_sDevNode; }
+        const std::string &GetName() const { return m_sName; }
+
+        GamepadMirrorStats_t GetStats();
+        void ResetStats();
+
+        // /dev/input/eventN for a uinput fd, there as soon as UI_DEV_CREATE returns.
+        static std::string GetUInputDevNode( int nUInputFD );
+
+    private:
+        bool CreateMirror( int nSourceFD, const char *pszPhys );
+        bool FinishMirror( int nFD, const uinput_setup &setup, const char *pszPhys );
+        void Write( uint16_t uType, uint16_t uCode, int32_t nValue );
+        bool WriteEvents( const input_event *pEvents, size_t uCount );
+
+        int m_nSourceFD = -1;
+        int m_nUInputFD = -1;
+        std::string m_sDevNode;
+        std::string m_sName;
+
+        // What we've said is down, and where the axes sit untouched,
+        // to put back on Detach.
+        std::bitset<KEY_CNT> m_KeysDown;
+        struct AbsRest_t
+        {
+            uint16_t uCode;
+            int32_t nValue;
+        };
+        std::vector<AbsRest_t> m_AbsRest;
+
+        // Axis ranges of the mirror and of what's attached to it, which
+        // only differ for a placeholder.
+        struct AbsRange_t
+        {
+            int32_t nMin = 0;
+            int32_t nMax = 0;
+        };
+        std::array<AbsRange_t, ABS_CNT> m_MirrorAbs{};
+        std::array<AbsRange_t, ABS_CNT> m_SourceAbs{};
+        bool m_bRescaleAbs = false;
+
+        // Only the first of a run of failed writes is logged.
+        bool m_bWriteFailing = false;
+
+        std::mutex m_mutStats;
+        GamepadMirrorStats_t m_Stats;
+    };
+}
@@ -0,0 +1,380 @@
+#include "HeldGamepads.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <libudev.h>
+
+#include "convar.h"
+#include "log.hpp"
+#include "Utils/Defer.h"
+
+namespace gamescope
+{
+    static LogScope log_held_gamepads( "HeldGamepads" );
+
+    static std::mutex s_mutHeldGamepads;
+    static CHeldGamepads *s_pHeldGamepads = nullptr;
+
+    static ConCommand cc_held_gamepad_stats( "held_gamepad_stats", "Show the --held-gamepad-dev controllers, their mirrors, and how long forwarding takes.",
+    []( std::span<std::string_view> args )
+    {
+        std::scoped_lock lock{ s_mutHeldGamepads };
+        if ( !s_pHeldGamepads )
+        {
+            console_log.infof( "Not holding any gamepads." );
+            return;
+        }
+
+        s_pHeldGamepads->DumpStats();
+    });
+
+    static ConCommand cc_held_gamepad_stats_reset( "held_gamepad_stats_reset", "Reset the held gamepad forwarding stats.",
+    []( std::span<std::string_view> args )
+    {
+        std::scoped_lock lock{ s_mutHeldGamepads };
+        if ( s_pHeldGamepads )
+            s_pHeldGamepads->ResetStats();
+    });
+
+    CHeldGamepads::CHeldGamepad::CHeldGamepad( CHeldGamepads *pParent, std::string sPath )
+        : pParent{ pParent }
+        , Spec{ .sPath = std::move( sPath ) }
+    {
+    }
+
+    void CHeldGamepads::CHeldGamepad::OnPollIn()
+    {
+        if ( !Mirror.Forward() )
+            pParent->Disconnect( *this );
+    }
+
+    void CHeldGamepads::CHeldGamepad::OnPollHangUp()
+    {
+        pParent->Disconnect( *this );
+    }
+
+    CHeldGamepads::CHeldGamepads()
+    {
+    }
+
+    CHeldGamepads::~CHeldGamepads()
+    {
+        {
+            std::scoped_lock lock{ s_mutHeldGamepads };
+            if ( s_pHeldGamepads == this )
+                s_pHeldGamepads = nullptr;
+        }
+
+        m_Waiter.Shutdown();
+
+        if ( m_pUdevMonitor )
+            udev_monitor_unref( m_pUdevMonitor );
+        if ( m_pUdev )
+            udev_unref( m_pUdev );
+    }
+
+    bool CHeldGamepads::Init( const std::vector<std::string> &paths )
+    {
+        m_pUdev = udev_new();
+        if ( !m_pUdev )
+        {
+            log_held_gamepads.errorf( "Failed to create udev interface" );
+            return false;
+        }
+
+        // Start listening before looking for them, so nothing plugged in
+        // in between gets missed.
+        m_pUdevMonitor = udev_monitor_new_from_netlink( m_pUdev, "udev" );
+        if ( m_pUdevMonitor )
+        {
+            udev_monitor_filter_add_match_subsystem_devtype( m_pUdevMonitor, "input", nullptr );
+            if ( udev_monitor_enable_receiving( m_pUdevMonitor ) < 0 )
+            {
+                udev_monitor_unref( m_pUdevMonitor );
+                m_pUdevMonitor = nullptr;
+            }
+        }
+
+        if ( !m_pUdevMonitor )
+            log_held_gamepads.warnf( "Failed to create udev monitor, held gamepads will not come back if they are unplugged" );
+
+        for ( const std::string &sPath : paths )
+        {
+            CHeldGamepad &pad = *m_Pads.emplace_back( std::make_unique<CHeldGamepad>( this, sPath ) );
+
+            std::optional<InputDeviceIdentity_t> oIdentity = GetInputDeviceIdentity( m_pUdev, sPath.c_str() );
+            if ( oIdentity && Connect( pad, *oIdentity ) )
+                continue;
+
+            // Children only get told about the mirrors once, when they start.
+            std::scoped_lock lock{ m_mutPads };
+            if ( pad.Mirror.CreatePlaceholder( GetMirrorPhys( pad ).c_str() ) )
+                log_held_gamepads.warnf( "Gamepad %s isn't there, mirrored at %s as a generic gamepad until it is", sPath.c_str(), pad.Mirror.GetDevNode().c_str() );
+            else
+                log_held_gamepads.errorf_errno( "Gamepad %s isn't there, and failed to make a mirror for it", sPath.c_str() );
+        }
+
+        if ( m_pUdevMonitor )
+        {
+            m_pUdevWaitable = std::make_unique<CFunctionWaitable>( udev_monitor_get_fd( m_pUdevMonitor ), [this]() { DispatchUdev(); } );
+            m_Waiter.AddWaitable( m_pUdevWaitable.get() );
+        }
+
+        std::scoped_lock lock{ s_mutHeldGamepads };
+        s_pHeldGamepads = this;
+        return true;
+    }
+
+    std::vector<std::string> CHeldGamepads::GetMirrorDevNodes()
+    {
+        std::scoped_lock lock{ m_mutPads };
+
+        std::vector<std::string> devNodes;
+        for ( const auto &pPad : m_Pads )
+        {
+            if ( !pPad->Mirror.GetDevNode().empty() )
+                devNodes.push_back( pPad->Mirror.GetDevNode() );
+        }
+        return devNodes;
+    }
+
+    static bool WriteProcFile( const char *pszPath, const char *pszContents )
+    {
+        int nFD = open( pszPath, O_WRONLY | O_CLOEXEC );
+        if ( nFD < 0 )
+            return false;
+        defer( close( nFD ) );
+
+        size_t uLength = strlen( pszContents );
+        return write( nFD, pszContents, uLength ) == ssize_t( uLength );
+    }
+
+    bool CHeldGamepads::RestrictChildToMirrors( const std::vector<std::string> &mirrors )
+    {
+        uid_t uUid = getuid();
+        gid_t uGid = getgid();
+        bool bUserNamespace = geteuid() != 0;
+        if ( unshare( CLONE_NEWNS | ( bUserNamespace ? CLONE_NEWUSER : 0 ) ) != 0 )
+        {
+            log_held_gamepads.errorf_errno( "Failed to make a namespace for held gamepads, children can see every gamepad" );
+            return false;
+        }
+
+        if ( bUserNamespace )
+        {
+            // Just ourselves, as ourselves.
+            char szUidMap[64];
+            char szGidMap[64];
+            snprintf( szUidMap, sizeof( szUidMap ), "%u %u 1\n", uUid, uUid );
+            snprintf( szGidMap, sizeof( szGidMap ), "%u %u 1\n", uGid, uGid );
+            if ( !WriteProcFile( "/proc/self/setgroups", "deny" ) ||
+                 !WriteProcFile( "/proc/self/uid_map", szUidMap ) ||
+                 !WriteProcFile( "/proc/self/gid_map", szGidMap ) )
+            {
+                log_held_gamepads.errorf_errno( "Failed to map ids in the held gamepad namespace, children can see every gamepad" );
+                return false;
+            }
+        }
+
+        // So what we mount doesn't make it back out, as root with no user namespace.
+        if ( mount( nullptr, "/", nullptr, MS_REC | MS_SLAVE, nullptr ) != 0 )
+        {
+            log_held_gamepads.errorf_errno( "Failed to make the held gamepad namespace private, children can see every gamepad" );
+            return false;
+        }
+
+        // Open them before /dev/input gets covered up, to bind them back in.
+        // In here, as a bind mount has to come from our own namespace.
+        std::vector<int> mirrorFDs;
+        defer(
+            for ( int nFD : mirrorFDs )
+            {
+                if ( nFD >= 0 )
+                    close( nFD );
+            }
+        );
+        for ( const std::string &sMirror : mirrors )
+        {
+            int nFD = open( sMirror.c_str(), O_PATH | O_CLOEXEC );
+            if ( nFD < 0 )
+                log_held_gamepads.errorf_errno( "Failed to open mirror %s", sMirror.c_str() );
+            mirrorFDs.push_back( nFD );
+        }
+
+        if ( mount( "tmpfs", "/dev/input", "tmpfs", MS_NOSUID | MS_NOEXEC, "mode=0755" ) != 0 )
+        {
+            log_held_gamepads.errorf_errno( "Failed to hide /dev/input, children can see every gamepad" );
+            return false;
+        }
+
+        bool bAll = true;
+        for ( size_t i = 0; i < mirrors.size(); i++ )
+        {
+            const std::string &sMirror = mirrors[ i ];
+            if ( mirrorFDs[ i ] < 0 )
+            {
+                bAll = false;
+                continue;
+            }
+
+            int nTargetFD = open( sMirror.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+            if ( nTargetFD >= 0 )
+                close( nTargetFD );
+
+            char szSource[64];
+            snprintf( szSource, sizeof( szSource ), "/proc/self/fd/%d", mirrorFDs[ i ] );
+            if ( nTargetFD < 0 || mount( szSource, sMirror.c_str(), nullptr, MS_BIND, nullptr ) != 0 )
+            {
+                log_held_gamepads.errorf_errno( "Failed to give children mirror %s", sMirror.c_str() );
+                bAll = false;
+            }
+        }
+
+        return bAll;
+    }
+
+    std::string CHeldGamepads::GetMirrorPhys( const CHeldGamepad &pad ) const
+    {
+        size_t uIndex = 0;
+        while ( m_Pads[ uIndex ].get() != &pad )
+            uIndex++;
+
+        char szPhys[64];
+        snprintf( szPhys, sizeof( szPhys ), "gamescope-%d/input%zu", getpid(), uIndex );
+        return szPhys;
+    }
+
+    bool CHeldGamepads::Connect( CHeldGamepad &pad, const InputDeviceIdentity_t &identity )
+    {
+        int nFD = open( identity.sDevNode.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+        if ( nFD < 0 )
+        {
+            log_held_gamepads.errorf_errno( "Failed to open gamepad %s", identity.sDevNode.c_str() );
+            return false;
+        }
+
+        // Nobody else gets to read it, the mirror is what they get instead.
+        bool bGrabbed = ioctl( nFD, EVIOCGRAB, 1 ) == 0;
+        if ( !bGrabbed )
+            log_held_gamepads.warnf( "Failed to grab gamepad %s exclusively", identity.sDevNode.c_str() );
+
+        std::string sPhys = GetMirrorPhys( pad );
+
+        {
+            std::scoped_lock lock{ m_mutPads };
+            if ( !pad.Mirror.Attach( nFD, sPhys.c_str() ) )
+            {
+                log_held_gamepads.errorf_errno( "Failed to mirror gamepad %s", identity.sDevNode.c_str() );
+                return false;
+            }
+
+            pad.sDevNode = identity.sDevNode;
+            pad.bGrabbed = bGrabbed;
+
+            // Remember what it is, to know it again if it is replugged.
+            if ( !pad.Spec.oIdentity && !identity.sVendorId.empty() )
+                pad.Spec.oIdentity = identity;
+        }
+
+        m_Waiter.AddWaitable( &pad );
+
+        log_held_gamepads.infof( "Holding gamepad %s (%s) at %s, mirrored at %s",
+            pad.Spec.sPath.c_str(), pad.Mirror.GetName().c_str(), identity.sDevNode.c_str(), pad.Mirror.GetDevNode().c_str() );
+        return true;
+    }
+
+    void CHeldGamepads::Disconnect( CHeldGamepad &pad )
+    {
+        if ( !pad.Mirror.IsAttached() )
+            return;
+
+        m_Waiter.RemoveWaitable( &pad );
+
+        std::scoped_lock lock{ m_mutPads };
+        pad.Mirror.Detach();
+        pad.sDevNode.clear();
+        pad.bGrabbed = false;
+
+        log_held_gamepads.infof( "Lost gamepad %s", pad.Spec.sPath.c_str() );
+    }
+
+    void CHeldGamepads::DispatchUdev()
+    {
+        while ( udev_device *pDevice = udev_monitor_receive_device( m_pUdevMonitor ) )
+        {
+            defer( udev_device_unref( pDevice ) );
+
+            const char *pszAction = udev_device_get_action( pDevice );
+            const char *pszDevNode = udev_device_get_devnode( pDevice );
+            if ( !pszAction || !pszDevNode )
+                continue;
+
+            if ( !strcmp( pszAction, "remove" ) )
+            {
+                for ( auto &pPad : m_Pads )
+                {
+                    if ( pPad->Mirror.IsAttached() && pPad->sDevNode == pszDevNode )
+                        Disconnect( *pPad );
+                }
+            }
+            else if ( !strcmp( pszAction, "add" ) )
+            {
+                // Including our own mirrors turning up.
+                bool bOurs = std::any_of( m_Pads.begin(), m_Pads.end(), [&]( const auto &pPad )
+                {
+                    return pPad->sDevNode == pszDevNode || pPad->Mirror.GetDevNode() == pszDevNode;
+                });
+                if ( bOurs )
+                    continue;
+
+                std::optional<InputDeviceIdentity_t> oIdentity = GetInputDeviceIdentity( pDevice );
+                if ( !oIdentity )
+                    continue;
+
+                for ( auto &pPad : m_Pads )
+                {
+                    if ( !pPad->Mirror.IsAttached() && IsHeldInputDevice( pPad->Spec, *oIdentity ) )
+                    {
+                        Connect( *pPad, *oIdentity );
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void CHeldGamepads::DumpStats()
+    {
+        std::scoped_lock lock{ m_mutPads };
+        for ( const auto &pPad : m_Pads )
+        {
+            GamepadMirrorStats_t stats = pPad->Mirror.GetStats();
+            console_log.infof( "%s: %s%s -> %s, connected %u time(s), %lu events, %lu failed writes dropping %lu events, latency p50 %.1fus p99 %.1fus max %.1fus over %lu reports",
+                pPad->Spec.sPath.c_str(),
+                pPad->Mirror.IsAttached() ? pPad->sDevNode.c_str() : "not connected",
+                pPad->Mirror.IsAttached() ? ( pPad->bGrabbed ? " (grabbed)" : " (NOT grabbed)" ) : "",
+                pPad->Mirror.GetDevNode().empty() ? "no mirror" : pPad->Mirror.GetDevNode().c_str(),
+                stats.uAttaches,
+                stats.ulEvents,
+                stats.ulWriteFailures,
+                stats.ulDroppedEvents,
+                stats.Latency.GetPercentileNs( 50 ) / 1'000.0,
+                stats.Latency.GetPercentileNs( 99 ) / 1'000.0,
+                stats.Latency.ulMaxNs / 1'000.0,
+                stats.Latency.GetCount() );
+        }
+    }
+
+    void CHeldGamepads::ResetStats()
+    {
+        std::scoped_lock lock{ m_mutPads };
+        for ( const auto &pPad : m_Pads )
+            pPad->Mirror.ResetStats();
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "waitable.h"
+#include "GamepadMirror.h"
+#include "HeldInputDevice.h"
+
+struct udev;
+struct udev_monitor;
+
+namespace gamescope
+{
+    //
+    // --held-gamepad-dev: controllers that only this instance gets.
+    //
+    // The real device is grabbed, as --libinput-hold-dev does for keyboards
+    // and mice, and its events are forwarded to a CGamepadMirror for our
+    // children to read instead. Replugging it re-grabs it and carries on
+    // forwarding to the same mirror, so games don't see it go.
+    //
+    class CHeldGamepads
+    {
+    public:
+        CHeldGamepads();
+        ~CHeldGamepads();
+
+        // Grabs what's there and makes the mirrors, placeholders for what
+        // isn't. Needs doing before any children are started, to tell them
+        // where the mirrors are.
+        bool Init( const std::vector<std::string> &paths );
+
+        // /dev/input/eventN of each mirror that got made.
+        std::vector<std::string> GetMirrorDevNodes();
+
+        // For a child, between fork and exec: puts it in its own mount
+        // namespace where /dev/input has only these mirrors in it, so it
+        // can't see the real pads or any other instance's mirrors.
+        //
+        // Unless we're root, that needs an unprivileged user namespace,
+        // where setuid binaries no longer gain anything. Children are
+        // started regardless if it fails, just without the restriction.
+        static bool RestrictChildToMirrors( const std::vector<std::string> &mirrors );
+
+        void DumpStats();
+        void ResetStats();
+
+    private:
+        class CHeldGamepad final : public IWaitable
+        {
+        public:
+            CHeldGamepad( CHeldGamepads *pParent, std::string sPath );
+
+            int GetFD() override { return Mirror.GetSourceFD(); }
+            void OnPollIn() override;
+            void OnPollHangUp() override;
+
+            CHeldGamepads *pParent;
+            HeldInputDeviceSpec_t Spec;
+            CGamepadMirror Mirror;
+            // The real one, while it's plugged in.
+            std::string sDevNode;
+            bool bGrabbed = false;
+        };
+
+        std::string GetMirrorPhys( const CHeldGamepad &pad ) const;
+        bool Connect( CHeldGamepad &pad, const InputDeviceIdentity_t &identity );
+        void Disconnect( CHeldGamepad &pad );
+        void DispatchUdev();
+
+        udev *m_pUdev = nullptr;
+        udev_monitor *m_pUdevMonitor = nullptr;
+        std::unique_ptr<CFunctionWaitable> m_pUdevWaitable;
+
+        // Connecting and disconnecting only happens on the waiter thread
+        // after Init, locked for reading from elsewhere.
+        std::mutex m_mutPads;
+        std::vector<std::unique_ptr<CHeldGamepad>> m_Pads;
+
+        // Last, its thread runs the above.
+        CAsyncWaiter<CRawPointer<IWaitable>, 16> m_Waiter{ "gamescope-gamepad" };
+    };
+}
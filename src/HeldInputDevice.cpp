@@ -0,0 +1,122 @@
+#include "HeldInputDevice.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include <libudev.h>
+#include <sys/stat.h>
+
+#include "Utils/Defer.h"
+
+namespace gamescope
+{
+    static std::string GetProperty( udev_device *pDevice, const char *pszName )
+    {
+        const char *pszValue = udev_device_get_property_value( pDevice, pszName );
+        return pszValue ? pszValue : "";
+    }
+
+    static std::string GetSysAttr( udev_device *pDevice, const char *pszName )
+    {
+        const char *pszValue = udev_device_get_sysattr_value( pDevice, pszName );
+        if ( !pszValue )
+            return "";
+
+        std::string sValue = pszValue;
+        while ( !sValue.empty() && ( sValue.back() == '\n' || sValue.back() == ' ' ) )
+            sValue.pop_back();
+        return sValue;
+    }
+
+    std::optional<InputDeviceIdentity_t> GetInputDeviceIdentity( udev_device *pDevice )
+    {
+        const char *pszSysName = udev_device_get_sysname( pDevice );
+        const char *pszDevNode = udev_device_get_devnode( pDevice );
+        if ( !pszSysName || !pszDevNode || strncmp( pszSysName, "event", 5 ) != 0 )
+            return std::nullopt;
+
+        InputDeviceIdentity_t identity;
+        identity.sDevNode = pszDevNode;
+
+        udev_list_entry *pEntry;
+        udev_list_entry_foreach( pEntry, udev_device_get_devlinks_list_entry( pDevice ) )
+            identity.DevLinks.emplace_back( udev_list_entry_get_name( pEntry ) );
+
+        identity.sIdPath = GetProperty( pDevice, "ID_PATH" );
+        identity.sVendorId = GetProperty( pDevice, "ID_VENDOR_ID" );
+        identity.sModelId = GetProperty( pDevice, "ID_MODEL_ID" );
+        identity.sSerial = GetProperty( pDevice, "ID_SERIAL_SHORT" );
+        identity.sInterfaceNum = GetProperty( pDevice, "ID_USB_INTERFACE_NUM" );
+
+        // The rest lives on the inputN the eventN belongs to. Also where to look
+        // for Bluetooth and virtual devices, which udev doesn't give USB ids to,
+        // or without udevd running at all.
+        if ( udev_device *pInput = udev_device_get_parent_with_subsystem_devtype( pDevice, "input", nullptr ) )
+        {
+            identity.sName = GetSysAttr( pInput, "name" );
+            identity.sPhys = GetSysAttr( pInput, "phys" );
+
+            if ( identity.sVendorId.empty() )
+                identity.sVendorId = GetSysAttr( pInput, "id/vendor" );
+            if ( identity.sModelId.empty() )
+                identity.sModelId = GetSysAttr( pInput, "id/product" );
+            if ( identity.sSerial.empty() )
+                identity.sSerial = GetSysAttr( pInput, "uniq" );
+        }
+
+        return identity;
+    }
+
+    std::optional<InputDeviceIdentity_t> GetInputDeviceIdentity( udev *pUdev, const char *pszPath )
+    {
+        struct stat st;
+        if ( stat( pszPath, &st ) != 0 || !S_ISCHR( st.st_mode ) )
+            return std::nullopt;
+
+        udev_device *pDevice = udev_device_new_from_devnum( pUdev, 'c', st.st_rdev );
+        if ( !pDevice )
+            return std::nullopt;
+        defer( udev_device_unref( pDevice ) );
+
+        return GetInputDeviceIdentity( pDevice );
+    }
+
+    static bool IsEventNode( std::string_view svPath )
+    {
+        return svPath.starts_with( "/dev/input/event" );
+    }
+
+    bool IsHeldInputDevice( const HeldInputDeviceSpec_t &spec, const InputDeviceIdentity_t &identity )
+    {
+        // eventN gets handed to whatever shows up next, so only links go by path.
+        if ( !IsEventNode( spec.sPath ) )
+        {
+            if ( identity.sDevNode == spec.sPath ||
+                 std::find( identity.DevLinks.begin(), identity.DevLinks.end(), spec.sPath ) != identity.DevLinks.end() )
+                return true;
+        }
+
+        if ( !spec.oIdentity )
+            return IsEventNode( spec.sPath ) && identity.sDevNode == spec.sPath;
+
+        const InputDeviceIdentity_t &held = *spec.oIdentity;
+
+        if ( held.sVendorId.empty() || held.sModelId.empty() )
+            return false;
+
+        if ( held.sVendorId != identity.sVendorId ||
+             held.sModelId != identity.sModelId ||
+             held.sInterfaceNum != identity.sInterfaceNum ||
+             held.sName != identity.sName )
+            return false;
+
+        if ( !held.sSerial.empty() )
+            return held.sSerial == identity.sSerial;
+
+        if ( !held.sIdPath.empty() )
+            return held.sIdPath == identity.sIdPath;
+
+        return !held.sPhys.empty() && held.sPhys == identity.sPhys;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+struct udev;
+struct udev_device;
+
+namespace gamescope
+{
+    // What an evdev node is, in a way that stays the same when it is
+    // unplugged and plugged back in and comes back as another eventN.
+    struct InputDeviceIdentity_t
+    {
+        std::string sDevNode;
+        // /dev/input/by-path/..., /dev/input/by-id/...
+        std::vector<std::string> DevLinks;
+
+        // The port it's plugged into, eg. pci-0000:00:14.0-usb-0:2:1.0
+        std::string sIdPath;
+        // The kernel's idea of the same, eg. usb-0000:00:14.0-2/input0, for when udev has none.
+        std::string sPhys;
+        std::string sVendorId;
+        std::string sModelId;
+        std::string sSerial;
+        // Keyboards and mice often have a few, eg. the keys and the media keys.
+        std::string sInterfaceNum;
+        std::string sName;
+    };
+
+    // Reads it out of udev, std::nullopt if it isn't an eventN.
+    std::optional<InputDeviceIdentity_t> GetInputDeviceIdentity( udev_device *pDevice );
+    // The same, for whatever is at pszPath right now, following links.
+    std::optional<InputDeviceIdentity_t> GetInputDeviceIdentity( udev *pUdev, const char *pszPath );
+
+    // One of --libinput-hold-dev.
+    struct HeldInputDeviceSpec_t
+    {
+        // As given on the command line.
+        std::string sPath;
+        // Of whatever was there the first time we found it.
+        std::optional<InputDeviceIdentity_t> oIdentity;
+    };
+
+    // Whether a device that has just turned up is the held one back again:
+    //  - Something at the path we were given, if it's a by-path or by-id link.
+    //  - The same vendor, model, serial, interface and name, wherever it's plugged in.
+    //  - Without a serial, the same vendor, model, interface and name on the same port.
+    //  - If we never saw it, something at the eventN we were given.
+    bool IsHeldInputDevice( const HeldInputDeviceSpec_t &spec, const InputDeviceIdentity_t &identity );
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <optional>
+
+#include "Utils/NonCopyable.h"
+
+namespace gamescope
+{
+    struct ImagePoolKey_t
+    {
+        uint32_t uWidth = 0;
+        uint32_t uHeight = 0;
+        uint32_t uDrmFormat = 0;
+        // What it's for. Images are only ever handed out again for the same thing.
+        uint32_t uUsage = 0;
+
+        bool operator == ( const ImagePoolKey_t &other ) const = default;
+    };
+
+    struct ImagePoolStats_t
+    {
+        uint64_t ulBytes = 0;
+        uint64_t ulPeakBytes = 0;
+        uint32_t uImages = 0;
+        uint64_t ulAllocations = 0;
+        uint64_t ulReuses = 0;
+        uint64_t ulEvictions = 0;
+    };
+
+    //
+    // Keeps images around by size, format and usage, so that flipping between
+    // resolutions (fullscreen toggles, dynamic render scale, split-screen
+    // tiles resizing) hands back the images from last time rather than
+    // allocating new ones each way.
+    //
+    // Once the images add up to more than the budget, the least recently used
+    // ones that are idle are let go of. Ones still in use are never evicted,
+    // so it can go over for a while, until the next Acquire after they're
+    // done with.
+    //
+    // TImage needs:
+    //   bool IsIdle() const         - nothing but the pool is holding on to it
+    //   uint64_t GetSize() const    - bytes of memory it takes up
+    //
+    template <typename TImage>
+    class CImagePool : public NonCopyable
+    {
+    public:
+        CImagePool( uint64_t ulBudget, uint32_t uMaxPerKey )
+            : m_ulBudget{ ulBudget }
+            , m_uMaxPerKey{ uMaxPerKey }
+        {
+        }
+
+        // Returns an idle image for key, the most recently used if there are a few,
+        // or one made with fnCreate if there are none, which returns std::optional<TImage>.
+        //
+        // bShared hands out the most recently used one even if it is in use, for
+        // scratch images that are only ever used one submission after another.
+        //
+        // Returns nullptr if creating one failed, or there are already
+        // uMaxPerKey of them in use.
+        template <typename TCreate>
+        TImage *Acquire( const ImagePoolKey_t &key, bool bShared, TCreate fnCreate )
+        {
+            m_ulTick++;
+
+            Slot_t *pBest = nullptr;
+            uint32_t uMatching = 0;
+            for ( Slot_t &slot : m_Slots )
+            {
+                if ( !( slot.Key == key ) )
+                    continue;
+
+                uMatching++;
+
+                if ( !bShared && !slot.Image.IsIdle() )
+                    continue;
+
+                if ( !pBest || slot.ulLastUsed > pBest->ulLastUsed )
+                    pBest = &slot;
+            }
+
+            if ( pBest )
+            {
+                pBest->ulLastUsed = m_ulTick;
+                m_Stats.ulReuses++;
+
+                // Whatever kept us over budget last time might be idle now.
+                Trim( pBest );
+
+                return &pBest->Image;
+            }
+
+            if ( uMatching >= m_uMaxPerKey )
+                return nullptr;
+
+            std::optional<TImage> oImage = fnCreate();
+            if ( !oImage )
+                return nullptr;
+
+            Slot_t &slot = m_Slots.emplace_back( Slot_t{ key, m_ulTick, std::move( *oImage ) } );
+            m_Stats.ulBytes += slot.Image.GetSize();
+            m_Stats.ulPeakBytes = std::max( m_Stats.ulPeakBytes, m_Stats.ulBytes );
+            m_Stats.uImages++;
+            m_Stats.ulAllocations++;
+
+            Trim( &slot );
+
+            return &slot.Image;
+        }
+
+        // Evicts idle images past the budget.
+        void SetBudget( uint64_t ulBudget )
+        {
+            m_ulBudget = ulBudget;
+            Trim( nullptr );
+        }
+
+        // Lets go of every idle image for uUsage, for when nothing is going to
+        // ask for them for a while.
+        void ReleaseIdle( uint32_t uUsage )
+        {
+            m_Slots.remove_if( [&]( const Slot_t &slot )
+            {
+                if ( slot.Key.uUsage != uUsage || !slot.Image.IsIdle() )
+                    return false;
+
+                m_Stats.ulBytes -= slot.Image.GetSize();
+                m_Stats.uImages--;
+                m_Stats.ulEvictions++;
+                return true;
+            });
+        }
+
+        // Lets go of everything. Anything still using them keeps its own reference.
+        void Clear()
+        {
+            m_Stats.ulEvictions += m_Slots.size();
+            m_Slots.clear();
+            m_Stats.ulBytes = 0;
+            m_Stats.uImages = 0;
+        }
+
+        uint64_t GetBudget() const { return m_ulBudget; }
+        const ImagePoolStats_t &GetStats() const { return m_Stats; }
+
+    private:
+        struct Slot_t
+        {
+            ImagePoolKey_t Key;
+            uint64_t ulLastUsed;
+            TImage Image;
+        };
+
+        void Trim( const Slot_t *pKeep )
+        {
+            while ( m_Stats.ulBytes > m_ulBudget )
+            {
+                auto oldest = m_Slots.end();
+                for ( auto iter = m_Slots.begin(); iter != m_Slots.end(); iter++ )
+                {
+                    if ( &*iter == pKeep || !iter->Image.IsIdle() )
+                        continue;
+
+                    if ( oldest == m_Slots.end() || iter->ulLastUsed < oldest->ulLastUsed )
+                        oldest = iter;
+                }
+
+                if ( oldest == m_Slots.end() )
+                    break;
+
+                m_Stats.ulBytes -= oldest->Image.GetSize();
+                m_Stats.uImages--;
+                m_Stats.ulEvictions++;
+                m_Slots.erase( oldest );
+            }
+        }
+
+        uint64_t m_ulBudget;
+        const uint32_t m_uMaxPerKey;
+
+        // Only a handful at a time, std::list for pointers to them that stay put.
+        std::list<Slot_t> m_Slots;
+        uint64_t m_ulTick = 0;
+        ImagePoolStats_t m_Stats;
+    };
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace gamescope
+{
+    struct QueuedInput_t
+    {
+        enum class Type : uint8_t
+        {
+            MouseMotion,
+            MouseWarp,
+            MouseButton,
+            MouseWheel,
+            Key,
+            // Nothing to deliver, just counts as input to whatever has
+            // keyboard focus, for input_latency_probe.
+            LatencyProbe,
+        };
+
+        Type eType;
+        // MouseButton, Key
+        uint32_t uCode = 0;
+        bool bPressed = false;
+        // MouseWarp
+        bool bSynthetic = false;
+        // MouseMotion, MouseWarp, MouseWheel
+        double flX = 0.0;
+        double flY = 0.0;
+        uint32_t uTime = 0;
+        // CLOCK_MONOTONIC nanos of when it actually happened, if known,
+        // for the input to present latency in frame_timing_stats.
+        // Filled in with when it got queued otherwise.
+        uint64_t ulInputTime = 0;
+    };
+
+    //
+    // Input from the input threads, for the Wayland thread to deliver
+    // in one go, rather than every event taking wlserver_lock on its own
+    // and getting in the compositor's way.
+    //
+    // The lock in here is only ever held for a push or a swap.
+    //
+    class CInputQueue
+    {
+    public:
+        // Returns true if it was empty, ie. whoever delivers it wants waking up.
+        bool Push( const QueuedInput_t &input )
+        {
+            std::scoped_lock lock{ m_mutInputs };
+            m_Inputs.push_back( input );
+            return m_Inputs.size() == 1;
+        }
+
+        // Swaps everything queued so far, in order, into inputs.
+        // Whatever was in there is dropped, but its storage is kept for next time.
+        void Take( std::vector<QueuedInput_t> &inputs )
+        {
+            inputs.clear();
+
+            std::scoped_lock lock{ m_mutInputs };
+            std::swap( inputs, m_Inputs );
+        }
+
+    private:
+        std::mutex m_mutInputs;
+        std::vector<QueuedInput_t> m_Inputs;
+    };
+}
@@ -1,19 +1,25 @@
 #include "LibInputHandler.h"
 
 #include <libinput.h>
+#include <libudev.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
 #include <vector>
 #include <string>
+#include <optional>
+#include <algorithm>
+#include <cstring>
 #include <errno.h>
 #include <stdio.h>
 #include <linux/input.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 
 #include "log.hpp"
 #include "backend.h"
 #include "wlserver.hpp"
+#include "convar.h"
 #include "Utils/Defer.h"
 
 // Splitux input device filtering (defined in main.cpp)
@@ -34,10 +40,31 @@ namespace gamescope
 {
     static LogScope log_input_stealer( "InputStealer" );
 
+    // The one holding --libinput-hold-dev devices, for libinput_hold_dev_status.
+    static std::mutex s_mutHoldingHandler;
+    static CLibInputHandler *s_pHoldingHandler = nullptr;
+
+    static ConCommand cc_libinput_hold_dev_status( "libinput_hold_dev_status", "Show the --libinput-hold-dev devices, whether they are plugged in and grabbed, and how many times they have been connected.",
+    []( std::span<std::string_view> args )
+    {
+        std::scoped_lock lock{ s_mutHoldingHandler };
+        if ( !s_pHoldingHandler )
+        {
+            console_log.infof( "Not holding any devices." );
+            return;
+        }
+
+        s_pHoldingHandler->DumpHeldDevices();
+    });
+
     const libinput_interface CLibInputHandler::s_LibInputInterface =
     {
         .open_restricted = []( const char *pszPath, int nFlags, void *pUserData ) -> int
         {
+            CLibInputHandler *pHandler = reinterpret_cast<CLibInputHandler *>( pUserData );
+            if ( pHandler )
+                pHandler->m_bLastOpenGrabbed = false;
+
             int fd = open( pszPath, nFlags );
             if ( fd >= 0 )
             {
@@ -51,6 +78,8 @@ namespace gamescope
                 else
                 {
                     fprintf( stderr, "[gamescope-splitux] Grabbed device %s exclusively\n", pszPath );
+                    if ( pHandler )
+                        pHandler->m_bLastOpenGrabbed = true;
                 }
             }
             return fd;
@@ -70,6 +99,31 @@ namespace gamescope
 
     CLibInputHandler::~CLibInputHandler()
     {
+        {
+            std::scoped_lock lock{ s_mutHoldingHandler };
+            if ( s_pHoldingHandler == this )
+                s_pHoldingHandler = nullptr;
+        }
+
+        for ( HeldInputDevice_t &held : m_HeldDevices )
+        {
+            if ( held.pDevice )
+                libinput_device_unref( held.pDevice );
+        }
+        m_HeldDevices.clear();
+
+        if ( m_nEpollFD >= 0 )
+        {
+            close( m_nEpollFD );
+            m_nEpollFD = -1;
+        }
+
+        if ( m_pUdevMonitor )
+        {
+            udev_monitor_unref( m_pUdevMonitor );
+            m_pUdevMonitor = nullptr;
+        }
+
         if ( m_pLibInput )
         {
             libinput_unref( m_pLibInput );
@@ -98,38 +152,79 @@ namespace gamescope
         {
             log_input_stealer.infof( "Using path-based libinput with %zu device(s)", g_vecLibInputHoldDevices.size() );
 
-            m_pLibInput = libinput_path_create_context( &s_LibInputInterface, nullptr );
+            m_pLibInput = libinput_path_create_context( &s_LibInputInterface, this );
             if ( !m_pLibInput )
             {
                 log_input_stealer.errorf( "Failed to create path-based libinput context" );
                 return false;
             }
 
+            // Start listening before looking for them, so nothing plugged in
+            // in between gets missed.
+            m_pUdevMonitor = udev_monitor_new_from_netlink( m_pUdev, "udev" );
+            if ( m_pUdevMonitor )
+            {
+                udev_monitor_filter_add_match_subsystem_devtype( m_pUdevMonitor, "input", nullptr );
+                if ( udev_monitor_enable_receiving( m_pUdevMonitor ) < 0 )
+                {
+                    udev_monitor_unref( m_pUdevMonitor );
+                    m_pUdevMonitor = nullptr;
+                }
+            }
+
+            if ( !m_pUdevMonitor )
+                log_input_stealer.warnf( "Failed to create udev monitor, held devices will not come back if they are unplugged" );
+
             int nDevicesAdded = 0;
+            m_HeldDevices.reserve( g_vecLibInputHoldDevices.size() );
             for ( const auto& path : g_vecLibInputHoldDevices )
             {
                 fprintf( stderr, "[gamescope-splitux] Attempting to add input device: %s\n", path.c_str() );
-                libinput_device *pDevice = libinput_path_add_device( m_pLibInput, path.c_str() );
-                if ( pDevice )
-                {
-                    fprintf( stderr, "[gamescope-splitux] Successfully added input device: %s\n", path.c_str() );
-                    log_input_stealer.infof( "Added input device: %s", path.c_str() );
-                    nDevicesAdded++;
-                }
-                else
+
+                HeldInputDevice_t &held = m_HeldDevices.emplace_back( HeldInputDevice_t{ .Spec = HeldInputDeviceSpec_t{ .sPath = path } } );
+
+                std::optional<InputDeviceIdentity_t> oIdentity = GetInputDeviceIdentity( m_pUdev, path.c_str() );
+                if ( !oIdentity )
                 {
-                    fprintf( stderr, "[gamescope-splitux] ERROR: Failed to add input device: %s (errno=%d: %s)\n",
-                             path.c_str(), errno, strerror(errno) );
-                    log_input_stealer.errorf( "Failed to add input device: %s", path.c_str() );
+                    // Not there (yet), or not something udev knows. Try it as given.
+                    oIdentity = InputDeviceIdentity_t{ .sDevNode = path };
                 }
+
+                if ( ConnectHeldDevice( held, *oIdentity ) )
+                    nDevicesAdded++;
+                else if ( m_pUdevMonitor )
+                    log_input_stealer.infof( "Will add %s when it shows up", path.c_str() );
             }
 
-            if ( nDevicesAdded == 0 )
+            if ( nDevicesAdded == 0 && !m_pUdevMonitor )
             {
                 fprintf( stderr, "[gamescope-splitux] ERROR: No input devices were successfully added! Input will not work.\n" );
                 return false;
             }
             fprintf( stderr, "[gamescope-splitux] LibInput initialized with %d device(s)\n", nDevicesAdded );
+
+            if ( m_pUdevMonitor )
+            {
+                m_nEpollFD = epoll_create1( EPOLL_CLOEXEC );
+                if ( m_nEpollFD < 0 )
+                {
+                    log_input_stealer.errorf_errno( "Failed to create epoll fd" );
+                    return false;
+                }
+
+                for ( int nFD : { libinput_get_fd( m_pLibInput ), udev_monitor_get_fd( m_pUdevMonitor ) } )
+                {
+                    epoll_event event{ .events = EPOLLIN };
+                    if ( epoll_ctl( m_nEpollFD, EPOLL_CTL_ADD, nFD, &event ) < 0 )
+                    {
+                        log_input_stealer.errorf_errno( "Failed to add fd to epoll" );
+                        return false;
+                    }
+                }
+            }
+
+            std::scoped_lock lock{ s_mutHoldingHandler };
+            s_pHoldingHandler = this;
         }
         else
         {
@@ -157,10 +252,132 @@ namespace gamescope
         if ( !m_pLibInput )
             return -1;
 
+        if ( m_nEpollFD >= 0 )
+            return m_nEpollFD;
+
         return libinput_get_fd( m_pLibInput );
     }
 
     void CLibInputHandler::OnPollIn()
+    {
+        // libinput first, so anything it has already let go of
+        // is gone by the time udev tells us about it.
+        DispatchLibInput();
+
+        if ( m_pUdevMonitor )
+            DispatchUdev();
+    }
+
+    bool CLibInputHandler::ConnectHeldDevice( HeldInputDevice_t &held, const InputDeviceIdentity_t &identity )
+    {
+        libinput_device *pDevice = libinput_path_add_device( m_pLibInput, identity.sDevNode.c_str() );
+        if ( !pDevice )
+        {
+            fprintf( stderr, "[gamescope-splitux] ERROR: Failed to add input device: %s (errno=%d: %s)\n",
+                     identity.sDevNode.c_str(), errno, strerror(errno) );
+            log_input_stealer.errorf( "Failed to add input device: %s", identity.sDevNode.c_str() );
+            return false;
+        }
+
+        std::scoped_lock lock{ m_mutHeldDevices };
+        held.pDevice = libinput_device_ref( pDevice );
+        held.sDevNode = identity.sDevNode;
+        held.bGrabbed = m_bLastOpenGrabbed;
+        held.uConnects++;
+
+        // Remember what it is, to know it again if it is replugged.
+        if ( !held.Spec.oIdentity && !identity.sVendorId.empty() )
+            held.Spec.oIdentity = identity;
+
+        fprintf( stderr, "[gamescope-splitux] Successfully added input device: %s\n", identity.sDevNode.c_str() );
+        if ( held.uConnects > 1 )
+            log_input_stealer.infof( "Reconnected input device: %s at %s", held.Spec.sPath.c_str(), identity.sDevNode.c_str() );
+        else
+            log_input_stealer.infof( "Added input device: %s", held.Spec.sPath.c_str() );
+
+        return true;
+    }
+
+    void CLibInputHandler::DisconnectHeldDevice( HeldInputDevice_t &held, bool bRemoveFromLibInput )
+    {
+        libinput_device *pDevice = held.pDevice;
+        {
+            std::scoped_lock lock{ m_mutHeldDevices };
+            held.pDevice = nullptr;
+            held.sDevNode.clear();
+            held.bGrabbed = false;
+        }
+
+        log_input_stealer.infof( "Lost input device: %s", held.Spec.sPath.c_str() );
+
+        if ( bRemoveFromLibInput )
+            libinput_path_remove_device( pDevice );
+        libinput_device_unref( pDevice );
+    }
+
+    void CLibInputHandler::DispatchUdev()
+    {
+        while ( udev_device *pDevice = udev_monitor_receive_device( m_pUdevMonitor ) )
+        {
+            defer( udev_device_unref( pDevice ) );
+
+            const char *pszAction = udev_device_get_action( pDevice );
+            const char *pszDevNode = udev_device_get_devnode( pDevice );
+            if ( !pszAction || !pszDevNode )
+                continue;
+
+            if ( !strcmp( pszAction, "remove" ) )
+            {
+                for ( HeldInputDevice_t &held : m_HeldDevices )
+                {
+                    if ( held.pDevice && held.sDevNode == pszDevNode )
+                        DisconnectHeldDevice( held, true );
+                }
+            }
+            else if ( !strcmp( pszAction, "add" ) )
+            {
+                std::optional<InputDeviceIdentity_t> oIdentity = GetInputDeviceIdentity( pDevice );
+                if ( !oIdentity )
+                    continue;
+
+                bool bAlreadyHeld = std::any_of( m_HeldDevices.begin(), m_HeldDevices.end(),
+                    [&]( const HeldInputDevice_t &held ) { return held.pDevice && held.sDevNode == oIdentity->sDevNode; } );
+                if ( bAlreadyHeld )
+                    continue;
+
+                for ( HeldInputDevice_t &held : m_HeldDevices )
+                {
+                    if ( !held.pDevice && IsHeldInputDevice( held.Spec, *oIdentity ) )
+                    {
+                        // Opening it again grabs it again.
+                        ConnectHeldDevice( held, *oIdentity );
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void CLibInputHandler::DumpHeldDevices()
+    {
+        std::scoped_lock lock{ m_mutHeldDevices };
+        for ( const HeldInputDevice_t &held : m_HeldDevices )
+        {
+            const InputDeviceIdentity_t *pIdentity = held.Spec.oIdentity ? &*held.Spec.oIdentity : nullptr;
+            console_log.infof( "%s: %s%s, connected %u time(s), %s:%s serial \"%s\" port \"%s\" \"%s\"",
+                held.Spec.sPath.c_str(),
+                held.pDevice ? held.sDevNode.c_str() : "not connected",
+                held.pDevice ? ( held.bGrabbed ? " (grabbed)" : " (NOT grabbed)" ) : "",
+                held.uConnects,
+                pIdentity ? pIdentity->sVendorId.c_str() : "?",
+                pIdentity ? pIdentity->sModelId.c_str() : "?",
+                pIdentity ? pIdentity->sSerial.c_str() : "",
+                pIdentity ? ( !pIdentity->sIdPath.empty() ? pIdentity->sIdPath.c_str() : pIdentity->sPhys.c_str() ) : "",
+                pIdentity ? pIdentity->sName.c_str() : "" );
+        }
+    }
+
+    void CLibInputHandler::DispatchLibInput()
     {
         static uint32_t s_uSequence = 0;
         static uint32_t s_nEventCount = 0;
@@ -201,9 +418,7 @@ namespace gamescope
 
                     GetBackend()->NotifyPhysicalInput( InputType::Mouse );
 
-                    wlserver_lock();
-                    wlserver_mousemotion( flDx, flDy, ++s_uSequence );
-                    wlserver_unlock();
+                    wlserver_queue_input( gamescope::QueuedInput_t{ .eType = gamescope::QueuedInput_t::Type::MouseMotion, .flX = flDx, .flY = flDy, .uTime = ++s_uSequence, .ulInputTime = libinput_event_pointer_get_time_usec( pPointerEvent ) * 1'000 } );
                 }
                 break;
 
@@ -219,9 +434,7 @@ namespace gamescope
 
                     GetBackend()->NotifyPhysicalInput( InputType::Mouse );
 
-                    wlserver_lock();
-                    wlserver_mousewarp( flX, flY, ++s_uSequence, true );
-                    wlserver_unlock();
+                    wlserver_queue_input( gamescope::QueuedInput_t{ .eType = gamescope::QueuedInput_t::Type::MouseWarp, .bSynthetic = true, .flX = flX, .flY = flY, .uTime = ++s_uSequence, .ulInputTime = libinput_event_pointer_get_time_usec( pPointerEvent ) * 1'000 } );
                 }
                 break;
 
@@ -235,9 +448,7 @@ namespace gamescope
                     uint32_t uButton = libinput_event_pointer_get_button( pPointerEvent );
                     libinput_button_state eButtonState = libinput_event_pointer_get_button_state( pPointerEvent );
 
-                    wlserver_lock();
-                    wlserver_mousebutton( uButton, eButtonState == LIBINPUT_BUTTON_STATE_PRESSED, ++s_uSequence );
-                    wlserver_unlock();
+                    wlserver_queue_input( gamescope::QueuedInput_t{ .eType = gamescope::QueuedInput_t::Type::MouseButton, .uCode = uButton, .bPressed = eButtonState == LIBINPUT_BUTTON_STATE_PRESSED, .uTime = ++s_uSequence, .ulInputTime = libinput_event_pointer_get_time_usec( pPointerEvent ) * 1'000 } );
                 }
                 break;
 
@@ -276,9 +487,19 @@ namespace gamescope
                     uint32_t uKey = libinput_event_keyboard_get_key( pKeyboardEvent );
                     libinput_key_state eState = libinput_event_keyboard_get_key_state( pKeyboardEvent );
 
-                    wlserver_lock();
-                    wlserver_key( uKey, eState == LIBINPUT_KEY_STATE_PRESSED, ++s_uSequence );
-                    wlserver_unlock();
+                    wlserver_queue_input( gamescope::QueuedInput_t{ .eType = gamescope::QueuedInput_t::Type::Key, .uCode = uKey, .bPressed = eState == LIBINPUT_KEY_STATE_PRESSED, .uTime = ++s_uSequence, .ulInputTime = libinput_event_keyboard_get_time_usec( pKeyboardEvent ) * 1'000 } );
+                }
+                break;
+
+                case LIBINPUT_EVENT_DEVICE_REMOVED:
+                {
+                    // libinput noticed it go before udev told us, and is done with it already.
+                    libinput_device *pDevice = libinput_event_get_device( pEvent );
+                    for ( HeldInputDevice_t &held : m_HeldDevices )
+                    {
+                        if ( held.pDevice == pDevice )
+                            DisconnectHeldDevice( held, false );
+                    }
                 }
                 break;
 
@@ -296,9 +517,7 @@ namespace gamescope
 
             if ( flScrollX != 0.0 || flScrollY != 0.0 )
             {
-                wlserver_lock();
-                wlserver_mousewheel( flScrollX, flScrollY, ++s_uSequence );
-                wlserver_unlock();
+                wlserver_queue_input( gamescope::QueuedInput_t{ .eType = gamescope::QueuedInput_t::Type::MouseWheel, .flX = flScrollX, .flY = flScrollY, .uTime = ++s_uSequence } );
             }
         }
     }
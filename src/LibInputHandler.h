@@ -1,10 +1,17 @@
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
 #include "waitable.h"
+#include "HeldInputDevice.h"
 
 struct libinput_interface;
 struct udev;
+struct udev_monitor;
 struct libinput;
+struct libinput_device;
 
 namespace gamescope
 {
@@ -18,10 +25,39 @@ namespace gamescope
 
         virtual int GetFD() override;
         virtual void OnPollIn() override;
+
+        // For libinput_hold_dev_status.
+        void DumpHeldDevices();
     private:
+        // A --libinput-hold-dev, and whether it is currently plugged in.
+        struct HeldInputDevice_t
+        {
+            HeldInputDeviceSpec_t Spec;
+            libinput_device *pDevice = nullptr;
+            std::string sDevNode;
+            bool bGrabbed = false;
+            uint32_t uConnects = 0;
+        };
+
+        void DispatchLibInput();
+        void DispatchUdev();
+        bool ConnectHeldDevice( HeldInputDevice_t &held, const InputDeviceIdentity_t &identity );
+        void DisconnectHeldDevice( HeldInputDevice_t &held, bool bRemoveFromLibInput );
+
         udev *m_pUdev = nullptr;
         libinput *m_pLibInput = nullptr;
 
+        // Only with --libinput-hold-dev, where we put the libinput fd and a
+        // udev monitor together to follow the held devices being replugged.
+        udev_monitor *m_pUdevMonitor = nullptr;
+        int m_nEpollFD = -1;
+
+        // Written on the input thread only, locked for reading from elsewhere.
+        std::mutex m_mutHeldDevices;
+        std::vector<HeldInputDevice_t> m_HeldDevices;
+        // Whether open_restricted managed to EVIOCGRAB the last device added.
+        bool m_bLastOpenGrabbed = false;
+
         double m_flScrollAccum[2]{};
 
         static const libinput_interface s_LibInputInterface;
@@ -0,0 +1,126 @@
+#include "LockStats.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace gamescope
+{
+    void CLockStats::Histogram_t::Add( uint64_t ulNs )
+    {
+        uint64_t ulMicros = ulNs / 1'000;
+        uint32_t uBucket = std::min<uint32_t>( std::bit_width( ulMicros ), k_uBuckets - 1 );
+
+        ulCounts[ uBucket ]++;
+        ulTotalNs += ulNs;
+        ulMaxNs = std::max( ulMaxNs, ulNs );
+    }
+
+    uint64_t CLockStats::Histogram_t::GetCount() const
+    {
+        uint64_t ulCount = 0;
+        for ( uint64_t ulBucketCount : ulCounts )
+            ulCount += ulBucketCount;
+        return ulCount;
+    }
+
+    uint64_t CLockStats::Histogram_t::GetPercentileNs( double flPercentile ) const
+    {
+        uint64_t ulCount = GetCount();
+        if ( !ulCount )
+            return 0;
+
+        uint64_t ulTarget = std::max<uint64_t>( 1, uint64_t( std::ceil( ulCount * flPercentile / 100.0 ) ) );
+
+        uint64_t ulSeen = 0;
+        for ( uint32_t i = 0; i < k_uBuckets - 1; i++ )
+        {
+            ulSeen += ulCounts[i];
+            if ( ulSeen >= ulTarget )
+                return std::min( ( uint64_t{ 1 } << i ) * 1'000, ulMaxNs );
+        }
+
+        return ulMaxNs;
+    }
+
+    CLockStats::Site_t *CLockStats::FindSite( const std::source_location &location )
+    {
+        const char *pszFile = location.file_name();
+        const uint32_t uLine = location.line();
+
+        uint64_t ulHash = ( uint64_t( uintptr_t( pszFile ) ) ^ ( uint64_t( uLine ) << 32 ) ) * 0x9E3779B97F4A7C15ull;
+        for ( uint32_t i = 0; i < k_uMaxSites; i++ )
+        {
+            Site_t &site = m_Sites[ ( ( ulHash >> 40 ) + i ) % k_uMaxSites ];
+
+            if ( site.pszFile == pszFile && site.uLine == uLine )
+                return &site;
+
+            if ( !site.pszFile )
+            {
+                // Leave a few free, so we aren't probing the whole thing to
+                // find out somewhere new has nowhere to go.
+                if ( m_uSiteCount >= k_uMaxSites - k_uMaxSites / 8 )
+                    break;
+
+                site.pszFile = pszFile;
+                site.pszFunction = location.function_name();
+                site.uLine = uLine;
+                m_uSiteCount++;
+                return &site;
+            }
+        }
+
+        return &m_OverflowSite;
+    }
+
+    void CLockStats::Acquired( const std::source_location &location, uint64_t ulWaitNs, uint64_t ulNow )
+    {
+        m_pHolder = FindSite( location );
+        m_pHolder->Wait.Add( ulWaitNs );
+        m_ulAcquiredTime = ulNow;
+    }
+
+    void CLockStats::Released( uint64_t ulNow )
+    {
+        if ( !m_pHolder )
+            return;
+
+        m_pHolder->Hold.Add( ulNow - m_ulAcquiredTime );
+        m_pHolder = nullptr;
+    }
+
+    std::vector<CLockStats::Site_t> CLockStats::GetSites() const
+    {
+        std::vector<Site_t> sites;
+        for ( const Site_t &site : m_Sites )
+        {
+            if ( site.Wait.GetCount() )
+                sites.push_back( site );
+        }
+
+        if ( m_OverflowSite.Wait.GetCount() )
+            sites.push_back( m_OverflowSite );
+
+        std::sort( sites.begin(), sites.end(), []( const Site_t &a, const Site_t &b )
+        {
+            return a.Wait.ulTotalNs > b.Wait.ulTotalNs;
+        });
+
+        return sites;
+    }
+
+    void CLockStats::Reset()
+    {
+        // The sites stay where they are, so whoever has it now
+        // still has somewhere to count their hold time.
+        for ( Site_t &site : m_Sites )
+        {
+            site.Wait = {};
+            site.Hold = {};
+        }
+
+        m_OverflowSite.Wait = {};
+        m_OverflowSite.Hold = {};
+    }
+}
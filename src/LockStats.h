@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <source_location>
+#include <vector>
+
+namespace gamescope
+{
+    //
+    // How long each place that takes a lock waits for it and then holds it,
+    // for finding out who is behind the stalls on a busy lock.
+    //
+    // Not thread-safe by itself: Acquired and Released are to be called
+    // with the lock being measured held, which is what keeps this consistent.
+    // Reading it back the same.
+    //
+    class CLockStats
+    {
+    public:
+        // Log2 microseconds: < 1us, < 2us, < 4us ... < 32ms, and anything longer.
+        static constexpr uint32_t k_uBuckets = 17;
+        // Call sites past this all end up together, rather than allocate.
+        static constexpr uint32_t k_uMaxSites = 256;
+
+        struct Histogram_t
+        {
+            std::array<uint64_t, k_uBuckets> ulCounts{};
+            uint64_t ulTotalNs = 0;
+            uint64_t ulMaxNs = 0;
+
+            void Add( uint64_t ulNs );
+            uint64_t GetCount() const;
+            // The upper bound of the bucket it lands in,
+            // or the max for the last one.
+            uint64_t GetPercentileNs( double flPercentile ) const;
+        };
+
+        struct Site_t
+        {
+            // Null for the overflow site.
+            const char *pszFile = nullptr;
+            const char *pszFunction = nullptr;
+            uint32_t uLine = 0;
+
+            Histogram_t Wait;
+            Histogram_t Hold;
+        };
+
+        // The lock was just taken at location at ulNow, after waiting ulWaitNs.
+        void Acquired( const std::source_location &location, uint64_t ulWaitNs, uint64_t ulNow );
+        // And is about to be released at ulNow.
+        void Released( uint64_t ulNow );
+
+        // Most time spent waiting first.
+        std::vector<Site_t> GetSites() const;
+        void Reset();
+
+    private:
+        Site_t *FindSite( const std::source_location &location );
+
+        // Open addressed by file and line.
+        std::array<Site_t, k_uMaxSites> m_Sites;
+        uint32_t m_uSiteCount = 0;
+        Site_t m_OverflowSite;
+
+        Site_t *m_pHolder = nullptr;
+        uint64_t m_ulAcquiredTime = 0;
+    };
+}
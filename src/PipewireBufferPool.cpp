@@ -0,0 +1,125 @@
+#include "PipewireBufferPool.h"
+
+#include <algorithm>
+
+namespace gamescope
+{
+    CPipewireBufferPoolSizer::CPipewireBufferPoolSizer( uint32_t uMinBuffers, uint32_t uMaxBuffers )
+        : m_uMinBuffers{ 1 }
+        , m_uMaxBuffers{ 1 }
+        , m_uTarget{ 1 }
+    {
+        SetLimits( uMinBuffers, uMaxBuffers );
+        m_uTarget = m_uMinBuffers;
+    }
+
+    void CPipewireBufferPoolSizer::SetLimits( uint32_t uMinBuffers, uint32_t uMaxBuffers )
+    {
+        m_uMinBuffers = std::max( uMinBuffers, 1u );
+        m_uMaxBuffers = std::max( uMaxBuffers, m_uMinBuffers );
+        m_uTarget = std::clamp( m_uTarget, m_uMinBuffers, m_uMaxBuffers );
+    }
+
+    bool CPipewireBufferPoolSizer::OnDequeue( bool bStarved, uint64_t ulNow )
+    {
+        if ( !m_ulLastResizeTime )
+        {
+            m_ulLastResizeTime = ulNow;
+            m_ulLastStarvedTime = ulNow;
+            m_ulWindowStart = ulNow + k_ulResizeSettleTime;
+        }
+
+        if ( ulNow >= m_ulWindowStart + 2 * k_ulGrowWindow )
+        {
+            m_ulWindowStart = ulNow;
+            m_ulWindowDequeues = 0;
+        }
+
+        const bool bSettled = ulNow >= m_ulWindowStart;
+
+        if ( !bStarved )
+        {
+            if ( bSettled )
+                m_ulWindowDequeues++;
+        }
+        else
+        {
+            m_ulStarvedCount++;
+
+            if ( !bSettled )
+                return false;
+
+            m_ulLastStarvedTime = ulNow;
+
+            // The last shrink went too far, go straight back to what worked.
+            if ( m_ulLastShrinkTime && ulNow - m_ulLastShrinkTime < m_ulShrinkDelay * 2 )
+            {
+                m_ulShrinkDelay = std::min( m_ulShrinkDelay * 2, k_ulMaxShrinkDelay );
+                m_ulLastShrinkTime = 0;
+
+                uint32_t uNewTarget = std::min( m_uTargetBeforeShrink, m_uMaxBuffers );
+                if ( uNewTarget <= m_uTarget )
+                    return false;
+
+                return Resize( uNewTarget, ulNow );
+            }
+
+            const uint64_t ulWindow = ulNow - m_ulWindowStart;
+            if ( ulWindow < k_ulGrowWindow )
+                return false;
+
+            const double flRate = m_ulWindowDequeues * 1'000'000'000.0 / ulWindow;
+
+            // The last grow didn't get buffers back any faster, the consumer is
+            // just slower than us. Give the memory back and stop there,
+            // unless it changes pace.
+            if ( m_uTargetBeforeGrow && flRate < m_flRateBeforeGrow * k_flMinGrowGain )
+            {
+                m_uGrowCap = m_uTargetBeforeGrow;
+                m_flRateAtCap = m_flRateBeforeGrow;
+                m_uTargetBeforeGrow = 0;
+                return Resize( m_uGrowCap, ulNow );
+            }
+            m_uTargetBeforeGrow = 0;
+
+            if ( m_uGrowCap )
+            {
+                if ( flRate < m_flRateAtCap * k_flMinGrowGain && flRate * k_flMinGrowGain > m_flRateAtCap )
+                    return false;
+
+                m_uGrowCap = 0;
+            }
+
+            uint32_t uNewTarget = std::min( m_uTarget + std::max( m_uTarget / 2, 2u ), m_uMaxBuffers );
+            if ( uNewTarget == m_uTarget )
+                return false;
+
+            m_uTargetBeforeGrow = m_uTarget;
+            m_flRateBeforeGrow = flRate;
+            return Resize( uNewTarget, ulNow );
+        }
+
+        if ( m_uTarget <= m_uMinBuffers )
+            return false;
+
+        if ( ulNow - m_ulLastStarvedTime < m_ulShrinkDelay || ulNow - m_ulLastResizeTime < m_ulShrinkDelay )
+            return false;
+
+        // Kept up, so whatever we measured at the cap no longer applies.
+        m_uGrowCap = 0;
+        m_uTargetBeforeGrow = 0;
+
+        m_uTargetBeforeShrink = m_uTarget;
+        m_ulLastShrinkTime = ulNow;
+        return Resize( std::max( m_uTarget - std::max( m_uTarget / 4, 1u ), m_uMinBuffers ), ulNow );
+    }
+
+    bool CPipewireBufferPoolSizer::Resize( uint32_t uNewTarget, uint64_t ulNow )
+    {
+        m_uTarget = uNewTarget;
+        m_ulLastResizeTime = ulNow;
+        m_ulWindowStart = ulNow + k_ulResizeSettleTime;
+        m_ulWindowDequeues = 0;
+        return true;
+    }
+}
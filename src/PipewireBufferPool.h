@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+namespace gamescope
+{
+    //
+    // Decides how many buffers to ask PipeWire for.
+    //
+    // Every buffer is a full size capture texture, so rather than
+    // allocating for the worst case consumer up front, we start small,
+    // grow when pw_stream_dequeue_buffer comes back empty, and give
+    // memory back once the consumer has kept up for a while.
+    //
+    // More buffers only help a consumer that holds on to frames for a
+    // while, not one that can't keep up with our frame rate: that one
+    // hands buffers back at the same rate however many it has. So we
+    // only keep growing while it gets buffers back to us faster for it,
+    // and otherwise go back to the size before and stay there.
+    //
+    // Changing the count makes PipeWire reallocate the whole pool,
+    // so this errs on the side of resizing rarely.
+    //
+    class CPipewireBufferPoolSizer
+    {
+    public:
+        // Don't count starvation right after a resize, the old buffers are
+        // being swapped out for new ones and the pool is empty for a bit.
+        static constexpr uint64_t k_ulResizeSettleTime = 250'000'000ul;
+        // How long the consumer has to go without starving us before we shrink.
+        static constexpr uint64_t k_ulShrinkDelay = 10'000'000'000ul;
+        // Starving again soon after a shrink means it was too eager,
+        // wait longer before the next one, up to this.
+        static constexpr uint64_t k_ulMaxShrinkDelay = 5ul * 60ul * 1'000'000'000ul;
+        // How long to measure how fast buffers come back before growing.
+        static constexpr uint64_t k_ulGrowWindow = 500'000'000ul;
+        // How much faster buffers have to come back after growing for it
+        // to count as having helped.
+        static constexpr double k_flMinGrowGain = 1.1;
+
+        CPipewireBufferPoolSizer( uint32_t uMinBuffers, uint32_t uMaxBuffers );
+
+        void SetLimits( uint32_t uMinBuffers, uint32_t uMaxBuffers );
+
+        // Call for every dequeue attempt, with whether it came back empty.
+        // Returns true if the target changed and the pool should be renegotiated.
+        bool OnDequeue( bool bStarved, uint64_t ulNow );
+
+        uint32_t GetTarget() const { return m_uTarget; }
+        uint64_t GetStarvedCount() const { return m_ulStarvedCount; }
+        // Non-zero while growing has been found not to help.
+        uint32_t GetGrowCap() const { return m_uGrowCap; }
+
+    private:
+        bool Resize( uint32_t uNewTarget, uint64_t ulNow );
+
+        uint32_t m_uMinBuffers;
+        uint32_t m_uMaxBuffers;
+        uint32_t m_uTarget;
+        uint32_t m_uTargetBeforeShrink = 0;
+        uint32_t m_uTargetBeforeGrow = 0;
+        uint32_t m_uGrowCap = 0;
+
+        uint64_t m_ulStarvedCount = 0;
+
+        // 0 until the first dequeue.
+        uint64_t m_ulLastStarvedTime = 0;
+        uint64_t m_ulLastResizeTime = 0;
+        uint64_t m_ulLastShrinkTime = 0;
+        uint64_t m_ulShrinkDelay = k_ulShrinkDelay;
+
+        // Buffers we got since m_ulWindowStart, ie. how fast the consumer
+        // is handing them back. Starts once we've settled after a resize,
+        // and restarts every couple of k_ulGrowWindow to keep it current.
+        uint64_t m_ulWindowStart = 0;
+        uint64_t m_ulWindowDequeues = 0;
+        // Buffers per second before the last grow, or at m_uGrowCap.
+        double m_flRateBeforeGrow = 0.0;
+        double m_flRateAtCap = 0.0;
+    };
+}
@@ -2,9 +2,11 @@
 #include "convar.h"
 #include "color_helpers.h"
 #include "../log.hpp"
+#include "../Utils/WorkerPool.h"
 
 #include <filesystem>
 #include <algorithm>
+#include <time.h>
 
 std::string_view GetHomeDir();
 
@@ -17,6 +19,27 @@ namespace gamescope
 
     static ConVar<bool> cv_script_use_local_scripts{ "script_use_local_scripts", false, "Whether or not to use the local scripts (../config) as opposed to the ones in /etc/gamescope.d" };
     static ConVar<bool> cv_script_use_user_scripts{ "script_use_user_scripts", true, "Whether or not to use user config scripts ($XDG_CONFIG_DIR/gamescope) at all." };
+    static ConVar<uint32_t> cv_script_hook_budget_us{ "script_hook_budget_us", 0, "How long the hooks for an event (eg. OnPostPaint, every frame) can take on the thread that calls them before the rest are run on the script worker instead. 0 for no limit." };
+
+    static ConCommand cc_script_hook_stats( "script_hook_stats", "Print how many times each script hook has been called and how long they took.",
+    []( std::span<std::string_view> args )
+    {
+        CScriptManager::DumpHookStats();
+    });
+
+    static ConCommand cc_script_hook_stats_reset( "script_hook_stats_reset", "Reset the script hook stats.",
+    []( std::span<std::string_view> args )
+    {
+        CScriptManager::ResetHookStats();
+    });
+
+    static CWorkerPool &GetScriptWorker()
+    {
+        // One thread, they'd only be waiting on the script lock for each other anyway.
+        // Never destroyed, so nothing waits on a script at exit.
+        static CWorkerPool *s_pWorker = new CWorkerPool{ "gamescope-script", 1, 16 };
+        return *s_pWorker;
+    }
 
     static std::string_view GetConfigDir()
     {
@@ -92,7 +115,15 @@ namespace gamescope
         m_Gamescope.Base = m_State.create_named_table( "gamescope" );
         m_Gamescope.Base["hook"] = [this]( std::string_view svName, sol::function fnFunc )
         {
-            m_Hooks.emplace( std::make_pair( svName, Hook_t{ std::move( fnFunc ), m_nCurrentScriptId } ) );
+            uint32_t uHookId;
+            {
+                std::scoped_lock lock{ m_mutHookStats };
+                uHookId = m_uNextHookId++;
+                m_HookStats.emplace( uHookId, HookStats_t{ .sName = std::string{ svName }, .nScriptId = m_nCurrentScriptId } );
+            }
+
+            m_Hooks.emplace( std::make_pair( svName, Hook_t{ std::move( fnFunc ), m_nCurrentScriptId, uHookId } ) );
+            m_ulHookNameMask |= GetHookNameBit( svName );
         };
         m_Gamescope.Base.new_enum<EOTF>( "eotf",
             {
@@ -240,6 +271,10 @@ namespace gamescope
     void CScriptManager::InvalidateAllHooks()
     {
         m_Hooks.clear();
+        UpdateHookNameMask();
+
+        std::scoped_lock lock{ m_mutHookStats };
+        m_HookStats.clear();
     }
 
     void CScriptManager::InvalidateHooksForScript( int32_t nScriptId )
@@ -251,6 +286,133 @@ namespace gamescope
         {
             return iter.second.nScriptId == nScriptId;
         });
+        UpdateHookNameMask();
+
+        std::scoped_lock lock{ m_mutHookStats };
+        std::erase_if( m_HookStats, [ nScriptId ]( const auto &iter ) -> bool
+        {
+            return iter.second.nScriptId == nScriptId;
+        });
+    }
+
+    bool CScriptManager::MightHaveHooks( std::string_view svName )
+    {
+        return GlobalScriptScope().m_ulHookNameMask.load( std::memory_order_relaxed ) & GetHookNameBit( svName );
+    }
+
+    void CScriptManager::DumpHookStats()
+    {
+        CScriptManager &manager = GlobalScriptScope();
+        std::scoped_lock lock{ manager.m_mutHookStats };
+
+        if ( manager.m_HookStats.empty() )
+        {
+            console_log.infof( "No script hooks." );
+            return;
+        }
+
+        std::vector<const HookStats_t *> sortedStats;
+        for ( const auto &[ uHookId, stats ] : manager.m_HookStats )
+            sortedStats.push_back( &stats );
+        std::stable_sort( sortedStats.begin(), sortedStats.end(), []( const HookStats_t *pA, const HookStats_t *pB )
+        {
+            return pA->ulTotalNs > pB->ulTotalNs;
+        });
+
+        console_log.infof( "Script hooks, most time taken first (budget: %uus):", uint32_t{ cv_script_hook_budget_us } );
+        for ( const HookStats_t *pStats : sortedStats )
+        {
+            console_log.infof( "  %s (script %d): %lu calls (%lu deferred), %.3fms total, %.3fms avg, %.3fms max",
+                pStats->sName.c_str(), pStats->nScriptId,
+                pStats->ulCalls, pStats->ulDeferredCalls,
+                pStats->ulTotalNs / 1'000'000.0,
+                pStats->ulCalls ? pStats->ulTotalNs / 1'000'000.0 / pStats->ulCalls : 0.0,
+                pStats->ulMaxNs / 1'000'000.0 );
+        }
+    }
+
+    void CScriptManager::ResetHookStats()
+    {
+        CScriptManager &manager = GlobalScriptScope();
+        std::scoped_lock lock{ manager.m_mutHookStats };
+
+        for ( auto &[ uHookId, stats ] : manager.m_HookStats )
+            stats = HookStats_t{ .sName = std::move( stats.sName ), .nScriptId = stats.nScriptId };
+    }
+
+    uint64_t CScriptManager::GetTimeNs()
+    {
+        timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        return uint64_t( ts.tv_sec ) * 1'000'000'000ul + uint64_t( ts.tv_nsec );
+    }
+
+    uint64_t CScriptManager::GetHookBudgetNs()
+    {
+        return uint64_t{ cv_script_hook_budget_us } * 1'000ul;
+    }
+
+    uint64_t CScriptManager::GetHookNameBit( std::string_view svName )
+    {
+        return 1ul << ( std::hash<std::string_view>{}( svName ) % 64 );
+    }
+
+    bool CScriptManager::DeferHook( const Hook_t &hook, std::function<void( sol::function & )> fnCall )
+    {
+        // Copied here and let go of on the worker, both under the script lock.
+        auto pCallback = std::make_shared<sol::function>( hook.fnCallback );
+
+        return GetScriptWorker().Submit( [ this, pCallback, nScriptId = hook.nScriptId, uHookId = hook.uHookId, fnCall = std::move( fnCall ) ]() mutable
+        {
+            CScriptScopedLock script{ *this };
+
+            // Its script may have been invalidated since this was deferred.
+            if ( IsHookAlive( uHookId ) )
+            {
+                int32_t nPreviousScriptId = m_nCurrentScriptId;
+
+                m_nCurrentScriptId = nScriptId;
+                uint64_t ulStartNs = GetTimeNs();
+                fnCall( *pCallback );
+                uint64_t ulElapsedNs = GetTimeNs() - ulStartNs;
+                m_nCurrentScriptId = nPreviousScriptId;
+
+                RecordHookTime( uHookId, ulElapsedNs, true );
+            }
+
+            pCallback = nullptr;
+            fnCall = nullptr;
+        });
+    }
+
+    bool CScriptManager::IsHookAlive( uint32_t uHookId )
+    {
+        std::scoped_lock lock{ m_mutHookStats };
+        return m_HookStats.contains( uHookId );
+    }
+
+    void CScriptManager::RecordHookTime( uint32_t uHookId, uint64_t ulElapsedNs, bool bDeferred )
+    {
+        std::scoped_lock lock{ m_mutHookStats };
+
+        auto iter = m_HookStats.find( uHookId );
+        if ( iter == m_HookStats.end() )
+            return;
+
+        HookStats_t &stats = iter->second;
+        stats.ulCalls++;
+        if ( bDeferred )
+            stats.ulDeferredCalls++;
+        stats.ulTotalNs += ulElapsedNs;
+        stats.ulMaxNs = std::max( stats.ulMaxNs, ulElapsedNs );
+    }
+
+    void CScriptManager::UpdateHookNameMask()
+    {
+        uint64_t ulMask = 0;
+        for ( const auto &iter : m_Hooks )
+            ulMask |= GetHookNameBit( iter.first );
+        m_ulHookNameMask = ulMask;
     }
 
     //
@@ -2,7 +2,12 @@
 
 #include "../Utils/Dict.h"
 
+#include <atomic>
+#include <functional>
 #include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #if HAVE_SCRIPTING
 
@@ -39,19 +44,51 @@ namespace gamescope
     public:
         CScriptManager();
 
+        // Doesn't need the lock, so callers can skip taking it when nothing
+        // is hooked to svName. Can be true when nothing is, never false when something is.
+        static bool MightHaveHooks( std::string_view svName );
+
+        static void DumpHookStats();
+        static void ResetHookStats();
+
+        // Once the hooks for this call have taken more than script_hook_budget_us,
+        // the rest are run on the script worker instead.
         template <typename... Args>
         void CallHook( std::string_view svName, Args&&... args )
         {
             auto range = m_Hooks.equal_range( svName );
+            if ( range.first == range.second )
+                return;
+
+            const uint64_t ulBudgetNs = GetHookBudgetNs();
+            uint64_t ulSpentNs = 0;
+
             for ( auto iter = range.first; iter != range.second; iter++ )
             {
-                int32_t nPreviousScriptId = m_nCurrentScriptId;
-
                 Hook_t *pHook = &iter->second;
 
+                if ( ulBudgetNs && ulSpentNs >= ulBudgetNs )
+                {
+                    bool bDeferred = DeferHook( *pHook, [ ...args = std::decay_t<Args>( args ) ]( sol::function &fnCallback )
+                    {
+                        fnCallback( args... );
+                    });
+
+                    // Otherwise the worker is backed up, better late than never.
+                    if ( bDeferred )
+                        continue;
+                }
+
+                int32_t nPreviousScriptId = m_nCurrentScriptId;
+
                 m_nCurrentScriptId = pHook->nScriptId;
-                iter->second.fnCallback( std::forward<Args>( args )... );    
+                uint64_t ulStartNs = GetTimeNs();
+                pHook->fnCallback( std::forward<Args>( args )... );
+                uint64_t ulElapsedNs = GetTimeNs() - ulStartNs;
                 m_nCurrentScriptId = nPreviousScriptId;
+
+                RecordHookTime( pHook->uHookId, ulElapsedNs, false );
+                ulSpentNs += ulElapsedNs;
             }
         }
 
@@ -85,9 +122,38 @@ namespace gamescope
         {
             sol::function fnCallback;
             int32_t nScriptId = -1;
+            uint32_t uHookId = 0;
+        };
+
+        struct HookStats_t
+        {
+            std::string sName;
+            int32_t nScriptId = -1;
+            uint64_t ulCalls = 0;
+            uint64_t ulDeferredCalls = 0;
+            uint64_t ulTotalNs = 0;
+            uint64_t ulMaxNs = 0;
         };
 
+        static uint64_t GetTimeNs();
+        static uint64_t GetHookBudgetNs();
+        static uint64_t GetHookNameBit( std::string_view svName );
+
+        bool DeferHook( const Hook_t &hook, std::function<void( sol::function & )> fnCall );
+        bool IsHookAlive( uint32_t uHookId );
+        void RecordHookTime( uint32_t uHookId, uint64_t ulElapsedNs, bool bDeferred );
+        void UpdateHookNameMask();
+
         MultiDict<Hook_t> m_Hooks;
+        // A bit for each name hash with hooks, for MightHaveHooks.
+        std::atomic<uint64_t> m_ulHookNameMask = { 0 };
+
+        // Its own lock, so looking at them never waits on a script.
+        std::mutex m_mutHookStats;
+        // Keyed by Hook_t::uHookId, and erased along with the hook,
+        // so an entry here is also what keeps a hook's deferred calls alive.
+        std::unordered_map<uint32_t, HookStats_t> m_HookStats;
+        uint32_t m_uNextHookId = 0;
 
         int32_t m_nCurrentScriptId = -1;
 
@@ -0,0 +1,106 @@
+#include "SyncobjEventFdPool.h"
+#include "log.hpp"
+
+#include <xf86drm.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace gamescope
+{
+    static LogScope s_SyncobjEventFdLog( "syncobj_eventfd" );
+
+    CSyncobjEventFdPool &CSyncobjEventFdPool::Get()
+    {
+        static CSyncobjEventFdPool s_Pool;
+        return s_Pool;
+    }
+
+    CSyncobjEventFdPool::~CSyncobjEventFdPool()
+    {
+        for ( int32_t nEventFd : m_nFreeFds )
+            close( nEventFd );
+    }
+
+    int32_t CSyncobjEventFdPool::Acquire()
+    {
+        {
+            std::unique_lock lock( m_mutFreeFds );
+            if ( !m_nFreeFds.empty() )
+            {
+                int32_t nEventFd = m_nFreeFds.back();
+                m_nFreeFds.pop_back();
+                return nEventFd;
+            }
+
+            m_ulCreatedCount++;
+        }
+
+        // Non-blocking so we can drain it without caring if it fired.
+        const int32_t nEventFd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+        if ( nEventFd < 0 )
+            s_SyncobjEventFdLog.errorf_errno( "Failed to create eventfd (%d)", nEventFd );
+
+        return nEventFd;
+    }
+
+    int32_t CSyncobjEventFdPool::Arm( int32_t nDrmFd, uint32_t uHandle, uint64_t ulPoint )
+    {
+        const int32_t nEventFd = Acquire();
+        if ( nEventFd < 0 )
+            return -1;
+
+        drm_syncobj_eventfd syncobjEventFd =
+        {
+            .handle = uHandle,
+            // Only valid flags are: DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE
+            // -> Wait for fence materialization rather than signal.
+            .flags  = 0u,
+            .point  = ulPoint,
+            .fd     = nEventFd,
+        };
+
+        if ( drmIoctl( nDrmFd, DRM_IOCTL_SYNCOBJ_EVENTFD, &syncobjEventFd ) != 0 )
+        {
+            s_SyncobjEventFdLog.errorf_errno( "DRM_IOCTL_SYNCOBJ_EVENTFD failed" );
+            // Never registered, so it's fine to reuse.
+            Release( nEventFd, true );
+            return -1;
+        }
+
+        return nEventFd;
+    }
+
+    void CSyncobjEventFdPool::Release( int32_t nEventFd, bool bSignalled )
+    {
+        if ( nEventFd < 0 )
+            return;
+
+        if ( bSignalled )
+        {
+            uint64_t ulValue = 0;
+            ssize_t sszRet = read( nEventFd, &ulValue, sizeof( ulValue ) );
+            (void) sszRet; // EAGAIN if it was never written to, which is fine.
+
+            std::unique_lock lock( m_mutFreeFds );
+            if ( m_nFreeFds.size() < k_zMaxFreeFds )
+            {
+                m_nFreeFds.push_back( nEventFd );
+                return;
+            }
+        }
+
+        close( nEventFd );
+    }
+
+    size_t CSyncobjEventFdPool::GetFreeCount() const
+    {
+        std::unique_lock lock( m_mutFreeFds );
+        return m_nFreeFds.size();
+    }
+
+    uint64_t CSyncobjEventFdPool::GetCreatedCount() const
+    {
+        std::unique_lock lock( m_mutFreeFds );
+        return m_ulCreatedCount;
+    }
+}
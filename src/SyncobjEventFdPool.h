@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace gamescope
+{
+    //
+    // eventfds for DRM_IOCTL_SYNCOBJ_EVENTFD that get re-armed
+    // instead of being created and closed for every explicit sync commit.
+    //
+    // An eventfd can only go back into the pool once it has fired.
+    // Until then the kernel may still have it registered against a
+    // syncobj point, and it would signal whoever got it next.
+    //
+    class CSyncobjEventFdPool
+    {
+    public:
+        static constexpr size_t k_zMaxFreeFds = 64;
+
+        static CSyncobjEventFdPool &Get();
+
+        ~CSyncobjEventFdPool();
+
+        // A drained eventfd, from the pool if there is one free.
+        int32_t Acquire();
+        // An eventfd that becomes readable once uHandle reaches ulPoint,
+        // or -1 on failure.
+        int32_t Arm( int32_t nDrmFd, uint32_t uHandle, uint64_t ulPoint );
+        void Release( int32_t nEventFd, bool bSignalled );
+
+        size_t GetFreeCount() const;
+        // How many eventfds we have had to create in total.
+        uint64_t GetCreatedCount() const;
+
+    private:
+        mutable std::mutex m_mutFreeFds;
+        std::vector<int32_t> m_nFreeFds;
+        uint64_t m_ulCreatedCount = 0;
+    };
+}
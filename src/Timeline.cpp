@@ -1,7 +1,7 @@
 #include <xf86drm.h>
-#include <sys/eventfd.h>
 
 #include "Timeline.h"
+#include "SyncobjEventFdPool.h"
 #include "wlserver.hpp"
 #include "rendervulkan.hpp"
 
@@ -131,29 +131,9 @@ namespace gamescope
         }
         else
         {
-            const int32_t nExplicitSyncEventFd = eventfd( 0, EFD_CLOEXEC );
+            const int32_t nExplicitSyncEventFd = CSyncobjEventFdPool::Get().Arm( m_pTimeline->GetDrmRenderFD(), uHandle, m_ulPoint );
             if ( nExplicitSyncEventFd < 0 )
-            {
-                s_TimelineLog.errorf_errno( "Failed to create eventfd (%d)", nExplicitSyncEventFd );
                 return k_InvalidEvent;
-            }
-
-            drm_syncobj_eventfd syncobjEventFd =
-            {
-                .handle = m_pTimeline->GetSyncobjHandle(),
-                // Only valid flags are: DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE
-                // -> Wait for fence materialization rather than signal.
-                .flags  = 0u,
-                .point  = m_ulPoint,
-                .fd     = nExplicitSyncEventFd,
-            };
-
-            if ( drmIoctl( m_pTimeline->GetDrmRenderFD(), DRM_IOCTL_SYNCOBJ_EVENTFD, &syncobjEventFd ) != 0 )
-            {
-                s_TimelineLog.errorf_errno( "DRM_IOCTL_SYNCOBJ_EVENTFD failed" );
-                close( nExplicitSyncEventFd );
-                return k_InvalidEvent;
-            }
 
             return { nExplicitSyncEventFd, false };
         }
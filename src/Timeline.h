@@ -74,6 +74,8 @@ namespace gamescope
 
         bool Wait( int64_t lTimeout = std::numeric_limits<int64_t>::max() );
 
+        // The eventfd comes from CSyncobjEventFdPool and should be
+        // handed back to it rather than closed.
         std::pair<int32_t, bool> CreateEventFd();
     private:
 
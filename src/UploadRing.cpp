@@ -0,0 +1,76 @@
+#include "UploadRing.h"
+
+#include <cassert>
+
+namespace gamescope
+{
+    CUploadRing::CUploadRing( uint64_t ulCapacity )
+        : m_ulCapacity{ ulCapacity }
+    {
+    }
+
+    std::optional<uint64_t> CUploadRing::Allocate( uint64_t ulSize, uint64_t ulAlignment )
+    {
+        assert( ( ulAlignment & ( ulAlignment - 1 ) ) == 0 );
+        assert( m_ulCapacity % ulAlignment == 0 );
+
+        if ( ulSize > m_ulCapacity )
+            return std::nullopt;
+
+        // Nothing in flight, start over at the beginning so that
+        // whatever space was left at the end isn't in the way.
+        if ( m_ulHead == m_ulTail )
+        {
+            m_ulHead = ( ( m_ulHead + m_ulCapacity - 1 ) / m_ulCapacity ) * m_ulCapacity;
+            m_ulTail = m_ulHead;
+        }
+
+        uint64_t ulPos = ( m_ulHead + ulAlignment - 1 ) & ~( ulAlignment - 1 );
+
+        // Allocations have to be contiguous, skip to the start
+        // rather than wrap around the end.
+        uint64_t ulOffset = ulPos % m_ulCapacity;
+        if ( ulOffset + ulSize > m_ulCapacity )
+        {
+            ulPos += m_ulCapacity - ulOffset;
+            ulOffset = 0;
+        }
+
+        if ( ulPos + ulSize - m_ulTail > m_ulCapacity )
+            return std::nullopt;
+
+        m_ulHead = ulPos + ulSize;
+        return ulOffset;
+    }
+
+    void CUploadRing::Fence( uint64_t ulSeqNo )
+    {
+        if ( !HasUnfenced() )
+            return;
+
+        m_Fences.push_back( Fence_t{ m_ulHead, ulSeqNo } );
+    }
+
+    void CUploadRing::Retire( uint64_t ulCompletedSeqNo )
+    {
+        while ( !m_Fences.empty() && m_Fences.front().ulSeqNo <= ulCompletedSeqNo )
+        {
+            m_ulTail = m_Fences.front().ulEnd;
+            m_Fences.pop_front();
+        }
+    }
+
+    void CUploadRing::Reset( uint64_t ulCapacity )
+    {
+        m_ulCapacity = ulCapacity;
+        m_ulHead = 0;
+        m_ulTail = 0;
+        m_Fences.clear();
+    }
+
+    bool CUploadRing::HasUnfenced() const
+    {
+        uint64_t ulFencedEnd = m_Fences.empty() ? m_ulTail : m_Fences.back().ulEnd;
+        return m_ulHead != ulFencedEnd;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+namespace gamescope
+{
+    //
+    // Hands out regions of a staging buffer in a ring,
+    // and takes them back once the GPU is done with them.
+    //
+    // Regions are tracked by submission sequence: everything allocated
+    // between two Fence() calls is in use until the GPU has completed
+    // the submission it was fenced with.
+    //
+    // This only does the bookkeeping, the buffer itself and what to do
+    // when nothing fits (grow, rather than wait) is up to the owner.
+    //
+    class CUploadRing
+    {
+    public:
+        CUploadRing( uint64_t ulCapacity );
+
+        // Returns the offset to use, or nothing if it doesn't fit
+        // until more has been retired.
+        // ulAlignment must be a power of two that divides the capacity.
+        std::optional<uint64_t> Allocate( uint64_t ulSize, uint64_t ulAlignment );
+
+        // Everything allocated since the last fence is in use until ulSeqNo completes.
+        void Fence( uint64_t ulSeqNo );
+
+        // The GPU has completed everything up to and including ulSeqNo.
+        void Retire( uint64_t ulCompletedSeqNo );
+
+        // Starts over with an empty ring, eg. in a new, bigger buffer.
+        // The old buffer needs to be kept alive by the owner until
+        // everything that was allocated from it has completed.
+        void Reset( uint64_t ulCapacity );
+
+        uint64_t GetCapacity() const { return m_ulCapacity; }
+        // Including anything skipped at the end to avoid wrapping an allocation.
+        uint64_t GetUsed() const { return m_ulHead - m_ulTail; }
+        bool HasUnfenced() const;
+
+    private:
+        struct Fence_t
+        {
+            // Virtual position, the end of the last allocation this fence covers.
+            uint64_t ulEnd;
+            uint64_t ulSeqNo;
+        };
+
+        uint64_t m_ulCapacity = 0;
+        // Virtual positions, that only ever increase.
+        // The offset in the buffer is the position modulo the capacity.
+        uint64_t m_ulHead = 0;
+        uint64_t m_ulTail = 0;
+        std::deque<Fence_t> m_Fences;
+    };
+}
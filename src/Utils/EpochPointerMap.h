@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "NonCopyable.h"
+
+namespace gamescope
+{
+    //
+    // A map from pointers to pointers where lookups never take a lock.
+    //
+    // Lookups are wait-free: they bump a per-thread reader counter,
+    // probe an open-addressed table and drop the counter again.
+    // Writers serialize among themselves, and before handing a removed value
+    // back (or freeing a table they have outgrown) wait for every reader that
+    // could still see it to leave, like RCU's synchronize.
+    //
+    // Writes are expected to be rare next to lookups, and a Remove can
+    // spin on a reader for as long as that reader holds its ReadGuard,
+    // so keep those short and never block inside one.
+    //
+    // Values are not owned by the map.
+    //
+    template <typename TKey, typename TValue>
+    class CEpochPointerMap : public NonCopyable
+    {
+    public:
+        class ReadGuard : public NonCopyable
+        {
+        public:
+            ReadGuard( const CEpochPointerMap &map )
+                : m_pReaders{ &map.GetReaderCount( map.m_uEpoch.load() ) }
+            {
+                m_pReaders->fetch_add( 1 );
+            }
+
+            ~ReadGuard()
+            {
+                m_pReaders->fetch_sub( 1 );
+            }
+
+        private:
+            std::atomic<uint32_t> *m_pReaders;
+        };
+
+        CEpochPointerMap()
+            : m_pTable{ new Table_t( k_unMinCapacity ) }
+        {
+        }
+
+        ~CEpochPointerMap()
+        {
+            delete m_pTable.load();
+        }
+
+        // The value is only good for as long as the guard is held.
+        TValue *Lookup( const TKey *pKey, const ReadGuard & ) const
+        {
+            const Table_t *pTable = m_pTable.load();
+
+            uint32_t uIndex = pTable->Hash( pKey );
+            for ( uint32_t i = 0; i < pTable->uCapacity; i++ )
+            {
+                const Slot_t &slot = pTable->pSlots[ uIndex ];
+
+                const TKey *pSlotKey = slot.pKey.load();
+                if ( !pSlotKey )
+                    return nullptr;
+
+                // Null if it's being removed.
+                if ( pSlotKey == pKey )
+                    return slot.pValue.load();
+
+                uIndex = ( uIndex + 1 ) & ( pTable->uCapacity - 1 );
+            }
+
+            return nullptr;
+        }
+
+        void Insert( TKey *pKey, TValue *pValue )
+        {
+            std::scoped_lock lock{ m_mutWriter };
+
+            Table_t *pTable = m_pTable.load();
+            if ( ( pTable->uUsed + 1 ) * 2 > pTable->uCapacity )
+                pTable = RebuildLocked( pTable->uLive + 1 );
+
+            uint32_t uIndex = pTable->Hash( pKey );
+            for ( ;; )
+            {
+                Slot_t &slot = pTable->pSlots[ uIndex ];
+
+                TKey *pSlotKey = slot.pKey.load();
+                assert( pSlotKey != pKey );
+                if ( !pSlotKey || pSlotKey == Tombstone() )
+                {
+                    // Value first, so a reader that finds the key finds it too.
+                    slot.pValue.store( pValue );
+                    slot.pKey.store( pKey );
+
+                    if ( !pSlotKey )
+                        pTable->uUsed++;
+                    pTable->uLive++;
+                    return;
+                }
+
+                uIndex = ( uIndex + 1 ) & ( pTable->uCapacity - 1 );
+            }
+        }
+
+        // Returns the value that was there, by which point no reader
+        // can still be looking at it.
+        TValue *Remove( TKey *pKey )
+        {
+            std::scoped_lock lock{ m_mutWriter };
+
+            Table_t *pTable = m_pTable.load();
+
+            uint32_t uIndex = pTable->Hash( pKey );
+            for ( uint32_t i = 0; i < pTable->uCapacity; i++ )
+            {
+                Slot_t &slot = pTable->pSlots[ uIndex ];
+
+                TKey *pSlotKey = slot.pKey.load();
+                if ( !pSlotKey )
+                    break;
+
+                if ( pSlotKey == pKey )
+                {
+                    TValue *pValue = slot.pValue.exchange( nullptr );
+                    // Keep the slot used so probes for keys that were
+                    // pushed past it still get there.
+                    slot.pKey.store( Tombstone() );
+                    pTable->uLive--;
+
+                    SynchronizeLocked();
+                    return pValue;
+                }
+
+                uIndex = ( uIndex + 1 ) & ( pTable->uCapacity - 1 );
+            }
+
+            return nullptr;
+        }
+
+        // For teardown, when nothing can be looking anymore.
+        template <typename TFunc>
+        void RemoveAll( TFunc func )
+        {
+            std::scoped_lock lock{ m_mutWriter };
+
+            Table_t *pTable = m_pTable.exchange( new Table_t( k_unMinCapacity ) );
+            for ( uint32_t i = 0; i < pTable->uCapacity; i++ )
+            {
+                TKey *pSlotKey = pTable->pSlots[ i ].pKey.load();
+                if ( pSlotKey && pSlotKey != Tombstone() )
+                    func( pSlotKey, pTable->pSlots[ i ].pValue.load() );
+            }
+            delete pTable;
+        }
+
+        uint32_t GetCapacity() const { return m_pTable.load()->uCapacity; }
+
+    private:
+        static constexpr uint32_t k_unMinCapacity = 16;
+        // Readers are spread over these by thread, so lookups from different
+        // threads don't all bounce the same cache line.
+        static constexpr uint32_t k_unReaderShards = 16;
+
+        struct Slot_t
+        {
+            std::atomic<TKey *> pKey{ nullptr };
+            std::atomic<TValue *> pValue{ nullptr };
+        };
+
+        struct Table_t
+        {
+            Table_t( uint32_t uCapacity )
+                : uCapacity{ uCapacity }
+                , uShift{ 64u - uint32_t( std::countr_zero( uCapacity ) ) }
+                , pSlots{ new Slot_t[ uCapacity ] }
+            {
+            }
+
+            uint32_t Hash( const TKey *pKey ) const
+            {
+                return uint32_t( ( uint64_t( uintptr_t( pKey ) ) * 0x9E3779B97F4A7C15ul ) >> uShift );
+            }
+
+            uint32_t uCapacity;
+            uint32_t uShift;
+            // Including tombstones.
+            uint32_t uUsed = 0;
+            uint32_t uLive = 0;
+            std::unique_ptr<Slot_t[]> pSlots;
+        };
+
+        struct alignas( 64 ) ReaderCount_t
+        {
+            std::atomic<uint32_t> uCount{ 0 };
+        };
+
+        static TKey *Tombstone()
+        {
+            return reinterpret_cast<TKey *>( uintptr_t( 1 ) );
+        }
+
+        static uint32_t GetThreadShard()
+        {
+            // Constant initialized, so there's no TLS init guard on every lookup.
+            static std::atomic<uint32_t> s_uNextShard{ 0 };
+            static thread_local uint32_t s_uShard = ~0u;
+            if ( s_uShard == ~0u ) [[unlikely]]
+                s_uShard = s_uNextShard++ % k_unReaderShards;
+            return s_uShard;
+        }
+
+        std::atomic<uint32_t> &GetReaderCount( uint32_t uEpoch ) const
+        {
+            return m_ReaderCounts[ uEpoch & 1 ][ GetThreadShard() ].uCount;
+        }
+
+        bool HasReadersLocked( uint32_t uEpoch ) const
+        {
+            for ( const ReaderCount_t &count : m_ReaderCounts[ uEpoch & 1 ] )
+            {
+                if ( count.uCount.load() )
+                    return true;
+            }
+            return false;
+        }
+
+        // Waits out every reader that started before this was called.
+        //
+        // New readers go to the other parity as soon as we flip,
+        // so each wait only has to outlast readers that are already in.
+        // Flipping twice catches readers that read the epoch before
+        // the first flip but only got around to counting themselves after it.
+        void SynchronizeLocked()
+        {
+            uint32_t uEpoch = m_uEpoch.load();
+            for ( uint32_t i = 0; i < 2; i++ )
+            {
+                m_uEpoch.store( uEpoch + i + 1 );
+                while ( HasReadersLocked( uEpoch + i ) )
+                    std::this_thread::yield();
+            }
+        }
+
+        Table_t *RebuildLocked( uint32_t uLive )
+        {
+            uint32_t uCapacity = std::max( std::bit_ceil( uLive * 4 ), k_unMinCapacity );
+
+            Table_t *pOldTable = m_pTable.load();
+            Table_t *pNewTable = new Table_t( uCapacity );
+            for ( uint32_t i = 0; i < pOldTable->uCapacity; i++ )
+            {
+                TKey *pSlotKey = pOldTable->pSlots[ i ].pKey.load();
+                if ( !pSlotKey || pSlotKey == Tombstone() )
+                    continue;
+
+                uint32_t uIndex = pNewTable->Hash( pSlotKey );
+                while ( pNewTable->pSlots[ uIndex ].pKey.load() )
+                    uIndex = ( uIndex + 1 ) & ( uCapacity - 1 );
+
+                pNewTable->pSlots[ uIndex ].pValue.store( pOldTable->pSlots[ i ].pValue.load() );
+                pNewTable->pSlots[ uIndex ].pKey.store( pSlotKey );
+                pNewTable->uUsed++;
+                pNewTable->uLive++;
+            }
+
+            m_pTable.store( pNewTable );
+            SynchronizeLocked();
+            delete pOldTable;
+
+            return pNewTable;
+        }
+
+        std::mutex m_mutWriter;
+        std::atomic<Table_t *> m_pTable;
+        std::atomic<uint32_t> m_uEpoch{ 0 };
+        mutable ReaderCount_t m_ReaderCounts[ 2 ][ k_unReaderShards ];
+    };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+#include "NonCopyable.h"
+
+namespace gamescope
+{
+    //
+    // A list any thread can push onto without taking a lock,
+    // and one thread takes everything off of at once.
+    //
+    // Pushing is an allocation and a compare-exchange. Taking is one exchange,
+    // as the consumer always takes the whole list, nothing else
+    // is ever removed from under a producer.
+    //
+    template <typename T>
+    class CMpscList : public NonCopyable
+    {
+    public:
+        CMpscList() = default;
+        ~CMpscList()
+        {
+            Drain( []( T value ) {} );
+        }
+
+        // Returns true if the list was empty, ie. the consumer wants waking up.
+        bool Push( T value )
+        {
+            Node_t *pNode = new Node_t{ std::move( value ), nullptr };
+
+            Node_t *pHead = m_pHead.load( std::memory_order_relaxed );
+            do
+            {
+                pNode->pNext = pHead;
+            }
+            while ( !m_pHead.compare_exchange_weak( pHead, pNode, std::memory_order_release, std::memory_order_relaxed ) );
+
+            return pHead == nullptr;
+        }
+
+        // Only from the one consumer thread.
+        // Calls fnConsume with everything pushed so far, oldest first,
+        // and returns how many that was.
+        template <typename TFunc>
+        size_t Drain( TFunc fnConsume )
+        {
+            Node_t *pNode = m_pHead.exchange( nullptr, std::memory_order_acquire );
+
+            // It's newest first, turn it around.
+            Node_t *pOldest = nullptr;
+            while ( pNode )
+            {
+                Node_t *pNext = pNode->pNext;
+                pNode->pNext = pOldest;
+                pOldest = pNode;
+                pNode = pNext;
+            }
+
+            size_t zCount = 0;
+            while ( pOldest )
+            {
+                Node_t *pNext = pOldest->pNext;
+                fnConsume( std::move( pOldest->Value ) );
+                delete pOldest;
+                pOldest = pNext;
+                zCount++;
+            }
+
+            return zCount;
+        }
+
+        bool IsEmpty() const
+        {
+            return m_pHead.load( std::memory_order_relaxed ) == nullptr;
+        }
+
+    private:
+        struct Node_t
+        {
+            T Value;
+            Node_t *pNext;
+        };
+
+        std::atomic<Node_t *> m_pHead = { nullptr };
+    };
+}
@@ -0,0 +1,154 @@
+#include "PixelUnpack.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXEL_UNPACK_SSE2 1
+#endif
+
+namespace gamescope
+{
+    static inline uint32_t LoadPixel( const uint8_t *pSrc )
+    {
+        // Mapped memory has no alignment guarantees past the texel,
+        // and this keeps the compiler from assuming otherwise.
+        uint32_t uPixel;
+        memcpy( &uPixel, pSrc, sizeof( uPixel ) );
+        return uPixel;
+    }
+
+    static void UnpackA2R10G10B10RowScalar( uint16_t *pR, uint16_t *pG, uint16_t *pB, const uint8_t *pSrc, uint32_t uWidth )
+    {
+        for ( uint32_t x = 0; x < uWidth; x++ )
+        {
+            uint32_t uPixel = LoadPixel( pSrc + x * 4 );
+            pR[x] = uint16_t( ( uPixel >> 20 ) & 0x3ff );
+            pG[x] = uint16_t( ( uPixel >> 10 ) & 0x3ff );
+            pB[x] = uint16_t( ( uPixel >> 0 )  & 0x3ff );
+        }
+    }
+
+    static void SwizzleBGRA8RowScalar( uint8_t *pDst, const uint8_t *pSrc, uint32_t uWidth )
+    {
+        for ( uint32_t x = 0; x < uWidth; x++ )
+        {
+            pDst[x * 4 + 0] = pSrc[x * 4 + 2];
+            pDst[x * 4 + 1] = pSrc[x * 4 + 1];
+            pDst[x * 4 + 2] = pSrc[x * 4 + 0];
+            pDst[x * 4 + 3] = 255;
+        }
+    }
+
+#if PIXEL_UNPACK_SSE2
+    // SSE2 is all x86_64 has to have, and all this needs:
+    // 10-bit channels fit in int16_t, so the signed pack never saturates.
+    static void UnpackA2R10G10B10Row( uint16_t *pR, uint16_t *pG, uint16_t *pB, const uint8_t *pSrc, uint32_t uWidth )
+    {
+        const __m128i mask = _mm_set1_epi32( 0x3ff );
+
+        uint32_t x = 0;
+        for ( ; x + 8 <= uWidth; x += 8 )
+        {
+            __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i *>( pSrc + x * 4 ) );
+            __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i *>( pSrc + x * 4 + 16 ) );
+
+            __m128i r = _mm_packs_epi32(
+                _mm_and_si128( _mm_srli_epi32( a, 20 ), mask ),
+                _mm_and_si128( _mm_srli_epi32( b, 20 ), mask ) );
+            __m128i g = _mm_packs_epi32(
+                _mm_and_si128( _mm_srli_epi32( a, 10 ), mask ),
+                _mm_and_si128( _mm_srli_epi32( b, 10 ), mask ) );
+            __m128i bl = _mm_packs_epi32(
+                _mm_and_si128( a, mask ),
+                _mm_and_si128( b, mask ) );
+
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( pR + x ), r );
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( pG + x ), g );
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( pB + x ), bl );
+        }
+
+        UnpackA2R10G10B10RowScalar( pR + x, pG + x, pB + x, pSrc + x * 4, uWidth - x );
+    }
+
+    static void SwizzleBGRA8Row( uint8_t *pDst, const uint8_t *pSrc, uint32_t uWidth )
+    {
+        // Swap the bytes at 0 and 2 of every pixel, keep 1, and set 3.
+        const __m128i maskRB = _mm_set1_epi32( 0x000000ff );
+        const __m128i maskG = _mm_set1_epi32( 0x0000ff00 );
+        const __m128i alpha = _mm_set1_epi32( int32_t( 0xff000000 ) );
+
+        uint32_t x = 0;
+        for ( ; x + 4 <= uWidth; x += 4 )
+        {
+            __m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i *>( pSrc + x * 4 ) );
+
+            __m128i out = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_slli_epi32( _mm_and_si128( p, maskRB ), 16 ),
+                    _mm_and_si128( _mm_srli_epi32( p, 16 ), maskRB ) ),
+                _mm_or_si128( _mm_and_si128( p, maskG ), alpha ) );
+
+            _mm_storeu_si128( reinterpret_cast<__m128i *>( pDst + x * 4 ), out );
+        }
+
+        SwizzleBGRA8RowScalar( pDst + x * 4, pSrc + x * 4, uWidth - x );
+    }
+#else
+    static void UnpackA2R10G10B10Row( uint16_t *pR, uint16_t *pG, uint16_t *pB, const uint8_t *pSrc, uint32_t uWidth )
+    {
+        UnpackA2R10G10B10RowScalar( pR, pG, pB, pSrc, uWidth );
+    }
+
+    static void SwizzleBGRA8Row( uint8_t *pDst, const uint8_t *pSrc, uint32_t uWidth )
+    {
+        SwizzleBGRA8RowScalar( pDst, pSrc, uWidth );
+    }
+#endif
+
+    template <typename T>
+    static T *RowOf( T *pPlane, size_t zStride, uint32_t y )
+    {
+        return reinterpret_cast<T *>( reinterpret_cast<uint8_t *>( pPlane ) + y * zStride );
+    }
+
+    void UnpackA2R10G10B10ToPlanes(
+        uint16_t *pR, size_t zRStride,
+        uint16_t *pG, size_t zGStride,
+        uint16_t *pB, size_t zBStride,
+        const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight )
+    {
+        for ( uint32_t y = 0; y < uHeight; y++ )
+        {
+            UnpackA2R10G10B10Row(
+                RowOf( pR, zRStride, y ), RowOf( pG, zGStride, y ), RowOf( pB, zBStride, y ),
+                pSrc + y * zSrcStride, uWidth );
+        }
+    }
+
+    void SwizzleBGRA8ToRGBA8( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight )
+    {
+        for ( uint32_t y = 0; y < uHeight; y++ )
+            SwizzleBGRA8Row( pDst + y * zDstStride, pSrc + y * zSrcStride, uWidth );
+    }
+
+    void UnpackA2R10G10B10ToPlanesScalar(
+        uint16_t *pR, size_t zRStride,
+        uint16_t *pG, size_t zGStride,
+        uint16_t *pB, size_t zBStride,
+        const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight )
+    {
+        for ( uint32_t y = 0; y < uHeight; y++ )
+        {
+            UnpackA2R10G10B10RowScalar(
+                RowOf( pR, zRStride, y ), RowOf( pG, zGStride, y ), RowOf( pB, zBStride, y ),
+                pSrc + y * zSrcStride, uWidth );
+        }
+    }
+
+    void SwizzleBGRA8ToRGBA8Scalar( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight )
+    {
+        for ( uint32_t y = 0; y < uHeight; y++ )
+            SwizzleBGRA8RowScalar( pDst + y * zDstStride, pSrc + y * zSrcStride, uWidth );
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gamescope
+{
+    // Splits uHeight rows of uWidth A2R10G10B10 pixels into three planes
+    // of 16-bit R, G and B, dropping the alpha. Strides are in bytes.
+    //
+    // Used for AVIF screenshots, which with the IDENTITY matrix take
+    // the colour channels as they are, just as separate planes.
+    void UnpackA2R10G10B10ToPlanes(
+        uint16_t *pR, size_t zRStride,
+        uint16_t *pG, size_t zGStride,
+        uint16_t *pB, size_t zBStride,
+        const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight );
+
+    // B8G8R8A8 to R8G8B8A8, with the alpha made opaque. Strides are in bytes.
+    void SwizzleBGRA8ToRGBA8( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight );
+
+    // The pixel at a time versions, for comparison.
+    void UnpackA2R10G10B10ToPlanesScalar(
+        uint16_t *pR, size_t zRStride,
+        uint16_t *pG, size_t zGStride,
+        uint16_t *pB, size_t zBStride,
+        const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight );
+    void SwizzleBGRA8ToRGBA8Scalar( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, uint32_t uWidth, uint32_t uHeight );
+}
@@ -0,0 +1,110 @@
+#include "PlaneCopy.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PLANE_COPY_X86 1
+#endif
+
+namespace gamescope
+{
+#if PLANE_COPY_X86
+    // MOVNTDQA is what makes reads from write-combined memory fast,
+    // it needs SSE4.1 and a 16 byte aligned source.
+    __attribute__(( target( "sse4.1" ) ))
+    static void CopyRowStreaming( uint8_t *pDst, const uint8_t *pSrc, size_t zSize )
+    {
+        // Align the destination for the non-temporal stores.
+        size_t zHead = ( 16 - ( uintptr_t( pDst ) & 15 ) ) & 15;
+        if ( zHead > zSize )
+            zHead = zSize;
+        memcpy( pDst, pSrc, zHead );
+        pDst += zHead;
+        pSrc += zHead;
+        zSize -= zHead;
+
+        __m128i *pDst128 = reinterpret_cast<__m128i *>( pDst );
+        const bool bSrcAligned = ( uintptr_t( pSrc ) & 15 ) == 0;
+
+        size_t zBlocks = zSize / 64;
+        if ( bSrcAligned )
+        {
+            __m128i *pSrc128 = reinterpret_cast<__m128i *>( const_cast<uint8_t *>( pSrc ) );
+            for ( size_t i = 0; i < zBlocks; i++ )
+            {
+                __m128i a = _mm_stream_load_si128( pSrc128 + 0 );
+                __m128i b = _mm_stream_load_si128( pSrc128 + 1 );
+                __m128i c = _mm_stream_load_si128( pSrc128 + 2 );
+                __m128i d = _mm_stream_load_si128( pSrc128 + 3 );
+                _mm_stream_si128( pDst128 + 0, a );
+                _mm_stream_si128( pDst128 + 1, b );
+                _mm_stream_si128( pDst128 + 2, c );
+                _mm_stream_si128( pDst128 + 3, d );
+                pSrc128 += 4;
+                pDst128 += 4;
+            }
+        }
+        else
+        {
+            const __m128i *pSrc128 = reinterpret_cast<const __m128i *>( pSrc );
+            for ( size_t i = 0; i < zBlocks; i++ )
+            {
+                __m128i a = _mm_loadu_si128( pSrc128 + 0 );
+                __m128i b = _mm_loadu_si128( pSrc128 + 1 );
+                __m128i c = _mm_loadu_si128( pSrc128 + 2 );
+                __m128i d = _mm_loadu_si128( pSrc128 + 3 );
+                _mm_stream_si128( pDst128 + 0, a );
+                _mm_stream_si128( pDst128 + 1, b );
+                _mm_stream_si128( pDst128 + 2, c );
+                _mm_stream_si128( pDst128 + 3, d );
+                pSrc128 += 4;
+                pDst128 += 4;
+            }
+        }
+
+        size_t zDone = zBlocks * 64;
+        memcpy( pDst + zDone, pSrc + zDone, zSize - zDone );
+    }
+
+    static bool SupportsStreamingCopy()
+    {
+        static const bool s_bSupported = __builtin_cpu_supports( "sse4.1" );
+        return s_bSupported;
+    }
+#endif
+
+    void CopyPlaneRows( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, size_t zRowSize, uint32_t uRows )
+    {
+        for ( uint32_t i = 0; i < uRows; i++ )
+            memcpy( pDst + i * zDstStride, pSrc + i * zSrcStride, zRowSize );
+    }
+
+    void CopyPlane( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, size_t zRowSize, uint32_t uRows )
+    {
+        if ( !uRows || !zRowSize )
+            return;
+
+        // Nothing between the rows on either side, one big copy.
+        if ( zDstStride == zRowSize && zSrcStride == zRowSize )
+        {
+            zRowSize *= uRows;
+            uRows = 1;
+        }
+
+#if PLANE_COPY_X86
+        if ( SupportsStreamingCopy() )
+        {
+            for ( uint32_t i = 0; i < uRows; i++ )
+                CopyRowStreaming( pDst + i * zDstStride, pSrc + i * zSrcStride, zRowSize );
+
+            // Non-temporal stores aren't ordered with anything else,
+            // make sure they land before whoever we hand this to reads it.
+            _mm_sfence();
+            return;
+        }
+#endif
+
+        CopyPlaneRows( pDst, zDstStride, pSrc, zSrcStride, zRowSize, uRows );
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gamescope
+{
+    // Copies uRows rows of zRowSize bytes between two pitched planes.
+    //
+    // Meant for reading back mapped GPU memory, which is usually
+    // write-combined/uncached: reads it with streaming loads where the CPU
+    // has them and writes with non-temporal stores, so a frame's worth of
+    // data doesn't go through (and evict) the cache on the way.
+    // Contiguous planes are copied in one go rather than row by row.
+    void CopyPlane( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, size_t zRowSize, uint32_t uRows );
+
+    // The plain memcpy per row version, for comparison.
+    void CopyPlaneRows( uint8_t *pDst, size_t zDstStride, const uint8_t *pSrc, size_t zSrcStride, size_t zRowSize, uint32_t uRows );
+}
@@ -6,6 +6,8 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
+#include <unordered_map>
 
 #include <errno.h>
 #include <pthread.h>
@@ -17,6 +19,9 @@
 #include <sys/capability.h>
 #endif
 #include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
 #elif defined(__DragonFly__) || defined(__FreeBSD__)
 #include <sys/procctl.h>
 #endif
@@ -62,9 +67,40 @@ namespace gamescope::Process
 #endif
     }
 
-    std::vector<pid_t> GetChildPids( pid_t nPid )
+    static std::optional<pid_t> ReadParentPid( int nProcDirFd, const char *pszPid )
     {
-        std::vector<pid_t> nPids;
+        char szPath[ 64 ];
+        snprintf( szPath, sizeof( szPath ), "%s/stat", pszPid );
+
+        int nFd = openat( nProcDirFd, szPath, O_RDONLY | O_CLOEXEC );
+        if ( nFd < 0 )
+            return std::nullopt;
+        defer( close( nFd ) );
+
+        char szStat[ 512 ];
+        ssize_t sszRead = read( nFd, szStat, sizeof( szStat ) - 1 );
+        if ( sszRead <= 0 )
+            return std::nullopt;
+        szStat[ sszRead ] = '\0';
+
+        // pid (comm) state ppid ...
+        // comm can have spaces and parens in it, so go from the last ')'.
+        const char *pszCommEnd = strrchr( szStat, ')' );
+        if ( !pszCommEnd )
+            return std::nullopt;
+
+        pid_t nParentPid = -1;
+        if ( sscanf( pszCommEnd + 1, " %*c %d", &nParentPid ) != 1 )
+            return std::nullopt;
+
+        return nParentPid;
+    }
+
+    // Snapshot of the whole process tree from one pass over /proc,
+    // parent -> children.
+    static std::unordered_map<pid_t, std::vector<pid_t>> GetProcessTree()
+    {
+        std::unordered_map<pid_t, std::vector<pid_t>> tree;
 
         DIR *pProcDir = opendir( "/proc" );
         if ( !pProcDir )
@@ -83,37 +119,100 @@ namespace gamescope::Process
             if ( !IsDigit( pEntry->d_name[0] ) )
                 continue;
 
-            char szPath[ PATH_MAX ];
-            snprintf( szPath, sizeof( szPath ), "/proc/%s/stat", pEntry->d_name );
-            
-            FILE *pStatFile = fopen( szPath, "r" );
-            if ( !pStatFile )
-                continue;
-            defer( fclose( pStatFile ) );
-
-            pid_t nParentPid = -1;
-            fscanf( pStatFile, "%*d %*s %*c %d", &nParentPid );
-            if ( nParentPid > 0 && nParentPid == nPid )
-                nPids.push_back( *Parse<pid_t>( pEntry->d_name ) );
+            std::optional<pid_t> onPid = Parse<pid_t>( pEntry->d_name );
+            std::optional<pid_t> onParentPid = ReadParentPid( dirfd( pProcDir ), pEntry->d_name );
+            if ( onPid && onParentPid && *onParentPid > 0 )
+                tree[ *onParentPid ].push_back( *onPid );
         }
 
-        return nPids;
+        return tree;
     }
 
-    void KillProcessTree( std::vector<pid_t> nPids, int nSignal )
+    std::vector<pid_t> GetChildPids( pid_t nPid )
     {
-        for ( pid_t nPid : nPids )
-        {
-            auto nChildPids = GetChildPids( nPid );
-            KillProcess( nPid, nSignal );
-            KillProcessTree( nChildPids, nSignal );
-        }
+        auto tree = GetProcessTree();
+
+        auto iter = tree.find( nPid );
+        if ( iter == tree.end() )
+            return {};
+
+        return std::move( iter->second );
+    }
+
+#if defined(__linux__) && defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+    static int PidfdOpen( pid_t nPid )
+    {
+        return (int)syscall( SYS_pidfd_open, nPid, 0 );
+    }
+
+    static bool PidfdSendSignal( int nPidfd, int nSignal )
+    {
+        return syscall( SYS_pidfd_send_signal, nPidfd, nSignal, nullptr, 0 ) == 0;
+    }
+#else
+    static int PidfdOpen( pid_t nPid )
+    {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    static bool PidfdSendSignal( int nPidfd, int nSignal )
+    {
+        errno = ENOSYS;
+        return false;
     }
+#endif
 
     void KillAllChildren( pid_t nParentPid, int nSignal )
     {
-        std::vector<pid_t> nChildPids = GetChildPids( nParentPid );
-        return KillProcessTree( nChildPids, nSignal );
+        auto tree = GetProcessTree();
+
+        // Parents before their children, like we'd get walking down the tree.
+        std::vector<pid_t> nPids;
+        std::vector<pid_t> nPending = { nParentPid };
+        while ( !nPending.empty() )
+        {
+            pid_t nPid = nPending.back();
+            nPending.pop_back();
+
+            auto iter = tree.find( nPid );
+            if ( iter == tree.end() )
+                continue;
+
+            for ( pid_t nChildPid : iter->second )
+            {
+                nPids.push_back( nChildPid );
+                nPending.push_back( nChildPid );
+            }
+        }
+
+        // Pin everything down before we start signalling, so a pid that
+        // gets recycled as the tree dies under us doesn't get hit.
+        std::vector<int> nPidfds;
+        nPidfds.reserve( nPids.size() );
+        for ( pid_t nPid : nPids )
+        {
+            int nPidfd = PidfdOpen( nPid );
+            nPidfds.push_back( nPidfd >= 0 ? nPidfd : -errno );
+        }
+
+        for ( size_t i = 0; i < nPids.size(); i++ )
+        {
+            int nPidfd = nPidfds[i];
+            if ( nPidfd < 0 )
+            {
+                // No pidfds, just use the pid.
+                if ( nPidfd == -ENOSYS )
+                    KillProcess( nPids[i], nSignal );
+                // Otherwise it's already gone.
+                continue;
+            }
+
+            if ( !PidfdSendSignal( nPidfd, nSignal ) && errno != ESRCH )
+                s_ProcessLog.errorf_errno( "Failed to kill process %d", nPids[i] );
+
+            CloseFd( nPidfd );
+        }
     }
 
     void KillProcess( pid_t nPid, int nSignal )
@@ -269,8 +368,19 @@ namespace gamescope::Process
         }
     }
 
+    static pid_t SpawnProcessVFork( char **argv );
+
     pid_t SpawnProcess( char **argv, std::function<void()> fnPreambleInChild, bool bDoubleFork )
     {
+        // Anything that needs to run arbitrary code in the child
+        // has to take the fork() path below.
+        if ( !fnPreambleInChild && !bDoubleFork )
+        {
+            pid_t nChild = SpawnProcessVFork( argv );
+            if ( nChild > 0 )
+                return nChild;
+        }
+
         // Create a pipe for the child to return the grandchild's
         // PID into.
         int nPidPipe[2] = { -1, -1 };
@@ -533,6 +643,129 @@ namespace gamescope::Process
 #endif
     }
 
+#if defined(__linux__)
+    // Everything the child needs, worked out up front by the parent.
+    // The child shares our address space and stack until it execs,
+    // so all it can do is make syscalls off of this.
+    struct VForkSpawnInfo_t
+    {
+        char **argv = nullptr;
+
+        std::optional<rlimit> oFdLimit;
+        std::optional<int> oNice;
+        std::optional<SchedulerInfo> oScheduler;
+
+        // Written by the child if exec fails.
+        int nExecErrno = 0;
+    };
+
+    static int VForkChild( void *pUserData )
+    {
+        VForkSpawnInfo_t *pInfo = reinterpret_cast<VForkSpawnInfo_t *>( pUserData );
+
+        // Handlers from the parent would run on our memory, drop them
+        // before letting any signals through. exec would do this anyway.
+        for ( int nSignal = 1; nSignal < NSIG; nSignal++ )
+        {
+            struct sigaction action{};
+            if ( sigaction( nSignal, nullptr, &action ) != 0 )
+                continue;
+
+            if ( action.sa_handler == SIG_IGN || action.sa_handler == SIG_DFL )
+                continue;
+
+            action = {};
+            action.sa_handler = SIG_DFL;
+            sigaction( nSignal, &action, nullptr );
+        }
+
+        // Before we drop the fd limit, so we catch everything above it.
+#if defined(SYS_close_range)
+        if ( syscall( SYS_close_range, STDERR_FILENO + 1, ~0u, 0 ) != 0 )
+#endif
+        {
+            const long lMaxFd = sysconf( _SC_OPEN_MAX );
+            for ( long lFd = STDERR_FILENO + 1; lFd < lMaxFd; lFd++ )
+                close( (int)lFd );
+        }
+
+        // Mirrors ProcessPreSpawn.
+        if ( pInfo->oFdLimit )
+            setrlimit( RLIMIT_NOFILE, &*pInfo->oFdLimit );
+        if ( pInfo->oNice )
+            setpriority( PRIO_PROCESS, 0, *pInfo->oNice );
+        if ( pInfo->oScheduler )
+            sched_setscheduler( 0, pInfo->oScheduler->nPolicy, &pInfo->oScheduler->SchedParam );
+
+        sigset_t set;
+        sigemptyset( &set );
+        sigprocmask( SIG_SETMASK, &set, nullptr );
+
+        execvp( pInfo->argv[0], pInfo->argv );
+
+        pInfo->nExecErrno = errno;
+        _exit( 0 );
+    }
+
+    // clone(CLONE_VM | CLONE_VFORK), like posix_spawn does.
+    //
+    // Unlike fork(), this doesn't copy our page tables, which get pretty big
+    // with all of the Vulkan and DRM mappings we have, and we'd have to
+    // copy again for every child we launch.
+    static pid_t SpawnProcessVFork( char **argv )
+    {
+        VForkSpawnInfo_t info;
+        info.argv = argv;
+        info.oFdLimit = g_oOriginalFDLimit;
+        if ( g_oOldNice && g_oNewNice && *g_oOldNice != *g_oNewNice )
+            info.oNice = g_oOldNice;
+        info.oScheduler = g_oOldSchedulerInfo;
+
+        // execvp may need to put a copy of argv on the stack for scripts.
+        size_t zArgc = 0;
+        while ( argv[ zArgc ] )
+            zArgc++;
+        const size_t zPageSize = sysconf( _SC_PAGESIZE );
+        const size_t zStackSize = ( ( ( zArgc + 1 ) * sizeof( char * ) + zPageSize - 1 ) & ~( zPageSize - 1 ) ) + 64 * 1024;
+
+        void *pStack = mmap( nullptr, zStackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0 );
+        if ( pStack == MAP_FAILED )
+            return -1;
+        defer( munmap( pStack, zStackSize ) );
+
+        // Nothing can be delivered to the child until it has
+        // put the handlers back to default.
+        sigset_t allSignals, oldSignals;
+        sigfillset( &allSignals );
+        pthread_sigmask( SIG_SETMASK, &allSignals, &oldSignals );
+
+        pid_t nChild = clone( VForkChild, (uint8_t *)pStack + zStackSize, CLONE_VM | CLONE_VFORK | SIGCHLD, &info );
+        int nCloneErrno = errno;
+
+        pthread_sigmask( SIG_SETMASK, &oldSignals, nullptr );
+
+        if ( nChild < 0 )
+        {
+            errno = nCloneErrno;
+            s_ProcessLog.errorf_errno( "Failed to clone() child, falling back to fork()" );
+            return -1;
+        }
+
+        if ( info.nExecErrno )
+        {
+            errno = info.nExecErrno;
+            s_ProcessLog.errorf_errno( "Failed to start process \"%s\"", argv[0] );
+        }
+
+        return nChild;
+    }
+#else
+    static pid_t SpawnProcessVFork( char **argv )
+    {
+        return -1;
+    }
+#endif
+
     const char *GetProcessName()
     {
         return __progname;
@@ -0,0 +1,80 @@
+#include "WorkerPool.h"
+
+#include <pthread.h>
+
+namespace gamescope
+{
+    CWorkerPool::CWorkerPool( const char *pszThreadName, uint32_t uThreads, uint32_t uMaxJobs )
+        : m_sThreadName{ pszThreadName }
+        , m_uThreads{ uThreads }
+        , m_uMaxJobs{ uMaxJobs }
+    {
+    }
+
+    CWorkerPool::~CWorkerPool()
+    {
+        {
+            std::unique_lock lock{ m_mutJobs };
+            m_bQuit = true;
+        }
+        m_cvJobs.notify_all();
+
+        for ( std::thread &thread : m_Threads )
+            thread.join();
+    }
+
+    bool CWorkerPool::Submit( std::function<void()> fnJob )
+    {
+        {
+            std::unique_lock lock{ m_mutJobs };
+
+            if ( m_Jobs.size() + m_uRunning >= m_uMaxJobs )
+                return false;
+
+            if ( m_Threads.empty() )
+            {
+                for ( uint32_t i = 0; i < m_uThreads; i++ )
+                    m_Threads.emplace_back( [this]() { WorkerThreadFunc(); } );
+            }
+
+            m_Jobs.emplace_back( std::move( fnJob ) );
+        }
+        m_cvJobs.notify_one();
+
+        return true;
+    }
+
+    void CWorkerPool::Flush()
+    {
+        std::unique_lock lock{ m_mutJobs };
+        m_cvIdle.wait( lock, [this]() { return m_Jobs.empty() && m_uRunning == 0; } );
+    }
+
+    void CWorkerPool::WorkerThreadFunc()
+    {
+        pthread_setname_np( pthread_self(), m_sThreadName.c_str() );
+
+        std::unique_lock lock{ m_mutJobs };
+        for ( ;; )
+        {
+            m_cvJobs.wait( lock, [this]() { return m_bQuit || !m_Jobs.empty(); } );
+
+            if ( m_Jobs.empty() )
+                return;
+
+            std::function<void()> fnJob = std::move( m_Jobs.front() );
+            m_Jobs.pop_front();
+            m_uRunning++;
+
+            lock.unlock();
+            fnJob();
+            // Anything it captured goes now, not with the next job.
+            fnJob = nullptr;
+            lock.lock();
+
+            m_uRunning--;
+            if ( m_Jobs.empty() && m_uRunning == 0 )
+                m_cvIdle.notify_all();
+        }
+    }
+}
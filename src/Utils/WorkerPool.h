@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NonCopyable.h"
+
+namespace gamescope
+{
+    //
+    // A fixed set of threads that run jobs handed to them,
+    // for work that shouldn't hold up the thread that has it.
+    //
+    // The number of jobs that can be queued or running at once is capped,
+    // past that Submit refuses rather than blocks, so whoever submits
+    // never has to wait on the workers, and they can't fall ever further behind.
+    //
+    // The threads are started on the first Submit.
+    //
+    class CWorkerPool : public NonCopyable
+    {
+    public:
+        CWorkerPool( const char *pszThreadName, uint32_t uThreads, uint32_t uMaxJobs );
+        // Runs anything still queued before returning.
+        ~CWorkerPool();
+
+        // Returns false, without taking fnJob, if uMaxJobs are already queued or running.
+        bool Submit( std::function<void()> fnJob );
+
+        // Waits for everything submitted so far to have run.
+        void Flush();
+
+        uint32_t GetMaxJobs() const { return m_uMaxJobs; }
+
+    private:
+        void WorkerThreadFunc();
+
+        const std::string m_sThreadName;
+        const uint32_t m_uThreads;
+        const uint32_t m_uMaxJobs;
+
+        std::mutex m_mutJobs;
+        std::condition_variable m_cvJobs;
+        std::condition_variable m_cvIdle;
+        std::deque<std::function<void()>> m_Jobs;
+        uint32_t m_uRunning = 0;
+        bool m_bQuit = false;
+
+        std::vector<std::thread> m_Threads;
+    };
+}
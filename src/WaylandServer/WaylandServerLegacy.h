@@ -55,6 +55,10 @@ struct wlserver_wl_surface_info
 	std::vector<struct wl_resource *> gamescope_swapchains;
 	std::optional<uint32_t> present_id = std::nullopt;
 	uint64_t desired_present_time = 0;
+	// When the first input delivered to this surface, while it had focus,
+	// that none of its commits have answered yet happened. 0 if none.
+	// Only the next commit gets it.
+	uint64_t pending_input_time = 0;
 
 	uint64_t last_refresh_cycle = 0;
 };
@@ -0,0 +1,139 @@
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "rc.h"
+#include "Utils/EpochPointerMap.h"
+
+using namespace gamescope;
+
+// CBufferMemoizer's lookups, with something refcounted standing in
+// for CVulkanTexture, as the real thing needs a Vulkan device and a wlserver.
+//
+// Every thread imports from its own set of buffers, like several Xwayland
+// servers' games with their swapchains. Thread 0 optionally also destroys and
+// recreates a buffer every so often, like the wlserver thread does.
+
+struct Buffer_t
+{
+    uint64_t ulPad;
+};
+
+class CTexture : public RcObject
+{
+};
+
+struct Memo_t
+{
+    OwningRc<CTexture> pTexture;
+};
+
+static constexpr uint32_t k_uBuffersPerThread = 8;
+static constexpr uint32_t k_uMaxThreads = 8;
+static constexpr uint32_t k_uChurnInterval = 256;
+
+// The old CBufferMemoizer.
+class CMutexMemoizer
+{
+public:
+    OwningRc<CTexture> Lookup( Buffer_t *pBuffer ) const
+    {
+        std::scoped_lock lock{ m_mutMemos };
+        auto iter = m_Memos.find( pBuffer );
+        if ( iter == m_Memos.end() )
+            return nullptr;
+
+        return iter->second->pTexture;
+    }
+
+    void Memoize( Buffer_t *pBuffer, Memo_t *pMemo )
+    {
+        std::scoped_lock lock{ m_mutMemos };
+        m_Memos.emplace( pBuffer, pMemo );
+    }
+
+    Memo_t *Unmemoize( Buffer_t *pBuffer )
+    {
+        std::scoped_lock lock{ m_mutMemos };
+        auto iter = m_Memos.find( pBuffer );
+        Memo_t *pMemo = iter->second;
+        m_Memos.erase( iter );
+        return pMemo;
+    }
+
+private:
+    mutable std::mutex m_mutMemos;
+    std::unordered_map<Buffer_t *, Memo_t *> m_Memos;
+};
+
+class CEpochMemoizer
+{
+public:
+    OwningRc<CTexture> Lookup( Buffer_t *pBuffer ) const
+    {
+        CEpochPointerMap<Buffer_t, Memo_t>::ReadGuard guard{ m_Memos };
+        Memo_t *pMemo = m_Memos.Lookup( pBuffer, guard );
+        if ( !pMemo )
+            return nullptr;
+
+        return pMemo->pTexture;
+    }
+
+    void Memoize( Buffer_t *pBuffer, Memo_t *pMemo ) { m_Memos.Insert( pBuffer, pMemo ); }
+    Memo_t *Unmemoize( Buffer_t *pBuffer ) { return m_Memos.Remove( pBuffer ); }
+
+private:
+    CEpochPointerMap<Buffer_t, Memo_t> m_Memos;
+};
+
+template <typename TMemoizer>
+struct MemoFixture_t
+{
+    MemoFixture_t()
+        : Buffers( k_uBuffersPerThread * k_uMaxThreads )
+    {
+        for ( Buffer_t &buffer : Buffers )
+            Memoizer.Memoize( &buffer, new Memo_t{ new CTexture } );
+    }
+
+    std::vector<Buffer_t> Buffers;
+    TMemoizer Memoizer;
+};
+
+template <typename TMemoizer, bool bChurn>
+static void Benchmark_Lookup( benchmark::State &state )
+{
+    // Shared by all the threads of a run.
+    static MemoFixture_t<TMemoizer> s_Fixture;
+
+    Buffer_t *pBuffers = &s_Fixture.Buffers[ state.thread_index() * k_uBuffersPerThread ];
+
+    uint32_t uIteration = 0;
+    for ( auto _ : state )
+    {
+        Buffer_t *pBuffer = &pBuffers[ uIteration % k_uBuffersPerThread ];
+
+        if ( bChurn && state.thread_index() == 0 && uIteration % k_uChurnInterval == 0 )
+        {
+            Memo_t *pMemo = s_Fixture.Memoizer.Unmemoize( pBuffer );
+            s_Fixture.Memoizer.Memoize( pBuffer, pMemo );
+        }
+
+        OwningRc<CTexture> pTexture = s_Fixture.Memoizer.Lookup( pBuffer );
+        benchmark::DoNotOptimize( pTexture.get() );
+
+        uIteration++;
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+
+BENCHMARK(Benchmark_Lookup<CMutexMemoizer, false>)->ThreadRange(1, k_uMaxThreads)->UseRealTime();
+BENCHMARK(Benchmark_Lookup<CEpochMemoizer, false>)->ThreadRange(1, k_uMaxThreads)->UseRealTime();
+BENCHMARK(Benchmark_Lookup<CMutexMemoizer, true>)->ThreadRange(1, k_uMaxThreads)->UseRealTime();
+BENCHMARK(Benchmark_Lookup<CEpochMemoizer, true>)->ThreadRange(1, k_uMaxThreads)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -2,6 +2,7 @@
 #include "rendervulkan.hpp"
 #include "steamcompmgr.hpp"
 #include "commit.h"
+#include "SyncobjEventFdPool.h"
 
 #include "gpuvis_trace_utils.h"
 
@@ -22,14 +23,7 @@ commit_t::~commit_t()
     if ( vulkanTex != nullptr )
         vulkanTex = nullptr;
 
-    wlserver_lock();
-    if (!presentation_feedbacks.empty())
-    {
-        wlserver_presentation_feedback_discard(surf, presentation_feedbacks);
-        // presentation_feedbacks cleared by wlserver_presentation_feedback_discard
-    }
-    wlr_buffer_unlock( buf );
-    wlserver_unlock();
+    wlserver_release_commit( buf, surf, std::move( presentation_feedbacks ) );
 }
 
 GamescopeAppTextureColorspace commit_t::colorspace() const
@@ -55,7 +49,7 @@ void commit_t::OnPollIn()
 
     {
         std::unique_lock lock( m_WaitableCommitStateMutex );
-        if ( !CloseFenceInternal() )
+        if ( !CloseFenceInternal( true ) )
             return;
     }
 
@@ -106,24 +100,29 @@ bool commit_t::IsPerfOverlayFIFO()
 }
 
 // Returns true if we had a fence that was closed.
-bool commit_t::CloseFenceInternal()
+bool commit_t::CloseFenceInternal( bool bSignalled )
 {
     if ( m_nCommitFence < 0 )
         return false;
 
     // Will automatically remove from epoll!
     g_ImageWaiter.RemoveWaitable( this );
-    close( m_nCommitFence );
+    if ( m_bPooledFence )
+        gamescope::CSyncobjEventFdPool::Get().Release( m_nCommitFence, bSignalled );
+    else
+        close( m_nCommitFence );
     m_nCommitFence = -1;
+    m_bPooledFence = false;
     return true;
 }
 
-void commit_t::SetFence( int nFence, bool bMangoNudge, CommitDoneList_t *pDoneCommits )
+void commit_t::SetFence( int nFence, bool bMangoNudge, CommitDoneList_t *pDoneCommits, bool bPooledFence )
 {
     std::unique_lock lock( m_WaitableCommitStateMutex );
     CloseFenceInternal();
 
     m_nCommitFence = nFence;
+    m_bPooledFence = bPooledFence;
     m_bMangoNudge = bMangoNudge;
     m_pDoneCommits = pDoneCommits;
 }
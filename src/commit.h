@@ -33,8 +33,8 @@ struct commit_t final : public gamescope::RcObject, public gamescope::IWaitable,
 	bool IsPerfOverlayFIFO();
 
 	// Returns true if we had a fence that was closed.
-	bool CloseFenceInternal();
-	void SetFence( int nFence, bool bMangoNudge, CommitDoneList_t *pDoneCommits );
+	bool CloseFenceInternal( bool bSignalled = false );
+	void SetFence( int nFence, bool bMangoNudge, CommitDoneList_t *pDoneCommits, bool bPooledFence = false );
 
 	bool ShouldPreemptivelyUpscale();
 
@@ -74,9 +74,13 @@ struct commit_t final : public gamescope::RcObject, public gamescope::IWaitable,
 	uint64_t earliest_present_time = 0;
 	uint64_t present_margin = 0;
 	uint64_t present_time = 0;
+	// CLOCK_MONOTONIC nanos of the first input this commit answers, 0 if none.
+	uint64_t input_time = 0;
 
 	std::mutex m_WaitableCommitStateMutex;
 	int m_nCommitFence = -1;
+	// From CSyncobjEventFdPool, goes back there instead of being closed.
+	bool m_bPooledFence = false;
 	bool m_bMangoNudge = false;
 	CommitDoneList_t *m_pDoneCommits = nullptr; // I hate this
 };
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include <benchmark/benchmark.h>
+
+#include "Utils/MpscList.h"
+
+using namespace gamescope;
+using namespace std::chrono_literals;
+
+// What dropping a commit costs the compositor thread, with the Wayland
+// thread busy dispatching for a client sending commits as fast as it can:
+// taking wlserver_lock to release the buffer like ~commit_t used to,
+// against handing it to the Wayland thread to release.
+//
+// Stand-ins for the real thing, which needs a wlserver: releasing a buffer
+// and dispatching are spins of roughly the right length.
+
+static constexpr auto k_ReleaseTime = 1us;
+static constexpr auto k_DispatchTime = 50us;
+static constexpr auto k_DispatchInterval = 100us;
+
+static void Spin( std::chrono::nanoseconds duration )
+{
+    auto end = std::chrono::steady_clock::now() + duration;
+    while ( std::chrono::steady_clock::now() < end )
+        ;
+}
+
+struct Release_t
+{
+    void *pBuffer;
+    void *pSurface;
+    std::vector<void *> presentationFeedbacks;
+};
+
+template <bool bDeferred>
+static void Benchmark_DropCommit( benchmark::State &state )
+{
+    pthread_mutex_t waylock = PTHREAD_MUTEX_INITIALIZER;
+    CMpscList<Release_t> releases;
+
+    std::atomic<bool> bDone = { false };
+    std::mutex mutNudge;
+    std::condition_variable cvNudge;
+    bool bNudged = false;
+
+    std::thread waylandThread( [&]()
+    {
+        while ( !bDone )
+        {
+            {
+                std::unique_lock lock{ mutNudge };
+                cvNudge.wait_for( lock, k_DispatchInterval, [&]() { return bNudged; } );
+                bNudged = false;
+            }
+
+            pthread_mutex_lock( &waylock );
+            releases.Drain( []( Release_t release ) { Spin( k_ReleaseTime ); } );
+            Spin( k_DispatchTime );
+            pthread_mutex_unlock( &waylock );
+        }
+    });
+
+    for ( auto _ : state )
+    {
+        Release_t release{ &release, &release, {} };
+
+        if ( bDeferred )
+        {
+            if ( releases.Push( std::move( release ) ) )
+            {
+                {
+                    std::scoped_lock lock{ mutNudge };
+                    bNudged = true;
+                }
+                cvNudge.notify_one();
+            }
+        }
+        else
+        {
+            pthread_mutex_lock( &waylock );
+            Spin( k_ReleaseTime );
+            pthread_mutex_unlock( &waylock );
+        }
+    }
+
+    bDone = true;
+    cvNudge.notify_one();
+    waylandThread.join();
+
+    state.SetItemsProcessed( state.iterations() );
+}
+
+BENCHMARK( Benchmark_DropCommit<false> )->UseRealTime();
+BENCHMARK( Benchmark_DropCommit<true> )->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,329 @@
+// Checks that cs_composite_blit skipping layers that don't touch a
+// workgroup's tile (layerTouchesTile in shaders/composite_blit.h) doesn't
+// change a single pixel, and counts how many layer samples it saves.
+//
+// Headless: there's no Vulkan driver to run the shader on, so
+// compositePixel and the parts of sampleLayerEx that decide whether a
+// layer is in its rect are mirrored here. Layers sample a nearest texel
+// inside their rect, colour management is left out as it's the same
+// either way.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "test_check.h"
+
+static constexpr uint32_t k_uWorkgroupSize = 8;
+
+enum EAlphaMode
+{
+    k_EAlphaMode_Premult = 0,
+    k_EAlphaMode_Coverage = 1,
+    k_EAlphaMode_None = 2,
+};
+
+struct Color_t
+{
+    float r, g, b, a;
+
+    bool operator==( const Color_t & ) const = default;
+};
+
+struct Layer_t
+{
+    float flOffset[ 2 ];
+    float flScale[ 2 ];
+    uint32_t uTexWidth;
+    uint32_t uTexHeight;
+    float flOpacity;
+    EAlphaMode eAlphaMode;
+    bool bBorder;
+    std::vector<Color_t> texels;
+};
+
+struct Frame_t
+{
+    uint32_t uWidth;
+    uint32_t uHeight;
+    std::vector<Layer_t> layers;
+};
+
+// sampleLayerEx, without the filtering and colour management.
+static Color_t SampleLayer( const Layer_t &layer, float u, float v )
+{
+    float flCoordX = ( u + layer.flOffset[ 0 ] ) * layer.flScale[ 0 ];
+    float flCoordY = ( v + layer.flOffset[ 1 ] ) * layer.flScale[ 1 ];
+
+    if ( flCoordX < 0.0f || flCoordY < 0.0f ||
+         flCoordX >= float( layer.uTexWidth ) || flCoordY >= float( layer.uTexHeight ) )
+    {
+        float flBorder = layer.bBorder ? 1.0f : 0.0f;
+        return Color_t{ 0.0f, 0.0f, 0.0f, flBorder };
+    }
+
+    return layer.texels[ uint32_t( flCoordY ) * layer.uTexWidth + uint32_t( flCoordX ) ];
+}
+
+// BlendLayer in alphamode.h.
+static Color_t BlendLayer( const Layer_t &layer, Color_t outputValue, Color_t layerColor )
+{
+    float flOpacity = layer.flOpacity;
+    float flLayerAlpha = flOpacity * layerColor.a;
+
+    auto fnBlend = [&]( float flOutput, float flLayer )
+    {
+        if ( layer.eAlphaMode == k_EAlphaMode_Premult )
+            return flLayer * flOpacity + flOutput * ( 1.0f - flLayerAlpha );
+        else if ( layer.eAlphaMode == k_EAlphaMode_Coverage )
+            return flLayer * flLayerAlpha + flOutput * ( 1.0f - flLayerAlpha );
+        else
+            return flLayer * flOpacity;
+    };
+
+    return Color_t
+    {
+        fnBlend( outputValue.r, layerColor.r ),
+        fnBlend( outputValue.g, layerColor.g ),
+        fnBlend( outputValue.b, layerColor.b ),
+        fnBlend( outputValue.a, layerColor.a ),
+    };
+}
+
+// layerTouchesTile
+static bool LayerTouchesTile( const Layer_t &layer, uint32_t uLayerIdx, const float flTileMin[2], const float flTileMax[2] )
+{
+    if ( layer.bBorder )
+        return true;
+
+    if ( uLayerIdx != 0 && layer.eAlphaMode == k_EAlphaMode_None )
+        return true;
+
+    const float flTexSize[ 2 ] = { float( layer.uTexWidth ), float( layer.uTexHeight ) };
+    for ( int i = 0; i < 2; i++ )
+    {
+        float flCoordA = ( flTileMin[ i ] + layer.flOffset[ i ] ) * layer.flScale[ i ];
+        float flCoordB = ( flTileMax[ i ] + layer.flOffset[ i ] ) * layer.flScale[ i ];
+        if ( !( std::max( flCoordA, flCoordB ) >= 0.0f && std::min( flCoordA, flCoordB ) < flTexSize[ i ] ) )
+            return false;
+    }
+    return true;
+}
+
+struct CompositeResult_t
+{
+    std::vector<Color_t> pixels;
+    uint64_t ulLayerSamples = 0;
+};
+
+// compositePixel over every pixel of the frame, workgroup by workgroup.
+static CompositeResult_t Composite( const Frame_t &frame, bool bCull )
+{
+    CompositeResult_t result;
+    result.pixels.resize( frame.uWidth * frame.uHeight );
+
+    for ( uint32_t y = 0; y < frame.uHeight; y++ )
+    {
+        for ( uint32_t x = 0; x < frame.uWidth; x++ )
+        {
+            const uint32_t uGroup[ 2 ] = { x / k_uWorkgroupSize, y / k_uWorkgroupSize };
+            const float flTileMin[ 2 ] = { float( uGroup[ 0 ] * k_uWorkgroupSize ) - 1.0f, float( uGroup[ 1 ] * k_uWorkgroupSize ) - 1.0f };
+            const float flTileMax[ 2 ] = { float( ( uGroup[ 0 ] + 1 ) * k_uWorkgroupSize ), float( ( uGroup[ 1 ] + 1 ) * k_uWorkgroupSize ) };
+
+            const float u = float( x );
+            const float v = float( y );
+
+            Color_t outputValue = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for ( uint32_t i = 0; i < frame.layers.size(); i++ )
+            {
+                const Layer_t &layer = frame.layers[ i ];
+                bool bTouches = !bCull || LayerTouchesTile( layer, i, flTileMin, flTileMax );
+
+                if ( i == 0 )
+                {
+                    if ( bTouches )
+                    {
+                        Color_t color = SampleLayer( layer, u, v );
+                        outputValue = Color_t{ color.r * layer.flOpacity, color.g * layer.flOpacity, color.b * layer.flOpacity, color.a * layer.flOpacity };
+                        result.ulLayerSamples++;
+                    }
+                    else
+                    {
+                        outputValue = Color_t{ 0.0f, 0.0f, 0.0f, 0.0f };
+                    }
+                    continue;
+                }
+
+                if ( !bTouches )
+                    continue;
+
+                outputValue = BlendLayer( layer, outputValue, SampleLayer( layer, u, v ) );
+                result.ulLayerSamples++;
+            }
+
+            result.pixels[ y * frame.uWidth + x ] = outputValue;
+        }
+    }
+
+    return result;
+}
+
+// A layer showing uTexWidth x uTexHeight texels at flX, flY on the output,
+// flZoom output pixels per texel, like steamcompmgr's layer setup.
+static Layer_t MakeLayer( float flX, float flY, uint32_t uTexWidth, uint32_t uTexHeight, float flZoom, std::mt19937 &rng )
+{
+    std::uniform_real_distribution<float> valueDist( 0.0f, 1.0f );
+
+    Layer_t layer;
+    layer.flScale[ 0 ] = layer.flScale[ 1 ] = 1.0f / flZoom;
+    layer.flOffset[ 0 ] = 0.5f / layer.flScale[ 0 ] - flX;
+    layer.flOffset[ 1 ] = 0.5f / layer.flScale[ 1 ] - flY;
+    layer.uTexWidth = uTexWidth;
+    layer.uTexHeight = uTexHeight;
+    layer.flOpacity = 1.0f;
+    layer.eAlphaMode = k_EAlphaMode_Premult;
+    layer.bBorder = false;
+
+    layer.texels.resize( uTexWidth * uTexHeight );
+    for ( Color_t &texel : layer.texels )
+    {
+        float flAlpha = valueDist( rng );
+        texel = Color_t{ valueDist( rng ) * flAlpha, valueDist( rng ) * flAlpha, valueDist( rng ) * flAlpha, flAlpha };
+    }
+
+    return layer;
+}
+
+static uint32_t CountMismatches( const CompositeResult_t &a, const CompositeResult_t &b )
+{
+    uint32_t uMismatches = 0;
+    for ( size_t i = 0; i < a.pixels.size(); i++ )
+        uMismatches += !( a.pixels[ i ] == b.pixels[ i ] );
+    return uMismatches;
+}
+
+static void CheckCullingMatches( const char *pszName, const Frame_t &frame, uint64_t *pulSamples = nullptr, uint64_t *pulCulledSamples = nullptr )
+{
+    CompositeResult_t full = Composite( frame, false );
+    CompositeResult_t culled = Composite( frame, true );
+
+    uint32_t uMismatches = CountMismatches( full, culled );
+    if ( uMismatches )
+        printf( "  %s: %u pixels differ\n", pszName, uMismatches );
+    TEST_CHECK( uMismatches == 0 );
+    TEST_CHECK( culled.ulLayerSamples <= full.ulLayerSamples );
+
+    if ( pulSamples )
+        *pulSamples = full.ulLayerSamples;
+    if ( pulCulledSamples )
+        *pulCulledSamples = culled.ulLayerSamples;
+}
+
+// A game, the Steam overlay over part of it, and a notification,
+// none of them lined up with the 8x8 tiles.
+static void test_overlay_and_notification()
+{
+    std::mt19937 rng{ 35 };
+
+    Frame_t frame{ 1280, 800, {} };
+    frame.layers.push_back( MakeLayer( 0.0f, 0.0f, 640, 400, 2.0f, rng ) );
+    frame.layers.push_back( MakeLayer( 203.0f, 117.0f, 501, 333, 1.0f, rng ) );
+    frame.layers.push_back( MakeLayer( 1013.5f, 733.25f, 259, 61, 1.0f, rng ) );
+
+    uint64_t ulSamples, ulCulledSamples;
+    CheckCullingMatches( "overlay and notification", frame, &ulSamples, &ulCulledSamples );
+
+    // The overlays cover ~18% of the frame, so most of their samples go.
+    TEST_CHECK( ulCulledSamples < ulSamples * 3 / 4 );
+    printf( "  overlay and notification: %lu layer samples, %lu with culling (%.0f%%)\n",
+        (unsigned long)ulSamples, (unsigned long)ulCulledSamples, 100.0 * ulCulledSamples / ulSamples );
+}
+
+// Layer 0 is the one that gets assigned rather than blended, and it's
+// culled to vec4(0) even as alpha_mode_none: letterboxed and pillarboxed
+// games, with and without a border.
+static void test_layer0()
+{
+    std::mt19937 rng{ 35 };
+
+    for ( bool bBorder : { false, true } )
+    {
+        for ( EAlphaMode eAlphaMode : { k_EAlphaMode_Premult, k_EAlphaMode_None } )
+        {
+            Frame_t frame{ 203, 117, {} };
+            frame.layers.push_back( MakeLayer( 21.5f, 0.0f, 80, 58, 2.0f, rng ) );
+            frame.layers.push_back( MakeLayer( 0.0f, 13.0f, 101, 40, 2.0f, rng ) );
+            frame.layers[ 0 ].bBorder = bBorder;
+            frame.layers[ 0 ].eAlphaMode = eAlphaMode;
+            frame.layers[ 0 ].flOpacity = 0.75f;
+
+            CheckCullingMatches( "layer 0", frame );
+
+            // Nothing over it, where layer 0 is culled it composites to 0.
+            frame.layers.resize( 1 );
+            CheckCullingMatches( "layer 0 alone", frame );
+        }
+    }
+}
+
+// Flipped layers, where (tileMax + offset) * scale is the lower bound.
+static void test_flipped()
+{
+    std::mt19937 rng{ 35 };
+
+    Frame_t frame{ 96, 64, {} };
+    frame.layers.push_back( MakeLayer( 0.0f, 0.0f, 96, 64, 1.0f, rng ) );
+    Layer_t flipped = MakeLayer( 0.0f, 0.0f, 23, 17, 1.0f, rng );
+    flipped.flScale[ 0 ] = -1.0f;
+    flipped.flOffset[ 0 ] = -60.5f;
+    flipped.flScale[ 1 ] = -1.0f;
+    flipped.flOffset[ 1 ] = -40.5f;
+    frame.layers.push_back( std::move( flipped ) );
+
+    CheckCullingMatches( "flipped", frame );
+}
+
+// Random stacks of up to four layers, partly off screen, at fractional
+// positions and zooms, in every alpha mode, some with borders.
+static void test_random_frames()
+{
+    std::mt19937 rng{ 35 };
+    std::uniform_int_distribution<uint32_t> layerCountDist( 1, 4 );
+    std::uniform_int_distribution<uint32_t> texSizeDist( 1, 48 );
+    std::uniform_real_distribution<float> posDist( -24.0f, 90.0f );
+    std::uniform_real_distribution<float> zoomDist( 0.25f, 3.0f );
+    std::uniform_real_distribution<float> opacityDist( 0.0f, 1.0f );
+    std::uniform_int_distribution<int> alphaModeDist( 0, 2 );
+    std::uniform_int_distribution<int> borderDist( 0, 7 );
+
+    for ( uint32_t i = 0; i < 500; i++ )
+    {
+        Frame_t frame{ 83, 61, {} };
+        uint32_t uLayerCount = layerCountDist( rng );
+        for ( uint32_t j = 0; j < uLayerCount; j++ )
+        {
+            Layer_t layer = MakeLayer( posDist( rng ), posDist( rng ), texSizeDist( rng ), texSizeDist( rng ), zoomDist( rng ), rng );
+            layer.flOpacity = opacityDist( rng );
+            layer.eAlphaMode = EAlphaMode( alphaModeDist( rng ) );
+            layer.bBorder = borderDist( rng ) == 0;
+            frame.layers.push_back( std::move( layer ) );
+        }
+
+        CheckCullingMatches( "random", frame );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    printf( "composite_tile_cull_tests\n" );
+
+    test_overlay_and_notification();
+    test_layer0();
+    test_flipped();
+    test_random_frames();
+
+    return TestExitCode();
+}
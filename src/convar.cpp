@@ -1,6 +1,7 @@
 #include "convar.h"
 #include "Utils/Version.h"
 #include <algorithm>
+#include <thread>
 
 LogScope console_log("console");
 
@@ -53,6 +54,71 @@ namespace gamescope
         return s_Commands;
     }
 
+    struct ConVarCallbackQueue_t
+    {
+        std::atomic<bool> bHasThread = { false };
+        std::thread::id CallbackThread;
+        std::function<void()> fnWakeup;
+
+        std::mutex mutPending;
+        std::vector<std::function<void()>> PendingCallbacks;
+    };
+
+    static ConVarCallbackQueue_t &GetConVarCallbackQueue()
+    {
+        static ConVarCallbackQueue_t s_Queue;
+        return s_Queue;
+    }
+
+    void SetConVarCallbackThread( std::function<void()> fnWakeup )
+    {
+        ConVarCallbackQueue_t &queue = GetConVarCallbackQueue();
+
+        {
+            std::unique_lock lock( queue.mutPending );
+            queue.CallbackThread = std::this_thread::get_id();
+            queue.fnWakeup = std::move( fnWakeup );
+        }
+        queue.bHasThread = true;
+    }
+
+    bool IsConVarCallbackThread()
+    {
+        ConVarCallbackQueue_t &queue = GetConVarCallbackQueue();
+
+        // CallbackThread is only written before bHasThread is set.
+        return !queue.bHasThread || queue.CallbackThread == std::this_thread::get_id();
+    }
+
+    void QueueConVarCallback( std::function<void()> fnCallback )
+    {
+        ConVarCallbackQueue_t &queue = GetConVarCallbackQueue();
+
+        {
+            std::unique_lock lock( queue.mutPending );
+            queue.PendingCallbacks.emplace_back( std::move( fnCallback ) );
+        }
+
+        if ( queue.bHasThread && queue.fnWakeup )
+            queue.fnWakeup();
+    }
+
+    void RunPendingConVarCallbacks()
+    {
+        ConVarCallbackQueue_t &queue = GetConVarCallbackQueue();
+
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::unique_lock lock( queue.mutPending );
+            if ( queue.PendingCallbacks.empty() )
+                return;
+            callbacks.swap( queue.PendingCallbacks );
+        }
+
+        for ( auto &fnCallback : callbacks )
+            fnCallback();
+    }
+
     static ConCommand cc_help("help", "List all Gamescope convars and commands",
     []( std::span<std::string_view> args )
     {
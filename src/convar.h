@@ -1,6 +1,9 @@
 #pragma once
 
 #include <span>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -11,6 +14,7 @@
 #include <cstdint>
 #include <functional>
 #include <cassert>
+#include <vector>
 
 #include "Script/Script.h"
 #include "Utils/Dict.h"
@@ -128,6 +132,87 @@ namespace gamescope
         SCRIPTDESC( "call", &ConCommand::CallWithArgString )
     END_SCRIPTDESC()
 
+    // Convar change callbacks run on the thread set here (steamcompmgr's),
+    // sets from any other thread queue them up for RunPendingConVarCallbacks.
+    // Until then, callbacks run inline on the setting thread.
+    void SetConVarCallbackThread( std::function<void()> fnWakeup );
+    void RunPendingConVarCallbacks();
+    bool IsConVarCallbackThread();
+    void QueueConVarCallback( std::function<void()> fnCallback );
+
+    template <typename T>
+    struct ConVarIsLockFree : std::bool_constant<std::atomic<T>::is_always_lock_free> {};
+
+    template <typename T>
+    inline constexpr bool k_bConVarIsAtomic = std::conjunction_v<std::is_trivially_copyable<T>, ConVarIsLockFree<T>>;
+
+    // Storage for a convar's value, so it can be read from any thread
+    // while being set from another.
+    template <typename T, bool bAtomic = k_bConVarIsAtomic<T>>
+    class CConVarValue;
+
+    template <typename T>
+    class CConVarValue<T, true>
+    {
+    public:
+        CConVarValue( T value ) : m_Value{ value } {}
+
+        T Load() const { return std::atomic_ref<T>( m_Value ).load( std::memory_order_acquire ); }
+        void Store( T value ) { std::atomic_ref<T>( m_Value ).store( value, std::memory_order_release ); }
+
+        // Read-modify-write, for the compound assignment operators.
+        template <typename Func>
+        T &Update( Func fnUpdate )
+        {
+            std::atomic_ref<T> value{ m_Value };
+            T oldValue = value.load( std::memory_order_relaxed );
+            while ( !value.compare_exchange_weak( oldValue, fnUpdate( oldValue ), std::memory_order_acq_rel ) )
+                ;
+            return m_Value;
+        }
+    private:
+        alignas( std::atomic_ref<T>::required_alignment ) mutable T m_Value;
+    };
+
+    // Copy-on-write snapshots for everything else, ie. strings.
+    // Readers take their own reference to the snapshot they load, so setting
+    // a new value never frees one that is still being read. The lock only
+    // covers swapping the pointer, and is held across a read-modify-write so
+    // concurrent updates can't lose each other.
+    template <typename T>
+    class CConVarValue<T, false>
+    {
+    public:
+        CConVarValue( T value ) : m_pValue{ std::make_shared<const T>( std::move( value ) ) } {}
+
+        std::shared_ptr<const T> LoadShared() const
+        {
+            std::unique_lock lock( m_mutValue );
+            return m_pValue;
+        }
+        T Load() const { return *LoadShared(); }
+        void Store( T value )
+        {
+            std::shared_ptr<const T> pNewValue = std::make_shared<const T>( std::move( value ) );
+
+            std::unique_lock lock( m_mutValue );
+            // The old snapshot is freed after unlocking, if this was the last reference.
+            m_pValue.swap( pNewValue );
+        }
+
+        template <typename Func>
+        T Update( Func fnUpdate )
+        {
+            std::unique_lock lock( m_mutValue );
+            T newValue = fnUpdate( *m_pValue );
+            m_pValue = std::make_shared<const T>( newValue );
+            return newValue;
+        }
+    private:
+        mutable std::mutex m_mutValue;
+        std::shared_ptr<const T> m_pValue;
+    };
+
     template <typename T>
     class ConVar : public ConCommand
     {
@@ -153,22 +238,32 @@ namespace gamescope
 #endif
         }
 
-        const T& Get() const
+        // Always a copy, so it stays valid whatever other threads set.
+        T Get() const
         {
-            return m_Value;
+            return m_Value.Load();
         }
 
         template <typename J>
         void SetValue( const J &newValue )
         {
-            m_Value = T{ newValue };
+            m_Value.Store( T{ newValue } );
 
             RunCallback();
         }
 
         void RunCallback()
         {
-            if ( !m_bInCallback && m_Callback )
+            if ( !m_Callback )
+                return;
+
+            if ( !IsConVarCallbackThread() )
+            {
+                QueueConVarCallback( [this]() { this->RunCallback(); } );
+                return;
+            }
+
+            if ( !m_bInCallback )
             {
                 m_bInCallback = true;
                 m_Callback( *this );
@@ -179,23 +274,21 @@ namespace gamescope
         template <typename J>
         ConVar<T>& operator =( const J &newValue ) { SetValue<J>( newValue ); return *this; }
 
-        operator T() const { return m_Value; }
+        operator T() const { return Get(); }
 
-        // SFINAE for std::string...
-        operator std::string_view() const { return m_Value; }
-
-        template <typename J> bool operator == ( const J &other ) const { return m_Value ==  other; }
-        template <typename J> bool operator != ( const J &other ) const { return m_Value !=  other; }
-        template <typename J> auto operator <=>( const J &other ) const { return m_Value <=> other; }
+        template <typename J> bool operator == ( const J &other ) const { return Get() ==  other; }
+        template <typename J> bool operator != ( const J &other ) const { return Get() !=  other; }
+        template <typename J> auto operator <=>( const J &other ) const { return Get() <=> other; }
 
         template <typename J>  bool operator == ( const ConVar<J> &other ) const { return *this ==  other.Get(); }
         template <typename J>  bool operator != ( const ConVar<J> &other ) const { return *this !=  other.Get(); }
         template <typename J>  auto operator <=>( const ConVar<J> &other ) const { return *this <=> other.Get(); }
 
-        T  operator | (T other) { return m_Value | other; }
-        T &operator |=(T other) { return m_Value |= other; }
-        T  operator & (T other) { return m_Value & other; }
-        T &operator &=(T other) { return m_Value &= other; }
+        // Like before, these don't run the callback.
+        T  operator | (T other) { return Get() | other; }
+        T &operator |=(T other) { return m_Value.Update( [other]( T value ) { return T( value | other ); } ); }
+        T  operator & (T other) { return Get() & other; }
+        T &operator &=(T other) { return m_Value.Update( [other]( T value ) { return T( value & other ); } ); }
 
         void InvokeFunc( std::span<std::string_view> pArgs )
         {
@@ -203,7 +296,7 @@ namespace gamescope
             {
                 // We should move to std format for logging and stuff.
                 // This is kinda gross and grody!
-                std::string sValue = ToString( m_Value );
+                std::string sValue = ToString( Get() );
                 console_log.infof( "%.*s: %.*s\n%.*s",
                     (int)m_pszName.length(), m_pszName.data(),
                     (int)sValue.length(), sValue.data(),
@@ -232,9 +325,12 @@ namespace gamescope
             }
         }
     private:
-        T m_Value{};
+        void SetValueForScript( T value ) { SetValue( value ); }
+
+        CConVarValue<T> m_Value;
         ConVarCallbackFunc m_Callback;
-        bool m_bInCallback;
+        // Only touched on the callback thread.
+        bool m_bInCallback = false;
     };
 
     SCRIPTDESC_TEMPLATE( T )
@@ -243,7 +339,7 @@ namespace gamescope
         SCRIPTDESC( "description", &ConVar<T>::m_pszDescription )
         SCRIPTDESC( "call", &ConVar<T>::CallWithArgString )
 
-        SCRIPTDESC( "value", &ConVar<T>::m_Value )
+        SCRIPTDESC( "value", sol::property( &ConVar<T>::Get, &ConVar<T>::SetValueForScript ) )
     END_SCRIPTDESC()
 
 }
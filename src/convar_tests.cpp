@@ -0,0 +1,139 @@
+// Sets and gets convars from several threads at once, checking callbacks
+// only run on the callback thread, that a string snapshot a reader holds
+// survives later sets, and that concurrent read-modify-writes don't lose
+// each other's updates.
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "convar.h"
+#include "test_check.h"
+
+static gamescope::ConVar<int> cv_test_int( "test_int", 0, "" );
+static gamescope::ConVar<float> cv_test_float( "test_float", 0.0f, "" );
+
+static std::thread::id s_CallbackThreadId;
+static std::atomic<uint32_t> s_uCallbacks = { 0 };
+static std::atomic<uint32_t> s_uCallbacksOffThread = { 0 };
+static gamescope::ConVar<std::string> cv_test_string( "test_string", "0", "",
+[]( gamescope::ConVar<std::string> &cvar )
+{
+    if ( std::this_thread::get_id() != s_CallbackThreadId )
+        s_uCallbacksOffThread++;
+    s_uCallbacks++;
+});
+
+static constexpr uint32_t k_uIterations = 20'000;
+static constexpr uint32_t k_uThreads = 4;
+
+static void test_concurrent_sets()
+{
+    std::atomic<bool> bWritersDone = { false };
+
+    std::vector<std::thread> threads;
+    for ( uint32_t i = 0; i < k_uThreads; i++ )
+    {
+        // Writers, through the same path gamescopectl takes.
+        threads.emplace_back( [i]()
+        {
+            for ( uint32_t j = 0; j < k_uIterations; j++ )
+            {
+                std::string sValue = std::to_string( i * k_uIterations + j );
+                std::string_view args[] = { "test_string", sValue };
+                gamescope::ConCommand::Exec( args );
+
+                cv_test_int = int( j );
+                cv_test_float = float( j );
+            }
+        });
+
+        // Readers, like the compositor/pipewire/input threads.
+        threads.emplace_back( [&bWritersDone]()
+        {
+            uint64_t ulSum = 0;
+            while ( !bWritersDone )
+            {
+                ulSum += cv_test_int + uint64_t( cv_test_float.Get() );
+                std::string sValue = cv_test_string;
+                ulSum += sValue.size();
+            }
+            (void) ulSum;
+        });
+    }
+
+    // Act as the callback thread while the others run.
+    for ( uint32_t i = 0; i < k_uThreads; i++ )
+    {
+        threads[ i * 2 ].join();
+        gamescope::RunPendingConVarCallbacks();
+    }
+    bWritersDone = true;
+    for ( uint32_t i = 0; i < k_uThreads; i++ )
+        threads[ i * 2 + 1 ].join();
+    gamescope::RunPendingConVarCallbacks();
+
+    TEST_CHECK( s_uCallbacks == k_uIterations * k_uThreads );
+    TEST_CHECK( s_uCallbacksOffThread == 0 );
+}
+
+static void test_compound_assignment()
+{
+    // Still hands back the value itself.
+    cv_test_int = 1;
+    int &nValue = ( cv_test_int |= 4 );
+    TEST_CHECK( nValue == 5 );
+    TEST_CHECK( &nValue == &( cv_test_int &= 4 ) );
+    TEST_CHECK( cv_test_int == 4 );
+}
+
+static void test_held_snapshot()
+{
+    gamescope::CConVarValue<std::string> value{ "first" };
+
+    std::shared_ptr<const std::string> pHeld = value.LoadShared();
+    for ( uint32_t i = 0; i < 1000; i++ )
+        value.Store( std::to_string( i ) );
+
+    TEST_CHECK( *pHeld == "first" );
+    TEST_CHECK( value.Load() == "999" );
+    TEST_CHECK( pHeld.use_count() == 1 );
+}
+
+static void test_concurrent_updates()
+{
+    static constexpr uint32_t k_uAppends = 2'000;
+
+    gamescope::CConVarValue<std::string> value{ "" };
+
+    std::vector<std::thread> threads;
+    for ( uint32_t i = 0; i < k_uThreads; i++ )
+    {
+        threads.emplace_back( [&value]()
+        {
+            for ( uint32_t j = 0; j < k_uAppends; j++ )
+                value.Update( []( const std::string &sValue ) { return sValue + "x"; } );
+        });
+    }
+    for ( std::thread &thread : threads )
+        thread.join();
+
+    TEST_CHECK( value.Load().size() == k_uAppends * k_uThreads );
+}
+
+int main( int argc, char *argv[] )
+{
+    printf( "convar_tests\n" );
+
+    s_CallbackThreadId = std::this_thread::get_id();
+    gamescope::SetConVarCallbackThread( nullptr );
+
+    test_concurrent_sets();
+    test_compound_assignment();
+    test_held_snapshot();
+    test_concurrent_updates();
+
+    return TestExitCode();
+}
@@ -0,0 +1,206 @@
+// Checks the tap layout and weights of the DOWNSCALE layer filter
+// (sampleDownscaled in shaders/composite.h) that shrinks layers into
+// small PipeWire captures: which texels every output pixel reads,
+// and how much of each.
+//
+// Headless: there's no Vulkan driver to run the shader on, so the shader's
+// maths is mirrored here along one axis. Both sampleBilinear and the grid
+// of taps are separable, so the 2D weights are the product of these.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "test_check.h"
+
+// What sampleBilinear reads at unnormalized coord, with the layers'
+// clamp to edge sampler, added into weights.
+static void AddBilinearWeights( float flCoord, double flWeight, std::vector<double> &weights )
+{
+    const int64_t nLast = int64_t( weights.size() ) - 1;
+
+    float flPixCoord = flCoord - 0.5f;
+    float flOrigin = std::floor( flPixCoord );
+    float flFilterWeight = flPixCoord - flOrigin;
+
+    weights[ std::clamp<int64_t>( int64_t( flOrigin ), 0, nLast ) ] += ( 1.0 - flFilterWeight ) * flWeight;
+    weights[ std::clamp<int64_t>( int64_t( flOrigin ) + 1, 0, nLast ) ] += flFilterWeight * flWeight;
+}
+
+// The weight of every texel in output pixel uPixel, for a layer of
+// uTexSize texels shrunk by flScale, as sampleLayerEx and sampleDownscaled
+// would compute it.
+static std::vector<double> DownscaleWeights( uint32_t uPixel, float flScale, uint32_t uTexSize )
+{
+    std::vector<double> weights( uTexSize, 0.0 );
+
+    // sampleLayerEx, with the layer's offset from offsetPixelCenter().
+    float flOffset = 0.5f / flScale;
+    float flCoord = ( float( uPixel ) + flOffset ) * flScale;
+
+    // sampleDownscaled
+    int nTaps = std::clamp( int( std::ceil( flScale ) ), 1, 8 );
+    float flCenter = flCoord + ( flScale - 1.0f ) * 0.5f;
+    for ( int i = 0; i < nTaps; i++ )
+    {
+        float flTapOffset = ( ( float( i ) + 0.5f ) / float( nTaps ) - 0.5f ) * flScale;
+        AddBilinearWeights( flCenter + flTapOffset, 1.0 / nTaps, weights );
+    }
+
+    return weights;
+}
+
+static bool Near( double a, double b, double flTolerance = 1e-5 )
+{
+    return std::abs( a - b ) <= flTolerance;
+}
+
+struct Downscale_t
+{
+    uint32_t uTexSize;
+    uint32_t uCaptureSize;
+};
+
+// Output sizes along one axis, and what calculate_capture_size makes of
+// requests for them, rounded down to even for NV12, eg. 1920x1080 asked
+// for 427x241 gets 426x240.
+static constexpr Downscale_t k_CaptureDownscales[] =
+{
+    { 1920, 426 },
+    { 1080, 240 },
+    { 1280, 332 },
+    { 800, 208 },
+    { 2560, 578 },
+    { 1600, 360 },
+    { 3840, 1278 },
+    { 2160, 718 },
+    { 1920, 1280 },
+    { 1280, 1266 },
+    { 2560, 400 },
+    { 2560, 350 },
+    { 3840, 480 },
+};
+
+static void test_integer_scales_are_box_filters()
+{
+    for ( uint32_t uScale : { 2u, 4u, 8u } )
+    {
+        const uint32_t uCaptureSize = 37;
+        const uint32_t uTexSize = uCaptureSize * uScale;
+
+        for ( uint32_t x = 0; x < uCaptureSize; x++ )
+        {
+            std::vector<double> weights = DownscaleWeights( x, float( uScale ), uTexSize );
+
+            // Exactly the texels the pixel covers, all the same.
+            for ( uint32_t i = 0; i < uTexSize; i++ )
+            {
+                bool bCovered = i >= x * uScale && i < ( x + 1 ) * uScale;
+                TEST_CHECK( Near( weights[ i ], bCovered ? 1.0 / uScale : 0.0 ) );
+            }
+        }
+    }
+}
+
+static void test_capture_sizes()
+{
+    for ( const Downscale_t &downscale : k_CaptureDownscales )
+    {
+        const float flScale = float( downscale.uTexSize ) / float( downscale.uCaptureSize );
+
+        for ( uint32_t x = 0; x < downscale.uCaptureSize; x++ )
+        {
+            std::vector<double> weights = DownscaleWeights( x, flScale, downscale.uTexSize );
+
+            // Where the pixel's footprint starts and ends, in texels.
+            const double flStart = x * double( flScale );
+            const double flEnd = ( x + 1 ) * double( flScale );
+
+            double flSum = 0.0;
+            double flCentroid = 0.0;
+            bool bOutsideFootprint = false;
+            bool bSkippedTexel = false;
+            for ( uint32_t i = 0; i < downscale.uTexSize; i++ )
+            {
+                flSum += weights[ i ];
+                flCentroid += weights[ i ] * ( i + 0.5 );
+
+                // Bilinear can reach up to a texel past the footprint.
+                if ( weights[ i ] > 1e-6 && ( i + 1.0 < flStart - 1.0 || i > flEnd + 1.0 ) )
+                    bOutsideFootprint = true;
+
+                // Until the taps run out, every texel entirely inside it counts.
+                if ( flScale <= 8.0f && i >= std::ceil( flStart ) && i + 1.0 <= std::floor( flEnd ) && weights[ i ] <= 0.0 )
+                    bSkippedTexel = true;
+            }
+
+            TEST_CHECK( Near( flSum, 1.0 ) );
+            TEST_CHECK( !bOutsideFootprint );
+            TEST_CHECK( !bSkippedTexel );
+
+            // Centred on the footprint, unless clamping at the edge pulls it in.
+            if ( flStart >= 1.0 && flEnd <= downscale.uTexSize - 1.0 )
+                TEST_CHECK( Near( flCentroid, ( flStart + flEnd ) * 0.5, 1e-3 ) );
+        }
+    }
+}
+
+// The reason for the filter: plain bilinear only reads the 2 texels nearest
+// the middle of each pixel and turns fine detail into whichever of them it
+// happened to land on. Every pixel should come out close to the average of
+// the texels it covers instead.
+static void test_fine_detail_averages_out()
+{
+    for ( const Downscale_t &downscale : k_CaptureDownscales )
+    {
+        const float flScale = float( downscale.uTexSize ) / float( downscale.uCaptureSize );
+
+        // Pixels barely bigger than a texel come out about as soft as
+        // bilinear, rather than as sharp as a box.
+        if ( flScale < 2.0f )
+            continue;
+
+        // One texel stripes.
+        std::vector<double> stripes( downscale.uTexSize );
+        for ( uint32_t i = 0; i < downscale.uTexSize; i++ )
+            stripes[ i ] = i % 2;
+
+        double flWorst = 0.0;
+        for ( uint32_t x = 0; x < downscale.uCaptureSize; x++ )
+        {
+            std::vector<double> weights = DownscaleWeights( x, flScale, downscale.uTexSize );
+
+            const double flStart = x * double( flScale );
+            const double flEnd = ( x + 1 ) * double( flScale );
+
+            double flValue = 0.0;
+            double flBoxValue = 0.0;
+            for ( uint32_t i = 0; i < downscale.uTexSize; i++ )
+            {
+                flValue += weights[ i ] * stripes[ i ];
+
+                double flCoverage = std::max( std::min( i + 1.0, flEnd ) - std::max( double( i ), flStart ), 0.0 );
+                flBoxValue += flCoverage / ( flEnd - flStart ) * stripes[ i ];
+            }
+
+            flWorst = std::max( flWorst, std::abs( flValue - flBoxValue ) );
+        }
+
+        if ( flWorst > 0.05 )
+            fprintf( stderr, "%u -> %u: stripes come out up to %.3f off the box average\n", downscale.uTexSize, downscale.uCaptureSize, flWorst );
+        TEST_CHECK( flWorst <= 0.05 );
+    }
+}
+
+int main( int argc, char **argv )
+{
+    printf( "downscale_filter_tests\n" );
+
+    test_integer_scales_are_box_filters();
+    test_capture_sizes();
+    test_fine_detail_averages_out();
+
+    return TestExitCode();
+}
@@ -0,0 +1,161 @@
+// Looks things up in a CEpochPointerMap from several threads while
+// another inserts and removes, checking a removed value is never handed
+// back to, or still held by, a reader once Remove has returned.
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Utils/EpochPointerMap.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+struct Key_t
+{
+    uint64_t ulPad;
+};
+
+struct Value_t
+{
+    Key_t *pKey = nullptr;
+    std::atomic<bool> bRetired = { false };
+};
+
+using Map = CEpochPointerMap<Key_t, Value_t>;
+
+static constexpr uint32_t k_uKeys = 256;
+static constexpr uint32_t k_uReaders = 4;
+static constexpr uint32_t k_uIterations = 20'000;
+
+static void test_basic()
+{
+    Map map;
+    std::vector<Key_t> keys( k_uKeys );
+    std::vector<Value_t> values( k_uKeys );
+
+    for ( uint32_t i = 0; i < k_uKeys; i++ )
+        map.Insert( &keys[i], &values[i] );
+
+    // Grew past the minimum, and at most half full.
+    TEST_CHECK( map.GetCapacity() >= k_uKeys * 2 );
+
+    {
+        Map::ReadGuard guard{ map };
+        for ( uint32_t i = 0; i < k_uKeys; i++ )
+            TEST_CHECK( map.Lookup( &keys[i], guard ) == &values[i] );
+
+        Key_t missing;
+        TEST_CHECK( map.Lookup( &missing, guard ) == nullptr );
+    }
+
+    for ( uint32_t i = 0; i < k_uKeys; i += 2 )
+        TEST_CHECK( map.Remove( &keys[i] ) == &values[i] );
+    TEST_CHECK( map.Remove( &keys[0] ) == nullptr );
+
+    {
+        Map::ReadGuard guard{ map };
+        for ( uint32_t i = 0; i < k_uKeys; i++ )
+            TEST_CHECK( map.Lookup( &keys[i], guard ) == ( i % 2 ? &values[i] : nullptr ) );
+    }
+
+    // Reinserting lands in tombstones without losing anything behind them.
+    for ( uint32_t i = 0; i < k_uKeys; i += 2 )
+        map.Insert( &keys[i], &values[i] );
+
+    {
+        Map::ReadGuard guard{ map };
+        for ( uint32_t i = 0; i < k_uKeys; i++ )
+            TEST_CHECK( map.Lookup( &keys[i], guard ) == &values[i] );
+    }
+
+    uint32_t uRemoved = 0;
+    map.RemoveAll( [&]( Key_t *pKey, Value_t *pValue ) { uRemoved++; } );
+    TEST_CHECK( uRemoved == k_uKeys );
+}
+
+static void test_concurrent()
+{
+    Map map;
+    std::vector<Key_t> keys( k_uKeys );
+
+    // Never freed until the end, so a stale value shows up as retired
+    // rather than as a use after free.
+    std::vector<std::unique_ptr<Value_t>> values;
+
+    std::atomic<bool> bDone = { false };
+    std::atomic<uint32_t> uStale = { 0 };
+    std::atomic<uint32_t> uWrongKey = { 0 };
+
+    std::vector<std::thread> readers;
+    for ( uint32_t i = 0; i < k_uReaders; i++ )
+    {
+        readers.emplace_back( [&, i]()
+        {
+            uint32_t uIndex = i;
+            while ( !bDone )
+            {
+                Key_t *pKey = &keys[ uIndex++ % k_uKeys ];
+
+                Map::ReadGuard guard{ map };
+                Value_t *pValue = map.Lookup( pKey, guard );
+                if ( !pValue )
+                    continue;
+
+                if ( pValue->pKey != pKey )
+                    uWrongKey++;
+
+                // Give the writer a chance to try and retire it under us.
+                std::this_thread::yield();
+
+                if ( pValue->bRetired )
+                    uStale++;
+            }
+        });
+    }
+
+    // Like the wlserver thread destroying buffers
+    // and the compositor memoizing new ones.
+    std::vector<Value_t *> live( k_uKeys, nullptr );
+    for ( uint32_t i = 0; i < k_uIterations; i++ )
+    {
+        uint32_t uKey = ( i * 7919 ) % k_uKeys;
+        if ( live[ uKey ] )
+        {
+            Value_t *pValue = map.Remove( &keys[ uKey ] );
+            TEST_CHECK( pValue == live[ uKey ] );
+            pValue->bRetired = true;
+            live[ uKey ] = nullptr;
+        }
+        else
+        {
+            values.emplace_back( std::make_unique<Value_t>() );
+            values.back()->pKey = &keys[ uKey ];
+            map.Insert( &keys[ uKey ], values.back().get() );
+            live[ uKey ] = values.back().get();
+        }
+
+        // Let the readers in between, rather than getting it all done
+        // before they've started.
+        std::this_thread::yield();
+    }
+
+    bDone = true;
+    for ( std::thread &thread : readers )
+        thread.join();
+
+    TEST_CHECK( uStale == 0 );
+    TEST_CHECK( uWrongKey == 0 );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "epoch_pointer_map_tests\n" );
+
+    test_basic();
+    test_concurrent();
+
+    return TestExitCode();
+}
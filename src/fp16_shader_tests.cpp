@@ -0,0 +1,490 @@
+// Checks that the half precision composite shaders (the _fp16 variants
+// picked when the device supports FP16, see composite_precision.h and
+// FsrRcasH) stay within a couple of 8-bit steps of the FP32 ones: layer
+// blending, blur accumulation, the NV12 colour matrix and RCAS.
+//
+// Headless: there's no Vulkan driver to run the shaders on, so their maths
+// is mirrored here, once on float and once on Half, which rounds every
+// result to the nearest float16_t the way the GPU stores them.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+#include "test_check.h"
+
+// How far apart, in 8-bit steps, the two precisions may end up.
+static constexpr int k_nTolerance = 2;
+
+// Nearest float16_t to flValue, ties to even, as a float.
+static float RoundToHalf( float flValue )
+{
+    if ( !std::isfinite( flValue ) )
+        return flValue;
+
+    float flAbs = std::fabs( flValue );
+    if ( flAbs >= 65520.0f )
+        return std::copysign( INFINITY, flValue );
+
+    // 11 significant bits, and a fixed 2^-24 spacing for subnormals.
+    int nExp;
+    std::frexp( flAbs, &nExp );
+    float flUlp = std::ldexp( 1.0f, std::max( nExp - 11, -24 ) );
+    return std::copysign( std::nearbyint( flAbs / flUlp ) * flUlp, flValue );
+}
+
+struct Half
+{
+    Half() = default;
+    explicit Half( float flValue ) : flValue{ RoundToHalf( flValue ) } {}
+    explicit operator float() const { return flValue; }
+
+    float flValue = 0.0f;
+};
+
+static Half operator+( Half a, Half b ) { return Half( float( a ) + float( b ) ); }
+static Half operator-( Half a, Half b ) { return Half( float( a ) - float( b ) ); }
+static Half operator*( Half a, Half b ) { return Half( float( a ) * float( b ) ); }
+static Half operator/( Half a, Half b ) { return Half( float( a ) / float( b ) ); }
+static Half operator-( Half a ) { return Half( -float( a ) ); }
+
+// GLSL's min/max, returning the other operand for NaN like GPUs do.
+static float Min( float a, float b ) { return std::fmin( a, b ); }
+static float Max( float a, float b ) { return std::fmax( a, b ); }
+static Half Min( Half a, Half b ) { return Half( std::fmin( float( a ), float( b ) ) ); }
+static Half Max( Half a, Half b ) { return Half( std::fmax( float( a ), float( b ) ) ); }
+
+static uint16_t HalfBits( Half h )
+{
+    float flAbs = std::fabs( float( h ) );
+    uint16_t uSign = std::signbit( float( h ) ) ? 0x8000 : 0;
+    if ( std::isinf( flAbs ) )
+        return uSign | 0x7c00;
+    if ( flAbs < 6.103515625e-05f )
+        return uSign | uint16_t( flAbs * 16777216.0f );
+
+    uint32_t uBits = std::bit_cast<uint32_t>( flAbs );
+    uint32_t uExp = ( uBits >> 23 ) - 127 + 15;
+    return uSign | uint16_t( uExp << 10 ) | uint16_t( ( uBits >> 13 ) & 0x3ff );
+}
+
+static Half HalfFromBits( uint16_t uBits )
+{
+    uint32_t uExp = ( uBits >> 10 ) & 0x1f;
+    uint32_t uMantissa = uBits & 0x3ff;
+
+    float flAbs;
+    if ( uExp == 0 )
+        flAbs = std::ldexp( float( uMantissa ), -24 );
+    else if ( uExp == 31 )
+        flAbs = uMantissa ? NAN : INFINITY;
+    else
+        flAbs = std::ldexp( float( uMantissa | 0x400 ), int( uExp ) - 25 );
+
+    return Half( ( uBits & 0x8000 ) ? -flAbs : flAbs );
+}
+
+// APrxMedRcpF1 and APrxMedRcpH1 from ffx_a.h.
+static float ApproxRcp( float a )
+{
+    float b = std::bit_cast<float>( 0x7ef19fffu - std::bit_cast<uint32_t>( a ) );
+    return b * ( -b * a + 2.0f );
+}
+
+static Half ApproxRcp( Half a )
+{
+    Half b = HalfFromBits( uint16_t( 0x778d - HalfBits( a ) ) );
+    return b * ( -b * a + Half( 2.0f ) );
+}
+
+// colorimetry.h, always in full precision.
+static float SrgbToLinear( float flValue )
+{
+    if ( flValue <= 0.04045f )
+        return flValue / 12.92f;
+    return std::pow( ( flValue + 0.055f ) / 1.055f, 12.0f / 5.0f );
+}
+
+static float LinearToSrgb( float flValue )
+{
+    if ( flValue <= 0.0031308f )
+        return flValue * 12.92f;
+    return std::pow( flValue, 5.0f / 12.0f ) * 1.055f - 0.055f;
+}
+
+static int Quantize( float flValue )
+{
+    return int( std::round( std::clamp( flValue, 0.0f, 1.0f ) * 255.0f ) );
+}
+
+template <typename T>
+struct Vec3
+{
+    T r, g, b;
+
+    T &operator[]( int i ) { return i == 0 ? r : i == 1 ? g : b; }
+};
+
+template <typename T>
+static Vec3<T> MakeVec3( float r, float g, float b )
+{
+    return Vec3<T>{ T( r ), T( g ), T( b ) };
+}
+
+struct ToleranceStats_t
+{
+    int nMaxDiff = 0;
+    uint32_t uChecked = 0;
+
+    void Check( int nFp32, int nFp16 )
+    {
+        int nDiff = std::abs( nFp32 - nFp16 );
+        nMaxDiff = std::max( nMaxDiff, nDiff );
+        uChecked++;
+        TEST_CHECK( nDiff <= k_nTolerance );
+    }
+
+    void Print( const char *pszName ) const
+    {
+        printf( "  %s: %u values, max difference %d\n", pszName, uChecked, nMaxDiff );
+    }
+};
+
+static constexpr uint32_t k_uSamples = 20'000;
+
+//
+// BlendLayer in alphamode.h, as compositePixel in composite_blit.h runs it.
+//
+
+enum EAlphaMode
+{
+    k_EAlphaMode_Premult = 0,
+    k_EAlphaMode_Coverage = 1,
+    k_EAlphaMode_None = 2,
+};
+
+struct BlendInput_t
+{
+    float flColor[ 4 ];
+    float flOpacity;
+    EAlphaMode eAlphaMode;
+};
+
+template <typename T>
+static void BlendLayer( T outputValue[4], const BlendInput_t &layer )
+{
+    T layerColor[ 4 ];
+    for ( int c = 0; c < 4; c++ )
+        layerColor[ c ] = T( layer.flColor[ c ] );
+    T opacity = T( layer.flOpacity );
+    T layerAlpha = opacity * layerColor[ 3 ];
+
+    for ( int c = 0; c < 4; c++ )
+    {
+        if ( layer.eAlphaMode == k_EAlphaMode_Premult )
+            outputValue[ c ] = layerColor[ c ] * opacity + outputValue[ c ] * ( T( 1.0f ) - layerAlpha );
+        else if ( layer.eAlphaMode == k_EAlphaMode_Coverage )
+            outputValue[ c ] = layerColor[ c ] * layerAlpha + outputValue[ c ] * ( T( 1.0f ) - layerAlpha );
+        else
+            outputValue[ c ] = layerColor[ c ] * opacity;
+    }
+}
+
+template <typename T>
+static void CompositeLayers( const BlendInput_t *pLayers, uint32_t uLayerCount, int nEncoded[3] )
+{
+    T outputValue[ 4 ];
+    for ( int c = 0; c < 4; c++ )
+        outputValue[ c ] = T( pLayers[ 0 ].flColor[ c ] ) * T( pLayers[ 0 ].flOpacity );
+
+    for ( uint32_t i = 1; i < uLayerCount; i++ )
+        BlendLayer( outputValue, pLayers[ i ] );
+
+    for ( int c = 0; c < 3; c++ )
+        nEncoded[ c ] = Quantize( LinearToSrgb( float( outputValue[ c ] ) ) );
+}
+
+static void test_blend_layers()
+{
+    std::mt19937 rng{ 46 };
+    std::uniform_int_distribution<int> byteDist( 0, 255 );
+    std::uniform_int_distribution<uint32_t> layerCountDist( 1, 4 );
+    std::uniform_int_distribution<int> alphaModeDist( 0, 2 );
+
+    ToleranceStats_t stats;
+    for ( uint32_t i = 0; i < k_uSamples; i++ )
+    {
+        BlendInput_t layers[ 4 ];
+        uint32_t uLayerCount = layerCountDist( rng );
+        for ( uint32_t j = 0; j < uLayerCount; j++ )
+        {
+            // Sampled wl_surface texels, linear and premultiplied.
+            float flAlpha = byteDist( rng ) / 255.0f;
+            for ( int c = 0; c < 3; c++ )
+                layers[ j ].flColor[ c ] = SrgbToLinear( byteDist( rng ) / 255.0f ) * flAlpha;
+            layers[ j ].flColor[ 3 ] = flAlpha;
+            layers[ j ].flOpacity = byteDist( rng ) / 255.0f;
+            layers[ j ].eAlphaMode = EAlphaMode( alphaModeDist( rng ) );
+        }
+
+        int nFp32[ 3 ], nFp16[ 3 ];
+        CompositeLayers<float>( layers, uLayerCount, nFp32 );
+        CompositeLayers<Half>( layers, uLayerCount, nFp16 );
+        for ( int c = 0; c < 3; c++ )
+            stats.Check( nFp32[ c ], nFp16[ c ] );
+    }
+    stats.Print( "blend" );
+}
+
+//
+// gaussian_blur in blur.h, at its widest radius.
+//
+
+static constexpr float k_flBlurWeights[] =
+{
+    0.05021843f, 0.06559712f, 0.06244280f, 0.05778965f, 0.05199815f,
+    0.04548788f, 0.03868776f, 0.03199053f, 0.02571813f, 0.02010145f,
+    0.01527514f, 0.01128530f, 0.00810608f, 0.00566081f, 0.00384341f,
+    0.00253702f, 0.00162818f, 0.00101589f, 0.00061626f,
+};
+static constexpr uint32_t k_uBlurSteps = std::size( k_flBlurWeights );
+
+// Taps are what the sampler hands back, already filtered and still
+// sRGB encoded. The same holds for each pass of the blur.
+template <typename T>
+static void GaussianBlur( const float flTaps[k_uBlurSteps][2][3], int nEncoded[3] )
+{
+    T color[ 3 ] = { T( 0.0f ), T( 0.0f ), T( 0.0f ) };
+    for ( uint32_t i = 0; i < k_uBlurSteps; i++ )
+    {
+        for ( int nSide = 0; nSide < 2; nSide++ )
+        {
+            for ( int c = 0; c < 3; c++ )
+                color[ c ] = color[ c ] + T( SrgbToLinear( flTaps[ i ][ nSide ][ c ] ) ) * T( k_flBlurWeights[ i ] );
+        }
+    }
+
+    for ( int c = 0; c < 3; c++ )
+        nEncoded[ c ] = Quantize( LinearToSrgb( float( color[ c ] ) ) );
+}
+
+static void test_gaussian_blur()
+{
+    std::mt19937 rng{ 46 };
+    std::uniform_real_distribution<float> valueDist( 0.0f, 1.0f );
+    std::uniform_real_distribution<float> darkDist( 0.0f, 0.1f );
+
+    ToleranceStats_t stats;
+    for ( uint32_t i = 0; i < k_uSamples; i++ )
+    {
+        // Every other sample is all dark, where sRGB is steepest.
+        bool bDark = i % 2;
+
+        float flTaps[ k_uBlurSteps ][ 2 ][ 3 ];
+        for ( uint32_t j = 0; j < k_uBlurSteps; j++ )
+        {
+            for ( int nSide = 0; nSide < 2; nSide++ )
+            {
+                for ( int c = 0; c < 3; c++ )
+                    flTaps[ j ][ nSide ][ c ] = bDark ? darkDist( rng ) : valueDist( rng );
+            }
+        }
+
+        int nFp32[ 3 ], nFp16[ 3 ];
+        GaussianBlur<float>( flTaps, nFp32 );
+        GaussianBlur<Half>( flTaps, nFp16 );
+        for ( int c = 0; c < 3; c++ )
+            stats.Check( nFp32[ c ], nFp16[ c ] );
+    }
+    stats.Print( "blur" );
+}
+
+//
+// The NV12 conversion in rgb_to_nv12.h and captureNV12 in composite_blit.h.
+//
+
+// g_rgb2yuv_srgb_to_bt709_limited in rendervulkan.cpp.
+static constexpr float k_flRGBToBT709Limited[3][4] =
+{
+    { 0.1826f, 0.6142f, 0.0620f, 0.0625f },
+    { -0.1006f, -0.3386f, 0.4392f, 0.5f },
+    { 0.4392f, -0.3989f, -0.0403f, 0.5f },
+};
+
+template <typename T>
+static Vec3<T> ApplyColorMatrix( Vec3<T> rgb )
+{
+    float flEncoded[ 4 ] = { LinearToSrgb( float( rgb.r ) ), LinearToSrgb( float( rgb.g ) ), LinearToSrgb( float( rgb.b ) ), 1.0f };
+
+    Vec3<T> yuv;
+    for ( int nRow = 0; nRow < 3; nRow++ )
+    {
+        T value = T( 0.0f );
+        for ( int c = 0; c < 4; c++ )
+            value = value + T( flEncoded[ c ] ) * T( k_flRGBToBT709Limited[ nRow ][ c ] );
+        yuv[ nRow ] = value;
+    }
+    return yuv;
+}
+
+// One 2x2 block of linear pixels into four Y and one UV.
+template <typename T>
+static void ConvertNV12Block( const float flLinear[4][3], int nY[4], int nUV[2] )
+{
+    Vec3<T> color[ 4 ];
+    for ( int i = 0; i < 4; i++ )
+        color[ i ] = MakeVec3<T>( flLinear[ i ][ 0 ], flLinear[ i ][ 1 ], flLinear[ i ][ 2 ] );
+
+    Vec3<T> avg;
+    for ( int c = 0; c < 3; c++ )
+        avg[ c ] = ( color[ 0 ][ c ] + color[ 1 ][ c ] + color[ 2 ][ c ] + color[ 3 ][ c ] ) / T( 4.0f );
+
+    Vec3<T> avgYUV = ApplyColorMatrix( avg );
+    nUV[ 0 ] = Quantize( float( avgYUV.g ) );
+    nUV[ 1 ] = Quantize( float( avgYUV.b ) );
+
+    for ( int i = 0; i < 4; i++ )
+        nY[ i ] = Quantize( float( ApplyColorMatrix( color[ i ] ).r ) );
+}
+
+static void test_nv12()
+{
+    std::mt19937 rng{ 46 };
+    std::uniform_int_distribution<int> byteDist( 0, 255 );
+
+    ToleranceStats_t stats;
+    for ( uint32_t i = 0; i < k_uSamples; i++ )
+    {
+        float flLinear[ 4 ][ 3 ];
+        for ( int j = 0; j < 4; j++ )
+        {
+            for ( int c = 0; c < 3; c++ )
+                flLinear[ j ][ c ] = SrgbToLinear( byteDist( rng ) / 255.0f );
+        }
+
+        int nYFp32[ 4 ], nUVFp32[ 2 ];
+        int nYFp16[ 4 ], nUVFp16[ 2 ];
+        ConvertNV12Block<float>( flLinear, nYFp32, nUVFp32 );
+        ConvertNV12Block<Half>( flLinear, nYFp16, nUVFp16 );
+        for ( int j = 0; j < 4; j++ )
+            stats.Check( nYFp32[ j ], nYFp16[ j ] );
+        for ( int j = 0; j < 2; j++ )
+            stats.Check( nUVFp32[ j ], nUVFp16[ j ] );
+    }
+    stats.Print( "nv12" );
+}
+
+//
+// FsrRcasF and FsrRcasH in ffx_fsr1.h, without FSR_RCAS_DENOISE like
+// composite_rcas.h builds them.
+//
+
+static constexpr float k_flRcasLimit = 0.25f - ( 1.0f / 16.0f );
+
+// b, d, e, f and h of RCAS' 3x3 neighbourhood, sRGB encoded.
+struct RcasNeighbourhood_t
+{
+    float flTexels[ 5 ][ 3 ];
+};
+
+template <typename T>
+static void Rcas( const RcasNeighbourhood_t &neighbourhood, float flSharpness, int nEncoded[3] )
+{
+    Vec3<T> b = MakeVec3<T>( neighbourhood.flTexels[ 0 ][ 0 ], neighbourhood.flTexels[ 0 ][ 1 ], neighbourhood.flTexels[ 0 ][ 2 ] );
+    Vec3<T> d = MakeVec3<T>( neighbourhood.flTexels[ 1 ][ 0 ], neighbourhood.flTexels[ 1 ][ 1 ], neighbourhood.flTexels[ 1 ][ 2 ] );
+    Vec3<T> e = MakeVec3<T>( neighbourhood.flTexels[ 2 ][ 0 ], neighbourhood.flTexels[ 2 ][ 1 ], neighbourhood.flTexels[ 2 ][ 2 ] );
+    Vec3<T> f = MakeVec3<T>( neighbourhood.flTexels[ 3 ][ 0 ], neighbourhood.flTexels[ 3 ][ 1 ], neighbourhood.flTexels[ 3 ][ 2 ] );
+    Vec3<T> h = MakeVec3<T>( neighbourhood.flTexels[ 4 ][ 0 ], neighbourhood.flTexels[ 4 ][ 1 ], neighbourhood.flTexels[ 4 ][ 2 ] );
+
+    T lobeMax = T( -INFINITY );
+    for ( int c = 0; c < 3; c++ )
+    {
+        T mn4 = Min( Min( Min( b[ c ], d[ c ] ), f[ c ] ), h[ c ] );
+        T mx4 = Max( Max( Max( b[ c ], d[ c ] ), f[ c ] ), h[ c ] );
+
+        // The limiters take an exact reciprocal.
+        T hitMin = Min( mn4, e[ c ] ) * ( T( 1.0f ) / ( T( 4.0f ) * mx4 ) );
+        T hitMax = ( T( 1.0f ) - Max( mx4, e[ c ] ) ) * ( T( 1.0f ) / ( T( 4.0f ) * mn4 + T( -4.0f ) ) );
+        lobeMax = Max( lobeMax, Max( -hitMin, hitMax ) );
+    }
+    T lobe = Max( T( -k_flRcasLimit ), Min( lobeMax, T( 0.0f ) ) ) * T( flSharpness );
+
+    T rcpL = ApproxRcp( T( 4.0f ) * lobe + T( 1.0f ) );
+    for ( int c = 0; c < 3; c++ )
+    {
+        T pix = ( lobe * b[ c ] + lobe * d[ c ] + lobe * h[ c ] + lobe * f[ c ] + e[ c ] ) * rcpL;
+        nEncoded[ c ] = Quantize( float( pix ) );
+    }
+}
+
+static void test_rcas()
+{
+    std::mt19937 rng{ 46 };
+    std::uniform_int_distribution<int> byteDist( 0, 255 );
+    std::uniform_int_distribution<int> nearDist( -8, 8 );
+    // FsrRcasCon's exp2(-stops), over the range of --sharpness.
+    std::uniform_real_distribution<float> stopsDist( 0.0f, 2.0f );
+
+    ToleranceStats_t stats;
+    for ( uint32_t i = 0; i < k_uSamples; i++ )
+    {
+        // Every other neighbourhood is a small variation around e, where
+        // the lobe isn't just clamped.
+        bool bSmooth = i % 2;
+
+        RcasNeighbourhood_t neighbourhood;
+        int nCenter[ 3 ] = { byteDist( rng ), byteDist( rng ), byteDist( rng ) };
+        for ( int j = 0; j < 5; j++ )
+        {
+            for ( int c = 0; c < 3; c++ )
+            {
+                int nValue = bSmooth ? std::clamp( nCenter[ c ] + nearDist( rng ), 0, 255 ) : byteDist( rng );
+                neighbourhood.flTexels[ j ][ c ] = nValue / 255.0f;
+            }
+        }
+        float flSharpness = std::exp2( -stopsDist( rng ) );
+
+        int nFp32[ 3 ], nFp16[ 3 ];
+        Rcas<float>( neighbourhood, flSharpness, nFp32 );
+        Rcas<Half>( neighbourhood, flSharpness, nFp16 );
+        for ( int c = 0; c < 3; c++ )
+            stats.Check( nFp32[ c ], nFp16[ c ] );
+    }
+    stats.Print( "rcas" );
+}
+
+static void test_round_to_half()
+{
+    TEST_CHECK( RoundToHalf( 1.0f ) == 1.0f );
+    TEST_CHECK( RoundToHalf( 1.0f + 1.0f / 4096.0f ) == 1.0f );
+    TEST_CHECK( RoundToHalf( 1.0f + 3.0f / 4096.0f ) == 1.0f + 1.0f / 1024.0f );
+    TEST_CHECK( RoundToHalf( 65504.0f ) == 65504.0f );
+    TEST_CHECK( std::isinf( RoundToHalf( 65520.0f ) ) );
+    TEST_CHECK( RoundToHalf( 0x1p-25f ) == 0.0f );
+    TEST_CHECK( RoundToHalf( 0x1.8p-24f ) == 0x1p-23f );
+
+    TEST_CHECK( HalfBits( Half( 1.0f ) ) == 0x3c00 );
+    TEST_CHECK( HalfBits( Half( -2.0f ) ) == 0xc000 );
+    TEST_CHECK( HalfBits( Half( 0x1p-24f ) ) == 0x0001 );
+    TEST_CHECK( float( HalfFromBits( 0x3555 ) ) == RoundToHalf( 1.0f / 3.0f ) );
+    TEST_CHECK( float( HalfFromBits( 0x7bff ) ) == 65504.0f );
+
+    TEST_CHECK( std::abs( float( ApproxRcp( Half( 3.0f ) ) ) - 1.0f / 3.0f ) < 1e-3f );
+    TEST_CHECK( std::abs( ApproxRcp( 3.0f ) - 1.0f / 3.0f ) < 1e-3f );
+}
+
+int main( int argc, char *argv[] )
+{
+    printf( "fp16_shader_tests\n" );
+
+    test_round_to_half();
+    test_blend_layers();
+    test_gaussian_blur();
+    test_nv12();
+    test_rcas();
+
+    return TestExitCode();
+}
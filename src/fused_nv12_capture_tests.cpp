@@ -0,0 +1,376 @@
+// Checks that the NV12 capture cs_composite_blit_nv12 writes from the
+// composite dispatch (captureNV12 in shaders/composite_blit.h) comes out
+// byte for byte the same as cs_rgb_to_nv12 reading the composite back
+// (shaders/rgb_to_nv12.h), which is what lets CanFuseNV12Capture skip
+// the second pass.
+//
+// Headless: there's no Vulkan driver to run the shaders on, so both are
+// mirrored here the way they're dispatched, workgroup by workgroup, over
+// composites of the sizes and formats we fuse. This is the FP32 variant;
+// the _fp16 ones do the same operations in the same order.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "test_check.h"
+
+struct Vec3_t
+{
+    float r, g, b;
+};
+
+// colorimetry.h
+static float SrgbToLinear( float flValue )
+{
+    if ( flValue <= 0.04045f )
+        return flValue / 12.92f;
+    return std::pow( ( flValue + 0.055f ) / 1.055f, 12.0f / 5.0f );
+}
+
+static float LinearToSrgb( float flValue )
+{
+    if ( flValue <= 0.0031308f )
+        return flValue * 12.92f;
+    return std::pow( flValue, 5.0f / 12.0f ) * 1.055f - 0.055f;
+}
+
+static Vec3_t SrgbToLinear( Vec3_t color )
+{
+    return Vec3_t{ SrgbToLinear( color.r ), SrgbToLinear( color.g ), SrgbToLinear( color.b ) };
+}
+
+// What a UNORM image stores for flValue, back as a float.
+static float StoreUnorm( float flValue, float flLevels )
+{
+    return std::round( std::clamp( flValue, 0.0f, 1.0f ) * flLevels ) / flLevels;
+}
+
+static uint8_t StoreUnorm8( float flValue )
+{
+    return uint8_t( std::round( std::clamp( flValue, 0.0f, 1.0f ) * 255.0f ) );
+}
+
+struct Matrix_t
+{
+    float flRows[ 3 ][ 4 ];
+};
+
+// The ones colorspace_to_conversion_from_srgb_matrix picks from in rendervulkan.cpp.
+static constexpr Matrix_t k_ConversionMatrices[] =
+{
+    {{ // BT.601 limited
+        { 0.257f, 0.504f, 0.098f, 0.0625f },
+        { -0.148f, -0.291f, 0.439f, 0.5f },
+        { 0.439f, -0.368f, -0.071f, 0.5f },
+    }},
+    {{ // BT.601 full
+        { 0.299f, 0.587f, 0.114f, 0.0f },
+        { -0.169f, -0.331f, 0.500f, 0.5f },
+        { 0.500f, -0.419f, -0.081f, 0.5f },
+    }},
+    {{ // BT.709 limited
+        { 0.1826f, 0.6142f, 0.0620f, 0.0625f },
+        { -0.1006f, -0.3386f, 0.4392f, 0.5f },
+        { 0.4392f, -0.3989f, -0.0403f, 0.5f },
+    }},
+    {{ // BT.709 full
+        { 0.2126f, 0.7152f, 0.0722f, 0.0f },
+        { -0.1146f, -0.3854f, 0.5000f, 0.5f },
+        { 0.5000f, -0.4542f, -0.0458f, 0.5f },
+    }},
+};
+
+// applyColorMatrix and applyCaptureColorMatrix: vec4(srgb, 1) * mat3x4.
+static Vec3_t ApplyColorMatrix( Vec3_t rgb, const Matrix_t &matrix )
+{
+    float flEncoded[ 4 ] = { LinearToSrgb( rgb.r ), LinearToSrgb( rgb.g ), LinearToSrgb( rgb.b ), 1.0f };
+
+    float flOut[ 3 ];
+    for ( int nRow = 0; nRow < 3; nRow++ )
+    {
+        float flValue = 0.0f;
+        for ( int c = 0; c < 4; c++ )
+            flValue += flEncoded[ c ] * matrix.flRows[ nRow ][ c ];
+        flOut[ nRow ] = flValue;
+    }
+    return Vec3_t{ flOut[ 0 ], flOut[ 1 ], flOut[ 2 ] };
+}
+
+static Vec3_t Average( Vec3_t a, Vec3_t b, Vec3_t c, Vec3_t d )
+{
+    return Vec3_t
+    {
+        ( a.r + b.r + c.r + d.r ) / 4.0f,
+        ( a.g + b.g + c.g + d.g ) / 4.0f,
+        ( a.b + b.b + c.b + d.b ) / 4.0f,
+    };
+}
+
+struct NV12Image_t
+{
+    uint32_t uWidth;
+    uint32_t uHeight;
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> chroma;
+
+    NV12Image_t( uint32_t uWidth, uint32_t uHeight )
+        : uWidth{ uWidth }
+        , uHeight{ uHeight }
+        , luma( uWidth * uHeight, 0 )
+        , chroma( ( uWidth / 2 ) * ( uHeight / 2 ) * 2, 0 )
+    {
+    }
+
+    void StoreLuma( int32_t x, int32_t y, float flY )
+    {
+        // Out of bounds imageStores are dropped.
+        if ( x < 0 || y < 0 || uint32_t( x ) >= uWidth || uint32_t( y ) >= uHeight )
+            return;
+        luma[ y * uWidth + x ] = StoreUnorm8( flY );
+    }
+
+    void StoreChroma( uint32_t x, uint32_t y, float flU, float flV )
+    {
+        if ( x >= uWidth / 2 || y >= uHeight / 2 )
+            return;
+        chroma[ ( y * ( uWidth / 2 ) + x ) * 2 + 0 ] = StoreUnorm8( flU );
+        chroma[ ( y * ( uWidth / 2 ) + x ) * 2 + 1 ] = StoreUnorm8( flV );
+    }
+};
+
+// What compositePixel hands to captureNV12, and imageStores to dst.
+struct Composite_t
+{
+    uint32_t uWidth;
+    uint32_t uHeight;
+    std::vector<Vec3_t> encoded;
+
+    Vec3_t At( uint32_t x, uint32_t y ) const { return encoded[ y * uWidth + x ]; }
+};
+
+static constexpr uint32_t k_uWorkgroupSize = 8;
+
+// cs_composite_blit_nv12: one invocation per output pixel, in 8x8 workgroups.
+static NV12Image_t FusedCapture( const Composite_t &composite, float flLevels, const Matrix_t &matrix )
+{
+    NV12Image_t capture( composite.uWidth, composite.uHeight );
+    const uint32_t uHalfExtent[ 2 ] = { composite.uWidth / 2, composite.uHeight / 2 };
+
+    for ( uint32_t uGroupY = 0; uGroupY < ( composite.uHeight + k_uWorkgroupSize - 1 ) / k_uWorkgroupSize; uGroupY++ )
+    {
+        for ( uint32_t uGroupX = 0; uGroupX < ( composite.uWidth + k_uWorkgroupSize - 1 ) / k_uWorkgroupSize; uGroupX++ )
+        {
+            // Up to the barrier: every invocation, in bounds or not.
+            Vec3_t captureColor[ k_uWorkgroupSize ][ k_uWorkgroupSize ];
+            for ( uint32_t ly = 0; ly < k_uWorkgroupSize; ly++ )
+            {
+                for ( uint32_t lx = 0; lx < k_uWorkgroupSize; lx++ )
+                {
+                    uint32_t x = uGroupX * k_uWorkgroupSize + lx;
+                    uint32_t y = uGroupY * k_uWorkgroupSize + ly;
+                    bool bInBounds = x < composite.uWidth && y < composite.uHeight;
+
+                    Vec3_t encoded = bInBounds ? composite.At( x, y ) : Vec3_t{ 0.0f, 0.0f, 0.0f };
+                    Vec3_t quantized = { StoreUnorm( encoded.r, flLevels ), StoreUnorm( encoded.g, flLevels ), StoreUnorm( encoded.b, flLevels ) };
+                    captureColor[ ly ][ lx ] = SrgbToLinear( quantized );
+                }
+            }
+
+            // After it.
+            for ( uint32_t ly = 0; ly < k_uWorkgroupSize; ly++ )
+            {
+                for ( uint32_t lx = 0; lx < k_uWorkgroupSize; lx++ )
+                {
+                    uint32_t x = uGroupX * k_uWorkgroupSize + lx;
+                    uint32_t y = uGroupY * k_uWorkgroupSize + ly;
+                    if ( x / 2 >= uHalfExtent[ 0 ] || y / 2 >= uHalfExtent[ 1 ] )
+                        continue;
+
+                    capture.StoreLuma( x, y, ApplyColorMatrix( captureColor[ ly ][ lx ], matrix ).r );
+
+                    if ( ( lx & 1 ) == 0 && ( ly & 1 ) == 0 )
+                    {
+                        Vec3_t avg = Average( captureColor[ ly ][ lx ], captureColor[ ly ][ lx + 1 ],
+                                              captureColor[ ly + 1 ][ lx ], captureColor[ ly + 1 ][ lx + 1 ] );
+                        Vec3_t yuv = ApplyColorMatrix( avg, matrix );
+                        capture.StoreChroma( x / 2, y / 2, yuv.g, yuv.b );
+                    }
+                }
+            }
+        }
+    }
+
+    return capture;
+}
+
+// sampleBilinear reading back the UNORM dst at unnormalized coord,
+// through the sampler dispatch_rgb_to_nv12 sets up.
+static Vec3_t SampleDst( const Composite_t &composite, float flLevels, float flCoordX, float flCoordY )
+{
+    // sampleLayerEx, with dispatch_rgb_to_nv12's offset 0 and scale 1.
+    if ( flCoordX < 0.0f || flCoordY < 0.0f || flCoordX >= float( composite.uWidth ) || flCoordY >= float( composite.uHeight ) )
+        return Vec3_t{ 0.0f, 0.0f, 0.0f };
+
+    float flPixX = flCoordX - 0.5f;
+    float flPixY = flCoordY - 0.5f;
+    float flOriginX = std::floor( flPixX );
+    float flOriginY = std::floor( flPixY );
+    float flWeightX = flPixX - flOriginX;
+    float flWeightY = flPixY - flOriginY;
+
+    auto fnTexel = [&]( float flX, float flY )
+    {
+        uint32_t x = uint32_t( std::clamp( flX, 0.0f, float( composite.uWidth - 1 ) ) );
+        uint32_t y = uint32_t( std::clamp( flY, 0.0f, float( composite.uHeight - 1 ) ) );
+        Vec3_t encoded = composite.At( x, y );
+        return SrgbToLinear( Vec3_t{ StoreUnorm( encoded.r, flLevels ), StoreUnorm( encoded.g, flLevels ), StoreUnorm( encoded.b, flLevels ) } );
+    };
+    auto fnMix = []( Vec3_t a, Vec3_t b, float t )
+    {
+        return Vec3_t{ a.r * ( 1.0f - t ) + b.r * t, a.g * ( 1.0f - t ) + b.g * t, a.b * ( 1.0f - t ) + b.b * t };
+    };
+
+    Vec3_t c00 = fnTexel( flOriginX, flOriginY );
+    Vec3_t c10 = fnTexel( flOriginX + 1.0f, flOriginY );
+    Vec3_t c01 = fnTexel( flOriginX, flOriginY + 1.0f );
+    Vec3_t c11 = fnTexel( flOriginX + 1.0f, flOriginY + 1.0f );
+
+    return fnMix( fnMix( c00, c10, flWeightX ), fnMix( c01, c11, flWeightX ), flWeightY );
+}
+
+// cs_rgb_to_nv12: one invocation per 2x2 block, over 16x16 pixel workgroups.
+static NV12Image_t TwoPassCapture( const Composite_t &composite, float flLevels, const Matrix_t &matrix )
+{
+    static constexpr float k_flOffsets[ 4 ][ 2 ] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+
+    NV12Image_t capture( composite.uWidth, composite.uHeight );
+    // CaptureConvertBlitData_t::halfExtent
+    const float flHalfExtent[ 2 ] = { composite.uWidth / 2.0f, composite.uHeight / 2.0f };
+
+    const uint32_t uDispatchSize = k_uWorkgroupSize * 2;
+    const uint32_t uThreadsX = ( composite.uWidth + uDispatchSize - 1 ) / uDispatchSize * k_uWorkgroupSize;
+    const uint32_t uThreadsY = ( composite.uHeight + uDispatchSize - 1 ) / uDispatchSize * k_uWorkgroupSize;
+    for ( uint32_t uThreadY = 0; uThreadY < uThreadsY; uThreadY++ )
+    {
+        for ( uint32_t uThreadX = 0; uThreadX < uThreadsX; uThreadX++ )
+        {
+            if ( !( float( uThreadX ) < flHalfExtent[ 0 ] && float( uThreadY ) < flHalfExtent[ 1 ] ) )
+                continue;
+
+            float flLumaX = float( uThreadX * 2 ) + 0.5f;
+            float flLumaY = float( uThreadY * 2 ) + 0.5f;
+
+            Vec3_t color[ 4 ];
+            for ( int i = 0; i < 4; i++ )
+                color[ i ] = SampleDst( composite, flLevels, flLumaX + k_flOffsets[ i ][ 0 ], flLumaY + k_flOffsets[ i ][ 1 ] );
+
+            Vec3_t yuv = ApplyColorMatrix( Average( color[ 0 ], color[ 1 ], color[ 2 ], color[ 3 ] ), matrix );
+            capture.StoreChroma( uThreadX, uThreadY, yuv.g, yuv.b );
+
+            for ( int i = 0; i < 4; i++ )
+            {
+                // ivec2(luma_uv + offset_table[i])
+                capture.StoreLuma( int32_t( flLumaX + k_flOffsets[ i ][ 0 ] ), int32_t( flLumaY + k_flOffsets[ i ][ 1 ] ),
+                    ApplyColorMatrix( color[ i ], matrix ).r );
+            }
+        }
+    }
+
+    return capture;
+}
+
+static uint32_t CountMismatches( const NV12Image_t &a, const NV12Image_t &b )
+{
+    uint32_t uMismatches = 0;
+    for ( size_t i = 0; i < a.luma.size(); i++ )
+        uMismatches += a.luma[ i ] != b.luma[ i ];
+    for ( size_t i = 0; i < a.chroma.size(); i++ )
+        uMismatches += a.chroma[ i ] != b.chroma[ i ];
+    return uMismatches;
+}
+
+struct CaptureSize_t
+{
+    uint32_t uWidth;
+    uint32_t uHeight;
+};
+
+// Even, as calculate_capture_size makes NV12 captures, and mostly not
+// multiples of the workgroup sizes.
+static constexpr CaptureSize_t k_CaptureSizes[] =
+{
+    { 16, 16 },
+    { 18, 10 },
+    { 426, 240 },
+    // Full width strips of 1366x768 and 1920x1080.
+    { 1366, 34 },
+    { 1920, 18 },
+};
+
+// NV12CaptureSourceLevels: 8-bit sources, and the XRGB2101010 intermediate.
+static constexpr float k_flSourceLevels[] = { 255.0f, 1023.0f };
+
+static Composite_t RandomComposite( uint32_t uWidth, uint32_t uHeight, std::mt19937 &rng )
+{
+    // Slightly out of range too, like HDR or the debug colours would be.
+    std::uniform_real_distribution<float> valueDist( -0.05f, 1.05f );
+
+    Composite_t composite{ uWidth, uHeight, std::vector<Vec3_t>( uWidth * uHeight ) };
+    for ( Vec3_t &color : composite.encoded )
+        color = Vec3_t{ valueDist( rng ), valueDist( rng ), valueDist( rng ) };
+    return composite;
+}
+
+static void test_fused_matches_two_pass()
+{
+    std::mt19937 rng{ 36 };
+
+    for ( const CaptureSize_t &size : k_CaptureSizes )
+    {
+        Composite_t composite = RandomComposite( size.uWidth, size.uHeight, rng );
+
+        for ( float flLevels : k_flSourceLevels )
+        {
+            for ( const Matrix_t &matrix : k_ConversionMatrices )
+            {
+                NV12Image_t fused = FusedCapture( composite, flLevels, matrix );
+                NV12Image_t twoPass = TwoPassCapture( composite, flLevels, matrix );
+
+                uint32_t uMismatches = CountMismatches( fused, twoPass );
+                if ( uMismatches )
+                    printf( "  %ux%u, %.0f levels: %u bytes differ\n", size.uWidth, size.uHeight, flLevels, uMismatches );
+                TEST_CHECK( uMismatches == 0 );
+            }
+        }
+    }
+}
+
+// Catches the mirrors agreeing with each other by both being wrong:
+// a flat colour gives what the matrix says for it.
+static void test_flat_colour()
+{
+    const Matrix_t &bt709Limited = k_ConversionMatrices[ 2 ];
+
+    Composite_t composite{ 18, 10, std::vector<Vec3_t>( 18 * 10, Vec3_t{ 1.0f, 1.0f, 1.0f } ) };
+    NV12Image_t fused = FusedCapture( composite, 255.0f, bt709Limited );
+
+    // Limited range white.
+    for ( uint8_t uLuma : fused.luma )
+        TEST_CHECK( uLuma == 235 );
+    for ( uint8_t uChroma : fused.chroma )
+        TEST_CHECK( uChroma == 128 );
+}
+
+int main( int argc, char *argv[] )
+{
+    printf( "fused_nv12_capture_tests\n" );
+
+    test_flat_colour();
+    test_fused_matches_two_pass();
+
+    return TestExitCode();
+}
@@ -0,0 +1,271 @@
+// Checks CGamepadMirror copies a pad's buttons and axes to its uinput
+// mirror, forwards what the real one does, lets go of everything when it
+// goes away, makes do with a placeholder until a pad turns up, and how
+// long forwarding takes.
+//
+// Uses a uinput pad as the real one, and is skipped without access to
+// /dev/uinput.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#include "GamepadMirror.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+static constexpr int32_t k_nAxisRest = 0;
+
+static int CreateVirtualPad()
+{
+    int nFD = open( "/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC );
+    if ( nFD < 0 )
+        return -1;
+
+    uinput_setup setup{};
+    setup.id.bustype = BUS_USB;
+    setup.id.vendor = 0x1234;
+    setup.id.product = 0x9abc;
+    snprintf( setup.name, sizeof( setup.name ), "gamescope mirror test pad" );
+
+    uinput_abs_setup absSetup{};
+    absSetup.code = ABS_X;
+    absSetup.absinfo = input_absinfo{ .value = k_nAxisRest, .minimum = -32768, .maximum = 32767, .flat = 128 };
+
+    // A trigger with more range than a placeholder's.
+    uinput_abs_setup triggerSetup{};
+    triggerSetup.code = ABS_Z;
+    triggerSetup.absinfo = input_absinfo{ .minimum = 0, .maximum = 1023 };
+
+    if ( ioctl( nFD, UI_SET_EVBIT, EV_KEY ) < 0 ||
+         ioctl( nFD, UI_SET_KEYBIT, BTN_SOUTH ) < 0 ||
+         ioctl( nFD, UI_SET_KEYBIT, BTN_EAST ) < 0 ||
+         ioctl( nFD, UI_SET_EVBIT, EV_ABS ) < 0 ||
+         ioctl( nFD, UI_SET_ABSBIT, ABS_X ) < 0 ||
+         ioctl( nFD, UI_ABS_SETUP, &absSetup ) < 0 ||
+         ioctl( nFD, UI_SET_ABSBIT, ABS_Z ) < 0 ||
+         ioctl( nFD, UI_ABS_SETUP, &triggerSetup ) < 0 ||
+         ioctl( nFD, UI_DEV_SETUP, &setup ) < 0 ||
+         ioctl( nFD, UI_DEV_CREATE ) < 0 )
+    {
+        close( nFD );
+        return -1;
+    }
+
+    return nFD;
+}
+
+static void Emit( int nFD, uint16_t uType, uint16_t uCode, int32_t nValue )
+{
+    input_event event{};
+    event.type = uType;
+    event.code = uCode;
+    event.value = nValue;
+    TEST_CHECK( write( nFD, &event, sizeof( event ) ) == sizeof( event ) );
+}
+
+// Everything the mirror has for us, waiting a little for the first of it.
+static std::vector<input_event> ReadAll( int nFD )
+{
+    std::vector<input_event> events;
+
+    pollfd pfd{ .fd = nFD, .events = POLLIN };
+    if ( poll( &pfd, 1, 1000 ) <= 0 )
+        return events;
+
+    for ( ;; )
+    {
+        input_event event;
+        if ( read( nFD, &event, sizeof( event ) ) != sizeof( event ) )
+            break;
+        events.push_back( event );
+    }
+    return events;
+}
+
+static bool Contains( const std::vector<input_event> &events, uint16_t uType, uint16_t uCode, int32_t nValue )
+{
+    for ( const input_event &event : events )
+    {
+        if ( event.type == uType && event.code == uCode && event.value == nValue )
+            return true;
+    }
+    return false;
+}
+
+static void test_mirror()
+{
+    int nPadFD = CreateVirtualPad();
+    TEST_CHECK( nPadFD >= 0 );
+    if ( nPadFD < 0 )
+        return;
+
+    std::string sPadNode = CGamepadMirror::GetUInputDevNode( nPadFD );
+    TEST_CHECK( !sPadNode.empty() );
+
+    int nSourceFD = open( sPadNode.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+    TEST_CHECK( nSourceFD >= 0 );
+    // Someone else reading it, who shouldn't see a thing once it's grabbed.
+    int nOtherFD = open( sPadNode.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+    if ( nSourceFD < 0 || nOtherFD < 0 )
+    {
+        close( nPadFD );
+        return;
+    }
+    TEST_CHECK( ioctl( nSourceFD, EVIOCGRAB, 1 ) == 0 );
+
+    CGamepadMirror mirror;
+    TEST_CHECK( mirror.Attach( nSourceFD, "gamescope-test/input0" ) );
+    TEST_CHECK( !mirror.GetDevNode().empty() );
+    TEST_CHECK( mirror.GetName() == "gamescope mirror test pad" );
+
+    int nMirrorFD = open( mirror.GetDevNode().c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+    TEST_CHECK( nMirrorFD >= 0 );
+    if ( nMirrorFD < 0 )
+    {
+        close( nOtherFD );
+        close( nPadFD );
+        return;
+    }
+
+    // Looks the same.
+    input_id id{};
+    TEST_CHECK( ioctl( nMirrorFD, EVIOCGID, &id ) == 0 && id.vendor == 0x1234 && id.product == 0x9abc );
+    input_absinfo absInfo{};
+    TEST_CHECK( ioctl( nMirrorFD, EVIOCGABS( ABS_X ), &absInfo ) == 0 && absInfo.minimum == -32768 && absInfo.maximum == 32767 );
+
+    // Does the same.
+    Emit( nPadFD, EV_KEY, BTN_SOUTH, 1 );
+    Emit( nPadFD, EV_ABS, ABS_X, 20000 );
+    Emit( nPadFD, EV_SYN, SYN_REPORT, 0 );
+    usleep( 10'000 );
+    TEST_CHECK( mirror.Forward() );
+
+    std::vector<input_event> events = ReadAll( nMirrorFD );
+    TEST_CHECK( Contains( events, EV_KEY, BTN_SOUTH, 1 ) );
+    TEST_CHECK( Contains( events, EV_ABS, ABS_X, 20000 ) );
+    TEST_CHECK( Contains( events, EV_SYN, SYN_REPORT, 0 ) );
+
+    // Only through the mirror.
+    input_event event;
+    TEST_CHECK( read( nOtherFD, &event, sizeof( event ) ) < 0 && errno == EAGAIN );
+
+    // Lets go of the button and puts the stick back when it goes away.
+    mirror.Detach();
+    events = ReadAll( nMirrorFD );
+    TEST_CHECK( Contains( events, EV_KEY, BTN_SOUTH, 0 ) );
+    TEST_CHECK( Contains( events, EV_ABS, ABS_X, k_nAxisRest ) );
+
+    // And carries on with it back.
+    nSourceFD = open( sPadNode.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+    TEST_CHECK( nSourceFD >= 0 && mirror.Attach( nSourceFD, "gamescope-test/input0" ) );
+
+    static constexpr uint32_t k_uReports = 1000;
+    mirror.ResetStats();
+    for ( uint32_t i = 0; i < k_uReports; i++ )
+    {
+        Emit( nPadFD, EV_KEY, BTN_EAST, i & 1 );
+        Emit( nPadFD, EV_SYN, SYN_REPORT, 0 );
+        TEST_CHECK( mirror.Forward() );
+        ReadAll( nMirrorFD );
+    }
+
+    GamepadMirrorStats_t stats = mirror.GetStats();
+    TEST_CHECK( stats.uAttaches == 2 );
+    TEST_CHECK( stats.Latency.GetCount() == k_uReports );
+    printf( "Forwarded %lu reports: p50 %.1fus p99 %.1fus max %.1fus\n",
+        stats.Latency.GetCount(),
+        stats.Latency.GetPercentileNs( 50 ) / 1'000.0,
+        stats.Latency.GetPercentileNs( 99 ) / 1'000.0,
+        stats.Latency.ulMaxNs / 1'000.0 );
+
+    // The real one going away for good.
+    ioctl( nPadFD, UI_DEV_DESTROY );
+    close( nPadFD );
+    usleep( 10'000 );
+    TEST_CHECK( !mirror.Forward() );
+
+    close( nMirrorFD );
+    close( nOtherFD );
+}
+
+// A pad that isn't there yet gets a generic mirror straight away, and
+// whatever turns up later is forwarded into it, axes rescaled to fit.
+static void test_placeholder()
+{
+    CGamepadMirror mirror;
+    TEST_CHECK( mirror.CreatePlaceholder( "gamescope-test/input1" ) );
+    TEST_CHECK( !mirror.GetDevNode().empty() );
+    TEST_CHECK( !mirror.IsAttached() );
+
+    int nMirrorFD = open( mirror.GetDevNode().c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+    TEST_CHECK( nMirrorFD >= 0 );
+    if ( nMirrorFD < 0 )
+        return;
+
+    input_absinfo absInfo{};
+    TEST_CHECK( ioctl( nMirrorFD, EVIOCGABS( ABS_X ), &absInfo ) == 0 && absInfo.minimum == -32768 && absInfo.maximum == 32767 );
+    TEST_CHECK( ioctl( nMirrorFD, EVIOCGABS( ABS_Z ), &absInfo ) == 0 && absInfo.minimum == 0 && absInfo.maximum == 255 );
+
+    int nPadFD = CreateVirtualPad();
+    TEST_CHECK( nPadFD >= 0 );
+    if ( nPadFD < 0 )
+    {
+        close( nMirrorFD );
+        return;
+    }
+
+    int nSourceFD = open( CGamepadMirror::GetUInputDevNode( nPadFD ).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+    TEST_CHECK( nSourceFD >= 0 && mirror.Attach( nSourceFD, "gamescope-test/input1" ) );
+
+    Emit( nPadFD, EV_KEY, BTN_SOUTH, 1 );
+    Emit( nPadFD, EV_ABS, ABS_X, 20000 );
+    Emit( nPadFD, EV_ABS, ABS_Z, 1023 );
+    Emit( nPadFD, EV_SYN, SYN_REPORT, 0 );
+    usleep( 10'000 );
+    TEST_CHECK( mirror.Forward() );
+
+    std::vector<input_event> events = ReadAll( nMirrorFD );
+    TEST_CHECK( Contains( events, EV_KEY, BTN_SOUTH, 1 ) );
+    TEST_CHECK( Contains( events, EV_ABS, ABS_X, 20000 ) );
+    TEST_CHECK( Contains( events, EV_ABS, ABS_Z, 255 ) );
+
+    GamepadMirrorStats_t stats = mirror.GetStats();
+    TEST_CHECK( stats.uAttaches == 1 );
+    TEST_CHECK( stats.ulWriteFailures == 0 && stats.ulDroppedEvents == 0 );
+
+    mirror.Detach();
+    events = ReadAll( nMirrorFD );
+    TEST_CHECK( Contains( events, EV_KEY, BTN_SOUTH, 0 ) );
+    TEST_CHECK( Contains( events, EV_ABS, ABS_Z, 0 ) );
+
+    ioctl( nPadFD, UI_DEV_DESTROY );
+    close( nPadFD );
+    close( nMirrorFD );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "gamepad_mirror_tests\n" );
+
+    int nFD = open( "/dev/uinput", O_WRONLY | O_CLOEXEC );
+    if ( nFD < 0 )
+    {
+        printf( "Skipping: can't open /dev/uinput (%s)\n", strerror( errno ) );
+        return 0;
+    }
+    close( nFD );
+
+    test_mirror();
+    test_placeholder();
+
+    return TestExitCode();
+}
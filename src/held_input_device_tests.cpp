@@ -0,0 +1,233 @@
+// Checks that --libinput-hold-dev devices are known again when they are
+// replugged and come back as another eventN, and that something else
+// turning up at their old eventN isn't mistaken for them.
+//
+// The uinput part makes, removes and remakes virtual devices, and is skipped
+// without access to /dev/uinput.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#include <libudev.h>
+
+#include "HeldInputDevice.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+static InputDeviceIdentity_t Keyboard( const char *pszDevNode )
+{
+    return InputDeviceIdentity_t
+    {
+        .sDevNode = pszDevNode,
+        .DevLinks = { "/dev/input/by-path/pci-0000:00:14.0-usb-0:2:1.0-event-kbd" },
+        .sIdPath = "pci-0000:00:14.0-usb-0:2:1.0",
+        .sPhys = "usb-0000:00:14.0-2/input0",
+        .sVendorId = "046d",
+        .sModelId = "c31c",
+        .sSerial = "",
+        .sInterfaceNum = "00",
+        .sName = "Logitech USB Keyboard",
+    };
+}
+
+static void test_match_rules()
+{
+    InputDeviceIdentity_t held = Keyboard( "/dev/input/event5" );
+
+    // Replugged into the same port, as another eventN.
+    InputDeviceIdentity_t replugged = Keyboard( "/dev/input/event9" );
+    TEST_CHECK( IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", held }, replugged ) );
+
+    // The same model in another port is someone else's.
+    InputDeviceIdentity_t other = Keyboard( "/dev/input/event5" );
+    other.DevLinks = { "/dev/input/by-path/pci-0000:00:14.0-usb-0:3:1.0-event-kbd" };
+    other.sIdPath = "pci-0000:00:14.0-usb-0:3:1.0";
+    TEST_CHECK( !IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", held }, other ) );
+
+    // Its media keys are too.
+    InputDeviceIdentity_t mediaKeys = Keyboard( "/dev/input/event10" );
+    mediaKeys.sInterfaceNum = "01";
+    mediaKeys.sName = "Logitech USB Keyboard Consumer Control";
+    TEST_CHECK( !IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", held }, mediaKeys ) );
+
+    // With a serial, the port doesn't matter.
+    InputDeviceIdentity_t serialHeld = Keyboard( "/dev/input/event5" );
+    serialHeld.sSerial = "ABC123";
+    InputDeviceIdentity_t serialMoved = other;
+    serialMoved.sDevNode = "/dev/input/event11";
+    serialMoved.sSerial = "ABC123";
+    TEST_CHECK( IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", serialHeld }, serialMoved ) );
+    serialMoved.sSerial = "XYZ789";
+    TEST_CHECK( !IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", serialHeld }, serialMoved ) );
+
+    // A by-path link is the port, whatever is in it.
+    TEST_CHECK( IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/by-path/pci-0000:00:14.0-usb-0:2:1.0-event-kbd", std::nullopt }, replugged ) );
+    TEST_CHECK( !IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/by-path/pci-0000:00:14.0-usb-0:2:1.0-event-kbd", std::nullopt }, other ) );
+
+    // Never seen it, so all there is to go on is the eventN.
+    TEST_CHECK( IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", std::nullopt }, other ) );
+    TEST_CHECK( !IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", std::nullopt }, replugged ) );
+
+    // Without a port or serial there's no telling identical ones apart.
+    InputDeviceIdentity_t anonymous = Keyboard( "/dev/input/event5" );
+    anonymous.sIdPath.clear();
+    anonymous.sPhys.clear();
+    TEST_CHECK( !IsHeldInputDevice( HeldInputDeviceSpec_t{ "/dev/input/event5", anonymous }, Keyboard( "/dev/input/event9" ) ) );
+}
+
+struct VirtualDevice_t
+{
+    int nFD = -1;
+    udev_device *pDevice = nullptr;
+};
+
+static VirtualDevice_t CreateVirtualDevice( udev *pUdev, uint16_t uProduct, const char *pszPhys )
+{
+    VirtualDevice_t device;
+    device.nFD = open( "/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC );
+    if ( device.nFD < 0 )
+        return device;
+
+    uinput_setup setup{};
+    setup.id.bustype = BUS_USB;
+    setup.id.vendor = 0x1234;
+    setup.id.product = uProduct;
+    snprintf( setup.name, sizeof( setup.name ), "gamescope held device test" );
+
+    bool bCreated =
+        ioctl( device.nFD, UI_SET_EVBIT, EV_KEY ) == 0 &&
+        ioctl( device.nFD, UI_SET_KEYBIT, KEY_A ) == 0 &&
+        ioctl( device.nFD, UI_SET_PHYS, pszPhys ) == 0 &&
+        ioctl( device.nFD, UI_DEV_SETUP, &setup ) == 0 &&
+        ioctl( device.nFD, UI_DEV_CREATE ) == 0;
+
+    char szSysName[64]{};
+    if ( !bCreated || ioctl( device.nFD, UI_GET_SYSNAME( sizeof( szSysName ) ), szSysName ) < 0 )
+    {
+        close( device.nFD );
+        device.nFD = -1;
+        return device;
+    }
+
+    // The eventN under the inputN uinput made.
+    std::string sInputDir = std::string( "/sys/devices/virtual/input/" ) + szSysName;
+    for ( int i = 0; i < 100 && !device.pDevice; i++ )
+    {
+        if ( DIR *pDir = opendir( sInputDir.c_str() ) )
+        {
+            while ( dirent *pEntry = readdir( pDir ) )
+            {
+                if ( strncmp( pEntry->d_name, "event", 5 ) == 0 )
+                {
+                    device.pDevice = udev_device_new_from_syspath( pUdev, ( sInputDir + "/" + pEntry->d_name ).c_str() );
+                    break;
+                }
+            }
+            closedir( pDir );
+        }
+
+        if ( !device.pDevice )
+            usleep( 10'000 );
+    }
+
+    return device;
+}
+
+static void DestroyVirtualDevice( VirtualDevice_t &device )
+{
+    if ( device.pDevice )
+        udev_device_unref( device.pDevice );
+    if ( device.nFD >= 0 )
+    {
+        ioctl( device.nFD, UI_DEV_DESTROY );
+        close( device.nFD );
+    }
+    device = VirtualDevice_t{};
+}
+
+static void test_uinput_replug()
+{
+    int nFD = open( "/dev/uinput", O_WRONLY | O_CLOEXEC );
+    if ( nFD < 0 )
+    {
+        printf( "Skipping uinput replug test: can't open /dev/uinput (%s)\n", strerror( errno ) );
+        return;
+    }
+    close( nFD );
+
+    udev *pUdev = udev_new();
+    TEST_CHECK( pUdev );
+    if ( !pUdev )
+        return;
+
+    VirtualDevice_t device = CreateVirtualDevice( pUdev, 0x5678, "gamescope-held-test/input0" );
+    TEST_CHECK( device.pDevice );
+    if ( !device.pDevice )
+    {
+        DestroyVirtualDevice( device );
+        udev_unref( pUdev );
+        return;
+    }
+
+    std::optional<InputDeviceIdentity_t> oIdentity = GetInputDeviceIdentity( device.pDevice );
+    TEST_CHECK( oIdentity );
+    TEST_CHECK( oIdentity && oIdentity->sVendorId == "1234" && oIdentity->sModelId == "5678" );
+    TEST_CHECK( oIdentity && oIdentity->sName == "gamescope held device test" );
+    TEST_CHECK( oIdentity && oIdentity->sPhys == "gamescope-held-test/input0" );
+    if ( !oIdentity )
+    {
+        DestroyVirtualDevice( device );
+        udev_unref( pUdev );
+        return;
+    }
+
+    HeldInputDeviceSpec_t spec{ oIdentity->sDevNode, oIdentity };
+    TEST_CHECK( IsHeldInputDevice( spec, *oIdentity ) );
+
+    // Unplug it, and have something else plug in first,
+    // which is likely to end up with its old eventN.
+    DestroyVirtualDevice( device );
+
+    VirtualDevice_t other = CreateVirtualDevice( pUdev, 0x5678, "gamescope-held-test/input1" );
+    TEST_CHECK( other.pDevice );
+    if ( other.pDevice )
+    {
+        std::optional<InputDeviceIdentity_t> oOtherIdentity = GetInputDeviceIdentity( other.pDevice );
+        TEST_CHECK( oOtherIdentity && !IsHeldInputDevice( spec, *oOtherIdentity ) );
+    }
+
+    // Plug it back in.
+    device = CreateVirtualDevice( pUdev, 0x5678, "gamescope-held-test/input0" );
+    TEST_CHECK( device.pDevice );
+    if ( device.pDevice )
+    {
+        std::optional<InputDeviceIdentity_t> oReplugged = GetInputDeviceIdentity( device.pDevice );
+        TEST_CHECK( oReplugged && IsHeldInputDevice( spec, *oReplugged ) );
+        if ( oReplugged )
+            printf( "Held device went from %s to %s\n", spec.sPath.c_str(), oReplugged->sDevNode.c_str() );
+    }
+
+    DestroyVirtualDevice( other );
+    DestroyVirtualDevice( device );
+    udev_unref( pUdev );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "held_input_device_tests\n" );
+
+    test_match_rules();
+    test_uinput_replug();
+
+    return TestExitCode();
+}
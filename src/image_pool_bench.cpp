@@ -0,0 +1,97 @@
+#include <optional>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "ImagePool.h"
+
+using namespace gamescope;
+
+// How many upscale images get made with the output flipping between
+// sizes, like dynamic resolution or a split-screen tile resizing back and
+// forth: the old way, which threw everything away whenever the size
+// changed, against keeping them in a CImagePool.
+//
+// Makes no actual images, a stand-in counts how often one would have been.
+
+struct FakeImage_t
+{
+    uint64_t ulSize = 0;
+
+    bool IsIdle() const { return true; }
+    uint64_t GetSize() const { return ulSize; }
+};
+
+static constexpr uint32_t k_uFormat = 0x34325241; // DRM_FORMAT_ARGB8888
+
+static const ImagePoolKey_t s_Sizes[] =
+{
+    { 1920, 1080, k_uFormat, 0 },
+    { 1280, 720, k_uFormat, 0 },
+    { 2560, 1440, k_uFormat, 0 },
+};
+
+// Frames before switching to the next size.
+static constexpr uint32_t k_uFramesPerSize = 4;
+
+static FakeImage_t MakeImage( const ImagePoolKey_t &key )
+{
+    // Pretend it takes a while, as vkAllocateMemory does.
+    std::vector<uint8_t> scratch( 64 * 1024 );
+    benchmark::DoNotOptimize( scratch.data() );
+    return FakeImage_t{ uint64_t( key.uWidth ) * key.uHeight * 4 };
+}
+
+static void Benchmark_ClearOnResize( benchmark::State &state )
+{
+    std::vector<FakeImage_t> images;
+    ImagePoolKey_t lastKey = {};
+    uint64_t ulAllocations = 0;
+    uint64_t ulFrame = 0;
+
+    for ( auto _ : state )
+    {
+        const ImagePoolKey_t &key = s_Sizes[ ( ulFrame++ / k_uFramesPerSize ) % std::size( s_Sizes ) ];
+
+        if ( !( key == lastKey ) )
+        {
+            images.clear();
+            lastKey = key;
+        }
+
+        if ( images.empty() )
+        {
+            images.push_back( MakeImage( key ) );
+            ulAllocations++;
+        }
+
+        benchmark::DoNotOptimize( images.data() );
+    }
+
+    state.counters[ "allocations" ] = double( ulAllocations );
+    state.counters[ "allocations/frame" ] = double( ulAllocations ) / double( state.iterations() );
+}
+
+static void Benchmark_Pool( benchmark::State &state )
+{
+    CImagePool<FakeImage_t> pool{ 256ull * 1024 * 1024, 8 };
+    uint64_t ulFrame = 0;
+
+    for ( auto _ : state )
+    {
+        const ImagePoolKey_t &key = s_Sizes[ ( ulFrame++ / k_uFramesPerSize ) % std::size( s_Sizes ) ];
+
+        FakeImage_t *pImage = pool.Acquire( key, true, [&]() -> std::optional<FakeImage_t> { return MakeImage( key ); } );
+        benchmark::DoNotOptimize( pImage );
+    }
+
+    const ImagePoolStats_t &stats = pool.GetStats();
+    state.counters[ "allocations" ] = double( stats.ulAllocations );
+    state.counters[ "allocations/frame" ] = double( stats.ulAllocations ) / double( state.iterations() );
+    state.counters[ "peak_mb" ] = double( stats.ulPeakBytes ) / ( 1024.0 * 1024.0 );
+}
+
+BENCHMARK( Benchmark_ClearOnResize );
+BENCHMARK( Benchmark_Pool );
+
+BENCHMARK_MAIN();
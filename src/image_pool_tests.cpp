@@ -0,0 +1,189 @@
+// Checks CImagePool hands back images by size, format and usage, only shares
+// the ones in use when asked to, and evicts the least recently used idle
+// ones once over budget, never ones still in use.
+
+#include <cstdio>
+#include <memory>
+#include <optional>
+
+#include "ImagePool.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+struct FakeImage_t
+{
+    uint32_t uId = 0;
+    uint64_t ulSize = 0;
+    // Stands in for someone else holding a reference.
+    std::shared_ptr<bool> pInUse = std::make_shared<bool>( false );
+
+    bool IsIdle() const { return !*pInUse; }
+    uint64_t GetSize() const { return ulSize; }
+};
+
+static constexpr uint32_t k_uFormat = 0x34325241; // DRM_FORMAT_ARGB8888
+
+static ImagePoolKey_t Key( uint32_t uWidth, uint32_t uHeight, uint32_t uUsage = 0 )
+{
+    return ImagePoolKey_t{ uWidth, uHeight, k_uFormat, uUsage };
+}
+
+static auto Creator( uint32_t &uNextId, uint64_t ulSize )
+{
+    return [&uNextId, ulSize]() -> std::optional<FakeImage_t>
+    {
+        return FakeImage_t{ .uId = uNextId++, .ulSize = ulSize };
+    };
+}
+
+static void test_reuse_across_sizes()
+{
+    CImagePool<FakeImage_t> pool{ 1000, 8 };
+    uint32_t uNextId = 1;
+
+    FakeImage_t *pA = pool.Acquire( Key( 1280, 720 ), false, Creator( uNextId, 100 ) );
+    FakeImage_t *pB = pool.Acquire( Key( 1920, 1080 ), false, Creator( uNextId, 200 ) );
+    TEST_CHECK( pA && pA->uId == 1 );
+    TEST_CHECK( pB && pB->uId == 2 );
+
+    // Going back to the first size gets the first image back.
+    FakeImage_t *pA2 = pool.Acquire( Key( 1280, 720 ), false, Creator( uNextId, 100 ) );
+    TEST_CHECK( pA2 == pA );
+
+    // Same size for something else doesn't.
+    FakeImage_t *pC = pool.Acquire( Key( 1280, 720, 1 ), false, Creator( uNextId, 100 ) );
+    TEST_CHECK( pC && pC->uId == 3 );
+
+    const ImagePoolStats_t &stats = pool.GetStats();
+    TEST_CHECK( stats.ulAllocations == 3 );
+    TEST_CHECK( stats.ulReuses == 1 );
+    TEST_CHECK( stats.ulBytes == 400 );
+    TEST_CHECK( stats.uImages == 3 );
+}
+
+static void test_in_use()
+{
+    CImagePool<FakeImage_t> pool{ 1000, 2 };
+    uint32_t uNextId = 1;
+
+    FakeImage_t *pA = pool.Acquire( Key( 64, 64 ), false, Creator( uNextId, 10 ) );
+    *pA->pInUse = true;
+
+    // In use, so exclusive users get another...
+    FakeImage_t *pB = pool.Acquire( Key( 64, 64 ), false, Creator( uNextId, 10 ) );
+    TEST_CHECK( pB && pB != pA );
+    *pB->pInUse = true;
+
+    // ...until there are too many.
+    TEST_CHECK( pool.Acquire( Key( 64, 64 ), false, Creator( uNextId, 10 ) ) == nullptr );
+
+    // Shared users get the most recently used regardless.
+    TEST_CHECK( pool.Acquire( Key( 64, 64 ), true, Creator( uNextId, 10 ) ) == pB );
+
+    *pA->pInUse = false;
+    TEST_CHECK( pool.Acquire( Key( 64, 64 ), false, Creator( uNextId, 10 ) ) == pA );
+    TEST_CHECK( pool.GetStats().ulAllocations == 2 );
+}
+
+static void test_budget()
+{
+    CImagePool<FakeImage_t> pool{ 300, 8 };
+    uint32_t uNextId = 1;
+
+    FakeImage_t *pA = pool.Acquire( Key( 1, 1 ), false, Creator( uNextId, 100 ) );
+    pool.Acquire( Key( 2, 2 ), false, Creator( uNextId, 100 ) );
+    pool.Acquire( Key( 3, 3 ), false, Creator( uNextId, 100 ) );
+    // Touch the first so the second is the oldest.
+    TEST_CHECK( pool.Acquire( Key( 1, 1 ), false, Creator( uNextId, 100 ) ) == pA );
+
+    FakeImage_t *pD = pool.Acquire( Key( 4, 4 ), false, Creator( uNextId, 100 ) );
+    TEST_CHECK( pD && pD->uId == 4 );
+    TEST_CHECK( pool.GetStats().ulBytes == 300 );
+    TEST_CHECK( pool.GetStats().ulEvictions == 1 );
+
+    // The second went, so it's made again.
+    FakeImage_t *pB = pool.Acquire( Key( 2, 2 ), false, Creator( uNextId, 100 ) );
+    TEST_CHECK( pB && pB->uId == 5 );
+
+    // Everything in use: over budget, nothing evicted.
+    pool.Clear();
+    FakeImage_t *pE = pool.Acquire( Key( 5, 5 ), false, Creator( uNextId, 200 ) );
+    *pE->pInUse = true;
+    FakeImage_t *pF = pool.Acquire( Key( 6, 6 ), false, Creator( uNextId, 200 ) );
+    TEST_CHECK( pF != nullptr );
+    TEST_CHECK( pool.GetStats().ulBytes == 400 );
+    TEST_CHECK( pool.GetStats().ulPeakBytes == 400 );
+
+    // Once it's idle, a smaller budget lets go of it.
+    *pE->pInUse = false;
+    pool.SetBudget( 200 );
+    TEST_CHECK( pool.GetStats().ulBytes == 200 );
+    TEST_CHECK( pool.GetStats().uImages == 1 );
+}
+
+static void test_trimmed_once_idle()
+{
+    CImagePool<FakeImage_t> pool{ 200, 8 };
+    uint32_t uNextId = 1;
+
+    FakeImage_t *pA = pool.Acquire( Key( 1, 1 ), false, Creator( uNextId, 200 ) );
+    *pA->pInUse = true;
+    FakeImage_t *pB = pool.Acquire( Key( 2, 2 ), false, Creator( uNextId, 200 ) );
+    TEST_CHECK( pool.GetStats().ulBytes == 400 );
+
+    // Nothing new gets made, but using the pool at all lets go of
+    // what's over budget once it's idle.
+    *pA->pInUse = false;
+    TEST_CHECK( pool.Acquire( Key( 2, 2 ), false, Creator( uNextId, 200 ) ) == pB );
+    TEST_CHECK( pool.GetStats().ulBytes == 200 );
+    TEST_CHECK( pool.GetStats().ulAllocations == 2 );
+}
+
+static void test_release_idle()
+{
+    CImagePool<FakeImage_t> pool{ 1000, 8 };
+    uint32_t uNextId = 1;
+
+    pool.Acquire( Key( 1, 1, 1 ), false, Creator( uNextId, 100 ) );
+    FakeImage_t *pB = pool.Acquire( Key( 2, 2, 1 ), false, Creator( uNextId, 100 ) );
+    FakeImage_t *pC = pool.Acquire( Key( 1, 1, 0 ), false, Creator( uNextId, 100 ) );
+    *pB->pInUse = true;
+
+    // Well within budget, but nobody wants usage 1 any more.
+    pool.ReleaseIdle( 1 );
+    TEST_CHECK( pool.GetStats().ulBytes == 200 );
+    TEST_CHECK( pool.GetStats().uImages == 2 );
+    TEST_CHECK( pool.GetStats().ulEvictions == 1 );
+
+    // The one in use stays, and so does the other usage.
+    TEST_CHECK( pool.Acquire( Key( 2, 2, 1 ), true, Creator( uNextId, 100 ) ) == pB );
+    TEST_CHECK( pool.Acquire( Key( 1, 1, 0 ), false, Creator( uNextId, 100 ) ) == pC );
+
+    FakeImage_t *pA2 = pool.Acquire( Key( 1, 1, 1 ), false, Creator( uNextId, 100 ) );
+    TEST_CHECK( pA2 && pA2->uId == 4 );
+}
+
+static void test_create_failed()
+{
+    CImagePool<FakeImage_t> pool{ 1000, 8 };
+
+    FakeImage_t *pImage = pool.Acquire( Key( 1, 1 ), false, []() -> std::optional<FakeImage_t> { return std::nullopt; } );
+    TEST_CHECK( pImage == nullptr );
+    TEST_CHECK( pool.GetStats().uImages == 0 );
+    TEST_CHECK( pool.GetStats().ulAllocations == 0 );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "image_pool_tests\n" );
+
+    test_reuse_across_sizes();
+    test_in_use();
+    test_budget();
+    test_trimmed_once_idle();
+    test_release_idle();
+    test_create_failed();
+
+    return TestExitCode();
+}
@@ -7,6 +7,7 @@
 #include <string.h>
 
 #include <deque>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -117,13 +118,31 @@ struct wlserver_input_method {
 	uint32_t uFakeTimestamp = 0;
 };
 
+struct wlserver_input_method_keysym_key {
+	xkb_keycode_t keycode;
+	xkb_mod_mask_t mask;
+};
+
 struct wlserver_input_method_manager {
 	struct wl_global *global;
 	struct wlserver_t *server;
 
 	struct wl_event_source *ime_reset_keyboard_event_source;
+
+	// Compiling a keymap is slow, so keep the ones we generated around,
+	// keyed by the keycode/keysym pairs they were generated from.
+	struct xkb_context *xkb_context;
+	std::unordered_map<std::string, struct xkb_keymap *> keymap_cache;
+
+	// keysym -> first keycode/modifiers producing it in the virtual keyboard's keymap
+	struct xkb_keymap *keysym_table_keymap;
+	std::unordered_map<xkb_keysym_t, struct wlserver_input_method_keysym_key> keysym_table;
 };
 
+// Generated keymaps are tiny, but there is no point holding on to
+// every combination someone ever typed.
+static const size_t IME_KEYMAP_CACHE_SIZE = 64;
+
 static LogScope ime_log("ime");
 
 static xkb_keysym_t keysym_from_ch(uint32_t ch)
@@ -182,6 +201,13 @@ static bool generate_keymap_key(FILE *f, uint32_t keycode, xkb_keysym_t keysym)
 	return true;
 }
 
+static struct xkb_context *get_xkb_context(struct wlserver_input_method_manager *manager)
+{
+	if (manager->xkb_context == nullptr)
+		manager->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	return manager->xkb_context;
+}
+
 static struct xkb_keymap *generate_keymap(struct wlserver_input_method *ime)
 {
 	uint32_t keycode_offset = 8;
@@ -251,15 +277,58 @@ static struct xkb_keymap *generate_keymap(struct wlserver_input_method *ime)
 
 	fclose(f);
 
-	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	struct xkb_context *context = get_xkb_context(ime->manager);
 	struct xkb_keymap *keymap = xkb_keymap_new_from_buffer(context, str, str_size, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
-	xkb_context_unref(context);
 
 	free(str);
 
 	return keymap;
 }
 
+// Returns a new reference to the keymap for the IME's current keys,
+// compiling it only if we haven't seen this set of keys before.
+static struct xkb_keymap *get_keymap(struct wlserver_input_method *ime)
+{
+	struct wlserver_input_method_manager *manager = ime->manager;
+
+	// actions[] are always part of the keymap, so only the typed keys matter
+	std::string cache_key;
+	cache_key.reserve(ime->keys.size() * sizeof(struct wlserver_input_method_key));
+	for (const auto& kk : ime->keys) {
+		cache_key.append((const char *)&kk.keycode, sizeof(kk.keycode));
+		cache_key.append((const char *)&kk.keysym, sizeof(kk.keysym));
+	}
+
+	auto iter = manager->keymap_cache.find(cache_key);
+	if (iter != manager->keymap_cache.end()) {
+		return xkb_keymap_ref(iter->second);
+	}
+
+	struct xkb_keymap *keymap = generate_keymap(ime);
+	if (keymap == nullptr) {
+		return nullptr;
+	}
+
+	if (manager->keymap_cache.size() >= IME_KEYMAP_CACHE_SIZE) {
+		for (auto& kv : manager->keymap_cache) {
+			xkb_keymap_unref(kv.second);
+		}
+		manager->keymap_cache.clear();
+	}
+	manager->keymap_cache.emplace(std::move(cache_key), xkb_keymap_ref(keymap));
+
+	return keymap;
+}
+
+static void set_ime_keymap(struct wlserver_input_method *ime, struct xkb_keymap *keymap)
+{
+	// wlroots re-serializes the keymap every time it's set, skip that if
+	// we're handing it the same one again.
+	if (ime->keyboard.keymap != keymap) {
+		wlr_keyboard_set_keymap(&ime->keyboard, keymap);
+	}
+}
+
 static int release_key_if_needed(void *data)
 {
 	struct wlserver_input_method *ime = (struct wlserver_input_method *)data;
@@ -312,12 +381,14 @@ static void press_key(struct wlserver_input_method *ime, uint32_t keycode, struc
 	wl_event_source_timer_update(ime->ime_reset_ime_keyboard_event_source, 30 /* ms */);
 }
 
-static bool try_type_keysym(struct wlserver_input_method *ime, xkb_keysym_t keysym)
+static void build_keysym_table(struct wlserver_input_method_manager *manager, struct xkb_keymap *keymap)
 {
-	struct wlr_seat *seat = ime->manager->server->wlr.seat;
-	struct wlr_keyboard *keyboard = ime->manager->server->wlr.virtual_keyboard_device;
+	manager->keysym_table.clear();
+	if (manager->keysym_table_keymap != nullptr) {
+		xkb_keymap_unref(manager->keysym_table_keymap);
+	}
+	manager->keysym_table_keymap = xkb_keymap_ref(keymap);
 
-	struct xkb_keymap *keymap = keyboard->keymap;
 	xkb_keycode_t min_keycode = xkb_keymap_min_keycode(keymap);
 	xkb_keycode_t max_keycode = xkb_keymap_max_keycode(keymap);
 	for (xkb_keycode_t keycode = min_keycode; keycode <= max_keycode; keycode++) {
@@ -330,9 +401,6 @@ static bool try_type_keysym(struct wlserver_input_method *ime, xkb_keysym_t keys
 				if (num_syms != 1) {
 					continue;
 				}
-				if (syms[0] != keysym) {
-					continue;
-				}
 
 				xkb_mod_mask_t mask;
 				size_t num_masks = xkb_keymap_key_get_mods_for_level(keymap, keycode, layout, level, &mask, 1);
@@ -345,21 +413,38 @@ static bool try_type_keysym(struct wlserver_input_method *ime, xkb_keysym_t keys
 					continue;
 				}
 
-				release_key_if_needed(ime); // before keymap change
-				wlr_seat_set_keyboard(seat, keyboard);
-
-				struct wlr_keyboard_modifiers mods = {
-					.depressed = mask,
-				};
-				assert(keycode >= 8);
-				press_key(ime, keycode - 8, &mods);
-
-				return true;
+				// First match wins, same as scanning the keymap in order
+				manager->keysym_table.emplace(syms[0], wlserver_input_method_keysym_key{ keycode, mask });
 			}
 		}
 	}
+}
 
-	return false;
+static bool try_type_keysym(struct wlserver_input_method *ime, xkb_keysym_t keysym)
+{
+	struct wlr_seat *seat = ime->manager->server->wlr.seat;
+	struct wlr_keyboard *keyboard = ime->manager->server->wlr.virtual_keyboard_device;
+
+	// The table holds a reference, so a new keymap can't alias the old pointer
+	if (ime->manager->keysym_table_keymap != keyboard->keymap) {
+		build_keysym_table(ime->manager, keyboard->keymap);
+	}
+
+	auto iter = ime->manager->keysym_table.find(keysym);
+	if (iter == ime->manager->keysym_table.end()) {
+		return false;
+	}
+
+	release_key_if_needed(ime); // before keymap change
+	wlr_seat_set_keyboard(seat, keyboard);
+
+	struct wlr_keyboard_modifiers mods = {
+		.depressed = iter->second.mask,
+	};
+	assert(iter->second.keycode >= 8);
+	press_key(ime, iter->second.keycode - 8, &mods);
+
+	return true;
 }
 
 void type_text(struct wlserver_input_method *ime, const char *text)
@@ -386,12 +471,12 @@ void type_text(struct wlserver_input_method *ime, const char *text)
 		keycodes.push_back(keycode);
 	}
 
-	struct xkb_keymap *keymap = generate_keymap(ime);
+	struct xkb_keymap *keymap = get_keymap(ime);
 	if (keymap == nullptr) {
 		ime_log.errorf("failed to generate keymap");
 		return;
 	}
-	wlr_keyboard_set_keymap(&ime->keyboard, keymap);
+	set_ime_keymap(ime, keymap);
 	xkb_keymap_unref(keymap);
 
 	struct wlr_seat *seat = ime->manager->server->wlr.seat;
@@ -422,12 +507,12 @@ static void perform_action(struct wlserver_input_method *ime, enum gamescope_inp
 
 	// Keymap always contains all actions[]
 
-	struct xkb_keymap *keymap = generate_keymap(ime);
+	struct xkb_keymap *keymap = get_keymap(ime);
 	if (keymap == nullptr) {
 		ime_log.errorf("failed to generate keymap");
 		return;
 	}
-	wlr_keyboard_set_keymap(&ime->keyboard, keymap);
+	set_ime_keymap(ime, keymap);
 	xkb_keymap_unref(keymap);
 
 	struct wlr_seat *seat = ime->manager->server->wlr.seat;
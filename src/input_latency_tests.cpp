@@ -0,0 +1,84 @@
+// Runs gamescope_compositor_bench --input-probe nested in a headless
+// gamescope. The bench has gamescope mark input just before some of its
+// commits, and fails if gamescope's InputToPresent doesn't land within what
+// the client saw for those commits.
+//
+// Expects gamescope and gamescope_compositor_bench next to it in the build
+// directory. Skipped if the bench never gets to finish, eg. without a
+// Vulkan device for gamescope to start on.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "test_check.h"
+
+static std::string GetBuildDir( const char *pszArgv0 )
+{
+    std::string sPath = pszArgv0;
+    size_t uSlash = sPath.rfind( '/' );
+    return uSlash == std::string::npos ? "." : sPath.substr( 0, uSlash );
+}
+
+static void test_input_to_present( const std::string &sBuildDir )
+{
+    const std::string sGamescope = sBuildDir + "/gamescope";
+    const std::string sBench = sBuildDir + "/gamescope_compositor_bench";
+
+    char szStatusPath[] = "/tmp/gamescope_input_latency_XXXXXX";
+    int nStatusFD = mkstemp( szStatusPath );
+    TEST_CHECK( nStatusFD >= 0 );
+    if ( nStatusFD < 0 )
+        return;
+    close( nStatusFD );
+
+    // gamescope exits 0 whatever its child does, so the child writes
+    // down how the bench went instead.
+    const char *pszScript = "\"$0\" --duration 5 --input-probe 10; echo $? > \"$1\"";
+
+    fflush( stdout );
+    pid_t nPid = fork();
+    if ( nPid == 0 )
+    {
+        execl( sGamescope.c_str(), sGamescope.c_str(), "--backend", "headless", "--expose-wayland",
+            "--", "sh", "-c", pszScript, sBench.c_str(), szStatusPath, nullptr );
+        fprintf( stderr, "Failed to run %s: %s\n", sGamescope.c_str(), strerror( errno ) );
+        _exit( 127 );
+    }
+    TEST_CHECK( nPid > 0 );
+
+    int nStatus = 0;
+    while ( nPid > 0 && waitpid( nPid, &nStatus, 0 ) < 0 && errno == EINTR )
+        continue;
+
+    int nBenchStatus = -1;
+    if ( FILE *pFile = fopen( szStatusPath, "r" ) )
+    {
+        if ( fscanf( pFile, "%d", &nBenchStatus ) != 1 )
+            nBenchStatus = -1;
+        fclose( pFile );
+    }
+    unlink( szStatusPath );
+
+    if ( nBenchStatus < 0 )
+    {
+        printf( "Skipping: the bench didn't finish, gamescope can't run headless here (wait status %d)\n", nStatus );
+        return;
+    }
+
+    TEST_CHECK( nBenchStatus == 0 );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "input_latency_tests\n" );
+
+    test_input_to_present( GetBuildDir( argv[0] ) );
+
+    return TestExitCode();
+}
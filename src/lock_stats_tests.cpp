@@ -0,0 +1,118 @@
+// Checks CLockStats puts waits and holds down to the right call site,
+// with sensible percentiles, and that CInputQueue hands input over
+// in order and only asks to be woken when it needs to be.
+
+#include <cstdio>
+#include <source_location>
+#include <vector>
+
+#include "InputQueue.h"
+#include "LockStats.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+static std::source_location SiteA() { return std::source_location::current(); }
+static std::source_location SiteB() { return std::source_location::current(); }
+
+static void test_sites()
+{
+    CLockStats stats;
+    uint64_t ulNow = 0;
+
+    // A waits a little and holds for long, B waits for long and holds briefly.
+    for ( uint32_t i = 0; i < 100; i++ )
+    {
+        stats.Acquired( SiteA(), 500, ulNow );
+        ulNow += 3'000'000;
+        stats.Released( ulNow );
+
+        stats.Acquired( SiteB(), 2'500'000, ulNow );
+        ulNow += 1'000;
+        stats.Released( ulNow );
+    }
+
+    std::vector<CLockStats::Site_t> sites = stats.GetSites();
+    TEST_CHECK( sites.size() == 2 );
+    if ( sites.size() != 2 )
+        return;
+
+    // Most waited on first.
+    TEST_CHECK( sites[0].uLine == SiteB().line() );
+    TEST_CHECK( sites[1].uLine == SiteA().line() );
+
+    const CLockStats::Site_t &b = sites[0];
+    const CLockStats::Site_t &a = sites[1];
+
+    TEST_CHECK( a.Wait.GetCount() == 100 );
+    TEST_CHECK( a.Wait.GetPercentileNs( 99 ) == 500 );
+    TEST_CHECK( a.Hold.ulTotalNs == 100 * 3'000'000ull );
+    // 3ms lands in the < 4096us bucket.
+    TEST_CHECK( a.Hold.GetPercentileNs( 50 ) == 3'000'000 );
+    TEST_CHECK( b.Wait.GetPercentileNs( 50 ) == 2'500'000 );
+    TEST_CHECK( b.Hold.GetPercentileNs( 50 ) == 1'000 );
+}
+
+static void test_percentiles()
+{
+    CLockStats::Histogram_t histogram;
+    for ( uint32_t i = 0; i < 99; i++ )
+        histogram.Add( 1'500 );
+    histogram.Add( 100'000'000 );
+
+    // 1.5us is in the < 2us bucket.
+    TEST_CHECK( histogram.GetPercentileNs( 50 ) == 2'000 );
+    TEST_CHECK( histogram.GetPercentileNs( 99 ) == 2'000 );
+    // Past the last bucket is the max.
+    TEST_CHECK( histogram.GetPercentileNs( 100 ) == 100'000'000 );
+}
+
+static void test_reset_while_held()
+{
+    CLockStats stats;
+
+    stats.Acquired( SiteA(), 0, 0 );
+    stats.Reset();
+    stats.Released( 1'000 );
+
+    std::vector<CLockStats::Site_t> sites = stats.GetSites();
+    // Nothing waited since the reset, but the hold still counted.
+    TEST_CHECK( sites.empty() );
+
+    stats.Acquired( SiteA(), 0, 2'000 );
+    stats.Released( 3'000 );
+    sites = stats.GetSites();
+    TEST_CHECK( sites.size() == 1 && sites[0].Hold.GetCount() == 2 );
+}
+
+static void test_input_queue()
+{
+    CInputQueue queue;
+    std::vector<QueuedInput_t> inputs;
+
+    TEST_CHECK( queue.Push( QueuedInput_t{ .eType = QueuedInput_t::Type::Key, .uCode = 30, .bPressed = true, .uTime = 1 } ) );
+    TEST_CHECK( !queue.Push( QueuedInput_t{ .eType = QueuedInput_t::Type::MouseMotion, .flX = 1.0, .flY = 2.0, .uTime = 2 } ) );
+    TEST_CHECK( !queue.Push( QueuedInput_t{ .eType = QueuedInput_t::Type::Key, .uCode = 30, .bPressed = false, .uTime = 3 } ) );
+
+    queue.Take( inputs );
+    TEST_CHECK( inputs.size() == 3 );
+    for ( uint32_t i = 0; i < inputs.size(); i++ )
+        TEST_CHECK( inputs[i].uTime == i + 1 );
+
+    // Empty again, so the next one wakes it.
+    queue.Take( inputs );
+    TEST_CHECK( inputs.empty() );
+    TEST_CHECK( queue.Push( QueuedInput_t{ .eType = QueuedInput_t::Type::MouseWheel, .flY = 1.0, .uTime = 4 } ) );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "lock_stats_tests\n" );
+
+    test_sites();
+    test_percentiles();
+    test_reset_while_held();
+    test_input_queue();
+
+    return TestExitCode();
+}
@@ -4,6 +4,12 @@
 #include <cerrno>
 
 #include <format>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <time.h>
 
 #include "Utils/Process.h"
 #include "Utils/Defer.h"
@@ -50,6 +56,352 @@ static constexpr LogPriority GetPriorityFromString( std::string_view psvScope )
 		return LOG_INFO;
 }
 
+namespace gamescope
+{
+	ConVar<bool> cv_log_async( "log_async", true, "Hand log records off to a logger thread instead of writing them to stderr on the calling thread." );
+	ConVar<uint32_t> cv_log_rate_limit( "log_rate_limit", 500, "Max messages per second from a single log callsite before further messages are suppressed. Errors are never suppressed. 0 = unlimited." );
+
+	static uint64_t GetLogTime()
+	{
+		timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return uint64_t( ts.tv_sec ) * 1'000'000'000ul + uint64_t( ts.tv_nsec );
+	}
+
+	//
+	// Per-callsite rate limiting.
+	//
+	// Callsites are identified by their format string, which is
+	// unique per call to *f in practice.
+	//
+
+	struct LogCallsite_t
+	{
+		std::atomic<const char *> pszFormat = { nullptr };
+		std::atomic<uint64_t> ulWindowStart = { 0 };
+		std::atomic<uint32_t> uCount = { 0 };
+		std::atomic<uint32_t> uSuppressed = { 0 };
+	};
+
+	static constexpr size_t k_unLogCallsiteCount = 1024;
+	static LogCallsite_t s_LogCallsites[ k_unLogCallsiteCount ];
+
+	static std::atomic<uint64_t> s_ulLogRateLimited = { 0 };
+	static std::atomic<uint64_t> s_ulLogOverflowed = { 0 };
+	static std::atomic<uint64_t> s_ulLogQueued = { 0 };
+
+	static LogCallsite_t *FindLogCallsite( const char *pszFormat )
+	{
+		size_t uIndex = ( reinterpret_cast<uintptr_t>( pszFormat ) >> 3 ) % k_unLogCallsiteCount;
+		for ( size_t i = 0; i < k_unLogCallsiteCount; i++ )
+		{
+			LogCallsite_t *pCallsite = &s_LogCallsites[ ( uIndex + i ) % k_unLogCallsiteCount ];
+
+			const char *pszExisting = pCallsite->pszFormat.load( std::memory_order_acquire );
+			if ( pszExisting == pszFormat )
+				return pCallsite;
+
+			if ( pszExisting == nullptr &&
+				 pCallsite->pszFormat.compare_exchange_strong( pszExisting, pszFormat, std::memory_order_acq_rel ) )
+				return pCallsite;
+
+			// Someone may have just claimed this slot for us.
+			if ( pszExisting == pszFormat )
+				return pCallsite;
+		}
+
+		// Table is full, don't rate limit this one.
+		return nullptr;
+	}
+
+	// Returns true if the message should be dropped.
+	// puSuppressed is set to the number of messages dropped since the
+	// last one we let through, so it can be noted in the output.
+	static bool ShouldRateLimit( const char *pszFormat, uint32_t *puSuppressed )
+	{
+		*puSuppressed = 0;
+
+		const uint32_t uLimit = cv_log_rate_limit;
+		if ( !uLimit || !pszFormat )
+			return false;
+
+		LogCallsite_t *pCallsite = FindLogCallsite( pszFormat );
+		if ( !pCallsite )
+			return false;
+
+		static constexpr uint64_t k_ulWindow = 1'000'000'000ul;
+		const uint64_t ulNow = GetLogTime();
+		uint64_t ulWindowStart = pCallsite->ulWindowStart.load( std::memory_order_relaxed );
+		if ( ulNow - ulWindowStart >= k_ulWindow &&
+			 pCallsite->ulWindowStart.compare_exchange_strong( ulWindowStart, ulNow, std::memory_order_relaxed ) )
+		{
+			pCallsite->uCount.store( 0, std::memory_order_relaxed );
+			*puSuppressed = pCallsite->uSuppressed.exchange( 0, std::memory_order_relaxed );
+		}
+
+		if ( pCallsite->uCount.fetch_add( 1, std::memory_order_relaxed ) >= uLimit )
+		{
+			pCallsite->uSuppressed.fetch_add( 1, std::memory_order_relaxed );
+			s_ulLogRateLimited.fetch_add( 1, std::memory_order_relaxed );
+			return true;
+		}
+
+		return false;
+	}
+
+	//
+	// Async logging.
+	//
+	// Every thread that logs gets its own single-producer, single-consumer
+	// byte ring. Producers never block or take locks after their first log;
+	// if their ring is full the line is dropped and counted.
+	// The consumer side of every ring is only touched with
+	// CAsyncLogger::m_DrainMutex held, either by the logger thread
+	// or by someone calling Flush.
+	//
+
+	class CLogRing
+	{
+	public:
+		static constexpr size_t k_unSize = 64 * 1024;
+		static constexpr uint32_t k_uWrapMarker = ~0u;
+
+		bool Push( std::string_view svLine )
+		{
+			const uint64_t ulRecordSize = sizeof( uint32_t ) + AlignRecord( svLine.size() );
+
+			const uint64_t ulHead = m_ulHead.load( std::memory_order_relaxed );
+			const uint64_t ulTail = m_ulTail.load( std::memory_order_acquire );
+
+			// Records never straddle the end of the ring, pad to the start if needed.
+			const uint64_t ulOffset = ulHead % k_unSize;
+			const uint64_t ulPadding = ulOffset + ulRecordSize > k_unSize ? k_unSize - ulOffset : 0;
+
+			if ( ( ulHead - ulTail ) + ulPadding + ulRecordSize > k_unSize )
+				return false;
+
+			uint64_t ulWritePos = ulHead;
+			if ( ulPadding )
+			{
+				memcpy( &m_Data[ ulOffset ], &k_uWrapMarker, sizeof( k_uWrapMarker ) );
+				ulWritePos += ulPadding;
+			}
+
+			const uint32_t uLength = uint32_t( svLine.size() );
+			memcpy( &m_Data[ ulWritePos % k_unSize ], &uLength, sizeof( uLength ) );
+			memcpy( &m_Data[ ulWritePos % k_unSize + sizeof( uLength ) ], svLine.data(), svLine.size() );
+
+			m_ulHead.store( ulWritePos + ulRecordSize, std::memory_order_release );
+			return true;
+		}
+
+		template <typename Func>
+		void Drain( Func fnConsume )
+		{
+			const uint64_t ulHead = m_ulHead.load( std::memory_order_acquire );
+			uint64_t ulTail = m_ulTail.load( std::memory_order_relaxed );
+
+			while ( ulTail != ulHead )
+			{
+				const uint64_t ulOffset = ulTail % k_unSize;
+
+				uint32_t uLength;
+				memcpy( &uLength, &m_Data[ ulOffset ], sizeof( uLength ) );
+
+				if ( uLength == k_uWrapMarker )
+				{
+					ulTail += k_unSize - ulOffset;
+					continue;
+				}
+
+				fnConsume( std::string_view{ reinterpret_cast<const char *>( &m_Data[ ulOffset + sizeof( uLength ) ] ), uLength } );
+				ulTail += sizeof( uLength ) + AlignRecord( uLength );
+			}
+
+			m_ulTail.store( ulTail, std::memory_order_release );
+		}
+
+		bool Empty() const
+		{
+			return m_ulHead.load( std::memory_order_acquire ) == m_ulTail.load( std::memory_order_acquire );
+		}
+
+		// Set when the owning thread exits.
+		std::atomic<bool> m_bOrphaned = { false };
+	private:
+		static constexpr uint64_t AlignRecord( uint64_t ulSize )
+		{
+			return ( ulSize + 3 ) & ~uint64_t( 3 );
+		}
+
+		alignas( 64 ) std::atomic<uint64_t> m_ulHead = { 0 };
+		alignas( 64 ) std::atomic<uint64_t> m_ulTail = { 0 };
+		alignas( 64 ) uint8_t m_Data[ k_unSize ];
+	};
+
+	class CAsyncLogger
+	{
+	public:
+		static CAsyncLogger &Get()
+		{
+			// Intentionally leaked, logging can happen
+			// from static destructors.
+			static CAsyncLogger *s_pLogger = new CAsyncLogger;
+			return *s_pLogger;
+		}
+
+		// Returns false if the caller should write the line itself.
+		bool Push( std::string_view svLine )
+		{
+			if ( s_bForkedChild || !cv_log_async )
+				return false;
+
+			CLogRing *pRing = GetThreadRing();
+			if ( !pRing )
+				return false;
+
+			if ( !pRing->Push( svLine ) )
+			{
+				s_ulLogOverflowed.fetch_add( 1, std::memory_order_relaxed );
+				return true;
+			}
+
+			s_ulLogQueued.fetch_add( 1, std::memory_order_relaxed );
+
+			// Only bother waking the logger thread once per batch.
+			if ( !m_bWakeup.exchange( true, std::memory_order_release ) )
+				m_bWakeup.notify_one();
+
+			return true;
+		}
+
+		void Write( std::string_view svLine )
+		{
+			if ( s_bForkedChild )
+			{
+				// Don't touch any of our locks, the logger thread
+				// did not come with us and may have been holding them.
+				fwrite( svLine.data(), 1, svLine.size(), stderr );
+				return;
+			}
+
+			std::unique_lock lock( m_DrainMutex );
+			DrainLocked();
+			fwrite( svLine.data(), 1, svLine.size(), stderr );
+		}
+
+		void Flush()
+		{
+			if ( s_bForkedChild )
+				return;
+
+			std::unique_lock lock( m_DrainMutex );
+			DrainLocked();
+			fflush( stderr );
+		}
+
+	private:
+		CAsyncLogger()
+		{
+			pthread_atfork( nullptr, nullptr, []{ s_bForkedChild = true; } );
+			atexit( []{ CAsyncLogger::Get().Flush(); } );
+
+			std::thread loggerThread( [this]() { this->LoggerThreadFunc(); } );
+			loggerThread.detach();
+		}
+
+		struct ThreadRing_t
+		{
+			~ThreadRing_t()
+			{
+				if ( pRing )
+					pRing->m_bOrphaned.store( true, std::memory_order_release );
+			}
+
+			CLogRing *pRing = nullptr;
+		};
+
+		CLogRing *GetThreadRing()
+		{
+			static thread_local ThreadRing_t s_ThreadRing;
+			if ( !s_ThreadRing.pRing )
+			{
+				CLogRing *pRing = new CLogRing;
+
+				std::unique_lock lock( m_RingsMutex );
+				m_pRings.push_back( pRing );
+				s_ThreadRing.pRing = pRing;
+			}
+
+			return s_ThreadRing.pRing;
+		}
+
+		void DrainLocked()
+		{
+			std::unique_lock lock( m_RingsMutex );
+
+			std::erase_if( m_pRings, [this]( CLogRing *pRing )
+			{
+				// Check before draining so nothing can be pushed after we look.
+				const bool bOrphaned = pRing->m_bOrphaned.load( std::memory_order_acquire );
+
+				pRing->Drain( [this]( std::string_view svLine )
+				{
+					m_sOutput.append( svLine );
+				});
+
+				if ( bOrphaned )
+				{
+					delete pRing;
+					return true;
+				}
+
+				return false;
+			});
+
+			if ( !m_sOutput.empty() )
+			{
+				fwrite( m_sOutput.data(), 1, m_sOutput.size(), stderr );
+				m_sOutput.clear();
+			}
+		}
+
+		void LoggerThreadFunc()
+		{
+			pthread_setname_np( pthread_self(), "gamescope-log" );
+
+			for ( ;; )
+			{
+				m_bWakeup.wait( false, std::memory_order_acquire );
+				m_bWakeup.store( false, std::memory_order_relaxed );
+
+				std::unique_lock lock( m_DrainMutex );
+				DrainLocked();
+				fflush( stderr );
+			}
+		}
+
+		static inline bool s_bForkedChild = false;
+
+		std::atomic<bool> m_bWakeup = { false };
+
+		std::mutex m_DrainMutex;
+		std::string m_sOutput;
+
+		std::mutex m_RingsMutex;
+		std::vector<CLogRing *> m_pRings;
+	};
+
+	static ConCommand cc_log_stats( "log_stats", "Print async logging statistics",
+	[]( std::span<std::string_view> args )
+	{
+		console_log.infof( "queued: %lu, dropped (rate limited): %lu, dropped (queue full): %lu",
+			(unsigned long)s_ulLogQueued.load(),
+			(unsigned long)s_ulLogRateLimited.load(),
+			(unsigned long)s_ulLogOverflowed.load() );
+	});
+}
+
 struct LogConVar_t
 {
 	LogConVar_t( LogScope *pScope, std::string_view psvName, LogPriority eDefaultPriority )
@@ -59,7 +411,7 @@ struct LogConVar_t
 		{ sName, std::string( GetLogName( eDefaultPriority ) ), sDescription,
 			[ pScope ]( gamescope::ConVar<std::string> &cvar )
 		 	{
-				pScope->SetPriority( GetPriorityFromString( cvar ) );
+				pScope->SetPriority( GetPriorityFromString( cvar.Get() ) );
 			},
 		}
 	{
@@ -93,11 +445,39 @@ bool LogScope::Enabled( LogPriority ePriority ) const
 	return ePriority <= m_eMaxPriority;
 }
 
+void LogScope::Flush()
+{
+	gamescope::CAsyncLogger::Get().Flush();
+}
+
 void LogScope::vlogf(enum LogPriority priority, const char *fmt, va_list args)
 {
 	if ( !Enabled( priority ) )
 		return;
 
+	uint32_t uSuppressed = 0;
+	if ( priority > LOG_ERROR && gamescope::ShouldRateLimit( fmt, &uSuppressed ) )
+	{
+		m_ulDroppedMessages.fetch_add( 1, std::memory_order_relaxed );
+		return;
+	}
+
+	// Avoid the allocation for the common case of short messages.
+	char szStackBuf[1024];
+	va_list argsCopy;
+	va_copy( argsCopy, args );
+	int nLength = vsnprintf( szStackBuf, sizeof( szStackBuf ), fmt, argsCopy );
+	va_end( argsCopy );
+
+	if ( nLength < 0 )
+		return;
+
+	if ( size_t( nLength ) < sizeof( szStackBuf ) )
+	{
+		log( priority, std::string_view{ szStackBuf, size_t( nLength ) }, uSuppressed );
+		return;
+	}
+
 	char *buf = nullptr;
 	vasprintf(&buf, fmt, args);
 	if (!buf)
@@ -105,10 +485,15 @@ void LogScope::vlogf(enum LogPriority priority, const char *fmt, va_list args)
 	defer( free(buf); );
 
 	std::string_view svBuf = buf;
-	log(priority, svBuf);
+	log(priority, svBuf, uSuppressed);
 }
 
 void LogScope::log(enum LogPriority priority, std::string_view psvText)
+{
+	log( priority, psvText, 0 );
+}
+
+void LogScope::log(enum LogPriority priority, std::string_view psvText, uint32_t uSuppressed)
 {
 	if ( !Enabled( priority ) )
 		return;
@@ -116,15 +501,44 @@ void LogScope::log(enum LogPriority priority, std::string_view psvText)
 	for (auto& listener : m_LoggingListeners)
 		listener.second( priority, m_psvPrefix, psvText );
 
+	char szLine[4096];
+	char szSuppressed[64] = "";
+	if ( uSuppressed )
+		snprintf( szSuppressed, sizeof( szSuppressed ), " (%u similar messages suppressed)", uSuppressed );
+
 	std::string_view psvLogName = GetLogPriorityText( priority );
+	int nLength;
 	if ( bPrefixEnabled )
-		fprintf(stderr, "[%s] %.*s \e[0;37m%.*s:\e[0m %.*s\n",
+		nLength = snprintf(szLine, sizeof(szLine), "[%s] %.*s \e[0;37m%.*s:\e[0m %.*s%s\n",
 		gamescope::Process::GetProcessName(),
 		(int)psvLogName.size(), psvLogName.data(),
 		(int)this->m_psvPrefix.size(), this->m_psvPrefix.data(),
-		(int)psvText.size(), psvText.data());
+		(int)psvText.size(), psvText.data(),
+		szSuppressed);
 	else
-	 	fprintf(stderr, "%.*s\n", (int)psvText.size(), psvText.data());
+	 	nLength = snprintf(szLine, sizeof(szLine), "%.*s%s\n", (int)psvText.size(), psvText.data(), szSuppressed);
+
+	if ( nLength < 0 )
+		return;
+
+	gamescope::CAsyncLogger &logger = gamescope::CAsyncLogger::Get();
+
+	// Very long lines don't go through the queue.
+	if ( size_t( nLength ) >= sizeof( szLine ) )
+	{
+		std::string sLine = bPrefixEnabled
+			? std::format( "[{}] {} \e[0;37m{}:\e[0m {}{}\n", gamescope::Process::GetProcessName(), psvLogName, m_psvPrefix, psvText, szSuppressed )
+			: std::format( "{}{}\n", psvText, szSuppressed );
+		logger.Write( sLine );
+		return;
+	}
+
+	std::string_view svLine{ szLine, size_t( nLength ) };
+
+	// Errors are written out immediately (after anything queued before them),
+	// as they are frequently followed by an abort.
+	if ( priority <= LOG_ERROR || !logger.Push( svLine ) )
+		logger.Write( svLine );
 }
 
 void LogScope::logf(enum LogPriority priority, const char *fmt, ...) {
@@ -3,9 +3,11 @@
 #include <cstdarg>
 #include <cstdint>
 
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <string_view>
+#include <unordered_map>
 
 #ifdef __GNUC__
 #define ATTRIB_PRINTF(start, end) __attribute__((format(printf, start, end)))
@@ -44,6 +46,12 @@ public:
 
 	void errorf_errno(const char *fmt, ...) ATTRIB_PRINTF(2, 3);
 
+	// Blocks until everything queued for the logger thread
+	// has been written out.
+	static void Flush();
+
+	uint64_t GetDroppedMessages() const { return m_ulDroppedMessages; }
+
 	bool bPrefixEnabled = true;
 
 	using LoggingListenerFunc = std::function<void( LogPriority ePriority, std::string_view psvScope, std::string_view psvText )>;
@@ -52,11 +60,14 @@ public:
 private:
 	void vprintf(enum LogPriority priority, const char *fmt, va_list args) ATTRIB_PRINTF(3, 0);
 	void logf(enum LogPriority priority, const char *fmt, ...) ATTRIB_PRINTF(3, 4);
+	void log(enum LogPriority priority, std::string_view psvText, uint32_t uSuppressed);
 
 	std::string_view m_psvName;
 	std::string_view m_psvPrefix;
 
 	LogPriority m_eMaxPriority = LOG_INFO;
+
+	std::atomic<uint64_t> m_ulDroppedMessages = { 0 };
 	
 	std::unique_ptr<LogConVar_t> m_pEnableConVar;
 };
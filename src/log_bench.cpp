@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "convar.h"
+#include "log.hpp"
+
+static LogScope s_BenchLog( "bench" );
+
+static void SetConVar( std::string_view svName, std::string_view svValue )
+{
+    std::vector<std::string_view> args = { svName, svValue };
+    gamescope::ConCommand::Exec( args );
+}
+
+static void Benchmark_Log_Sync(benchmark::State &state)
+{
+    SetConVar( "log_async", "0" );
+    SetConVar( "log_rate_limit", "0" );
+
+    for (auto _ : state)
+        s_BenchLog.infof( "frame %d took %.2fms", 42, 16.67 );
+
+    LogScope::Flush();
+}
+BENCHMARK(Benchmark_Log_Sync)->Threads(1)->Threads(4);
+
+static void Benchmark_Log_Async(benchmark::State &state)
+{
+    SetConVar( "log_async", "1" );
+    SetConVar( "log_rate_limit", "0" );
+
+    for (auto _ : state)
+        s_BenchLog.infof( "frame %d took %.2fms", 42, 16.67 );
+
+    LogScope::Flush();
+}
+BENCHMARK(Benchmark_Log_Async)->Threads(1)->Threads(4);
+
+static void Benchmark_Log_RateLimited(benchmark::State &state)
+{
+    SetConVar( "log_async", "1" );
+    SetConVar( "log_rate_limit", "100" );
+
+    for (auto _ : state)
+        s_BenchLog.infof( "frame %d took %.2fms", 42, 16.67 );
+
+    LogScope::Flush();
+}
+BENCHMARK(Benchmark_Log_RateLimited)->Threads(1)->Threads(4);
+
+static void Benchmark_Log_Disabled(benchmark::State &state)
+{
+    for (auto _ : state)
+        s_BenchLog.debugf( "frame %d took %.2fms", 42, 16.67 );
+}
+BENCHMARK(Benchmark_Log_Disabled);
+
+int main(int argc, char **argv)
+{
+    // We only care about the cost on the calling thread,
+    // not how fast the terminal is.
+    if ( !freopen( "/dev/null", "w", stderr ) )
+        return 1;
+
+    benchmark::Initialize( &argc, argv );
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -33,6 +33,7 @@
 #include "Utils/Defer.h"
 
 #include "backends.h"
+#include "HeldGamepads.h"
 #include "refresh_rate.h"
 
 #if HAVE_PIPEWIRE
@@ -55,6 +56,9 @@ bool g_bAllowDeferredBackend = false;
 
 // Splitux input device filtering
 std::vector<std::string> g_vecLibInputHoldDevices;
+std::vector<std::string> g_vecHeldGamepadDevices;
+std::vector<std::string> g_vecHeldGamepadMirrors;
+static std::unique_ptr<gamescope::CHeldGamepads> g_pHeldGamepads;
 bool g_bUseLibInputDevices = false;
 bool g_bBackendDisableKeyboard = false;
 bool g_bBackendDisableMouse = false;
@@ -165,6 +169,7 @@ const struct option *gamescope_options = (struct option[]){
 
 	// Splitux input device filtering options
 	{ "libinput-hold-dev", required_argument, nullptr, 0 },
+	{ "held-gamepad-dev", required_argument, nullptr, 0 },
 	{ "backend-disable-keyboard", no_argument, nullptr, 0 },
 	{ "backend-disable-mouse", no_argument, nullptr, 0 },
 
@@ -481,6 +486,19 @@ static float parse_float(const char *str, const char *optionName)
 	}
 }
 
+// Comma-separated device paths
+static void parse_device_list(const char *str, std::vector<std::string> &paths)
+{
+	std::string_view svList = str;
+	while (!svList.empty()) {
+		size_t pos = svList.find(',');
+		std::string_view svPath = svList.substr(0, pos);
+		if (!svPath.empty())
+			paths.emplace_back(svPath);
+		svList = pos == std::string_view::npos ? std::string_view{} : svList.substr(pos + 1);
+	}
+}
+
 struct sigaction handle_signal_action = {};
 
 void ShutdownGamescope()
@@ -836,19 +854,9 @@ int main(int argc, char **argv)
 				} else if (strcmp(opt_name, "keep-alive") == 0) {
 					cv_shutdown_on_primary_child_death = false;
 				} else if (strcmp(opt_name, "libinput-hold-dev") == 0) {
-					// Parse comma-separated device paths
-					std::string paths(optarg);
-					size_t pos = 0;
-					while ((pos = paths.find(',')) != std::string::npos) {
-						std::string path = paths.substr(0, pos);
-						if (!path.empty()) {
-							g_vecLibInputHoldDevices.push_back(path);
-						}
-						paths.erase(0, pos + 1);
-					}
-					if (!paths.empty()) {
-						g_vecLibInputHoldDevices.push_back(paths);
-					}
+					parse_device_list(optarg, g_vecLibInputHoldDevices);
+				} else if (strcmp(opt_name, "held-gamepad-dev") == 0) {
+					parse_device_list(optarg, g_vecHeldGamepadDevices);
 				} else if (strcmp(opt_name, "backend-disable-keyboard") == 0) {
 					g_bBackendDisableKeyboard = true;
 				} else if (strcmp(opt_name, "backend-disable-mouse") == 0) {
@@ -1061,6 +1069,34 @@ int main(int argc, char **argv)
 	if ( g_bExposeWayland )
 		setenv("WAYLAND_DISPLAY", wlserver_get_wl_display_name(), 1);
 
+	if ( !g_vecHeldGamepadDevices.empty() )
+	{
+		g_pHeldGamepads = std::make_unique<gamescope::CHeldGamepads>();
+		if ( !g_pHeldGamepads->Init( g_vecHeldGamepadDevices ) )
+		{
+			fprintf( stderr, "Failed to hold gamepads\n" );
+			return 1;
+		}
+
+		// Point our children at the mirrors rather than the real ones.
+		// They only get to see those, see RestrictChildToMirrors.
+		g_vecHeldGamepadMirrors = g_pHeldGamepads->GetMirrorDevNodes();
+		std::string sMirrors;
+		for ( const std::string &sDevNode : g_vecHeldGamepadMirrors )
+		{
+			if ( !sMirrors.empty() )
+				sMirrors += ':';
+			sMirrors += sDevNode;
+		}
+		if ( !sMirrors.empty() )
+		{
+			setenv( "GAMESCOPE_HELD_GAMEPADS", sMirrors.c_str(), 1 );
+			setenv( "SDL_JOYSTICK_DEVICE", sMirrors.c_str(), 1 );
+			// Otherwise SDL opens the real ones through hidraw, around the grab.
+			setenv( "SDL_JOYSTICK_HIDAPI", "0", 0 );
+		}
+	}
+
 #if HAVE_PIPEWIRE
 	if ( !init_pipewire() )
 	{
@@ -37,6 +37,7 @@ enum class GamescopeUpscaleFilter : uint32_t
     NIS,
     PIXEL,
 
+    DOWNSCALE = 5, // internal, for captures smaller than the layer
     FROM_VIEW = 0xF, // internal
 };
 
@@ -2,54 +2,63 @@
 #include <unistd.h>
 #include <sys/msg.h>
 #include <cstring>
+#include <algorithm>
 
 #include "steamcompmgr.hpp"
 #include "refresh_rate.h"
 #include "main.hpp"
 
+#include "FrameTiming.h"
+#include "mangoapp_gamescope.hpp"
+
 static bool inited = false;
 static int msgid = 0;
+static uint32_t s_uMangoappVersion = 1;
 extern bool g_bAppWantsHDRCached;
 extern uint32_t g_focusedBaseAppId;
 
-struct mangoapp_msg_header {
-    long msg_type;  // Message queue ID, never change
-    uint32_t version;  // for major changes in the way things work //
-} __attribute__((packed));
-
-struct mangoapp_msg_v1 {
-    struct mangoapp_msg_header hdr;
-
-    uint32_t pid;
-    uint64_t app_frametime_ns;
-    uint8_t fsrUpscale;
-    uint8_t fsrSharpness;
-    uint64_t visible_frametime_ns;
-    uint64_t latency_ns;
-    uint32_t outputWidth;
-    uint32_t outputHeight;
-    uint16_t displayRefresh;
-    bool bAppWantsHDR : 1;
-    bool bSteamFocused : 1;
-    char engineName[40];
-    
-    // WARNING: Always ADD fields, never remove or repurpose fields
-} __attribute__((packed)) mangoapp_msg_v1;
+static struct mangoapp_msg_v3 mangoapp_msg;
 
 void init_mangoapp(){
     int key = ftok("mangoapp", 65);
     msgid = msgget(key, 0666 | IPC_CREAT);
-    mangoapp_msg_v1.hdr.msg_type = 1;
-    mangoapp_msg_v1.hdr.version = 1;
-    mangoapp_msg_v1.fsrUpscale = 0;
-    mangoapp_msg_v1.fsrSharpness = 0;
+    mangoapp_msg.v2.v1.hdr.msg_type = MANGOAPP_MSG_TYPE_UPDATE;
+    mangoapp_msg.v2.v1.hdr.version = 1;
+    mangoapp_msg.v2.v1.fsrUpscale = 0;
+    mangoapp_msg.v2.v1.fsrSharpness = 0;
     inited = true;
 }
 
+// Look for mangoapp telling us it can read a newer message version.
+// Don't bother checking every frame, it only changes when mangoapp (re)starts.
+static void mangoapp_poll_hello()
+{
+    static uint32_t s_uUpdateCount = 0;
+    if ( ( s_uUpdateCount++ % 60 ) != 0 )
+        return;
+
+    s_uMangoappVersion = mangoapp_read_hello( msgid, s_uMangoappVersion );
+}
+
+static uint64_t mangoapp_stage_duration( const gamescope::FrameTimingRecord_t &record, gamescope::FrameStage eStage )
+{
+    return record.Stages[ eStage ].ulBegin ? record.Stages[ eStage ].ulDuration : uint64_t(~0ull);
+}
+
+static uint64_t mangoapp_percentile_or_unknown( uint64_t ulValue )
+{
+    return ulValue ? ulValue : uint64_t(~0ull);
+}
+
 void mangoapp_update( uint64_t visible_frametime, uint64_t app_frametime_ns, uint64_t latency_ns ) {
     if (!inited)
         init_mangoapp();
 
+    mangoapp_poll_hello();
+
+    struct mangoapp_msg_v2 &mangoapp_msg_v2 = mangoapp_msg.v2;
+    struct mangoapp_msg_v1 &mangoapp_msg_v1 = mangoapp_msg_v2.v1;
+    mangoapp_msg_v1.hdr.version = s_uMangoappVersion;
     mangoapp_msg_v1.visible_frametime_ns = visible_frametime;
     mangoapp_msg_v1.fsrUpscale = g_bFSRActive;
     mangoapp_msg_v1.fsrSharpness = g_upscaleFilterSharpness;
@@ -66,7 +75,33 @@ void mangoapp_update( uint64_t visible_frametime, uint64_t app_frametime_ns, uin
         focusWindow_engine->copy(mangoapp_msg_v1.engineName, sizeof(mangoapp_msg_v1.engineName) / sizeof(char));
     else
         std::string("gamescope").copy(mangoapp_msg_v1.engineName, sizeof(mangoapp_msg_v1.engineName) / sizeof(char));
-    msgsnd(msgid, &mangoapp_msg_v1, sizeof(mangoapp_msg_v1) - sizeof(mangoapp_msg_v1.hdr.msg_type), IPC_NOWAIT);
+
+    if ( s_uMangoappVersion >= 2 )
+    {
+        gamescope::FrameTimingRecord_t record = gamescope::CFrameTimingRecorder::Get().GetLastRecord();
+        mangoapp_msg_v2.commit_to_latch_ns = record.ulCommitToLatch ? record.ulCommitToLatch : uint64_t(~0ull);
+        mangoapp_msg_v2.compositor_cpu_ns = mangoapp_stage_duration( record, gamescope::FrameStages::PaintAll );
+        mangoapp_msg_v2.gpu_composite_ns = mangoapp_stage_duration( record, gamescope::FrameStages::CompositeGPU );
+        mangoapp_msg_v2.capture_ns = mangoapp_stage_duration( record, gamescope::FrameStages::Capture );
+        mangoapp_msg_v2.bComposited = record.bComposited;
+    }
+
+    if ( s_uMangoappVersion >= 3 )
+    {
+        // These go over the whole history, so don't redo them every frame.
+        static uint32_t s_uPercentileCount = 0;
+        if ( ( s_uPercentileCount++ % 30 ) == 0 )
+        {
+            gamescope::CFrameTimingRecorder &recorder = gamescope::CFrameTimingRecorder::Get();
+            mangoapp_msg.input_to_present_p50_ns = mangoapp_percentile_or_unknown( recorder.GetInputToPresentPercentile( 0.50f ) );
+            mangoapp_msg.input_to_present_p99_ns = mangoapp_percentile_or_unknown( recorder.GetInputToPresentPercentile( 0.99f ) );
+            mangoapp_msg.input_to_capture_p50_ns = mangoapp_percentile_or_unknown( recorder.GetInputToCapturePercentile( 0.50f ) );
+            mangoapp_msg.input_to_capture_p99_ns = mangoapp_percentile_or_unknown( recorder.GetInputToCapturePercentile( 0.99f ) );
+        }
+    }
+
+    size_t msgSize = mangoapp_msg_size( s_uMangoappVersion );
+    msgsnd(msgid, &mangoapp_msg, msgSize - sizeof(mangoapp_msg_v1.hdr.msg_type), IPC_NOWAIT);
 }
 
 extern uint64_t g_uCurrentBasePlaneCommitID;
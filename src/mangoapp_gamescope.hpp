@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/msg.h>
+
+// Messages exchanged between gamescope and mangoapp over the SysV message
+// queue keyed by ftok( "mangoapp", 65 ).
+//
+// gamescope sends mangoapp_msg_v1 until mangoapp says it understands
+// something newer with a mangoapp_hello_msg, so an older mangoapp that
+// only knows v1 keeps working.
+
+enum {
+    // gamescope -> mangoapp
+    MANGOAPP_MSG_TYPE_UPDATE = 1,
+    // mangoapp -> gamescope
+    MANGOAPP_MSG_TYPE_HELLO = 2,
+};
+
+static constexpr uint32_t k_uMangoappMaxVersion = 3;
+
+struct mangoapp_msg_header {
+    long msg_type;  // Message queue ID, never change
+    uint32_t version;  // for major changes in the way things work //
+} __attribute__((packed));
+
+struct mangoapp_msg_v1 {
+    struct mangoapp_msg_header hdr;
+
+    uint32_t pid;
+    uint64_t app_frametime_ns;
+    uint8_t fsrUpscale;
+    uint8_t fsrSharpness;
+    uint64_t visible_frametime_ns;
+    uint64_t latency_ns;
+    uint32_t outputWidth;
+    uint32_t outputHeight;
+    uint16_t displayRefresh;
+    bool bAppWantsHDR : 1;
+    bool bSteamFocused : 1;
+    char engineName[40];
+    
+    // WARNING: Always ADD fields, never remove or repurpose fields
+} __attribute__((packed));
+
+// A strict superset of v1, so a v2 reader can still
+// look at the v1 part the same way.
+struct mangoapp_msg_v2 {
+    struct mangoapp_msg_v1 v1;
+
+    // Per-stage timings of the last frame gamescope finished.
+    // ~0 if not known.
+    uint64_t commit_to_latch_ns;
+    uint64_t compositor_cpu_ns;
+    uint64_t gpu_composite_ns;
+    uint64_t capture_ns;
+    // Whether that frame was composited, as opposed to scanned out directly.
+    bool bComposited : 1;
+
+    // WARNING: Always ADD fields, never remove or repurpose fields
+} __attribute__((packed));
+
+struct mangoapp_msg_v3 {
+    struct mangoapp_msg_v2 v2;
+
+    // Percentiles over gamescope's recent frame history, from input being
+    // delivered to the app to the frame answering it being presented, or
+    // handed to pipewire. ~0 if there haven't been any.
+    uint64_t input_to_present_p50_ns;
+    uint64_t input_to_present_p99_ns;
+    uint64_t input_to_capture_p50_ns;
+    uint64_t input_to_capture_p99_ns;
+
+    // WARNING: Always ADD fields, never remove or repurpose fields
+} __attribute__((packed));
+
+struct mangoapp_hello_msg {
+    long msg_type;  // MANGOAPP_MSG_TYPE_HELLO
+    uint32_t max_version;  // Highest mangoapp_msg version mangoapp can read
+} __attribute__((packed));
+
+// Takes any hellos waiting on the queue, and returns the version to send
+// from now on, uVersion if there weren't any.
+inline uint32_t mangoapp_read_hello( int msgid, uint32_t uVersion )
+{
+    mangoapp_hello_msg hello{};
+    while ( msgrcv( msgid, &hello, sizeof( hello ) - sizeof( hello.msg_type ), MANGOAPP_MSG_TYPE_HELLO, IPC_NOWAIT | MSG_NOERROR ) >= 0 )
+        uVersion = std::clamp<uint32_t>( hello.max_version, 1, k_uMangoappMaxVersion );
+    return uVersion;
+}
+
+// How much of the newest message to send for a given version,
+// msg_type included.
+inline size_t mangoapp_msg_size( uint32_t uVersion )
+{
+    switch ( uVersion )
+    {
+        case 0:
+        case 1:  return sizeof( mangoapp_msg_v1 );
+        case 2:  return sizeof( mangoapp_msg_v2 );
+        default: return sizeof( mangoapp_msg_v3 );
+    }
+}
@@ -0,0 +1,185 @@
+// Round-trips the mangoapp messages through a private SysV message queue,
+// the same way gamescope and mangoapp talk to each other.
+
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "mangoapp_gamescope.hpp"
+#include "test_check.h"
+
+static_assert( offsetof( mangoapp_msg_v2, v1 ) == 0 );
+static_assert( sizeof( mangoapp_msg_v2 ) > sizeof( mangoapp_msg_v1 ) );
+static_assert( offsetof( mangoapp_msg_v3, v2 ) == 0 );
+static_assert( sizeof( mangoapp_msg_v3 ) > sizeof( mangoapp_msg_v2 ) );
+
+static mangoapp_msg_v2 make_v2_msg()
+{
+    mangoapp_msg_v2 msg{};
+    msg.v1.hdr.msg_type = MANGOAPP_MSG_TYPE_UPDATE;
+    msg.v1.hdr.version = 2;
+    msg.v1.pid = 1234;
+    msg.v1.app_frametime_ns = 16'666'666;
+    msg.v1.visible_frametime_ns = 16'600'000;
+    msg.v1.latency_ns = 4'000'000;
+    msg.v1.outputWidth = 1280;
+    msg.v1.outputHeight = 800;
+    msg.v1.displayRefresh = 90;
+    msg.v1.bSteamFocused = true;
+    strncpy( msg.v1.engineName, "DXVK", sizeof( msg.v1.engineName ) );
+    msg.commit_to_latch_ns = 1'200'000;
+    msg.compositor_cpu_ns = 300'000;
+    msg.gpu_composite_ns = 450'000;
+    msg.capture_ns = ~0ull;
+    msg.bComposited = true;
+    return msg;
+}
+
+static void test_v2_round_trip( int msgid )
+{
+    mangoapp_msg_v2 sent = make_v2_msg();
+    TEST_CHECK( msgsnd( msgid, &sent, sizeof( sent ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+
+    mangoapp_msg_v2 recvd{};
+    ssize_t ret = msgrcv( msgid, &recvd, sizeof( recvd ) - sizeof( long ), MANGOAPP_MSG_TYPE_UPDATE, IPC_NOWAIT );
+    TEST_CHECK( ret == ssize_t( sizeof( recvd ) - sizeof( long ) ) );
+    TEST_CHECK( memcmp( &sent, &recvd, sizeof( sent ) ) == 0 );
+    TEST_CHECK( recvd.v1.hdr.version == 2 );
+    TEST_CHECK( recvd.commit_to_latch_ns == 1'200'000 );
+    TEST_CHECK( recvd.capture_ns == ~0ull );
+    TEST_CHECK( recvd.bComposited );
+}
+
+static void test_v3_round_trip( int msgid )
+{
+    mangoapp_msg_v3 sent{};
+    sent.v2 = make_v2_msg();
+    sent.v2.v1.hdr.version = 3;
+    sent.input_to_present_p50_ns = 21'000'000;
+    sent.input_to_present_p99_ns = 34'000'000;
+    sent.input_to_capture_p50_ns = ~0ull;
+    sent.input_to_capture_p99_ns = ~0ull;
+    TEST_CHECK( msgsnd( msgid, &sent, sizeof( sent ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+
+    mangoapp_msg_v3 recvd{};
+    ssize_t ret = msgrcv( msgid, &recvd, sizeof( recvd ) - sizeof( long ), MANGOAPP_MSG_TYPE_UPDATE, IPC_NOWAIT );
+    TEST_CHECK( ret == ssize_t( sizeof( recvd ) - sizeof( long ) ) );
+    TEST_CHECK( memcmp( &sent, &recvd, sizeof( sent ) ) == 0 );
+    TEST_CHECK( recvd.v2.commit_to_latch_ns == 1'200'000 );
+    TEST_CHECK( recvd.input_to_present_p50_ns == 21'000'000 );
+    TEST_CHECK( recvd.input_to_capture_p99_ns == ~0ull );
+}
+
+// A v2 mangoapp reading what a v3 gamescope sends it.
+static void test_v2_reader_sees_v2_prefix( int msgid )
+{
+    mangoapp_msg_v3 sent{};
+    sent.v2 = make_v2_msg();
+    sent.input_to_present_p50_ns = 21'000'000;
+    TEST_CHECK( msgsnd( msgid, &sent, sizeof( sent ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+
+    mangoapp_msg_v2 recvd{};
+    ssize_t ret = msgrcv( msgid, &recvd, sizeof( recvd ) - sizeof( long ), MANGOAPP_MSG_TYPE_UPDATE, IPC_NOWAIT | MSG_NOERROR );
+    TEST_CHECK( ret == ssize_t( sizeof( recvd ) - sizeof( long ) ) );
+    TEST_CHECK( memcmp( &sent.v2, &recvd, sizeof( recvd ) ) == 0 );
+}
+
+// An old mangoapp only reads a v1 sized message.
+static void test_v1_reader_sees_v1_prefix( int msgid )
+{
+    mangoapp_msg_v2 sent = make_v2_msg();
+    TEST_CHECK( msgsnd( msgid, &sent, sizeof( sent ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+
+    mangoapp_msg_v1 recvd{};
+    ssize_t ret = msgrcv( msgid, &recvd, sizeof( recvd ) - sizeof( long ), MANGOAPP_MSG_TYPE_UPDATE, IPC_NOWAIT | MSG_NOERROR );
+    TEST_CHECK( ret == ssize_t( sizeof( recvd ) - sizeof( long ) ) );
+    TEST_CHECK( memcmp( &sent.v1, &recvd, sizeof( recvd ) ) == 0 );
+    TEST_CHECK( strcmp( recvd.engineName, "DXVK" ) == 0 );
+}
+
+// The hello from mangoapp must not be picked up as an update and vice versa.
+static void test_hello( int msgid )
+{
+    mangoapp_hello_msg hello{ MANGOAPP_MSG_TYPE_HELLO, k_uMangoappMaxVersion };
+    TEST_CHECK( msgsnd( msgid, &hello, sizeof( hello ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+
+    mangoapp_msg_v2 update{};
+    TEST_CHECK( msgrcv( msgid, &update, sizeof( update ) - sizeof( long ), MANGOAPP_MSG_TYPE_UPDATE, IPC_NOWAIT ) < 0 );
+
+    mangoapp_hello_msg recvd{};
+    ssize_t ret = msgrcv( msgid, &recvd, sizeof( recvd ) - sizeof( long ), MANGOAPP_MSG_TYPE_HELLO, IPC_NOWAIT | MSG_NOERROR );
+    TEST_CHECK( ret == ssize_t( sizeof( recvd ) - sizeof( long ) ) );
+    TEST_CHECK( recvd.max_version == k_uMangoappMaxVersion );
+}
+
+static void send_hello( int msgid, uint32_t uMaxVersion )
+{
+    mangoapp_hello_msg hello{ MANGOAPP_MSG_TYPE_HELLO, uMaxVersion };
+    TEST_CHECK( msgsnd( msgid, &hello, sizeof( hello ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+}
+
+// What gamescope sends follows what mangoapp last said it can read.
+static void test_negotiation( int msgid )
+{
+    // Nothing said yet, stays on v1.
+    uint32_t uVersion = mangoapp_read_hello( msgid, 1 );
+    TEST_CHECK( uVersion == 1 );
+    TEST_CHECK( mangoapp_msg_size( uVersion ) == sizeof( mangoapp_msg_v1 ) );
+
+    // An update waiting for mangoapp is left alone.
+    mangoapp_msg_v3 update{};
+    update.v2 = make_v2_msg();
+    TEST_CHECK( msgsnd( msgid, &update, sizeof( update ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+
+    send_hello( msgid, 2 );
+    uVersion = mangoapp_read_hello( msgid, uVersion );
+    TEST_CHECK( uVersion == 2 );
+    TEST_CHECK( mangoapp_msg_size( uVersion ) == sizeof( mangoapp_msg_v2 ) );
+
+    mangoapp_msg_v3 recvd{};
+    TEST_CHECK( msgrcv( msgid, &recvd, sizeof( recvd ) - sizeof( long ), MANGOAPP_MSG_TYPE_UPDATE, IPC_NOWAIT ) == ssize_t( sizeof( recvd ) - sizeof( long ) ) );
+
+    // Sending at the negotiated size is all a v2 mangoapp gets.
+    update.v2.v1.hdr.version = uVersion;
+    TEST_CHECK( msgsnd( msgid, &update, mangoapp_msg_size( uVersion ) - sizeof( long ), IPC_NOWAIT ) == 0 );
+    TEST_CHECK( msgrcv( msgid, &recvd, sizeof( recvd ) - sizeof( long ), MANGOAPP_MSG_TYPE_UPDATE, IPC_NOWAIT ) == ssize_t( sizeof( mangoapp_msg_v2 ) - sizeof( long ) ) );
+    TEST_CHECK( recvd.v2.v1.hdr.version == 2 );
+
+    // Newer than us is clamped to what we have, and the last hello wins.
+    send_hello( msgid, 1 );
+    send_hello( msgid, 99 );
+    uVersion = mangoapp_read_hello( msgid, uVersion );
+    TEST_CHECK( uVersion == k_uMangoappMaxVersion );
+    TEST_CHECK( mangoapp_msg_size( uVersion ) == sizeof( mangoapp_msg_v3 ) );
+
+    // A restarted old mangoapp takes it back down.
+    send_hello( msgid, 0 );
+    uVersion = mangoapp_read_hello( msgid, uVersion );
+    TEST_CHECK( uVersion == 1 );
+    TEST_CHECK( mangoapp_msg_size( uVersion ) == sizeof( mangoapp_msg_v1 ) );
+}
+
+int main(int argc, char* argv[])
+{
+    printf("mangoapp_tests\n");
+
+    int msgid = msgget( IPC_PRIVATE, 0600 | IPC_CREAT );
+    if ( msgid < 0 )
+    {
+        perror( "msgget" );
+        return 1;
+    }
+
+    test_v2_round_trip( msgid );
+    test_v3_round_trip( msgid );
+    test_v1_reader_sees_v1_prefix( msgid );
+    test_v2_reader_sees_v2_prefix( msgid );
+    test_hello( msgid );
+    test_negotiation( msgid );
+
+    msgctl( msgid, IPC_RMID, nullptr );
+
+    return TestExitCode();
+}
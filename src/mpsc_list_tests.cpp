@@ -0,0 +1,118 @@
+// Pushes onto a CMpscList from several threads while another drains it,
+// checking everything comes out exactly once, in the order each
+// thread pushed it, and that only a push onto an empty list asks for a wakeup.
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Utils/MpscList.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+struct Item_t
+{
+    uint32_t uProducer;
+    uint32_t uSequence;
+    // Something that has to be moved, not copied, and freed exactly once.
+    std::unique_ptr<uint32_t> pPayload;
+};
+
+static constexpr uint32_t k_uProducers = 4;
+static constexpr uint32_t k_uItemsPerProducer = 20'000;
+
+static void test_basic()
+{
+    CMpscList<Item_t> list;
+    TEST_CHECK( list.IsEmpty() );
+
+    TEST_CHECK( list.Push( Item_t{ 0, 0, std::make_unique<uint32_t>( 0 ) } ) );
+    TEST_CHECK( !list.Push( Item_t{ 0, 1, std::make_unique<uint32_t>( 1 ) } ) );
+    TEST_CHECK( !list.Push( Item_t{ 0, 2, std::make_unique<uint32_t>( 2 ) } ) );
+
+    uint32_t uNext = 0;
+    size_t zCount = list.Drain( [&]( Item_t item )
+    {
+        TEST_CHECK( item.uSequence == uNext );
+        TEST_CHECK( *item.pPayload == uNext );
+        uNext++;
+    });
+    TEST_CHECK( zCount == 3 );
+    TEST_CHECK( list.IsEmpty() );
+
+    TEST_CHECK( list.Push( Item_t{ 0, 3, std::make_unique<uint32_t>( 3 ) } ) );
+    // Left for the destructor to free.
+}
+
+static void test_concurrent()
+{
+    CMpscList<Item_t> list;
+
+    std::atomic<uint32_t> uProducersDone = { 0 };
+    std::atomic<uint32_t> uWakeups = { 0 };
+
+    std::vector<std::thread> producers;
+    for ( uint32_t i = 0; i < k_uProducers; i++ )
+    {
+        producers.emplace_back( [&, i]()
+        {
+            for ( uint32_t j = 0; j < k_uItemsPerProducer; j++ )
+            {
+                if ( list.Push( Item_t{ i, j, std::make_unique<uint32_t>( i * k_uItemsPerProducer + j ) } ) )
+                    uWakeups++;
+
+                if ( j % 64 == 0 )
+                    std::this_thread::yield();
+            }
+            uProducersDone++;
+        });
+    }
+
+    std::vector<uint32_t> nextSequence( k_uProducers, 0 );
+    uint32_t uOutOfOrder = 0;
+    uint32_t uBadPayload = 0;
+    uint32_t uDrained = 0;
+    uint32_t uDrains = 0;
+
+    auto fnConsume = [&]( Item_t item )
+    {
+        if ( item.uSequence != nextSequence[ item.uProducer ] )
+            uOutOfOrder++;
+        if ( *item.pPayload != item.uProducer * k_uItemsPerProducer + item.uSequence )
+            uBadPayload++;
+        nextSequence[ item.uProducer ] = item.uSequence + 1;
+        uDrained++;
+    };
+
+    while ( uProducersDone != k_uProducers )
+    {
+        if ( list.Drain( fnConsume ) )
+            uDrains++;
+        std::this_thread::yield();
+    }
+    list.Drain( fnConsume );
+
+    for ( std::thread &thread : producers )
+        thread.join();
+
+    TEST_CHECK( uDrained == k_uProducers * k_uItemsPerProducer );
+    TEST_CHECK( uOutOfOrder == 0 );
+    TEST_CHECK( uBadPayload == 0 );
+    // Every drain that found something was preceded by a push that asked
+    // for a wakeup, and no more of those than that, plus the final one.
+    TEST_CHECK( uWakeups >= uDrains );
+    TEST_CHECK( uWakeups <= uDrains + 1 );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "mpsc_list_tests\n" );
+
+    test_basic();
+    test_concurrent();
+
+    return TestExitCode();
+}
@@ -1,17 +1,25 @@
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <linux/dma-buf.h>
 #include <poll.h>
 #include <stdio.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <vector>
 
 #include "main.hpp"
 #include "pipewire.hpp"
 #include "log.hpp"
+#include "convar.h"
+#include "steamcompmgr.hpp"
+#include "PipewireBufferPool.h"
+#include "Utils/PlaneCopy.h"
 
 #include <spa/debug/format.h>
 
@@ -25,6 +33,17 @@ static struct pipewire_state pipewire_state = { .stream_node_id = SPA_ID_INVALID
 // loop thread (add_buffer/remove_buffer), read from the steamcompmgr thread.
 static std::atomic<int> s_nConsumerBuffers{0};
 
+// Bytes held by capture textures and shm for the current pool, for pipewire_stats.
+static std::atomic<uint64_t> s_ulPoolBytes{0};
+
+gamescope::ConVar<uint32_t> cv_pipewire_buffers_min( "pipewire_buffers_min", 4, "Buffers to start a PipeWire stream with, the pool grows from here when the consumer starves us." );
+gamescope::ConVar<uint32_t> cv_pipewire_buffers_max( "pipewire_buffers_max", 48, "Most buffers the PipeWire pool may grow to." );
+
+gamescope::ConVar<bool> cv_pipewire_memfd_zero_copy( "pipewire_memfd_zero_copy", true, "Hand MemFd PipeWire consumers the capture texture's memory directly when its layout matches, instead of copying it out." );
+
+// Only touched with the thread-loop lock held.
+static gamescope::CPipewireBufferPoolSizer s_PoolSizer{ 4, 48 };
+
 // Requested capture size
 static uint32_t s_nRequestedWidth;
 static uint32_t s_nRequestedHeight;
@@ -33,6 +52,41 @@ static uint32_t s_nCaptureHeight;
 static uint32_t s_nOutputWidth;
 static uint32_t s_nOutputHeight;
 
+static bool dma_buf_sync(int fd, uint64_t flags)
+{
+	struct dma_buf_sync sync = { .flags = flags };
+	int ret;
+	do {
+		ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+	return ret == 0;
+}
+
+// Zero-copy MemFd buffers are read by the consumer through its own mmap of
+// the dma-buf, so they're bracketed with DMA_BUF_IOCTL_SYNC like any CPU
+// access to one: started when queued to the consumer, ended when the buffer
+// comes back to us to render into.
+static void begin_consumer_read(struct pipewire_buffer *buffer)
+{
+	if (buffer->type != SPA_DATA_MemFd || !buffer->shm.zero_copy || buffer->shm.consumer_reading)
+		return;
+
+	if (dma_buf_sync(buffer->shm.fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ))
+		buffer->shm.consumer_reading = true;
+	else
+		pwr_log.errorf_errno("DMA_BUF_SYNC_START failed");
+}
+
+static void end_consumer_read(struct pipewire_buffer *buffer)
+{
+	if (buffer->type != SPA_DATA_MemFd || !buffer->shm.consumer_reading)
+		return;
+
+	if (!dma_buf_sync(buffer->shm.fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ))
+		pwr_log.errorf_errno("DMA_BUF_SYNC_END failed");
+	buffer->shm.consumer_reading = false;
+}
+
 static void destroy_buffer(struct pipewire_buffer *buffer) {
 	// The ownership protocol (every pool call under the thread-loop lock +
 	// in_producer) now guarantees a buffer is freed exactly once, with its
@@ -47,6 +101,12 @@ static void destroy_buffer(struct pipewire_buffer *buffer) {
 	switch (buffer->type) {
 	case SPA_DATA_MemFd:
 	{
+		if (buffer->shm.zero_copy) {
+			end_consumer_read(buffer);
+			close(buffer->shm.fd);
+			break;
+		}
+
 		off_t size = buffer->shm.stride * buffer->video_info.size.height;
 		if (buffer->video_info.format == SPA_VIDEO_FORMAT_NV12) {
 			size += buffer->shm.stride * ((buffer->video_info.size.height + 1) / 2);
@@ -62,6 +122,8 @@ static void destroy_buffer(struct pipewire_buffer *buffer) {
 		return;
 	}
 
+	s_ulPoolBytes.fetch_sub(buffer->pool_bytes, std::memory_order_relaxed);
+
 	delete buffer;
 }
 
@@ -87,6 +149,11 @@ static void calculate_capture_size()
 			s_nCaptureWidth = static_cast<uint32_t>(ceilf(flRatioH * s_nOutputWidth));
 			s_nCaptureHeight = s_nRequestedHeight;
 		}
+
+		// NV12 needs even dimensions, and odd requests (or odd results of
+		// the aspect maths above) would otherwise fail to allocate.
+		s_nCaptureWidth = std::max(s_nCaptureWidth & ~1u, 2u);
+		s_nCaptureHeight = std::max(s_nCaptureHeight & ~1u, 2u);
 	}
 }
 
@@ -225,34 +292,28 @@ static void copy_buffer(struct pipewire_state *state, struct pipewire_buffer *bu
 		}
 		chunk->stride = buffer->shm.stride;
 
-		if (!needs_reneg) {
+		if (!needs_reneg && !buffer->shm.zero_copy) {
 			uint8_t *pMappedData = tex->mappedData();
+			const size_t stride = buffer->shm.stride;
 
 			if (state->video_info.format == SPA_VIDEO_FORMAT_NV12) {
-				for (uint32_t i = 0; i < tex->height(); i++) {
-					const uint32_t lumaPwOffset = 0;
-					memcpy(
-						&buffer->shm.data[lumaPwOffset      + i * buffer->shm.stride],
-						&pMappedData     [tex->lumaOffset() + i * tex->lumaRowPitch()],
-						std::min<size_t>(buffer->shm.stride, tex->lumaRowPitch()));
-				}
-
-				for (uint32_t i = 0; i < (tex->height() + 1) / 2; i++) {
-					const uint32_t chromaPwOffset = tex->height() * buffer->shm.stride;
-					memcpy(
-						&buffer->shm.data[chromaPwOffset      + i * buffer->shm.stride],
-						&pMappedData     [tex->chromaOffset() + i * tex->chromaRowPitch()],
-						std::min<size_t>(buffer->shm.stride, tex->chromaRowPitch()));
-				}
+				const size_t chromaPwOffset = tex->height() * stride;
+
+				gamescope::CopyPlane(
+					&buffer->shm.data[0], stride,
+					&pMappedData[tex->lumaOffset()], tex->lumaRowPitch(),
+					std::min<size_t>(stride, tex->lumaRowPitch()), tex->height());
+				gamescope::CopyPlane(
+					&buffer->shm.data[chromaPwOffset], stride,
+					&pMappedData[tex->chromaOffset()], tex->chromaRowPitch(),
+					std::min<size_t>(stride, tex->chromaRowPitch()), (tex->height() + 1) / 2);
 			}
 			else
 			{
-				for (uint32_t i = 0; i < tex->height(); i++) {
-					memcpy(
-						&buffer->shm.data[i * buffer->shm.stride],
-						&pMappedData     [i * tex->rowPitch()],
-						std::min<size_t>(buffer->shm.stride, tex->rowPitch()));
-				}
+				gamescope::CopyPlane(
+					&buffer->shm.data[0], stride,
+					&pMappedData[0], tex->rowPitch(),
+					std::min<size_t>(stride, tex->rowPitch()), tex->height());
 			}
 		}
 		break;
@@ -302,47 +363,22 @@ static void stream_handle_state_changed(void *data, enum pw_stream_state old_str
 	}
 }
 
-static void stream_handle_param_changed(void *data, uint32_t id, const struct spa_pod *param)
+// (Re)announce the buffer pool we want, sized by s_PoolSizer. PipeWire
+// reallocates every buffer when this changes. Must be called with the
+// thread-loop lock held, returns the size of each shm buffer.
+static int update_buffer_params_locked(struct pipewire_state *state)
 {
-	struct pipewire_state *state = (struct pipewire_state *) data;
-
-	if (param == nullptr || id != SPA_PARAM_Format)
-		return;
-
-	struct spa_gamescope gamescope_info{};
-
-	int ret = spa_format_video_raw_parse_with_gamescope(param, &state->video_info, &gamescope_info);
-	if (ret < 0) {
-		pwr_log.errorf("spa_format_video_raw_parse failed");
-		return;
-	}
-	s_nRequestedWidth = gamescope_info.requested_size.width;
-	s_nRequestedHeight = gamescope_info.requested_size.height;
-	calculate_capture_size();
-
-	state->gamescope_info = gamescope_info;
-
-	int bpp = 4;
-	if (state->video_info.format == SPA_VIDEO_FORMAT_NV12) {
-		bpp = 1;
-	}
-
-	state->shm_stride = SPA_ROUND_UP_N(state->video_info.size.width * bpp, 4);
-
-	const struct spa_pod_prop *modifier_prop = spa_pod_find_prop(param, nullptr, SPA_FORMAT_VIDEO_modifier);
-	state->dmabuf = modifier_prop != nullptr;
-
 	uint8_t buf[1024];
 	struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(buf, sizeof(buf));
 
-	// 48 (range max 64): in-flight buffer depth scales with capture fps. At the
-	// 200fps tier the producer's render depth plus a zero-copy consumer
-	// (splitux-together seat-streamer, va+always-copy) holding frames briefly
-	// can otherwise starve capture ("out of buffers") and throttle the stream.
-	// The SPA_POD_CHOICE_RANGE_Int max silently caps any larger request, so it
-	// must be raised in lockstep. 48 dmabufs @1080p NV12 ≈ 160MB. min=1 lets
-	// reneg shrink the pool.
-	int buffers = 48;
+	// Each buffer is a full capture texture (48 dmabufs @1080p NV12 ≈ 160MB),
+	// so start from a handful and let s_PoolSizer grow it if the consumer
+	// starves us, eg. a 200fps producer feeding a zero-copy encoder that holds
+	// frames for a while. The SPA_POD_CHOICE_RANGE_Int max silently caps any
+	// larger request, so it follows pipewire_buffers_max. min=1 lets reneg
+	// shrink the pool.
+	int buffers = s_PoolSizer.GetTarget();
+	int max_buffers = std::max<int>(buffers, cv_pipewire_buffers_max);
 	int shm_size = state->shm_stride * state->video_info.size.height;
 	if (state->video_info.format == SPA_VIDEO_FORMAT_NV12) {
 		shm_size += ((state->video_info.size.height + 1) / 2) * state->shm_stride;
@@ -352,7 +388,7 @@ static void stream_handle_param_changed(void *data, uint32_t id, const struct sp
 	const struct spa_pod *buffers_param =
 		(const struct spa_pod *) spa_pod_builder_add_object(&builder,
 		SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
-		SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(buffers, 1, 64),
+		SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(buffers, 1, max_buffers),
 		SPA_PARAM_BUFFERS_blocks, SPA_POD_Int(1),
 		SPA_PARAM_BUFFERS_size, SPA_POD_Int(shm_size),
 		SPA_PARAM_BUFFERS_stride, SPA_POD_Int(state->shm_stride),
@@ -369,11 +405,47 @@ static void stream_handle_param_changed(void *data, uint32_t id, const struct sp
 		SPA_PARAM_META_size, SPA_POD_Int(sizeof(float)));
 	const struct spa_pod *params[] = { buffers_param, meta_param, scale_param };
 
-	ret = pw_stream_update_params(state->stream, params, sizeof(params) / sizeof(params[0]));
+	int ret = pw_stream_update_params(state->stream, params, sizeof(params) / sizeof(params[0]));
 	if (ret != 0) {
 		pwr_log.errorf("pw_stream_update_params failed");
 	}
 
+	return shm_size;
+}
+
+static void stream_handle_param_changed(void *data, uint32_t id, const struct spa_pod *param)
+{
+	struct pipewire_state *state = (struct pipewire_state *) data;
+
+	if (param == nullptr || id != SPA_PARAM_Format)
+		return;
+
+	struct spa_gamescope gamescope_info{};
+
+	int ret = spa_format_video_raw_parse_with_gamescope(param, &state->video_info, &gamescope_info);
+	if (ret < 0) {
+		pwr_log.errorf("spa_format_video_raw_parse failed");
+		return;
+	}
+	s_nRequestedWidth = gamescope_info.requested_size.width;
+	s_nRequestedHeight = gamescope_info.requested_size.height;
+	calculate_capture_size();
+
+	state->gamescope_info = gamescope_info;
+
+	int bpp = 4;
+	if (state->video_info.format == SPA_VIDEO_FORMAT_NV12) {
+		bpp = 1;
+	}
+
+	state->shm_stride = SPA_ROUND_UP_N(state->video_info.size.width * bpp, 4);
+
+	const struct spa_pod_prop *modifier_prop = spa_pod_find_prop(param, nullptr, SPA_FORMAT_VIDEO_modifier);
+	state->dmabuf = modifier_prop != nullptr;
+
+	s_PoolSizer.SetLimits(cv_pipewire_buffers_min, cv_pipewire_buffers_max);
+	int shm_size = update_buffer_params_locked(state);
+
 	pwr_log.debugf("format changed (size: %dx%d, requested %dx%d, format %d, stride %d, size: %d, dmabuf: %d)",
 		state->video_info.size.width, state->video_info.size.height,
 		s_nRequestedWidth, s_nRequestedHeight,
@@ -421,6 +493,72 @@ uint32_t spa_format_to_drm(uint32_t spa_format)
 	}
 }
 
+// If the capture texture's memory is laid out exactly like the shm buffer we
+// advertised, hand its fd to the consumer as the MemFd and skip copy_buffer's
+// copy entirely. The consumer only gets the buffer after the capture's GPU
+// work has been waited on, so it never sees a partial frame, and its reads
+// are bracketed by begin_consumer_read/end_consumer_read.
+static bool share_texture_as_memfd(struct pipewire_state *state, struct pipewire_buffer *buffer, struct spa_data *spa_data)
+{
+	CVulkanTexture *tex = buffer->texture.get();
+	const struct wlr_dmabuf_attributes dmabuf = tex->dmabuf();
+	if (dmabuf.n_planes != 1 || dmabuf.fd[0] < 0)
+		return false;
+
+	const uint32_t stride = state->shm_stride;
+	const uint32_t height = state->video_info.size.height;
+	uint32_t size = stride * height;
+	if (state->video_info.format == SPA_VIDEO_FORMAT_NV12) {
+		if (tex->lumaRowPitch() != stride || tex->chromaRowPitch() != stride ||
+		    tex->lumaOffset() != dmabuf.offset[0] ||
+		    tex->chromaOffset() != tex->lumaOffset() + stride * height)
+			return false;
+		size += stride * ((height + 1) / 2);
+	} else {
+		if (tex->rowPitch() != stride || dmabuf.offset[0] != 0)
+			return false;
+	}
+
+	off_t fd_size = lseek(dmabuf.fd[0], 0, SEEK_END);
+	if (fd_size < 0 || fd_size < off_t(dmabuf.offset[0]) + size)
+		return false;
+
+	// Not every driver lets dma-bufs be mmapped, and a consumer
+	// asking for MemFd is going to.
+	void *data = mmap(nullptr, fd_size, PROT_READ, MAP_SHARED, dmabuf.fd[0], 0);
+	if (data == MAP_FAILED)
+		return false;
+	munmap(data, fd_size);
+
+	// Without DMA_BUF_IOCTL_SYNC we can't keep the consumer's view
+	// coherent, copy out instead.
+	if (!dma_buf_sync(dmabuf.fd[0], DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ) ||
+	    !dma_buf_sync(dmabuf.fd[0], DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ))
+		return false;
+
+	int fd = fcntl(dmabuf.fd[0], F_DUPFD_CLOEXEC, 0);
+	if (fd < 0) {
+		pwr_log.errorf_errno("failed to dup capture texture fd");
+		return false;
+	}
+
+	buffer->type = SPA_DATA_MemFd;
+	buffer->shm.stride = stride;
+	buffer->shm.data = nullptr;
+	buffer->shm.fd = fd;
+	buffer->shm.zero_copy = true;
+	buffer->shm.consumer_reading = false;
+
+	spa_data->type = SPA_DATA_MemFd;
+	spa_data->flags = SPA_DATA_FLAG_READABLE;
+	spa_data->fd = fd;
+	spa_data->mapoffset = dmabuf.offset[0];
+	spa_data->maxsize = size;
+	spa_data->data = nullptr;
+
+	return true;
+}
+
 static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffer)
 {
 	struct pipewire_state *state = (struct pipewire_state *) user_data;
@@ -473,7 +611,7 @@ static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffe
 	screenshotImageFlags.bMappable = true;
 	screenshotImageFlags.bTransferDst = true;
 	screenshotImageFlags.bStorage = true;
-	if (is_dmabuf || drmFormat == DRM_FORMAT_NV12)
+	if (is_dmabuf || drmFormat == DRM_FORMAT_NV12 || (is_memfd && cv_pipewire_memfd_zero_copy))
 	{
 		screenshotImageFlags.bExportable = true;
 		screenshotImageFlags.bLinear = true; // TODO: support multi-planar DMA-BUF export via PipeWire
@@ -508,6 +646,8 @@ static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffe
 		spa_data->mapoffset = dmabuf.offset[0];
 		spa_data->maxsize = size;
 		spa_data->data = nullptr;
+	} else if (is_memfd && cv_pipewire_memfd_zero_copy && share_texture_as_memfd(state, buffer, spa_data)) {
+		pwr_log.debugf("sharing capture texture with the consumer directly");
 	} else if (is_memfd) {
 		int fd = anonymous_shm_open();
 		if (fd < 0) {
@@ -551,6 +691,11 @@ static void stream_handle_add_buffer(void *user_data, struct pw_buffer *pw_buffe
 
 	pw_buffer->user_data = buffer;
 
+	buffer->pool_bytes = buffer->texture->totalSize();
+	if (buffer->type == SPA_DATA_MemFd && !buffer->shm.zero_copy)
+		buffer->pool_bytes += spa_data->maxsize;
+	s_ulPoolBytes.fetch_add(buffer->pool_bytes, std::memory_order_relaxed);
+
 	s_nConsumerBuffers.fetch_add(1, std::memory_order_relaxed);
 
 	return;
@@ -735,9 +880,21 @@ struct pipewire_buffer *pipewire_dequeue_buffer(void)
 	pw_thread_loop_lock(state->thread_loop);
 	maybe_renegotiate_size_locked(state);
 	struct pw_buffer *pw_buffer = pw_stream_dequeue_buffer(state->stream);
+
+	// Only count starvation once buffers are flowing, the PAUSED bootstrap
+	// and a reallocation in progress both legitimately have none.
+	if (state->streaming && pipewire_has_consumer()) {
+		s_PoolSizer.SetLimits(cv_pipewire_buffers_min, cv_pipewire_buffers_max);
+		if (s_PoolSizer.OnDequeue(pw_buffer == nullptr, get_time_in_nanos())) {
+			pwr_log.debugf("resizing buffer pool to %u buffers", s_PoolSizer.GetTarget());
+			update_buffer_params_locked(state);
+		}
+	}
+
 	if (pw_buffer) {
 		buffer = (struct pipewire_buffer *) pw_buffer->user_data;
 		buffer->in_producer = true;
+		end_consumer_read(buffer);
 	} else {
 		// Pool momentarily drained: above the consumer's recycle rate (e.g. a
 		// 200fps producer vs a ~130fps encoder) the in-flight buffers can all be
@@ -778,6 +935,7 @@ void pipewire_submit_buffer(struct pipewire_buffer *buffer)
 	}
 
 	copy_buffer(state, buffer);
+	begin_consumer_read(buffer);
 
 	int ret = pw_stream_queue_buffer(state->stream, buffer->buffer);
 	if (ret < 0) {
@@ -793,3 +951,26 @@ void pipewire_submit_buffer(struct pipewire_buffer *buffer)
 
 	pw_thread_loop_unlock(state->thread_loop);
 }
+
+static gamescope::ConCommand cc_pipewire_stats("pipewire_stats", "Print the PipeWire buffer pool size and memory use.",
+[](std::span<std::string_view> args)
+{
+	struct pipewire_state *state = &pipewire_state;
+	if (!state->thread_loop) {
+		console_log.infof("PipeWire is not running");
+		return;
+	}
+
+	pw_thread_loop_lock(state->thread_loop);
+	uint32_t target = s_PoolSizer.GetTarget();
+	uint64_t starved = s_PoolSizer.GetStarvedCount();
+	uint32_t grow_cap = s_PoolSizer.GetGrowCap();
+	pw_thread_loop_unlock(state->thread_loop);
+
+	console_log.infof("buffers: %d (target %u, min %u, max %u), pool: %.1f MiB, starved dequeues: %lu",
+		s_nConsumerBuffers.load(), target,
+		(uint32_t)cv_pipewire_buffers_min, (uint32_t)cv_pipewire_buffers_max,
+		s_ulPoolBytes.load() / (1024.0 * 1024.0), starved);
+	if (grow_cap)
+		console_log.infof("consumer is slower than us, not growing past %u buffers", grow_cap);
+});
@@ -45,6 +45,13 @@ struct pipewire_buffer {
 		int stride;
 		uint8_t *data;
 		int fd;
+		// fd is the texture's own memory, with the same layout PipeWire
+		// expects, so the consumer reads it directly and there is no copy.
+		// data is nullptr in that case.
+		bool zero_copy;
+		// Between DMA_BUF_SYNC_START and _END for the consumer's reads
+		// of a zero_copy fd, while it's queued to them.
+		bool consumer_reading;
 	} shm;
 
 	// The PipeWire buffer, or nullptr if remove_buffer has detached it. Only
@@ -56,6 +63,9 @@ struct pipewire_buffer {
 	// runs its GPU work with the lock released, so remove_buffer consults this
 	// flag to decide free-now vs defer-to-producer.
 	bool in_producer;
+
+	// Texture + shm bytes this buffer adds to the pool.
+	uint64_t pool_bytes;
 };
 
 bool init_pipewire(void);
@@ -0,0 +1,171 @@
+// Checks how CPipewireBufferPoolSizer sizes the PipeWire buffer pool
+// for consumers that keep up and consumers that hold on to frames.
+//
+// The consumer is simulated rather than a PipeWire daemon: a 200fps producer,
+// and a consumer that hands each buffer back after a fixed hold time,
+// either all at once or one after the other.
+// A dequeue starves when every buffer in the pool is still held.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+
+#include "PipewireBufferPool.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+static constexpr uint64_t k_ulFrameTime = 1'000'000'000ul / 200;
+static constexpr uint64_t k_ulSecond = 1'000'000'000ul;
+
+struct SimResult_t
+{
+    uint64_t ulStarved = 0;
+    uint32_t uResizes = 0;
+    uint32_t uPeakTarget = 0;
+};
+
+class CSimulatedStream
+{
+public:
+    CSimulatedStream( uint32_t uMin, uint32_t uMax )
+        : m_Sizer{ uMin, uMax }
+    {
+    }
+
+    // bSerial: the consumer works on one buffer at a time, so can't take
+    // more than one every ulHoldTime, however many buffers it has.
+    SimResult_t Run( uint64_t ulHoldTime, uint64_t ulDuration, bool bSerial = false )
+    {
+        SimResult_t result;
+
+        const uint64_t ulEnd = m_ulNow + ulDuration;
+        for ( ; m_ulNow < ulEnd; m_ulNow += k_ulFrameTime )
+        {
+            while ( !m_ulReleaseTimes.empty() && m_ulReleaseTimes.front() <= m_ulNow )
+                m_ulReleaseTimes.pop_front();
+
+            bool bStarved = m_ulReleaseTimes.size() >= m_Sizer.GetTarget();
+            if ( m_Sizer.OnDequeue( bStarved, m_ulNow ) )
+            {
+                // PipeWire reallocates the lot, the consumer loses what it held.
+                m_ulReleaseTimes.clear();
+                result.uResizes++;
+            }
+
+            if ( bStarved )
+                result.ulStarved++;
+            else if ( bSerial && !m_ulReleaseTimes.empty() )
+                m_ulReleaseTimes.push_back( m_ulReleaseTimes.back() + ulHoldTime );
+            else
+                m_ulReleaseTimes.push_back( m_ulNow + ulHoldTime );
+
+            result.uPeakTarget = std::max( result.uPeakTarget, m_Sizer.GetTarget() );
+        }
+
+        return result;
+    }
+
+    uint32_t GetTarget() const { return m_Sizer.GetTarget(); }
+
+private:
+    CPipewireBufferPoolSizer m_Sizer;
+    std::deque<uint64_t> m_ulReleaseTimes;
+    uint64_t m_ulNow = 1;
+};
+
+static void test_fast_consumer_stays_small()
+{
+    CSimulatedStream stream{ 4, 48 };
+
+    // Hands every frame back well within a frame.
+    SimResult_t result = stream.Run( k_ulFrameTime / 2, 60 * k_ulSecond );
+
+    TEST_CHECK( result.ulStarved == 0 );
+    TEST_CHECK( result.uResizes == 0 );
+    TEST_CHECK( stream.GetTarget() == 4 );
+}
+
+static void test_slow_consumer_grows()
+{
+    CSimulatedStream stream{ 4, 48 };
+
+    // Holds 100ms worth, 20 frames, eg. an encoder with a deep queue.
+    stream.Run( 100'000'000ul, 10 * k_ulSecond );
+    TEST_CHECK( stream.GetTarget() > 20 );
+
+    // Then hardly ever starves us, only when probing whether it can shrink.
+    SimResult_t result = stream.Run( 100'000'000ul, 30 * k_ulSecond );
+    TEST_CHECK( result.ulStarved < 50 );
+}
+
+static void test_shrinks_when_consumer_speeds_up()
+{
+    CSimulatedStream stream{ 4, 48 };
+
+    stream.Run( 100'000'000ul, 10 * k_ulSecond );
+    const uint32_t uGrownTarget = stream.GetTarget();
+    TEST_CHECK( uGrownTarget > 20 );
+
+    SimResult_t result = stream.Run( k_ulFrameTime / 2, 120 * k_ulSecond );
+    TEST_CHECK( result.ulStarved == 0 );
+    TEST_CHECK( stream.GetTarget() == 4 );
+}
+
+static void test_capped_at_max()
+{
+    CSimulatedStream stream{ 4, 16 };
+
+    // Would want 200 buffers.
+    SimResult_t result = stream.Run( k_ulSecond, 30 * k_ulSecond );
+    TEST_CHECK( result.uPeakTarget == 16 );
+    TEST_CHECK( stream.GetTarget() == 16 );
+}
+
+static void test_doesnt_thrash()
+{
+    CSimulatedStream stream{ 4, 48 };
+
+    // Needs 11 buffers. Shrinking below that starves us again,
+    // which should back the shrinking off rather than keep cycling.
+    // Probing every k_ulShrinkDelay would be 120 resizes over 10 minutes.
+    stream.Run( 50'000'000ul, 10 * k_ulSecond );
+    SimResult_t result = stream.Run( 50'000'000ul, 10 * 60 * k_ulSecond );
+
+    TEST_CHECK( stream.GetTarget() >= 10 );
+    TEST_CHECK( result.uResizes < 20 );
+    TEST_CHECK( result.ulStarved < 100 );
+}
+
+static void test_steady_slow_consumer_doesnt_grow()
+{
+    CSimulatedStream stream{ 4, 48 };
+
+    // Only manages 100fps of our 200. It starves us half the time
+    // however many buffers it has, so growing is tried once and undone.
+    SimResult_t result = stream.Run( 10'000'000ul, 60 * k_ulSecond, true );
+
+    TEST_CHECK( stream.GetTarget() == 4 );
+    TEST_CHECK( result.uPeakTarget <= 6 );
+    TEST_CHECK( result.uResizes <= 2 );
+
+    // Then starts keeping up, but holds on to frames for 50ms,
+    // which more buffers do help with.
+    stream.Run( 50'000'000ul, 10 * k_ulSecond );
+    TEST_CHECK( stream.GetTarget() >= 10 );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "pipewire_buffer_pool_tests\n" );
+
+    test_fast_consumer_stays_small();
+    test_slow_consumer_grows();
+    test_shrinks_when_consumer_speeds_up();
+    test_capped_at_max();
+    test_doesnt_thrash();
+    test_steady_slow_consumer_doesnt_grow();
+
+    return TestExitCode();
+}
@@ -0,0 +1,82 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Utils/PixelUnpack.h"
+
+using namespace gamescope;
+
+// A screenshot readback, converted into what the AVIF and PNG encoders
+// take, like the screenshot workers do before encoding.
+//
+// The source here is ordinary cached memory, where the per-pixel
+// versions are at their best.
+struct Screenshot_t
+{
+    Screenshot_t( size_t zWidth, size_t zHeight )
+        : zWidth{ zWidth }
+        , zHeight{ zHeight }
+        , zSrcStride{ ( zWidth * 4 + 255 ) & ~size_t( 255 ) }
+        , Src( zSrcStride * zHeight, 0x55 )
+        , Dst( zWidth * zHeight * 4 )
+    {
+    }
+
+    size_t zWidth;
+    size_t zHeight;
+    size_t zSrcStride;
+    std::vector<uint8_t> Src;
+    // Big enough for three 16-bit planes, or one RGBA8 image.
+    std::vector<uint16_t> Dst;
+};
+
+template <auto fnUnpack>
+static void UnpackAVIF( benchmark::State &state )
+{
+    Screenshot_t shot{ size_t( state.range( 0 ) ), size_t( state.range( 1 ) ) };
+
+    const size_t zPlaneSize = shot.zWidth * shot.zHeight;
+    const size_t zPlaneStride = shot.zWidth * sizeof( uint16_t );
+
+    for ( auto _ : state )
+    {
+        fnUnpack(
+            shot.Dst.data() + zPlaneSize * 2, zPlaneStride,
+            shot.Dst.data(), zPlaneStride,
+            shot.Dst.data() + zPlaneSize, zPlaneStride,
+            shot.Src.data(), shot.zSrcStride, uint32_t( shot.zWidth ), uint32_t( shot.zHeight ) );
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed( int64_t( state.iterations() ) * int64_t( shot.zWidth * shot.zHeight ) );
+}
+
+template <auto fnSwizzle>
+static void SwizzlePNG( benchmark::State &state )
+{
+    Screenshot_t shot{ size_t( state.range( 0 ) ), size_t( state.range( 1 ) ) };
+
+    for ( auto _ : state )
+    {
+        fnSwizzle(
+            reinterpret_cast<uint8_t *>( shot.Dst.data() ), shot.zWidth * 4,
+            shot.Src.data(), shot.zSrcStride, uint32_t( shot.zWidth ), uint32_t( shot.zHeight ) );
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed( int64_t( state.iterations() ) * int64_t( shot.zWidth * shot.zHeight ) );
+}
+
+static void ScreenshotSizes( benchmark::internal::Benchmark *pBenchmark )
+{
+    pBenchmark->Args( { 1280, 800 } );
+    pBenchmark->Args( { 1920, 1080 } );
+    pBenchmark->Args( { 3840, 2160 } );
+}
+
+BENCHMARK( UnpackAVIF<UnpackA2R10G10B10ToPlanesScalar> )->Apply( ScreenshotSizes );
+BENCHMARK( UnpackAVIF<UnpackA2R10G10B10ToPlanes> )->Apply( ScreenshotSizes );
+BENCHMARK( SwizzlePNG<SwizzleBGRA8ToRGBA8Scalar> )->Apply( ScreenshotSizes );
+BENCHMARK( SwizzlePNG<SwizzleBGRA8ToRGBA8> )->Apply( ScreenshotSizes );
+
+BENCHMARK_MAIN();
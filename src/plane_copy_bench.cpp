@@ -0,0 +1,69 @@
+#include <cstring>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Utils/PlaneCopy.h"
+
+using namespace gamescope;
+
+// An NV12 capture, copied from a mapped texture with the driver's pitch
+// into a PipeWire shm buffer with a tight one, like copy_buffer does.
+//
+// The source here is ordinary cached memory, so this understates the
+// difference against uncached GPU memory, where streaming loads matter most.
+struct NV12Frame_t
+{
+    NV12Frame_t( size_t zWidth, size_t zHeight, size_t zSrcStride, size_t zDstStride )
+        : zWidth{ zWidth }
+        , zHeight{ zHeight }
+        , zSrcStride{ zSrcStride }
+        , zDstStride{ zDstStride }
+        , Src( zSrcStride * ( zHeight + zHeight / 2 ), 0x55 )
+        , Dst( zDstStride * ( zHeight + zHeight / 2 ) )
+    {
+    }
+
+    size_t zWidth;
+    size_t zHeight;
+    size_t zSrcStride;
+    size_t zDstStride;
+    std::vector<uint8_t> Src;
+    std::vector<uint8_t> Dst;
+};
+
+template <auto fnCopy>
+static void CopyNV12( benchmark::State &state )
+{
+    const size_t zWidth = size_t( state.range( 0 ) );
+    const size_t zHeight = size_t( state.range( 1 ) );
+    const size_t zSrcStride = ( zWidth + 255 ) & ~size_t( 255 );
+    // Same pitch on both sides is the one-copy-per-plane case.
+    const size_t zDstStride = state.range( 2 ) ? zSrcStride : zWidth;
+
+    NV12Frame_t frame{ zWidth, zHeight, zSrcStride, zDstStride };
+
+    for ( auto _ : state )
+    {
+        fnCopy( frame.Dst.data(), zDstStride, frame.Src.data(), zSrcStride, zWidth, zHeight );
+        fnCopy( frame.Dst.data() + zHeight * zDstStride, zDstStride, frame.Src.data() + zHeight * zSrcStride, zSrcStride, zWidth, zHeight / 2 );
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed( int64_t( state.iterations() ) * int64_t( zWidth * ( zHeight + zHeight / 2 ) ) );
+}
+
+static void FrameSizes( benchmark::internal::Benchmark *pBenchmark )
+{
+    for ( int64_t bSameStride : { 0, 1 } )
+    {
+        pBenchmark->Args( { 1280, 720, bSameStride } );
+        pBenchmark->Args( { 1920, 1080, bSameStride } );
+        pBenchmark->Args( { 2560, 1440, bSameStride } );
+    }
+}
+
+BENCHMARK( CopyNV12<CopyPlaneRows> )->Apply( FrameSizes );
+BENCHMARK( CopyNV12<CopyPlane> )->Apply( FrameSizes );
+
+BENCHMARK_MAIN();
@@ -0,0 +1,75 @@
+#include <cstring>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <sys/mman.h>
+
+#include "Utils/Process.h"
+
+using namespace gamescope;
+
+// Something like the address space we have once Vulkan and DRM are up,
+// which is what fork() has to copy the page tables of.
+static void *MapHeap( size_t zSize )
+{
+    if ( !zSize )
+        return nullptr;
+
+    void *pHeap = mmap( nullptr, zSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( pHeap == MAP_FAILED )
+        return nullptr;
+
+    memset( pHeap, 0x55, zSize );
+    return pHeap;
+}
+
+static void SpawnChildren( benchmark::State &state, bool bForceFork )
+{
+    const size_t zHeapSize = size_t( state.range( 0 ) ) << 20;
+    const int nChildren = int( state.range( 1 ) );
+
+    void *pHeap = MapHeap( zHeapSize );
+    if ( zHeapSize && !pHeap )
+    {
+        state.SkipWithError( "Failed to map heap" );
+        return;
+    }
+
+    char szTrue[] = "true";
+    char *argv[] = { szTrue, nullptr };
+
+    // A preamble makes SpawnProcess take the fork() path.
+    std::function<void()> fnPreamble = nullptr;
+    if ( bForceFork )
+        fnPreamble = [](){};
+
+    std::vector<pid_t> nPids( nChildren );
+    for ( auto _ : state )
+    {
+        for ( int i = 0; i < nChildren; i++ )
+            nPids[i] = Process::SpawnProcess( argv, fnPreamble );
+
+        for ( pid_t nPid : nPids )
+            Process::WaitForChild( nPid );
+    }
+
+    state.SetItemsProcessed( state.iterations() * nChildren );
+
+    if ( pHeap )
+        munmap( pHeap, zHeapSize );
+}
+
+static void Benchmark_Spawn_VFork(benchmark::State &state)
+{
+    SpawnChildren( state, false );
+}
+BENCHMARK(Benchmark_Spawn_VFork)->ArgsProduct({ { 0, 256, 2048 }, { 16 } })->Unit(benchmark::kMillisecond);
+
+static void Benchmark_Spawn_Fork(benchmark::State &state)
+{
+    SpawnChildren( state, true );
+}
+BENCHMARK(Benchmark_Spawn_Fork)->ArgsProduct({ { 0, 256, 2048 }, { 16 } })->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -7,7 +7,9 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <algorithm>
+#include <cstdlib>
 #include <array>
+#include <bit>
 #include <bitset>
 #include <thread>
 #include <dlfcn.h>
@@ -36,18 +38,28 @@
 #include "main.hpp"
 #include "steamcompmgr.hpp"
 #include "log.hpp"
+#include "FrameTiming.h"
 #include "Utils/Process.h"
+#include "ImagePool.h"
 
 #include "cs_composite_blit.h"
+#include "cs_composite_blit_fp16.h"
+#include "cs_composite_blit_nv12.h"
+#include "cs_composite_blit_nv12_fp16.h"
 #include "cs_composite_blur.h"
+#include "cs_composite_blur_fp16.h"
 #include "cs_composite_blur_cond.h"
+#include "cs_composite_blur_cond_fp16.h"
 #include "cs_composite_rcas.h"
+#include "cs_composite_rcas_fp16.h"
 #include "cs_easu.h"
 #include "cs_easu_fp16.h"
 #include "cs_gaussian_blur_horizontal.h"
+#include "cs_gaussian_blur_horizontal_fp16.h"
 #include "cs_nis.h"
 #include "cs_nis_fp16.h"
 #include "cs_rgb_to_nv12.h"
+#include "cs_rgb_to_nv12_fp16.h"
 
 #define A_CPU
 #include "shaders/ffx_a.h"
@@ -123,6 +135,7 @@ VulkanOutput_t g_output;
 
 uint32_t g_uCompositeDebug = 0u;
 gamescope::ConVar<uint32_t> cv_composite_debug{ "composite_debug", 0, "Debug composition flags" };
+gamescope::ConVar<bool> cv_composite_fused_nv12_capture{ "composite_fused_nv12_capture", true, "Write same-size NV12 captures from the composite dispatch instead of a separate conversion pass." };
 
 static std::map< VkFormat, std::map< uint64_t, VkDrmFormatModifierPropertiesEXT > > DRMModifierProps = {};
 static std::unordered_map<uint32_t, std::vector<uint64_t>> s_SampledModifierFormats = {};
@@ -422,6 +435,14 @@ bool CVulkanDevice::selectPhysDev(VkSurfaceKHR surface)
 	vk.GetPhysicalDeviceProperties( m_physDev, &props );
 	vk_log.infof( "selecting physical device '%s': queue family %x (general queue family %x)", props.deviceName, m_queueFamily, m_generalQueueFamily );
 
+	uint32_t queueFamilyCount = 0;
+	vk.GetPhysicalDeviceQueueFamilyProperties( m_physDev, &queueFamilyCount, nullptr );
+	std::vector<VkQueueFamilyProperties> queueFamilyProperties( queueFamilyCount );
+	vk.GetPhysicalDeviceQueueFamilyProperties( m_physDev, &queueFamilyCount, queueFamilyProperties.data() );
+
+	m_uTimestampValidBits = m_queueFamily < queueFamilyCount ? queueFamilyProperties[ m_queueFamily ].timestampValidBits : 0;
+	m_flTimestampPeriod = props.limits.timestampPeriod;
+
 	return true;
 }
 
@@ -530,6 +551,13 @@ bool CVulkanDevice::createDevice()
 		vk.GetPhysicalDeviceFeatures2( physDev(), &features2 );
 
 		m_bSupportsFp16 = vulkan12Features.shaderFloat16 && features2.features.shaderInt16;
+
+		// To compare against, or for drivers that claim it and get it wrong.
+		if ( m_bSupportsFp16 && env_to_bool( getenv( "GAMESCOPE_DISABLE_FP16" ) ) )
+		{
+			vk_log.infof( "GAMESCOPE_DISABLE_FP16 set, not using FP16 shaders" );
+			m_bSupportsFp16 = false;
+		}
 	}
 
 	float queuePriorities = 1.0f;
@@ -769,7 +797,7 @@ bool CVulkanDevice::createLayouts()
 	for (auto& sampler : ycbcrSamplers)
 		sampler = m_ycbcrSampler;
 
-	std::array<VkDescriptorSetLayoutBinding, 7 > layoutBindings = {
+	std::array<VkDescriptorSetLayoutBinding, 9 > layoutBindings = {
 		VkDescriptorSetLayoutBinding {
 			.binding = 0,
 			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
@@ -813,6 +841,18 @@ bool CVulkanDevice::createLayouts()
 			.descriptorCount = VKR_LUT3D_COUNT,
 			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 		},
+		VkDescriptorSetLayoutBinding {
+			.binding = 7,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		},
+		VkDescriptorSetLayoutBinding {
+			.binding = 8,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		},
 	};
 
 	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo =
@@ -907,7 +947,7 @@ bool CVulkanDevice::createPools()
 		},
 		{
 			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-			uint32_t(m_descriptorSets.size()) * 2,
+			uint32_t(m_descriptorSets.size()) * 4,
 		},
 		{
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
@@ -942,22 +982,33 @@ bool CVulkanDevice::createShaders()
 
 	std::array<ShaderInfo_t, SHADER_TYPE_COUNT> shaderInfos;
 #define SHADER(type, array) shaderInfos[SHADER_TYPE_##type] = {array , sizeof(array)}
-	SHADER(BLIT, cs_composite_blit);
-	SHADER(BLUR, cs_composite_blur);
-	SHADER(BLUR_COND, cs_composite_blur_cond);
-	SHADER(BLUR_FIRST_PASS, cs_gaussian_blur_horizontal);
-	SHADER(RCAS, cs_composite_rcas);
 	if (m_bSupportsFp16)
 	{
+		// The _fp16 variants of the composite shaders only blend, blur and
+		// convert to NV12 in half precision; sampling and colour management
+		// stay in FP32. BLIT_NV12 and RGB_TO_NV12 must always match.
+		SHADER(BLIT, cs_composite_blit_fp16);
+		SHADER(BLIT_NV12, cs_composite_blit_nv12_fp16);
+		SHADER(BLUR, cs_composite_blur_fp16);
+		SHADER(BLUR_COND, cs_composite_blur_cond_fp16);
+		SHADER(BLUR_FIRST_PASS, cs_gaussian_blur_horizontal_fp16);
+		SHADER(RCAS, cs_composite_rcas_fp16);
 		SHADER(EASU, cs_easu_fp16);
 		SHADER(NIS, cs_nis_fp16);
+		SHADER(RGB_TO_NV12, cs_rgb_to_nv12_fp16);
 	}
 	else
 	{
+		SHADER(BLIT, cs_composite_blit);
+		SHADER(BLIT_NV12, cs_composite_blit_nv12);
+		SHADER(BLUR, cs_composite_blur);
+		SHADER(BLUR_COND, cs_composite_blur_cond);
+		SHADER(BLUR_FIRST_PASS, cs_gaussian_blur_horizontal);
+		SHADER(RCAS, cs_composite_rcas);
 		SHADER(EASU, cs_easu);
 		SHADER(NIS, cs_nis);
+		SHADER(RGB_TO_NV12, cs_rgb_to_nv12);
 	}
-	SHADER(RGB_TO_NV12, cs_rgb_to_nv12);
 #undef SHADER
 
 	for (uint32_t i = 0; i < shaderInfos.size(); i++)
@@ -997,15 +1048,41 @@ bool CVulkanDevice::createScratchResources()
 		return false;
 	}
 
-	// Make and map upload buffer
-	
+	if ( !createUploadBuffer( upload_buffer_size, &m_uploadBuffer ) )
+		return false;
+
+	VkSemaphoreTypeCreateInfo timelineCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+	};
+
+	VkSemaphoreCreateInfo semCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &timelineCreateInfo,
+	};
+
+	res = vk.CreateSemaphore( device(), &semCreateInfo, NULL, &m_scratchTimelineSemaphore );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkCreateSemaphore failed" );
+		return false;
+	}
+
+	return true;
+}
+
+bool CVulkanDevice::createUploadBuffer( uint64_t ulSize, VulkanUploadBuffer_t *pOutBuffer )
+{
 	VkBufferCreateInfo bufferCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = upload_buffer_size,
+		.size = ulSize,
 		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 	};
 
-	res = vk.CreateBuffer( device(), &bufferCreateInfo, nullptr, &m_uploadBuffer );
+	VulkanUploadBuffer_t uploadBuffer;
+	uploadBuffer.ulSize = ulSize;
+
+	VkResult res = vk.CreateBuffer( device(), &bufferCreateInfo, nullptr, &uploadBuffer.buffer );
 	if ( res != VK_SUCCESS )
 	{
 		vk_errorf( res, "vkCreateBuffer failed" );
@@ -1013,12 +1090,13 @@ bool CVulkanDevice::createScratchResources()
 	}
 	
 	VkMemoryRequirements memRequirements;
-	vk.GetBufferMemoryRequirements(device(), m_uploadBuffer, &memRequirements);
+	vk.GetBufferMemoryRequirements(device(), uploadBuffer.buffer, &memRequirements);
 	
 	uint32_t memTypeIndex =  findMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT|VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, memRequirements.memoryTypeBits );
 	if ( memTypeIndex == ~0u )
 	{
 		vk_log.errorf( "findMemoryType failed" );
+		destroyUploadBuffer( uploadBuffer );
 		return false;
 	}
 	
@@ -1028,35 +1106,107 @@ bool CVulkanDevice::createScratchResources()
 		.memoryTypeIndex = memTypeIndex,
 	};
 	
-	vk.AllocateMemory( device(), &allocInfo, nullptr, &m_uploadBufferMemory);
+	res = vk.AllocateMemory( device(), &allocInfo, nullptr, &uploadBuffer.memory );
+	if ( res != VK_SUCCESS )
+	{
+		vk_errorf( res, "vkAllocateMemory failed" );
+		destroyUploadBuffer( uploadBuffer );
+		return false;
+	}
 	
-	vk.BindBufferMemory( device(), m_uploadBuffer, m_uploadBufferMemory, 0 );
+	vk.BindBufferMemory( device(), uploadBuffer.buffer, uploadBuffer.memory, 0 );
 
-	res = vk.MapMemory( device(), m_uploadBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&m_uploadBufferData );
+	res = vk.MapMemory( device(), uploadBuffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)&uploadBuffer.pData );
 	if ( res != VK_SUCCESS )
 	{
 		vk_errorf( res, "vkMapMemory failed" );
+		destroyUploadBuffer( uploadBuffer );
 		return false;
 	}
 
-	VkSemaphoreTypeCreateInfo timelineCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
-		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
-	};
+	*pOutBuffer = uploadBuffer;
+	return true;
+}
 
-	VkSemaphoreCreateInfo semCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-		.pNext = &timelineCreateInfo,
-	};
+void CVulkanDevice::destroyUploadBuffer( VulkanUploadBuffer_t &uploadBuffer )
+{
+	if ( uploadBuffer.buffer != VK_NULL_HANDLE )
+		vk.DestroyBuffer( device(), uploadBuffer.buffer, nullptr );
+	if ( uploadBuffer.memory != VK_NULL_HANDLE )
+		vk.FreeMemory( device(), uploadBuffer.memory, nullptr );
+	uploadBuffer = VulkanUploadBuffer_t{};
+}
 
-	res = vk.CreateSemaphore( device(), &semCreateInfo, NULL, &m_scratchTimelineSemaphore );
-	if ( res != VK_SUCCESS )
+void CVulkanDevice::retireUploads( uint64_t ulCompletedSeqNo )
+{
+	m_uploadRing.Retire( ulCompletedSeqNo );
+
+	std::erase_if( m_outgrownUploadBuffers, [&]( std::pair<uint64_t, VulkanUploadBuffer_t> &outgrown )
 	{
-		vk_errorf( res, "vkCreateSemaphore failed" );
-		return false;
+		if ( !outgrown.first || outgrown.first > ulCompletedSeqNo )
+			return false;
+
+		destroyUploadBuffer( outgrown.second );
+		return true;
+	});
+}
+
+VulkanUploadRegion_t CVulkanDevice::uploadBufferData(uint32_t size)
+{
+	static constexpr uint64_t k_ulUploadAlignment = 16;
+
+	std::optional<uint64_t> oulOffset = m_uploadRing.Allocate( size, k_ulUploadAlignment );
+	if ( !oulOffset )
+	{
+		// See if the GPU has caught up with anything since we last looked.
+		uint64_t ulCompletedSeqNo = 0;
+		vk_check( vk.GetSemaphoreCounterValue( device(), m_scratchTimelineSemaphore, &ulCompletedSeqNo ) );
+		retireUploads( ulCompletedSeqNo );
+
+		oulOffset = m_uploadRing.Allocate( size, k_ulUploadAlignment );
 	}
 
-	return true;
+	if ( !oulOffset )
+	{
+		// Still in use, rather than wait for it, move to a bigger buffer and
+		// let the old one go once the GPU is done with it.
+		uint64_t ulNewSize = std::bit_ceil( std::max<uint64_t>( m_uploadBuffer.ulSize * 2, uint64_t( size ) * 2 ) );
+
+		VulkanUploadBuffer_t newBuffer;
+		if ( createUploadBuffer( ulNewSize, &newBuffer ) )
+		{
+			vk_log.infof( "Growing upload buffer: %lu -> %lu bytes", m_uploadBuffer.ulSize, ulNewSize );
+
+			// Fenced with the next submission, which comes after anything
+			// that could still be reading from it.
+			m_outgrownUploadBuffers.emplace_back( 0, m_uploadBuffer );
+			m_uploadBuffer = newBuffer;
+			m_uploadRing.Reset( ulNewSize );
+			m_ulUploadBufferGrowCount++;
+		}
+		else
+		{
+			vk_log.errorf( "Failed to grow upload buffer to %lu bytes, waiting for the GPU instead", ulNewSize );
+			waitIdle( false );
+		}
+
+		oulOffset = m_uploadRing.Allocate( size, k_ulUploadAlignment );
+		assert( oulOffset );
+	}
+
+	return VulkanUploadRegion_t
+	{
+		.pData = m_uploadBuffer.pData + *oulOffset,
+		.buffer = m_uploadBuffer.buffer,
+		.uOffset = uint32_t( *oulOffset ),
+	};
+}
+
+void CVulkanDevice::dumpUploadStats()
+{
+	console_log.infof( "Upload buffer: %lu bytes, %lu in use, grown %lu times, %lu outgrown still in flight",
+		m_uploadRing.GetCapacity(), m_uploadRing.GetUsed(), m_ulUploadBufferGrowCount, (uint64_t)m_outgrownUploadBuffers.size() );
+	console_log.infof( "waitIdle calls: %lu", m_ulWaitIdleCount );
 }
 
 VkSampler CVulkanDevice::sampler( SamplerState key )
@@ -1181,6 +1331,7 @@ void CVulkanDevice::compileAllPipelines()
 	std::array<PipelineInfo_t, SHADER_TYPE_COUNT> pipelineInfos;
 #define SHADER(type, layer_count, max_ycbcr, blur_layers) pipelineInfos[SHADER_TYPE_##type] = {SHADER_TYPE_##type, layer_count, max_ycbcr, blur_layers}
 	SHADER(BLIT, k_nMaxLayers, k_nMaxYcbcrMask_ToPreCompile, 1);
+	SHADER(BLIT_NV12, k_nMaxLayers, k_nMaxYcbcrMask_ToPreCompile, 1);
 	SHADER(BLUR, k_nMaxLayers, k_nMaxYcbcrMask_ToPreCompile, k_nMaxBlurLayers);
 	SHADER(BLUR_COND, k_nMaxLayers, k_nMaxYcbcrMask_ToPreCompile, k_nMaxBlurLayers);
 	SHADER(BLUR_FIRST_PASS, 1, 2, 1);
@@ -1305,6 +1456,14 @@ uint64_t CVulkanDevice::submitInternal( CVulkanCmdBuffer* cmdBuffer )
 	pSignalSemaphores.push_back( m_scratchTimelineSemaphore );
 	ulSignalPoints.push_back( nextSeqNo );
 
+	// Anything uploaded for this submission stays put until it completes.
+	m_uploadRing.Fence( nextSeqNo );
+	for ( auto &outgrown : m_outgrownUploadBuffers )
+	{
+		if ( !outgrown.first )
+			outgrown.first = nextSeqNo;
+	}
+
 	for ( auto &dep : cmdBuffer->GetExternalSignals() )
 	{
 		pSignalSemaphores.push_back( dep.pTimelineSemaphore->pVkSemaphore );
@@ -1359,6 +1518,7 @@ void CVulkanDevice::garbageCollect( void )
 	vk_check( vk.GetSemaphoreCounterValue(device(), m_scratchTimelineSemaphore, &currentSeqNo) );
 
 	resetCmdBuffers(currentSeqNo);
+	retireUploads(currentSeqNo);
 }
 
 VulkanTimelineSemaphore_t::~VulkanTimelineSemaphore_t()
@@ -1485,11 +1645,8 @@ void CVulkanCmdBuffer::AddSignal( std::shared_ptr<VulkanTimelineSemaphore_t> pTi
 	m_ExternalSignals.emplace_back( std::move( pTimelineSemaphore ), ulPoint );
 }
 
-void CVulkanDevice::wait(uint64_t sequence, bool reset)
+void CVulkanDevice::waitForCompletion(uint64_t sequence)
 {
-	if (m_submissionSeqNo == sequence)
-		m_uploadBufferOffset = 0;
-
 	VkSemaphoreWaitInfo waitInfo = {
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
 		.semaphoreCount = 1,
@@ -1498,6 +1655,13 @@ void CVulkanDevice::wait(uint64_t sequence, bool reset)
 	} ;
 
 	vk_check( vk.WaitSemaphores( device(), &waitInfo, ~0ull ) );
+}
+
+void CVulkanDevice::wait(uint64_t sequence, bool reset)
+{
+	waitForCompletion(sequence);
+
+	retireUploads(sequence);
 
 	if (reset)
 		resetCmdBuffers(sequence);
@@ -1505,6 +1669,7 @@ void CVulkanDevice::wait(uint64_t sequence, bool reset)
 
 void CVulkanDevice::waitIdle(bool reset)
 {
+	m_ulWaitIdleCount++;
 	wait(m_submissionSeqNo, reset);
 }
 
@@ -1532,11 +1697,16 @@ CVulkanCmdBuffer::CVulkanCmdBuffer(CVulkanDevice *parent, VkCommandBuffer cmdBuf
 
 CVulkanCmdBuffer::~CVulkanCmdBuffer()
 {
+	if (m_timestampQueryPool != VK_NULL_HANDLE)
+		m_device->vk.DestroyQueryPool(m_device->device(), m_timestampQueryPool, nullptr);
 	m_device->vk.FreeCommandBuffers(m_device->device(), m_device->commandPool(), 1, &m_cmdBuffer);
 }
 
 void CVulkanCmdBuffer::reset()
 {
+	// We only get reset once the GPU is done with us.
+	resolveTimestampQuery();
+
 	vk_check( m_device->vk.ResetCommandBuffer(m_cmdBuffer, 0) );
 	m_textureRefs.clear();
 	m_textureState.clear();
@@ -1557,8 +1727,63 @@ void CVulkanCmdBuffer::begin()
 	clearState();
 }
 
+void CVulkanCmdBuffer::beginTimestampQuery(uint64_t ulFrameId)
+{
+	if (!m_device->supportsTimestamps() || !gamescope::cv_frame_timing)
+		return;
+
+	if (m_timestampQueryPool == VK_NULL_HANDLE)
+	{
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = 2,
+		};
+
+		VkResult res = m_device->vk.CreateQueryPool(m_device->device(), &queryPoolCreateInfo, nullptr, &m_timestampQueryPool);
+		if (res != VK_SUCCESS)
+		{
+			vk_errorf( res, "vkCreateQueryPool failed" );
+			return;
+		}
+	}
+
+	m_device->vk.CmdResetQueryPool(m_cmdBuffer, m_timestampQueryPool, 0, 2);
+	m_device->vk.CmdWriteTimestamp(m_cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampQueryPool, 0);
+	m_oTimestampFrameId = ulFrameId;
+}
+
+void CVulkanCmdBuffer::resolveTimestampQuery()
+{
+	if (!m_oTimestampFrameId)
+		return;
+
+	const uint64_t ulFrameId = *std::exchange(m_oTimestampFrameId, std::nullopt);
+
+	uint64_t ulTimestamps[2] = {};
+	VkResult res = m_device->vk.GetQueryPoolResults(m_device->device(), m_timestampQueryPool, 0, 2,
+		sizeof(ulTimestamps), ulTimestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (res != VK_SUCCESS)
+		return;
+
+	const uint32_t uValidBits = m_device->timestampValidBits();
+	const uint64_t ulMask = uValidBits >= 64 ? ~0ull : ( ( 1ull << uValidBits ) - 1 );
+	const uint64_t ulTicks = ( ulTimestamps[1] - ulTimestamps[0] ) & ulMask;
+	const uint64_t ulDuration = uint64_t( double( ulTicks ) * m_device->timestampPeriod() );
+
+	// GPU timestamps are in their own time domain, so the execution is
+	// placed at the submission time. The duration is what matters.
+	gamescope::CFrameTimingRecorder::Get().MarkStageForFrame(ulFrameId, gamescope::FrameStages::CompositeGPU, m_ulTimestampSubmitTime, ulDuration);
+}
+
 void CVulkanCmdBuffer::end()
 {
+	if (m_oTimestampFrameId)
+	{
+		m_device->vk.CmdWriteTimestamp(m_cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPool, 1);
+		m_ulTimestampSubmitTime = get_time_in_nanos();
+	}
+
 	insertBarrier(true);
 	vk_check( m_device->vk.EndCommandBuffer(m_cmdBuffer) );
 }
@@ -1603,6 +1828,14 @@ void CVulkanCmdBuffer::bindTarget(gamescope::Rc<CVulkanTexture> target)
 		m_textureRefs.emplace_back(std::move(target));
 }
 
+void CVulkanCmdBuffer::bindCaptureTarget(gamescope::Rc<CVulkanTexture> target)
+{
+	assert(!target || target->isYcbcr());
+	m_captureTarget = target.get();
+	if (target)
+		m_textureRefs.emplace_back(std::move(target));
+}
+
 void CVulkanCmdBuffer::clearState()
 {
 	for (auto& texture : m_boundTextures)
@@ -1612,6 +1845,7 @@ void CVulkanCmdBuffer::clearState()
 		sampler = {};
 
 	m_target = nullptr;
+	m_captureTarget = nullptr;
 	m_useSrgb.reset();
 }
 
@@ -1620,7 +1854,8 @@ void CVulkanCmdBuffer::uploadConstants(Args&&... args)
 {
 	PushData data(std::forward<Args>(args)...);
 
-	auto [ptr, offset] = m_device->uploadBufferData(sizeof(data));
+	auto [ptr, buffer, offset] = m_device->uploadBufferData(sizeof(data));
+	m_renderBuffer = buffer;
 	m_renderBufferOffset = offset;
 	memcpy(ptr, &data, sizeof(data));
 }
@@ -1639,16 +1874,19 @@ void CVulkanCmdBuffer::dispatch(uint32_t x, uint32_t y, uint32_t z)
 	}
 	assert(m_target != nullptr);
 	prepareDestImage(m_target);
+	if (m_captureTarget)
+		prepareDestImage(m_captureTarget);
 	insertBarrier();
 
 	VkDescriptorSet descriptorSet = m_device->descriptorSet();
 
-	std::array<VkWriteDescriptorSet, 7> writeDescriptorSets;
+	std::array<VkWriteDescriptorSet, 9> writeDescriptorSets;
 	std::array<VkDescriptorImageInfo, VKR_SAMPLER_SLOTS> imageDescriptors = {};
 	std::array<VkDescriptorImageInfo, VKR_SAMPLER_SLOTS> ycbcrImageDescriptors = {};
 	std::array<VkDescriptorImageInfo, VKR_TARGET_SLOTS> targetDescriptors = {};
 	std::array<VkDescriptorImageInfo, VKR_LUT3D_COUNT> shaperLutDescriptor = {};
 	std::array<VkDescriptorImageInfo, VKR_LUT3D_COUNT> lut3DDescriptor = {};
+	std::array<VkDescriptorImageInfo, 2> captureDescriptors = {};
 	VkDescriptorBufferInfo scratchDescriptor = {};
 
 	writeDescriptorSets[0] = {
@@ -1721,7 +1959,27 @@ void CVulkanCmdBuffer::dispatch(uint32_t x, uint32_t y, uint32_t z)
 		.pImageInfo = lut3DDescriptor.data(),
 	};
 
-	scratchDescriptor.buffer = m_device->m_uploadBuffer;
+	writeDescriptorSets[7] = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = descriptorSet,
+		.dstBinding = 7,
+		.dstArrayElement = 0,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		.pImageInfo = &captureDescriptors[0],
+	};
+
+	writeDescriptorSets[8] = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = descriptorSet,
+		.dstBinding = 8,
+		.dstArrayElement = 0,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		.pImageInfo = &captureDescriptors[1],
+	};
+
+	scratchDescriptor.buffer = m_renderBuffer;
 	scratchDescriptor.offset = m_renderBufferOffset;
 	scratchDescriptor.range = VK_WHOLE_SIZE;
 
@@ -1775,6 +2033,14 @@ void CVulkanCmdBuffer::dispatch(uint32_t x, uint32_t y, uint32_t z)
 		targetDescriptors[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 	}
 
+	captureDescriptors[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	captureDescriptors[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	if (m_captureTarget)
+	{
+		captureDescriptors[0].imageView = m_captureTarget->lumaView();
+		captureDescriptors[1].imageView = m_captureTarget->chromaView();
+	}
+
 	m_device->vk.UpdateDescriptorSets(m_device->device(), writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
 
 	m_device->vk.CmdBindDescriptorSets(m_cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_device->pipelineLayout(), 0, 1, &descriptorSet, 0, nullptr);
@@ -1782,6 +2048,8 @@ void CVulkanCmdBuffer::dispatch(uint32_t x, uint32_t y, uint32_t z)
 	m_device->vk.CmdDispatch(m_cmdBuffer, x, y, z);
 
 	markDirty(m_target);
+	if (m_captureTarget)
+		markDirty(m_captureTarget);
 }
 
 void CVulkanCmdBuffer::copyImage(gamescope::Rc<CVulkanTexture> src, gamescope::Rc<CVulkanTexture> dst)
@@ -1914,7 +2182,9 @@ void CVulkanCmdBuffer::insertBarrier(bool flush)
 		{
 			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 			.srcAccessMask = state.dirty ? write_bits : 0u,
-			.dstAccessMask = flush ? 0u : read_bits | write_bits,
+			// Flushing anything that isn't leaving our queue still needs to be
+			// visible to what comes after in it, eg. uploads for the next composite.
+			.dstAccessMask = ( isExport || isPresent ) ? 0u : read_bits | write_bits,
 			.oldLayout = state.discarded ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL,
 			.newLayout = isPresent ? GetBackend()->GetPresentLayout() : VK_IMAGE_LAYOUT_GENERAL,
 			.srcQueueFamilyIndex = isExport ? image->queueFamily : state.needsImport ? externalQueue : image->queueFamily,
@@ -3068,18 +3338,19 @@ void vulkan_update_luts(const gamescope::Rc<CVulkanTexture>& lut1d, const gamesc
 	size_t lut1d_size = lut1d->width() * sizeof(uint16_t) * 4;
 	size_t lut3d_size = lut3d->width() * lut3d->height() * lut3d->depth() * sizeof(uint16_t) * 4;
 
-	auto [base_dst, base_offset] = g_device.uploadBufferData(lut1d_size + lut3d_size);
+	auto [base_dst, buffer, base_offset] = g_device.uploadBufferData(lut1d_size + lut3d_size);
 
 	void* lut1d_dst = base_dst;
 	void *lut3d_dst = ((uint8_t*)base_dst) + lut1d_size;
 	memcpy(lut1d_dst, lut1d_data, lut1d_size);
 	memcpy(lut3d_dst, lut3d_data, lut3d_size);
 
+	// The next composite comes after this in the queue, and the barrier
+	// at the end of this command buffer makes the copy visible to it.
 	auto cmdBuffer = g_device.commandBuffer();
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), base_offset, 0, lut1d);
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), base_offset + lut1d_size, 0, lut3d);
+	cmdBuffer->copyBufferToImage(buffer, base_offset, 0, lut1d);
+	cmdBuffer->copyBufferToImage(buffer, base_offset + lut1d_size, 0, lut3d);
 	g_device.submit(std::move(cmdBuffer));
-	g_device.waitIdle(); // TODO: Sync this better
 }
 
 gamescope::Rc<CVulkanTexture> vulkan_get_hacky_blank_texture()
@@ -3098,7 +3369,7 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_flat_texture( uint32_t width,
 	bool bRes = texture->BInit( width, height, 1u, VulkanFormatToDRM( VK_FORMAT_B8G8R8A8_UNORM ), flags );
 	assert( bRes );
 
-	auto [_dst, offset] = g_device.uploadBufferData( width * height * 4 );
+	auto [_dst, buffer, offset] = g_device.uploadBufferData( width * height * 4 );
 	uint8_t *dst = (uint8_t *)_dst;
 	for ( uint32_t i = 0; i < width * height * 4; i += 4 )
 	{
@@ -3109,9 +3380,8 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_flat_texture( uint32_t width,
 	}
 
 	auto cmdBuffer = g_device.commandBuffer();
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), offset, 0, texture.get());
-	g_device.submit(std::move(cmdBuffer));
-	g_device.waitIdle();
+	cmdBuffer->copyBufferToImage(buffer, offset, 0, texture.get());
+	texture->setPendingUploadSeqNo( g_device.submit(std::move(cmdBuffer)) );
 
 	return texture;
 }
@@ -3444,6 +3714,76 @@ bool vulkan_make_output()
 	return true;
 }
 
+static gamescope::CImagePool<UpscaleImage_t> &GetUpscaleImagePool();
+
+gamescope::ConVar<uint32_t> cv_upscale_image_pool_budget_mb{ "upscale_image_pool_budget_mb", 256, "How much memory upscale images of sizes not currently in use can hold on to before the least recently used are freed.",
+[]( gamescope::ConVar<uint32_t> &cvar )
+{
+	GetUpscaleImagePool().SetBudget( uint64_t{ cvar } * 1024 * 1024 );
+}};
+
+static gamescope::CImagePool<UpscaleImage_t> &GetUpscaleImagePool()
+{
+	// 8 of one size in use at once is already something having gone wrong.
+	static gamescope::CImagePool<UpscaleImage_t> s_Pool{ uint64_t{ cv_upscale_image_pool_budget_mb } * 1024 * 1024, 8 };
+	return s_Pool;
+}
+
+UpscaleImage_t *vulkan_acquire_upscale_image( uint32_t uWidth, uint32_t uHeight, uint32_t uDrmFormat, EUpscaleImageUsage eUsage )
+{
+	gamescope::ImagePoolKey_t key{ uWidth, uHeight, uDrmFormat, uint32_t( eUsage ) };
+	// The temp image is only ever used by one composite after the next, it doesn't matter if the last is still in flight.
+	const bool bShared = eUsage == EUpscaleImageUsage::Temp;
+
+	UpscaleImage_t *pImage = GetUpscaleImagePool().Acquire( key, bShared, [&]() -> std::optional<UpscaleImage_t>
+	{
+		UpscaleImage_t image;
+		image.pTexture = new CVulkanTexture();
+
+		CVulkanTexture::createFlags imageFlags;
+		imageFlags.bSampled = true;
+		imageFlags.bStorage = true;
+		imageFlags.bFlippable = eUsage == EUpscaleImageUsage::Preemptive;
+		if ( !image.pTexture->BInit( uWidth, uHeight, 1u, uDrmFormat, imageFlags ) )
+		{
+			vk_log.errorf( "failed to create %ux%u upscale image", uWidth, uHeight );
+			return std::nullopt;
+		}
+
+		if ( eUsage == EUpscaleImageUsage::Preemptive )
+		{
+			image.pReleaseTimeline = gamescope::CTimeline::Create();
+			if ( !image.pReleaseTimeline )
+				return std::nullopt;
+		}
+
+		return image;
+	});
+
+	if ( !pImage && eUsage == EUpscaleImageUsage::Preemptive )
+		vk_log.warnf( "No upscale images free!" );
+
+	return pImage;
+}
+
+void vulkan_release_idle_upscale_images( EUpscaleImageUsage eUsage )
+{
+	GetUpscaleImagePool().ReleaseIdle( uint32_t( eUsage ) );
+}
+
+static gamescope::ConCommand cc_upscale_image_pool_stats( "upscale_image_pool_stats", "Print how much memory upscale images are holding on to and how often they were reused.",
+[]( std::span<std::string_view> args )
+{
+	const gamescope::ImagePoolStats_t &stats = GetUpscaleImagePool().GetStats();
+	console_log.infof( "Upscale images: %u, %.1fMB of %.1fMB budget (peak %.1fMB)",
+		stats.uImages,
+		stats.ulBytes / ( 1024.0 * 1024.0 ),
+		GetUpscaleImagePool().GetBudget() / ( 1024.0 * 1024.0 ),
+		stats.ulPeakBytes / ( 1024.0 * 1024.0 ) );
+	console_log.infof( "  %lu allocations, %lu reuses, %lu evictions",
+		stats.ulAllocations, stats.ulReuses, stats.ulEvictions );
+});
+
 static void update_tmp_images( uint32_t width, uint32_t height )
 {
 	if ( g_output.tmpOutput != nullptr
@@ -3453,18 +3793,14 @@ static void update_tmp_images( uint32_t width, uint32_t height )
 		return;
 	}
 
-	CVulkanTexture::createFlags createFlags;
-	createFlags.bSampled = true;
-	createFlags.bStorage = true;
-
-	g_output.tmpOutput = new CVulkanTexture();
-	bool bSuccess = g_output.tmpOutput->BInit( width, height, 1u, DRM_FORMAT_ARGB8888, createFlags, nullptr );
-
-	if ( !bSuccess )
+	UpscaleImage_t *pImage = vulkan_acquire_upscale_image( width, height, DRM_FORMAT_ARGB8888, EUpscaleImageUsage::Temp );
+	if ( !pImage )
 	{
 		vk_log.errorf( "failed to create fsr output" );
 		return;
 	}
+
+	g_output.tmpOutput = pImage->pTexture;
 }
 
 
@@ -3584,16 +3920,16 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_texture_from_bits( uint32_t wi
 		return nullptr;
 
 	size_t size = width * height * DRMFormatGetBPP(drmFormat);
-	auto [ dst, offset ] = g_device.uploadBufferData(size);
+	auto [ dst, buffer, offset ] = g_device.uploadBufferData(size);
 	memcpy( dst, bits, size );
 
 	auto cmdBuffer = g_device.commandBuffer();
 
-	cmdBuffer->copyBufferToImage(g_device.uploadBuffer(), offset, 0, pTex.get());
-	// TODO: Sync this copyBufferToImage.
+	cmdBuffer->copyBufferToImage(buffer, offset, 0, pTex.get());
 
-	g_device.submit(std::move(cmdBuffer));
-	g_device.waitIdle();
+	// Composites are ordered after this by the queue, scanout isn't,
+	// see vulkan_wait_for_texture_upload.
+	pTex->setPendingUploadSeqNo( g_device.submit(std::move(cmdBuffer)) );
 
 	return pTex;
 }
@@ -3666,8 +4002,17 @@ struct BlitPushData_t
     float u_itmSdrNits; // unset
     float u_itmTargetNits; // unset
 
+	// Only for SHADER_TYPE_BLIT_NV12
+	mat3x4 captureCTM;
+	uint32_t captureHalfExtent[2];
+	float captureQuantize;
+
 	explicit BlitPushData_t(const struct FrameInfo_t *frameInfo)
 	{
+		captureCTM = {};
+		captureHalfExtent[0] = captureHalfExtent[1] = 0;
+		captureQuantize = 0.0f;
+
 		u_shaderFilter = 0;
 		u_alphaMode = 0;
 
@@ -3708,7 +4053,19 @@ struct BlitPushData_t
 		u_itmTargetNits = g_flHDRItmTargetNits;
 	}
 
+	explicit BlitPushData_t(const struct FrameInfo_t *frameInfo, const mat3x4 &capture_matrix, uint32_t captureWidth, uint32_t captureHeight, uint32_t captureLevels)
+		: BlitPushData_t(frameInfo)
+	{
+		captureCTM = capture_matrix;
+		captureHalfExtent[0] = captureWidth / 2;
+		captureHalfExtent[1] = captureHeight / 2;
+		captureQuantize = float(captureLevels);
+	}
+
 	explicit BlitPushData_t(float blit_scale) {
+		captureCTM = {};
+		captureHalfExtent[0] = captureHalfExtent[1] = 0;
+		captureQuantize = 0.0f;
 		scale[0] = { blit_scale, blit_scale };
 		offset[0] = { 0.5f, 0.5f };
 		opacity[0] = 1.0f;
@@ -3800,7 +4157,7 @@ struct RcasPushData_t
     float u_itmSdrNits; // unset
     float u_itmTargetNits; // unset
 
-	RcasPushData_t(const struct FrameInfo_t *frameInfo, float sharpness)
+	RcasPushData_t(const struct FrameInfo_t *frameInfo, float sharpness, bool bFp16)
 	{
 		uvec4_t tmp;
 		FsrRcasCon(&tmp.x, sharpness);
@@ -3808,7 +4165,8 @@ struct RcasPushData_t
 		u_layer0Offset.y = uint32_t(int32_t(frameInfo->layers[0].offset.y));
 		u_borderMask = frameInfo->borderMask() >> 1u;
 		u_frameId = s_frameId++;
-		u_c1 = tmp.x;
+		// The half version wants it as two packed halves.
+		u_c1 = bFp16 ? tmp.y : tmp.x;
 		u_shaderFilter = 0;
 		u_alphaMode = 0;
 
@@ -3892,58 +4250,130 @@ void bind_all_layers(CVulkanCmdBuffer* cmdBuffer, const struct FrameInfo_t *fram
 	}
 }
 
-std::optional<uint64_t> vulkan_screenshot( const struct FrameInfo_t *frameInfo, gamescope::Rc<CVulkanTexture> pScreenshotTexture, gamescope::Rc<CVulkanTexture> pYUVOutTexture )
+// How many levels per channel cs_rgb_to_nv12 reads back from a capture source
+// of this format, or 0 if cs_composite_blit_nv12 can't reproduce that.
+static uint32_t NV12CaptureSourceLevels( VkFormat format )
 {
-	EOTF outputTF = frameInfo->outputEncodingEOTF;
-	if (!frameInfo->applyOutputColorMgmt)
-		outputTF = EOTF_Count; //Disable blending stuff.
+	switch ( format )
+	{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			return 255;
+		// The XRGB2101010 intermediate paint_pipewire captures through.
+		case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+		case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+			return 1023;
+		default:
+			return 0;
+	}
+}
 
-	auto cmdBuffer = g_device.commandBuffer();
+// Whether cs_composite_blit_nv12 can write pCapture while compositing into pSource,
+// with the same result as the cs_rgb_to_nv12 pass reading pSource back.
+// That pass samples pSource 1:1, so only same-size captures qualify.
+// Checked by fused_nv12_capture_tests.cpp.
+static bool CanFuseNV12Capture( CVulkanTexture *pSource, CVulkanTexture *pCapture )
+{
+	if ( !cv_composite_fused_nv12_capture || !pCapture || !pCapture->isYcbcr() )
+		return false;
+
+	// The debug markers draw over dst after the fact.
+	if ( g_uCompositeDebug != 0 )
+		return false;
+
+	return NV12CaptureSourceLevels( pSource->format() ) &&
+		pSource->width() == pCapture->width() &&
+		pSource->height() == pCapture->height();
+}
+
+// cs_rgb_to_nv12, reading pSource back into pCapture.
+static void dispatch_rgb_to_nv12( CVulkanCmdBuffer *cmdBuffer, gamescope::Rc<CVulkanTexture> pSource, gamescope::Rc<CVulkanTexture> pCapture )
+{
+	float scale = (float)pSource->width() / pCapture->width();
+
+	CaptureConvertBlitData_t constants( scale, colorspace_to_conversion_from_srgb_matrix( pCapture->streamColorspace() ) );
+	constants.halfExtent[0] = pCapture->width() / 2.0f;
+	constants.halfExtent[1] = pCapture->height() / 2.0f;
+	cmdBuffer->uploadConstants<CaptureConvertBlitData_t>(constants);
 
 	for (uint32_t i = 0; i < EOTF_Count; i++)
-		cmdBuffer->bindColorMgmtLuts(i, frameInfo->shaperLut[i], frameInfo->lut3D[i]);
+		cmdBuffer->bindColorMgmtLuts(i, nullptr, nullptr);
 
-	cmdBuffer->bindPipeline( g_device.pipeline(SHADER_TYPE_BLIT, frameInfo->layerCount, frameInfo->ycbcrMask(), 0u, frameInfo->colorspaceMask(), outputTF ));
-	bind_all_layers(cmdBuffer.get(), frameInfo);
-	cmdBuffer->bindTarget(pScreenshotTexture);
-	cmdBuffer->uploadConstants<BlitPushData_t>(frameInfo);
+	cmdBuffer->bindPipeline(g_device.pipeline( SHADER_TYPE_RGB_TO_NV12, 1, 0, 0, GAMESCOPE_APP_TEXTURE_COLORSPACE_SRGB, EOTF_Count ));
+	cmdBuffer->bindTexture(0, pSource);
+	cmdBuffer->setTextureSrgb(0, true);
+	cmdBuffer->setSamplerNearest(0, false);
+	cmdBuffer->setSamplerUnnormalized(0, true);
+	for (uint32_t i = 1; i < VKR_SAMPLER_SLOTS; i++)
+	{
+		cmdBuffer->bindTexture(i, nullptr);
+	}
+	cmdBuffer->bindTarget(pCapture);
 
 	const int pixelsPerGroup = 8;
 
-	cmdBuffer->dispatch(div_roundup(currentOutputWidth, pixelsPerGroup), div_roundup(currentOutputHeight, pixelsPerGroup));
+	// For ycbcr, we operate on 2 pixels at a time, so use the half-extent.
+	const int dispatchSize = pixelsPerGroup * 2;
 
-	if ( pYUVOutTexture != nullptr )
+	cmdBuffer->dispatch(div_roundup(pCapture->width(), dispatchSize), div_roundup(pCapture->height(), dispatchSize));
+}
+
+// The plain composite of frameInfo into pTarget. If there's an NV12 pCapture
+// to take and it can be fused, it's written from the same dispatch.
+// Returns whether pCapture was written, otherwise it still needs converting.
+static bool dispatch_composite_blit( CVulkanCmdBuffer *cmdBuffer, const struct FrameInfo_t *frameInfo, EOTF outputTF,
+	gamescope::Rc<CVulkanTexture> pTarget, gamescope::Rc<CVulkanTexture> pCapture )
+{
+	const bool bFuse = CanFuseNV12Capture( pTarget.get(), pCapture.get() );
+	if ( bFuse )
+	{
+		cmdBuffer->bindPipeline( g_device.pipeline(SHADER_TYPE_BLIT_NV12, frameInfo->layerCount, frameInfo->ycbcrMask(), 0u, frameInfo->colorspaceMask(), outputTF ));
+		bind_all_layers(cmdBuffer, frameInfo);
+		cmdBuffer->bindTarget(pTarget);
+		cmdBuffer->bindCaptureTarget(pCapture);
+		cmdBuffer->uploadConstants<BlitPushData_t>(frameInfo,
+			colorspace_to_conversion_from_srgb_matrix( pCapture->streamColorspace() ),
+			pCapture->width(), pCapture->height(),
+			NV12CaptureSourceLevels( pTarget->format() ));
+	}
+	else
 	{
-		float scale = (float)pScreenshotTexture->width() / pYUVOutTexture->width();
+		cmdBuffer->bindPipeline( g_device.pipeline(SHADER_TYPE_BLIT, frameInfo->layerCount, frameInfo->ycbcrMask(), 0u, frameInfo->colorspaceMask(), outputTF ));
+		bind_all_layers(cmdBuffer, frameInfo);
+		cmdBuffer->bindTarget(pTarget);
+		cmdBuffer->uploadConstants<BlitPushData_t>(frameInfo);
+	}
 
-		CaptureConvertBlitData_t constants( scale, colorspace_to_conversion_from_srgb_matrix( pYUVOutTexture->streamColorspace() ) );
-		constants.halfExtent[0] = pYUVOutTexture->width() / 2.0f;
-		constants.halfExtent[1] = pYUVOutTexture->height() / 2.0f;
-		cmdBuffer->uploadConstants<CaptureConvertBlitData_t>(constants);
+	const int pixelsPerGroup = 8;
 
-		for (uint32_t i = 0; i < EOTF_Count; i++)
-			cmdBuffer->bindColorMgmtLuts(i, nullptr, nullptr);
+	cmdBuffer->dispatch(div_roundup(currentOutputWidth, pixelsPerGroup), div_roundup(currentOutputHeight, pixelsPerGroup));
 
-		cmdBuffer->bindPipeline(g_device.pipeline( SHADER_TYPE_RGB_TO_NV12, 1, 0, 0, GAMESCOPE_APP_TEXTURE_COLORSPACE_SRGB, EOTF_Count ));
-		cmdBuffer->bindTexture(0, pScreenshotTexture);
-		cmdBuffer->setTextureSrgb(0, true);
-		cmdBuffer->setSamplerNearest(0, false);
-		cmdBuffer->setSamplerUnnormalized(0, true);
-		for (uint32_t i = 1; i < VKR_SAMPLER_SLOTS; i++)
-		{
-			cmdBuffer->bindTexture(i, nullptr);
-		}
-		cmdBuffer->bindTarget(pYUVOutTexture);
+	if ( bFuse )
+		cmdBuffer->bindCaptureTarget(nullptr);
+
+	return bFuse;
+}
+
+std::optional<uint64_t> vulkan_screenshot( const struct FrameInfo_t *frameInfo, gamescope::Rc<CVulkanTexture> pScreenshotTexture, gamescope::Rc<CVulkanTexture> pYUVOutTexture )
+{
+	EOTF outputTF = frameInfo->outputEncodingEOTF;
+	if (!frameInfo->applyOutputColorMgmt)
+		outputTF = EOTF_Count; //Disable blending stuff.
+
+	auto cmdBuffer = g_device.commandBuffer();
 
-		const int pixelsPerGroup = 8;
+	for (uint32_t i = 0; i < EOTF_Count; i++)
+		cmdBuffer->bindColorMgmtLuts(i, frameInfo->shaperLut[i], frameInfo->lut3D[i]);
 
-		// For ycbcr, we operate on 2 pixels at a time, so use the half-extent.
-		const int dispatchSize = pixelsPerGroup * 2;
+	bool bCaptured = dispatch_composite_blit( cmdBuffer.get(), frameInfo, outputTF, pScreenshotTexture, pYUVOutTexture );
 
-		cmdBuffer->dispatch(div_roundup(pYUVOutTexture->width(), dispatchSize), div_roundup(pYUVOutTexture->height(), dispatchSize));
-	}
+	if ( pYUVOutTexture != nullptr && !bCaptured )
+		dispatch_rgb_to_nv12( cmdBuffer.get(), pScreenshotTexture, pYUVOutTexture );
 
 	uint64_t sequence = g_device.submit(std::move(cmdBuffer));
+
 	return sequence;
 }
 
@@ -3954,6 +4384,16 @@ ReshadeEffectPipeline *g_pLastReshadeEffect = nullptr;
 
 std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamescope::Rc<CVulkanTexture> pPipewireTexture, bool partial, gamescope::Rc<CVulkanTexture> pOutputOverride, bool increment, std::unique_ptr<CVulkanCmdBuffer> pInCommandBuffer )
 {
+	// Only the composite for the output counts towards frame timings,
+	// not screenshots or pre-emptive upscales.
+	const bool bTimedComposite = pOutputOverride == nullptr;
+	std::optional<gamescope::CScopedFrameStage> oRecordStage;
+	if ( bTimedComposite )
+	{
+		oRecordStage.emplace( gamescope::FrameStages::CompositeRecord );
+		gamescope::CFrameTimingRecorder::Get().MarkComposited( true );
+	}
+
 	EOTF outputTF = frameInfo->outputEncodingEOTF;
 	if (!frameInfo->applyOutputColorMgmt)
 		outputTF = EOTF_Count; //Disable blending stuff.
@@ -3996,6 +4436,9 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 
 	auto cmdBuffer = pInCommandBuffer ? std::move( pInCommandBuffer ) : g_device.commandBuffer();
 
+	if ( bTimedComposite )
+		cmdBuffer->beginTimestampQuery( gamescope::CFrameTimingRecorder::Get().GetCurrentFrameId() );
+
 	for (uint32_t i = 0; i < EOTF_Count; i++)
 		cmdBuffer->bindColorMgmtLuts(i, frameInfo->shaperLut[i], frameInfo->lut3D[i]);
 
@@ -4028,7 +4471,7 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 		cmdBuffer->setSamplerUnnormalized(0, false);
 		cmdBuffer->setSamplerNearest(0, false);
 		cmdBuffer->bindTarget(compositeImage);
-		cmdBuffer->uploadConstants<RcasPushData_t>(frameInfo, g_upscaleFilterSharpness / 10.0f);
+		cmdBuffer->uploadConstants<RcasPushData_t>(frameInfo, g_upscaleFilterSharpness / 10.0f, g_device.supportsFp16());
 
 		cmdBuffer->dispatch(div_roundup(currentOutputWidth, pixelsPerGroup), div_roundup(currentOutputHeight, pixelsPerGroup));
 	}
@@ -4118,14 +4561,8 @@ std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamesco
 	}
 	else
 	{
-		cmdBuffer->bindPipeline( g_device.pipeline(SHADER_TYPE_BLIT, frameInfo->layerCount, frameInfo->ycbcrMask(), 0u, frameInfo->colorspaceMask(), outputTF ));
-		bind_all_layers(cmdBuffer.get(), frameInfo);
-		cmdBuffer->bindTarget(compositeImage);
-		cmdBuffer->uploadConstants<BlitPushData_t>(frameInfo);
-
-		const int pixelsPerGroup = 8;
-
-		cmdBuffer->dispatch(div_roundup(currentOutputWidth, pixelsPerGroup), div_roundup(currentOutputHeight, pixelsPerGroup));
+		if ( dispatch_composite_blit( cmdBuffer.get(), frameInfo, outputTF, compositeImage, pPipewireTexture ) )
+			pPipewireTexture = nullptr; // Already captured.
 	}
 
 	if ( pPipewireTexture != nullptr )
@@ -4190,6 +4627,33 @@ void vulkan_wait( uint64_t ulSeqNo, bool bReset )
 	return g_device.wait( ulSeqNo, bReset );
 }
 
+void vulkan_wait_for_completion( uint64_t ulSeqNo )
+{
+	g_device.waitForCompletion( ulSeqNo );
+}
+
+void vulkan_wait_for_texture_upload( CVulkanTexture *pTexture )
+{
+	if ( !pTexture || !pTexture->pendingUploadSeqNo() )
+		return;
+
+	// Usually long done by the time anything gets around to scanning it out.
+	g_device.wait( pTexture->pendingUploadSeqNo(), false );
+	pTexture->setPendingUploadSeqNo( 0 );
+}
+
+void vulkan_wait_for_texture_uploads( const FrameInfo_t *pFrameInfo )
+{
+	for ( int i = 0; i < pFrameInfo->layerCount; i++ )
+		vulkan_wait_for_texture_upload( pFrameInfo->layers[i].tex.get() );
+}
+
+static gamescope::ConCommand cc_vk_upload_stats( "vk_upload_stats", "Print the upload buffer's size and how often we have had to wait on the GPU.",
+[]( std::span<std::string_view> args )
+{
+	g_device.dumpUploadStats();
+});
+
 gamescope::Rc<CVulkanTexture> vulkan_get_last_output_image( bool partial, bool defer )
 {
 	// Get previous image ( +2 )
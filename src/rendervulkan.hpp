@@ -16,6 +16,7 @@
 
 #include "gamescope_shared.h"
 #include "backend.h"
+#include "UploadRing.h"
 
 #include "shaders/descriptor_set_constants.h"
 
@@ -201,6 +202,12 @@ public:
 
 	int memoryFence();
 
+	// The submission that fills this texture from the upload buffer, if any.
+	// Composites see it through queue order, anything else reading the
+	// texture directly, eg. scanout, needs to vulkan_wait_for_texture_upload.
+	inline uint64_t pendingUploadSeqNo() const { return m_ulPendingUploadSeqNo; }
+	inline void setPendingUploadSeqNo( uint64_t ulSeqNo ) { m_ulPendingUploadSeqNo = ulSeqNo; }
+
 	CVulkanTexture( void );
 	~CVulkanTexture( void );
 
@@ -246,6 +253,8 @@ private:
 
 	EStreamColorspace m_streamColorspace = k_EStreamColorspace_Unknown;
 
+	uint64_t m_ulPendingUploadSeqNo = 0;
+
 	struct wlr_dmabuf_attributes m_dmabuf = {};
 };
 
@@ -410,7 +419,36 @@ gamescope::OwningRc<CVulkanTexture> vulkan_create_texture_from_wlr_buffer( struc
 
 std::optional<uint64_t> vulkan_composite( struct FrameInfo_t *frameInfo, gamescope::Rc<CVulkanTexture> pScreenshotTexture, bool partial, gamescope::Rc<CVulkanTexture> pOutputOverride = nullptr, bool increment = true, std::unique_ptr<CVulkanCmdBuffer> pInCommandBuffer = nullptr );
 void vulkan_wait( uint64_t ulSeqNo, bool bReset );
+// Like vulkan_wait, but safe to call off the compositor thread.
+void vulkan_wait_for_completion( uint64_t ulSeqNo );
+void vulkan_wait_for_texture_upload( CVulkanTexture *pTexture );
+void vulkan_wait_for_texture_uploads( const FrameInfo_t *pFrameInfo );
 gamescope::Rc<CVulkanTexture> vulkan_get_last_output_image( bool partial, bool defer );
+
+enum class EUpscaleImageUsage : uint32_t
+{
+	// The FSR/NIS intermediate, only ever used by one composite after another.
+	Temp,
+	// Pre-emptively upscaled commits, one for each in flight.
+	Preemptive,
+};
+
+struct UpscaleImage_t
+{
+	gamescope::OwningRc<CVulkanTexture> pTexture;
+	// Timeline of upscale -> release, to be used as acquire for the commit.
+	std::shared_ptr<gamescope::CTimeline> pReleaseTimeline;
+	uint64_t ulLastPoint = 0ul;
+
+	bool IsIdle() const { return !pTexture->IsInUse(); }
+	uint64_t GetSize() const { return pTexture->totalSize(); }
+};
+
+// From a pool kept across size changes, up to upscale_image_pool_budget_mb.
+// Compositor thread only.
+UpscaleImage_t *vulkan_acquire_upscale_image( uint32_t uWidth, uint32_t uHeight, uint32_t uDrmFormat, EUpscaleImageUsage eUsage );
+// Frees the idle ones for eUsage straight away rather than when the pool is over budget.
+void vulkan_release_idle_upscale_images( EUpscaleImageUsage eUsage );
 gamescope::Rc<CVulkanTexture> vulkan_acquire_screenshot_texture(uint32_t width, uint32_t height, bool exportable, uint32_t drmFormat, EStreamColorspace colorspace = k_EStreamColorspace_Unknown);
 
 void vulkan_present_to_window( void );
@@ -539,8 +577,8 @@ struct VulkanOutput_t
 
 	std::array<gamescope::OwningRc<CVulkanTexture>, 2> pScreenshotImages;
 
-	// NIS and FSR
-	gamescope::OwningRc<CVulkanTexture> tmpOutput;
+	// NIS and FSR, borrowed from the upscale image pool.
+	gamescope::Rc<CVulkanTexture> tmpOutput;
 
 	// NIS
 	gamescope::OwningRc<CVulkanTexture> nisScalerImage;
@@ -550,6 +588,7 @@ struct VulkanOutput_t
 
 enum ShaderType {
 	SHADER_TYPE_BLIT = 0,
+	SHADER_TYPE_BLIT_NV12,
 	SHADER_TYPE_BLUR,
 	SHADER_TYPE_BLUR_COND,
 	SHADER_TYPE_BLUR_FIRST_PASS,
@@ -687,6 +726,8 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(CmdEndRendering) \
 	VK_FUNC(CmdPipelineBarrier) \
 	VK_FUNC(CmdPushConstants) \
+	VK_FUNC(CmdResetQueryPool) \
+	VK_FUNC(CmdWriteTimestamp) \
 	VK_FUNC(CreateBuffer) \
 	VK_FUNC(CreateCommandPool) \
 	VK_FUNC(CreateComputePipelines) \
@@ -697,6 +738,7 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(CreateImage) \
 	VK_FUNC(CreateImageView) \
 	VK_FUNC(CreatePipelineLayout) \
+	VK_FUNC(CreateQueryPool) \
 	VK_FUNC(CreateSampler) \
 	VK_FUNC(CreateSamplerYcbcrConversion) \
 	VK_FUNC(CreateSemaphore) \
@@ -712,6 +754,7 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(DestroyPipeline) \
 	VK_FUNC(DestroySemaphore) \
 	VK_FUNC(DestroyPipelineLayout) \
+	VK_FUNC(DestroyQueryPool) \
 	VK_FUNC(DestroySampler) \
 	VK_FUNC(DestroySwapchainKHR) \
 	VK_FUNC(EndCommandBuffer) \
@@ -724,6 +767,7 @@ static inline uint32_t div_roundup(uint32_t x, uint32_t y)
 	VK_FUNC(GetImageMemoryRequirements) \
 	VK_FUNC(GetImageSubresourceLayout) \
 	VK_FUNC(GetMemoryFdKHR) \
+	VK_FUNC(GetQueryPoolResults) \
 	VK_FUNC(GetSemaphoreCounterValue) \
 	VK_FUNC(GetSwapchainImagesKHR) \
 	VK_FUNC(MapMemory) \
@@ -762,6 +806,21 @@ struct VulkanTimelinePoint_t
 	uint64_t ulPoint;
 };
 
+struct VulkanUploadBuffer_t
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	uint8_t *pData = nullptr;
+	uint64_t ulSize = 0;
+};
+
+struct VulkanUploadRegion_t
+{
+	void *pData;
+	VkBuffer buffer;
+	uint32_t uOffset;
+};
+
 class CVulkanDevice
 {
 public:
@@ -774,6 +833,8 @@ public:
 	uint64_t submit( std::unique_ptr<CVulkanCmdBuffer> cmdBuf);
 	uint64_t submitInternal( CVulkanCmdBuffer* cmdBuf );
 	void wait(uint64_t sequence, bool reset = true);
+	// Only waits, doesn't retire or reset anything, so can be called from any thread.
+	void waitForCompletion(uint64_t sequence);
 	void waitIdle(bool reset = true);
 	void garbageCollect();
 	inline VkDescriptorSet descriptorSet()
@@ -786,6 +847,7 @@ public:
 	std::shared_ptr<VulkanTimelineSemaphore_t> CreateTimelineSemaphore( uint64_t ulStartingPoint, bool bShared = false );
 	std::shared_ptr<VulkanTimelineSemaphore_t> ImportTimelineSemaphore( gamescope::CTimeline *pTimeline );
 
+	// What the upload buffer starts out as, it grows if it runs out.
 	static const uint32_t upload_buffer_size = 1920 * 1080 * 4;
 
 	inline VkDevice device() { return m_device; }
@@ -797,31 +859,21 @@ public:
 	inline VkCommandPool generalCommandPool() {return m_generalCommandPool;}
 	inline uint32_t queueFamily() {return m_queueFamily;}
 	inline uint32_t generalQueueFamily() {return m_generalQueueFamily;}
-	inline VkBuffer uploadBuffer() {return m_uploadBuffer;}
 	inline VkPipelineLayout pipelineLayout() {return m_pipelineLayout;}
 	inline int drmRenderFd() {return m_drmRendererFd;}
 	inline bool supportsModifiers() {return m_bSupportsModifiers;}
 	inline bool hasDrmPrimaryDevId() {return m_bHasDrmPrimaryDevId;}
 	inline dev_t primaryDevId() {return m_drmPrimaryDevId;}
 	inline bool supportsFp16() {return m_bSupportsFp16;}
+	inline bool supportsTimestamps() {return m_uTimestampValidBits != 0;}
+	inline uint32_t timestampValidBits() {return m_uTimestampValidBits;}
+	inline float timestampPeriod() {return m_flTimestampPeriod;}
 
-	inline std::pair<void *, uint32_t> uploadBufferData(uint32_t size)
-	{
-		assert(size <= upload_buffer_size);
-
-		m_uploadBufferOffset = align(m_uploadBufferOffset, 16);
-		if (m_uploadBufferOffset + size > upload_buffer_size)
-		{
-			fprintf(stderr, "Exceeded uploadBufferData\n");
-			waitIdle(false);
-		}
-
-		uint32_t uOffset = m_uploadBufferOffset;
+	// Space in the upload buffer for the next submission to read from.
+	// It stays valid until that submission completes, so there's no need to wait.
+	VulkanUploadRegion_t uploadBufferData(uint32_t size);
 
-		uint8_t *ptr = ((uint8_t*)m_uploadBufferData) + uOffset;
-		m_uploadBufferOffset += size;
-		return std::make_pair( ptr, uOffset );
-	}
+	void dumpUploadStats();
 
 	#define VK_FUNC(x) PFN_vk##x x = nullptr;
 	struct
@@ -842,6 +894,9 @@ protected:
 	bool createPools();
 	bool createShaders();
 	bool createScratchResources();
+	bool createUploadBuffer( uint64_t ulSize, VulkanUploadBuffer_t *pOutBuffer );
+	void destroyUploadBuffer( VulkanUploadBuffer_t &uploadBuffer );
+	void retireUploads( uint64_t ulCompletedSeqNo );
 	VkPipeline compilePipeline(uint32_t layerCount, uint32_t ycbcrMask, ShaderType type, uint32_t blur_layer_count, uint32_t composite_debug, uint32_t colorspace_mask, uint32_t output_eotf, bool itm_enable);
 	void compileAllPipelines();
 
@@ -866,6 +921,8 @@ protected:
 
 	bool m_bSupportsFp16 = false;
 	bool m_bHasDrmPrimaryDevId = false;
+	uint32_t m_uTimestampValidBits = 0;
+	float m_flTimestampPeriod = 1.0f;
 	bool m_bSupportsModifiers = false;
 	bool m_bInitialized = false;
 
@@ -885,10 +942,13 @@ protected:
 	std::array<VkDescriptorSet, k_uMaxConcurrentSubmits * 3> m_descriptorSets;
 	uint32_t m_currentDescriptorSet = 0;
 
-	VkBuffer m_uploadBuffer;
-	VkDeviceMemory m_uploadBufferMemory;
-	void *m_uploadBufferData;
-	uint32_t m_uploadBufferOffset = 0;
+	VulkanUploadBuffer_t m_uploadBuffer;
+	gamescope::CUploadRing m_uploadRing{ upload_buffer_size };
+	// Upload buffers we have outgrown, and the submission after which the
+	// GPU is done with them. 0 until the next submission is made.
+	std::vector<std::pair<uint64_t, VulkanUploadBuffer_t>> m_outgrownUploadBuffers;
+	uint64_t m_ulUploadBufferGrowCount = 0;
+	uint64_t m_ulWaitIdleCount = 0;
 
 	VkSemaphore m_scratchTimelineSemaphore;
 	std::atomic<uint64_t> m_submissionSeqNo = { 0 };
@@ -935,6 +995,8 @@ public:
 	void setSamplerNearest(uint32_t slot, bool nearest);
 	void setSamplerUnnormalized(uint32_t slot, bool unnormalized);
 	void bindTarget(gamescope::Rc<CVulkanTexture> target);
+	// NV12 image for SHADER_TYPE_BLIT_NV12 to write alongside the target.
+	void bindCaptureTarget(gamescope::Rc<CVulkanTexture> target);
 	void clearState();
 	template<class PushData, class... Args>
 	void uploadConstants(Args&&... args);
@@ -959,7 +1021,13 @@ public:
 	const std::vector<VulkanTimelinePoint_t> &GetExternalDependencies() const { return m_ExternalDependencies; }
 	const std::vector<VulkanTimelinePoint_t> &GetExternalSignals() const { return m_ExternalSignals; }
 
+	// Measures how long this command buffer takes to execute on the GPU,
+	// the result is handed to the frame timing recorder once it has completed.
+	void beginTimestampQuery(uint64_t ulFrameId);
+
 private:
+	void resolveTimestampQuery();
+
 	VkCommandBuffer m_cmdBuffer;
 	CVulkanDevice *m_device;
 
@@ -975,6 +1043,7 @@ private:
 	std::bitset<VKR_SAMPLER_SLOTS> m_useSrgb;
 	std::array<SamplerState, VKR_SAMPLER_SLOTS> m_samplerState;
 	CVulkanTexture *m_target;
+	CVulkanTexture *m_captureTarget = nullptr;
 
 	std::array<CVulkanTexture *, VKR_LUT3D_COUNT> m_shaperLut;
 	std::array<CVulkanTexture *, VKR_LUT3D_COUNT> m_lut3D;
@@ -982,6 +1051,11 @@ private:
 	std::vector<VulkanTimelinePoint_t> m_ExternalDependencies;
 	std::vector<VulkanTimelinePoint_t> m_ExternalSignals;
 
+	VkQueryPool m_timestampQueryPool = VK_NULL_HANDLE;
+	std::optional<uint64_t> m_oTimestampFrameId;
+	uint64_t m_ulTimestampSubmitTime = 0;
+
+	VkBuffer m_renderBuffer = VK_NULL_HANDLE;
 	uint32_t m_renderBufferOffset = 0;
 };
 
@@ -0,0 +1,225 @@
+// Checks the screenshot path's pixel conversions come out exactly the same as
+// the per-pixel loops they replaced did, for all the sizes and pitches
+// a readback texture could have, and that the screenshot workers
+// turn work away rather than making the compositor wait.
+//
+// Headless: the readback is random data standing in for a mapped texture,
+// and libavif's IDENTITY matrix conversion (Y = G, U = B, V = R at the
+// same depth and full range) is spelled out here rather than linked in.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "Utils/PixelUnpack.h"
+#include "Utils/WorkerPool.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+struct Size_t
+{
+    uint32_t uWidth;
+    uint32_t uHeight;
+    // Extra bytes at the end of every row, like a driver's pitch alignment.
+    uint32_t uPitchPadding;
+};
+
+static constexpr Size_t k_Sizes[] =
+{
+    { 1, 1, 0 },
+    { 7, 3, 4 },
+    { 8, 2, 0 },
+    { 13, 5, 12 },
+    { 1280, 800, 0 },
+    { 1366, 17, 248 },
+};
+
+static std::vector<uint8_t> RandomReadback( const Size_t &size, size_t zPitch, uint32_t uSeed )
+{
+    std::mt19937 rng{ uSeed };
+    std::vector<uint8_t> data( zPitch * size.uHeight );
+    for ( uint8_t &byte : data )
+        byte = uint8_t( rng() );
+    return data;
+}
+
+// What steamcompmgr did before: an interleaved RGB copy for avifImageRGBToYUV...
+static std::vector<uint16_t> OldUnpackA2R10G10B10( const uint8_t *mappedData, size_t rowPitch, uint32_t uWidth, uint32_t uHeight )
+{
+    constexpr uint32_t kCompCnt = 3;
+    auto imageData = std::vector<uint16_t>( uWidth * uHeight * kCompCnt );
+
+    for (uint32_t y = 0; y < uHeight; y++)
+    {
+        for (uint32_t x = 0; x < uWidth; x++)
+        {
+            uint32_t *pInPixel = (uint32_t *)&mappedData[(y * rowPitch) + x * (32 / 8)];
+            uint32_t uInPixel = *pInPixel;
+
+            imageData[y * uWidth * kCompCnt + x * kCompCnt + 0] = (uInPixel & (0b1111111111 << 20)) >> 20;
+            imageData[y * uWidth * kCompCnt + x * kCompCnt + 1] = (uInPixel & (0b1111111111 << 10)) >> 10;
+            imageData[y * uWidth * kCompCnt + x * kCompCnt + 2] = (uInPixel & (0b1111111111 << 0))  >> 0;
+        }
+    }
+
+    return imageData;
+}
+
+// ...and the PNG one with the channels swapped.
+static std::vector<uint8_t> OldSwizzleBGRA8( const uint8_t *mappedData, size_t rowPitch, uint32_t uWidth, uint32_t uHeight )
+{
+    auto imageData = std::vector<uint8_t>(uWidth * uHeight * 4);
+    const uint32_t comp = 4;
+    const uint32_t pitch = uWidth * comp;
+    for (uint32_t y = 0; y < uHeight; y++)
+    {
+        for (uint32_t x = 0; x < uWidth; x++)
+        {
+            // BGR...
+            imageData[y * pitch + x * comp + 0] = mappedData[y * rowPitch + x * comp + 2];
+            imageData[y * pitch + x * comp + 1] = mappedData[y * rowPitch + x * comp + 1];
+            imageData[y * pitch + x * comp + 2] = mappedData[y * rowPitch + x * comp + 0];
+            imageData[y * pitch + x * comp + 3] = 255;
+        }
+    }
+    return imageData;
+}
+
+static void test_unpack_a2r10g10b10()
+{
+    uint32_t uSeed = 1;
+    for ( const Size_t &size : k_Sizes )
+    {
+        const size_t zSrcPitch = size.uWidth * 4 + size.uPitchPadding;
+        std::vector<uint8_t> readback = RandomReadback( size, zSrcPitch, uSeed++ );
+
+        std::vector<uint16_t> expected = OldUnpackA2R10G10B10( readback.data(), zSrcPitch, size.uWidth, size.uHeight );
+
+        // Planes with their own padding, as avifImageAllocatePlanes is free to do.
+        const size_t zPlanePitch = ( size.uWidth * sizeof( uint16_t ) + 63 ) & ~size_t( 63 );
+        const size_t zPlaneElements = zPlanePitch / sizeof( uint16_t );
+
+        for ( auto fnUnpack : { UnpackA2R10G10B10ToPlanes, UnpackA2R10G10B10ToPlanesScalar } )
+        {
+            // Y, U and V.
+            std::vector<uint16_t> planes[3];
+            for ( auto &plane : planes )
+                plane.assign( zPlaneElements * size.uHeight, 0xdead );
+
+            fnUnpack(
+                planes[2].data(), zPlanePitch,
+                planes[0].data(), zPlanePitch,
+                planes[1].data(), zPlanePitch,
+                readback.data(), zSrcPitch, size.uWidth, size.uHeight );
+
+            uint32_t uMismatches = 0;
+            uint32_t uPaddingTouched = 0;
+            for ( uint32_t y = 0; y < size.uHeight; y++ )
+            {
+                for ( uint32_t x = 0; x < size.uWidth; x++ )
+                {
+                    const uint16_t *pRGB = &expected[ ( y * size.uWidth + x ) * 3 ];
+                    const size_t zIndex = y * zPlaneElements + x;
+
+                    if ( planes[0][zIndex] != pRGB[1] || planes[1][zIndex] != pRGB[2] || planes[2][zIndex] != pRGB[0] )
+                        uMismatches++;
+                }
+
+                for ( size_t x = size.uWidth; x < zPlaneElements; x++ )
+                {
+                    for ( auto &plane : planes )
+                        uPaddingTouched += plane[ y * zPlaneElements + x ] != 0xdead;
+                }
+            }
+
+            TEST_CHECK( uMismatches == 0 );
+            TEST_CHECK( uPaddingTouched == 0 );
+        }
+    }
+}
+
+static void test_swizzle_bgra8()
+{
+    uint32_t uSeed = 100;
+    for ( const Size_t &size : k_Sizes )
+    {
+        const size_t zSrcPitch = size.uWidth * 4 + size.uPitchPadding;
+        std::vector<uint8_t> readback = RandomReadback( size, zSrcPitch, uSeed++ );
+
+        std::vector<uint8_t> expected = OldSwizzleBGRA8( readback.data(), zSrcPitch, size.uWidth, size.uHeight );
+
+        for ( auto fnSwizzle : { SwizzleBGRA8ToRGBA8, SwizzleBGRA8ToRGBA8Scalar } )
+        {
+            std::vector<uint8_t> image( size.uWidth * size.uHeight * 4 );
+            fnSwizzle( image.data(), size.uWidth * 4, readback.data(), zSrcPitch, size.uWidth, size.uHeight );
+
+            TEST_CHECK( image == expected );
+        }
+    }
+}
+
+static void test_workers_run_everything()
+{
+    std::atomic<uint32_t> uRan = { 0 };
+
+    {
+        CWorkerPool workers{ "scrsh-test", 2, 4 };
+        for ( uint32_t i = 0; i < 100; i++ )
+        {
+            // Like the compositor, try again next frame when it's full.
+            while ( !workers.Submit( [&]() { uRan++; } ) )
+                ;
+        }
+
+        workers.Flush();
+        TEST_CHECK( uRan == 100 );
+
+        // Anything still queued is run on destruction.
+        TEST_CHECK( workers.Submit( [&]() { uRan++; } ) );
+    }
+
+    TEST_CHECK( uRan == 101 );
+}
+
+static void test_workers_refuse_when_full()
+{
+    // Jobs stuck waiting on the GPU must never make Submit wait.
+    std::mutex mutGpu;
+    std::unique_lock gpuBusy{ mutGpu };
+    std::atomic<uint32_t> uRan = { 0 };
+
+    CWorkerPool workers{ "scrsh-test", 2, 4 };
+
+    uint32_t uAccepted = 0;
+    for ( uint32_t i = 0; i < 10; i++ )
+    {
+        if ( workers.Submit( [&]() { std::scoped_lock wait{ mutGpu }; uRan++; } ) )
+            uAccepted++;
+    }
+
+    TEST_CHECK( uAccepted == workers.GetMaxJobs() );
+    TEST_CHECK( uRan == 0 );
+
+    gpuBusy.unlock();
+    workers.Flush();
+
+    TEST_CHECK( uRan == uAccepted );
+    TEST_CHECK( workers.Submit( [&]() { uRan++; } ) );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "screenshot_tests\n" );
+
+    test_unpack_a2r10g10b10();
+    test_swizzle_bgra8();
+    test_workers_run_everything();
+    test_workers_refuse_when_full();
+
+    return TestExitCode();
+}
@@ -0,0 +1,61 @@
+#include <benchmark/benchmark.h>
+
+#include "Script/Script.h"
+
+using namespace gamescope;
+
+// What calling a script hook costs the compositor thread, which it does
+// for OnPostPaint after every paint: with nothing hooked, taking the
+// script lock to find that out against checking MightHaveHooks first,
+// and with an empty Lua function hooked, for the cost of the call itself.
+
+std::string_view GetHomeDir()
+{
+    return "/nonexistent";
+}
+
+static void Benchmark_NoHooks_Locked( benchmark::State &state )
+{
+    for ( auto _ : state )
+    {
+        CScriptScopedLock script;
+        script.Manager().CallHook( "OnPostPaint" );
+    }
+}
+
+static void Benchmark_NoHooks_MightHaveHooks( benchmark::State &state )
+{
+    for ( auto _ : state )
+    {
+        if ( CScriptManager::MightHaveHooks( "OnPostPaint" ) )
+        {
+            CScriptScopedLock script;
+            script.Manager().CallHook( "OnPostPaint" );
+        }
+    }
+}
+
+static void Benchmark_EmptyLuaHook( benchmark::State &state )
+{
+    static bool s_bHooked = false;
+    if ( !s_bHooked )
+    {
+        CScriptScopedLock().Manager().RunScriptText( "gamescope.hook( 'OnBenchmark', function() end )" );
+        s_bHooked = true;
+    }
+
+    for ( auto _ : state )
+    {
+        if ( CScriptManager::MightHaveHooks( "OnBenchmark" ) )
+        {
+            CScriptScopedLock script;
+            script.Manager().CallHook( "OnBenchmark" );
+        }
+    }
+}
+
+BENCHMARK( Benchmark_NoHooks_Locked );
+BENCHMARK( Benchmark_NoHooks_MightHaveHooks );
+BENCHMARK( Benchmark_EmptyLuaHook );
+
+BENCHMARK_MAIN();
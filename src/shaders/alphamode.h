@@ -1,6 +1,8 @@
 #ifndef ALPHAMODE_H
 #define ALPHAMODE_H
 
+#include "composite_precision.h"
+
 const int alpha_mode_premult = 0;
 const int alpha_mode_coverage = 1;
 const int alpha_mode_none = 2;
@@ -11,9 +13,9 @@ uint get_layer_alphamode(uint layerIdx) {
     return bitfieldExtract(u_alphaMode, int(layerIdx) * alpha_mode_max_bits, alpha_mode_max_bits);
 }
 
-vec4 BlendLayer( uint layerIdx, vec4 outputValue, vec4 layerColor, float opacity )
+mvec4 BlendLayer( uint layerIdx, mvec4 outputValue, mvec4 layerColor, mfloat opacity )
 {
-    float layerAlpha = opacity * layerColor.a;
+    mfloat layerAlpha = opacity * layerColor.a;
     
     uint alphaMode = get_layer_alphamode( layerIdx );
     if ( alphaMode == alpha_mode_premult )
@@ -23,11 +25,11 @@ vec4 BlendLayer( uint layerIdx, vec4 outputValue, vec4 layerColor, float opacity
         // We need to then multiply that by the layer's opacity to get to our
         // final premultiplied state.
         // For the other side of things, we need to multiply by (1.0f - (layerColor.a * opacity))
-        outputValue = layerColor * opacity + outputValue * (1.0f - layerAlpha);
+        outputValue = layerColor * opacity + outputValue * (mfloat(1.0f) - layerAlpha);
     }
     else if ( alphaMode == alpha_mode_coverage ) // coverage for accessibility looks
     {
-        outputValue = layerColor * layerAlpha + outputValue * (1.0f - layerAlpha);
+        outputValue = layerColor * layerAlpha + outputValue * (mfloat(1.0f) - layerAlpha);
     }
     else // none
     {
@@ -37,9 +39,9 @@ vec4 BlendLayer( uint layerIdx, vec4 outputValue, vec4 layerColor, float opacity
     return outputValue;
 }
 
-vec3 BlendLayer( uint layerIdx, vec3 outputValue, vec4 layerColor, float opacity )
+mvec3 BlendLayer( uint layerIdx, mvec3 outputValue, mvec4 layerColor, mfloat opacity )
 {
-    return BlendLayer( layerIdx, vec4( outputValue, 1 ), layerColor, opacity ).rgb;
+    return BlendLayer( layerIdx, mvec4( outputValue, 1 ), layerColor, opacity ).rgb;
 }
 
 #endif
\ No newline at end of file
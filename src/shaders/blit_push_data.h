@@ -16,5 +16,10 @@ uniform layers_t {
     float u_nitsToLinear; // hdr -> sdr
     float u_itmSdrNits;
     float u_itmTargetNits;
+
+    // NV12 capture, only read by cs_composite_blit_nv12.
+    mat3x4 u_captureCTM;
+    uvec2 u_captureHalfExtent;
+    float u_captureQuantize; // levels of dst's format, eg. 255 or 1023
 };
 
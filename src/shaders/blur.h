@@ -480,7 +480,7 @@ vec4 gaussian_blur(sampler2D layerSampler, uint layerIdx, vec2 pos, uint radius,
         offsets[18] = 36.43599701;
     }
 
-    vec4 color = vec4(0);
+    mvec4 color = mvec4(0);
 
     uint colorspace = get_layer_colorspace(layerIdx);
 
@@ -492,18 +492,19 @@ vec4 gaussian_blur(sampler2D layerSampler, uint layerIdx, vec2 pos, uint radius,
             posOffset = vec2(offsets[i], 0);
 
         vec4 tmp0 = textureCond(layerSampler, layerIdx, pos - posOffset, unnormalized);
-        tmp0.rgb = colorspace_plane_degamma_tf(tmp0.rgb, colorspace) * weights[i];
-        color += tmp0;
+        tmp0.rgb = colorspace_plane_degamma_tf(tmp0.rgb, colorspace);
+        color += mvec4(mvec3(tmp0.rgb) * mfloat(weights[i]), mfloat(tmp0.a));
 
         vec4 tmp1 = textureCond(layerSampler, layerIdx, pos + posOffset, unnormalized);
-        tmp1.rgb = colorspace_plane_degamma_tf(tmp1.rgb, colorspace) * weights[i];
-        color += tmp1;
+        tmp1.rgb = colorspace_plane_degamma_tf(tmp1.rgb, colorspace);
+        color += mvec4(mvec3(tmp1.rgb) * mfloat(weights[i]), mfloat(tmp1.a));
     }
 
+    vec4 result = vec4(color);
     if (vertical)
     {
-        color.rgb = apply_layer_color_mgmt(color.rgb, layerIdx, colorspace);
+        result.rgb = apply_layer_color_mgmt(result.rgb, layerIdx, colorspace);
     }
 
-    return color;
+    return result;
 }
@@ -146,6 +146,32 @@ vec4 sampleBilinear(sampler2D tex, vec2 coord, uint colorspace, bool unnormalize
     return mix(temp1, temp0, filterWeight.y);
 }
 
+// Averages a grid of bilinear taps over the layer texels one output pixel
+// covers, footprint in texels. Plain bilinear only ever looks at 2x2 texels
+// so it aliases badly for small captures and thumbnails.
+//
+// Mirrored by downscale_filter_tests.cpp, keep the two in sync.
+vec4 sampleDownscaled(sampler2D tex, vec2 coord, vec2 footprint, uint colorspace, bool unnormalized) {
+    // Taps no more than a texel apart, so the bilinear weights between them
+    // add up to an even box over the footprint. Landing them 2 texels apart
+    // would put them all on the same texel of any 1 texel detail.
+    ivec2 taps = clamp(ivec2(ceil(footprint)), ivec2(1), ivec2(8));
+    vec2 texelToCoord = unnormalized ? vec2(1.0f) : vec2(1.0f) / vec2(textureSize(tex, 0));
+
+    // coord lands on the first texel the output pixel covers
+    // (see offsetPixelCenter), not the middle of them.
+    vec2 center = coord + (footprint - 1.0f) * 0.5f * texelToCoord;
+
+    vec4 color = vec4(0.0f);
+    for (int y = 0; y < taps.y; y++) {
+        for (int x = 0; x < taps.x; x++) {
+            vec2 offset = ((vec2(x, y) + 0.5f) / vec2(taps) - 0.5f) * footprint;
+            color += sampleBilinear(tex, center + offset * texelToCoord, colorspace, unnormalized);
+        }
+    }
+    return color / float(taps.x * taps.y);
+}
+
 vec4 sampleLayerEx(sampler2D layerSampler, uint offsetLayerIdx, uint colorspaceLayerIdx, vec2 uv, bool unnormalized) {
     vec2 coord = ((uv + u_offset[offsetLayerIdx]) * u_scale[offsetLayerIdx]);
     vec2 texSize = textureSize(layerSampler, 0);
@@ -173,6 +199,9 @@ vec4 sampleLayerEx(sampler2D layerSampler, uint offsetLayerIdx, uint colorspaceL
     else if (get_layer_shaderfilter(offsetLayerIdx) == filter_linear_emulated) {
         color = sampleBilinear(layerSampler, coord, colorspace, unnormalized);
     }
+    else if (get_layer_shaderfilter(offsetLayerIdx) == filter_downscale) {
+        color = sampleDownscaled(layerSampler, coord, abs(u_scale[offsetLayerIdx]), colorspace, unnormalized);
+    }
     else {
         color = sampleRegular(layerSampler, coord, colorspace);
     }
@@ -0,0 +1,142 @@
+#include "blit_push_data.h"
+#include "composite.h"
+
+vec4 sampleLayer(uint layerIdx, vec2 uv) {
+    if ((c_ycbcrMask & (1 << layerIdx)) != 0)
+        return sampleLayer(s_ycbcr_samplers[layerIdx], layerIdx, uv, false);
+    return sampleLayer(s_samplers[layerIdx], layerIdx, uv, true);
+}
+
+vec2 layerTexSize(uint layerIdx) {
+    if ((c_ycbcrMask & (1 << layerIdx)) != 0)
+        return vec2(textureSize(s_ycbcr_samplers[layerIdx], 0));
+    return vec2(textureSize(s_samplers[layerIdx], 0));
+}
+
+// Whether a layer can contribute anything to the tile between tileMin and tileMax.
+// Outside of its rect a layer samples as vec4(0), which blends to a no-op,
+// unless it has a border or replaces what's under it (alpha_mode_none).
+// Mirrored by composite_tile_cull_tests.cpp, keep the two in sync.
+bool layerTouchesTile(uint layerIdx, vec2 tileMin, vec2 tileMax) {
+    if ((u_borderMask & (1u << layerIdx)) != 0)
+        return true;
+
+    if (layerIdx != 0 && get_layer_alphamode(layerIdx) == alpha_mode_none)
+        return true;
+
+    // Same maths as sampleLayerEx, which is monotonic in uv,
+    // so the corners of the tile bound every pixel in it.
+    vec2 coordA = (tileMin + u_offset[layerIdx]) * u_scale[layerIdx];
+    vec2 coordB = (tileMax + u_offset[layerIdx]) * u_scale[layerIdx];
+    vec2 coordMin = min(coordA, coordB);
+    vec2 coordMax = max(coordA, coordB);
+
+    return all(greaterThanEqual(coordMax, vec2(0.0f))) && all(lessThan(coordMin, layerTexSize(layerIdx)));
+}
+
+vec4 compositePixel(uvec2 coord) {
+    vec2 uv = vec2(coord);
+    mvec4 outputValue = mvec4(0.0f);
+
+    if (checkDebugFlag(compositedebug_PlaneBorders))
+        outputValue = mvec4(1.0f, 0.0f, 0.0f, 0.0f);
+
+    // This workgroup's tile, which every invocation in it agrees on,
+    // so skipping layers below doesn't diverge.
+    // A pixel of slack either side in case the driver doesn't do the maths
+    // in exactly the same order as sampleLayerEx.
+    vec2 tileMin = vec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) - 1.0f;
+    vec2 tileMax = vec2((gl_WorkGroupID.xy + 1u) * gl_WorkGroupSize.xy);
+
+    if (c_layerCount > 0) {
+        if (layerTouchesTile(0, tileMin, tileMax))
+            outputValue = mvec4(sampleLayer(0, uv)) * mfloat(u_opacity[0]);
+        else
+            outputValue = mvec4(0.0f);
+    }
+
+    for (int i = 1; i < c_layerCount; i++) {
+        // Overlays and notifications only cover a few tiles.
+        if (!layerTouchesTile(i, tileMin, tileMax))
+            continue;
+
+        vec4 layerColor = sampleLayer(i, uv);
+        outputValue = BlendLayer( i, outputValue, mvec4(layerColor), mfloat(u_opacity[i]) );
+    }
+
+    vec4 encodedValue = vec4(outputValue);
+    encodedValue.rgb = encodeOutputColor(encodedValue.rgb);
+    return encodedValue;
+}
+
+#ifdef COMPOSITE_NV12_CAPTURE
+// Writes the NV12 capture of the composite from the same dispatch,
+// instead of reading dst back in a cs_rgb_to_nv12 pass.
+//
+// Everything here has to come out bit-identical to cs_rgb_to_nv12
+// reading dst, so we go through the same quantisation and maths,
+// in the same order.
+//
+// Mirrored by fused_nv12_capture_tests.cpp, keep the two in sync.
+
+shared mvec3 s_captureColor[8][8];
+
+mvec3 applyCaptureColorMatrix(mvec3 rgb) {
+    return mvec4(linearToSrgb(vec3(rgb)), 1.0f) * mmat3x4(u_captureCTM);
+}
+
+void captureNV12(uvec2 coord, vec3 encodedColor) {
+    uvec2 localId = gl_LocalInvocationID.xy;
+
+    // What cs_rgb_to_nv12 would sample back from dst, which is 8 or 10 bit UNORM.
+    vec3 quantized = round(clamp(encodedColor, vec3(0.0f), vec3(1.0f)) * u_captureQuantize) / u_captureQuantize;
+    vec3 color = colorspace_plane_degamma_tf(quantized, colorspace_sRGB);
+
+    s_captureColor[localId.y][localId.x] = mvec3(color);
+    barrier();
+
+    // The workgroup is 8x8, so every 2x2 chroma block lives in it.
+    uvec2 chromaCoord = coord / 2u;
+    if (any(greaterThanEqual(chromaCoord, u_captureHalfExtent)))
+        return;
+
+    float y = float(applyCaptureColorMatrix(mvec3(color)).x);
+    imageStore(dst_capture_luma, ivec2(coord), vec4(y, 0.0f, 0.0f, 1.0f));
+
+    if (all(equal(localId & 1u, uvec2(0u)))) {
+        mvec3 avg_color = (s_captureColor[localId.y    ][localId.x    ] +
+                           s_captureColor[localId.y    ][localId.x + 1] +
+                           s_captureColor[localId.y + 1][localId.x    ] +
+                           s_captureColor[localId.y + 1][localId.x + 1]) / mfloat(4.0f);
+        vec2 uv = vec2(applyCaptureColorMatrix(avg_color).yz);
+        imageStore(dst_capture_chroma, ivec2(chromaCoord), vec4(uv, 0.0f, 1.0f));
+    }
+}
+#endif
+
+void main() {
+    uvec2 coord = uvec2(gl_GlobalInvocationID.x, gl_GlobalInvocationID.y);
+    uvec2 outSize = imageSize(dst);
+    bool inBounds = coord.x < outSize.x && coord.y < outSize.y;
+
+#ifndef COMPOSITE_NV12_CAPTURE
+    if (!inBounds)
+        return;
+#endif
+
+    // Out of bounds invocations still have to reach the barrier
+    // in captureNV12.
+    vec4 outputValue = vec4(0.0f);
+    if (inBounds) {
+        outputValue = compositePixel(coord);
+        imageStore(dst, ivec2(coord), outputValue);
+
+        // Indicator to quickly tell if we're in the compositing path or not.
+        if (checkDebugFlag(compositedebug_Markers))
+            compositing_debug(coord);
+    }
+
+#ifdef COMPOSITE_NV12_CAPTURE
+    captureNV12(coord, outputValue.rgb);
+#endif
+}
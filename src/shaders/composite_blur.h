@@ -0,0 +1,39 @@
+#include "blit_push_data.h"
+
+#define BLUR_DONT_SCALE 1
+#include "composite.h"
+#include "blur.h"
+
+vec4 sampleLayer(uint layerIdx, vec2 uv) {
+    if ((c_ycbcrMask & (1 << layerIdx)) != 0)
+        return sampleLayer(s_ycbcr_samplers[layerIdx], layerIdx, uv, false);
+    return sampleLayer(s_samplers[layerIdx], layerIdx, uv, true);
+}
+
+void main() {
+    uvec2 coord = uvec2(gl_GlobalInvocationID.x, gl_GlobalInvocationID.y);
+    uvec2 outSize = imageSize(dst);
+
+    if (coord.x >= outSize.x || coord.y >= outSize.y)
+        return;
+
+    vec2 uv = vec2(coord);
+    mvec3 outputValue = mvec3(0.0f);
+
+    if (checkDebugFlag(compositedebug_PlaneBorders))
+        outputValue = mvec3(1.0f, 0.0f, 0.0f);
+
+    if (c_layerCount > 0)
+        outputValue = mvec3(gaussian_blur(s_samplers[VKR_BLUR_EXTRA_SLOT], 0, vec2(coord), u_blur_radius, true, true).rgb);
+
+    for (int i = c_blur_layer_count; i < c_layerCount; i++) {
+        vec4 layerColor = sampleLayer(i, uv);
+        outputValue = BlendLayer( i, outputValue, mvec4(layerColor), mfloat(u_opacity[i]) );
+    }
+
+    vec3 encodedValue = encodeOutputColor(vec3(outputValue));
+    imageStore(dst, ivec2(coord), vec4(encodedValue, 0));
+
+    if (checkDebugFlag(compositedebug_Markers))
+        compositing_debug(coord);
+}
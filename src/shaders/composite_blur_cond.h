@@ -0,0 +1,57 @@
+#include "blit_push_data.h"
+
+#define BLUR_DONT_SCALE 1
+#include "composite.h"
+#include "blur.h"
+
+vec4 sampleLayer(uint layerIdx, vec2 uv) {
+    if ((c_ycbcrMask & (1 << layerIdx)) != 0)
+        return sampleLayer(s_ycbcr_samplers[layerIdx], layerIdx, uv, false);
+    return sampleLayer(s_samplers[layerIdx], layerIdx, uv, true);
+}
+
+void main() {
+    uvec2 coord = uvec2(gl_GlobalInvocationID.x, gl_GlobalInvocationID.y);
+    uvec2 outSize = imageSize(dst);
+
+    if (coord.x >= outSize.x || coord.y >= outSize.y)
+        return;
+
+    vec2 uv = vec2(coord);
+    mvec3 outputValue = mvec3(0.0f);
+
+    if (checkDebugFlag(compositedebug_PlaneBorders))
+        outputValue = mvec3(1.0f, 0.0f, 0.0f);
+
+    // Full precision whatever we blend in, so we pick the same way as FP32.
+    float finalRevAlpha = 1.0f;
+
+    for (int i = c_blur_layer_count; i < c_layerCount; i++) {
+        vec4 layerColor = sampleLayer(i, uv);
+        float opacity = u_opacity[i];
+        float layerAlpha = opacity * layerColor.a;
+        float revAlpha = (1.0f - layerAlpha);
+        outputValue = BlendLayer( i, outputValue, mvec4(layerColor), mfloat(opacity) );
+        finalRevAlpha *= revAlpha;
+    }
+
+    if (c_layerCount > 0) {
+        if (finalRevAlpha < 0.95) {
+            outputValue += mvec3(gaussian_blur(s_samplers[VKR_BLUR_EXTRA_SLOT], 0, vec2(coord), u_blur_radius, true, true).rgb * finalRevAlpha);
+        } else {
+            outputValue = mvec3(sampleLayer(0, uv).rgb) * mfloat(u_opacity[0]);
+            for (int i = 1; i < c_blur_layer_count; i++) {
+                vec4 layerColor = sampleLayer(i, uv);
+                float opacity = u_opacity[i];
+                float layerAlpha = opacity * layerColor.a;
+                outputValue = BlendLayer( i, outputValue, mvec4(layerColor), mfloat(opacity) );
+            }
+        }
+    }
+
+    vec3 encodedValue = encodeOutputColor(vec3(outputValue));
+    imageStore(dst, ivec2(coord), vec4(encodedValue, 0));
+
+    if (checkDebugFlag(compositedebug_Markers))
+        compositing_debug(coord);
+}
@@ -0,0 +1,21 @@
+#ifndef COMPOSITE_PRECISION_H
+#define COMPOSITE_PRECISION_H
+
+// Types for the maths the _fp16 composite shaders do in half precision:
+// blending layers, accumulating blur taps and the NV12 colour matrix.
+// Sampling and colour management feeding them stay in full precision.
+//
+// Mirrored by fp16_shader_tests.cpp, keep the two in sync.
+#ifdef COMPOSITE_FP16
+#define mfloat float16_t
+#define mvec3 f16vec3
+#define mvec4 f16vec4
+#define mmat3x4 f16mat3x4
+#else
+#define mfloat float
+#define mvec3 vec3
+#define mvec4 vec4
+#define mmat3x4 mat3x4
+#endif
+
+#endif
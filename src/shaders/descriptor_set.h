@@ -21,6 +21,7 @@ const int filter_nearest = 1;
 const int filter_fsr = 2;
 const int filter_nis = 3;
 const int filter_pixel = 4;
+const int filter_downscale = 5;
 const int filter_from_view = 255;
 
 const int EOTF_Gamma22 = 0;
@@ -54,3 +55,7 @@ layout(binding = 4) uniform sampler2D s_ycbcr_samplers[VKR_SAMPLER_SLOTS];
 
 layout(binding = 5) uniform sampler1D s_shaperLut[VKR_LUT3D_COUNT];
 layout(binding = 6) uniform sampler3D s_lut3D[VKR_LUT3D_COUNT];
+
+// NV12 capture written alongside dst by cs_composite_blit_nv12.
+layout(binding = 7, rgba8) writeonly uniform image2D dst_capture_luma;
+layout(binding = 8, rgba8) writeonly uniform image2D dst_capture_chroma;
@@ -77,6 +77,8 @@
 #include <signal.h>
 #include <linux/input-event-codes.h>
 #include <X11/Xmu/CurUtil.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
 #include "waitable.h"
 
 #include "main.hpp"
@@ -94,8 +96,12 @@
 #include "commit.h"
 #include "reshade_effect_manager.hpp"
 #include "BufferMemo.h"
+#include "FrameTiming.h"
+#include "HeldGamepads.h"
 #include "Utils/Process.h"
 #include "Utils/Algorithm.h"
+#include "Utils/PixelUnpack.h"
+#include "Utils/WorkerPool.h"
 
 #include "wlr_begin.hpp"
 #include "wlr/types/wlr_pointer_constraints_v1.h"
@@ -1375,6 +1381,7 @@ import_commit (
 	std::vector<struct wl_resource*> presentation_feedbacks,
 	std::optional<uint32_t> present_id,
 	uint64_t desired_present_time,
+	uint64_t input_time,
 	bool fifo )
 {
 	gamescope::Rc<commit_t> commit = new commit_t;
@@ -1390,6 +1397,7 @@ import_commit (
 		commit->feedback = *swapchain_feedback;
 	commit->present_id = present_id;
 	commit->desired_present_time = desired_present_time;
+	commit->input_time = input_time;
 	if (window_is_vr_scene_app( w )) {
 		commit->async = true;
 		commit->fifo = false;
@@ -2347,6 +2355,8 @@ static void update_touch_scaling( const struct FrameInfo_t *frameInfo )
 }
 
 #if HAVE_PIPEWIRE
+gamescope::ConVar<bool> cv_pipewire_downscale_filter{ "pipewire_downscale_filter", true, "Filter over the whole footprint of each pixel when PipeWire captures are smaller than the output, rather than plain bilinear." };
+
 static void paint_pipewire()
 {
 	static struct pipewire_buffer *s_pPipewireBuffer = nullptr;
@@ -2482,6 +2492,25 @@ static void paint_pipewire()
 			pStreamCursor->paint( pFocus->focusWindow, pFocus->overrideWindow, &frameInfo );
 	}
 
+	// Layers get shrunk here whenever the capture is smaller than them, eg. a
+	// consumer asked for a preview or thumbnail size (see calculate_capture_size).
+	// The upscale filters don't help there and plain bilinear aliases once
+	// layers get shrunk by more than 2x, so average over each pixel's footprint.
+	if ( cv_pipewire_downscale_filter )
+	{
+		for ( int i = 0; i < frameInfo.layerCount; i++ )
+		{
+			FrameInfo_t::Layer_t *pLayer = &frameInfo.layers[ i ];
+			if ( !pLayer->tex || pLayer->tex->isYcbcr() )
+				continue;
+
+			if ( pLayer->scale.x > 1.0f || pLayer->scale.y > 1.0f )
+				pLayer->filter = GamescopeUpscaleFilter::DOWNSCALE;
+		}
+	}
+
+	// For NV12 buffers, vulkan_screenshot writes the buffer from the same dispatch
+	// that composites into pRGBTexture where it can (see CanFuseNV12Capture).
 	gamescope::Rc<CVulkanTexture> pRGBTexture = s_pPipewireBuffer->texture->isYcbcr()
 		? vulkan_acquire_screenshot_texture( uWidth, uHeight, false, DRM_FORMAT_XRGB2101010 )
 		: gamescope::Rc<CVulkanTexture>{ s_pPipewireBuffer->texture };
@@ -2514,8 +2543,11 @@ static void paint_pipewire()
 	{
 		vulkan_wait( *oPipewireSequence, true );
 
+		gamescope::CScopedFrameStage submitStage{ gamescope::FrameStages::PipewireSubmit };
 		pipewire_submit_buffer( s_pPipewireBuffer );
 		s_pPipewireBuffer = nullptr;
+
+		gamescope::CFrameTimingRecorder::Get().MarkCaptured( get_time_in_nanos() );
 	}
 }
 #endif
@@ -2571,6 +2603,18 @@ gamescope::ConVar<bool> cv_paint_external_overlay_plane{ "paint_external_overlay
 gamescope::ConVar<bool> cv_paint_cursor_plane{ "paint_cursor_plane", true };
 gamescope::ConVar<bool> cv_paint_mura_plane{ "paint_mura_plane", true };
 
+static gamescope::CWorkerPool &GetScreenshotWorkers()
+{
+	// Enough for a burst of screenshots, or one every frame for a bit, to queue up
+	// behind a slow encode. The readback texture is let go of as soon as it's
+	// been copied out, so it's the encoding that this is waiting on, not the pool of those.
+	//
+	// Never destroyed, like the threads it replaces: a screenshot half written at exit
+	// shouldn't hold it up, or go on to use things that are being torn down.
+	static gamescope::CWorkerPool *s_pWorkers = new gamescope::CWorkerPool{ "gamescope-scrsh", 2, 8 };
+	return *s_pWorkers;
+}
+
 static void
 paint_all( global_focus_t *pFocus, bool async )
 {
@@ -2584,6 +2628,8 @@ paint_all( global_focus_t *pFocus, bool async )
 	gamescope_xwayland_server_t *root_server = wlserver_get_xwayland_server(0);
 	xwayland_ctx_t *root_ctx = root_server->ctx.get();
 
+	gamescope::CScopedFrameStage paintStage{ gamescope::FrameStages::PaintAll };
+
 	static long long int paintID = 0;
 
 	update_color_mgmt();
@@ -2915,9 +2961,11 @@ paint_all( global_focus_t *pFocus, bool async )
 
 	ForwardVROverlayTargets();
 
-	if ( pConnector && pConnector->Present( &frameInfo, async ) != 0 )
+	if ( pConnector )
 	{
-		return;
+		gamescope::CScopedFrameStage presentStage{ gamescope::FrameStages::Present };
+		if ( pConnector->Present( &frameInfo, async ) != 0 )
+			return;
 	}
 
 	std::optional<gamescope::GamescopeScreenshotInfo> oScreenshotInfo =
@@ -3018,8 +3066,6 @@ paint_all( global_focus_t *pFocus, bool async )
 				return;
 			}
 
-			vulkan_wait( *oScreenshotSeq, false );
-
 			uint16_t maxCLLNits = 0;
 			uint16_t maxFALLNits = 0;
 
@@ -3050,8 +3096,17 @@ paint_all( global_focus_t *pFocus, bool async )
 				}
 			}
 
-			std::thread screenshotThread = std::thread([=] {
-				pthread_setname_np( pthread_self(), "gamescope-scrsh" );
+			// Waiting for the GPU and writing the file out are left to the screenshot workers,
+			// so we can get on with the next frame. Anything they need from us is copied here.
+			const uint64_t ulScreenshotSeq = *oScreenshotSeq;
+			const uint32_t uOutputWidth = g_nOutputWidth;
+			const uint32_t uOutputHeight = g_nOutputHeight;
+			const uint32_t uCurrentOutputWidth = currentOutputWidth;
+			const uint32_t uCurrentOutputHeight = currentOutputHeight;
+
+			bool bQueued = GetScreenshotWorkers().Submit( [=]() mutable
+			{
+				vulkan_wait_for_completion( ulScreenshotSeq );
 
 				const uint8_t *mappedData = pScreenshotTexture->mappedData();
 
@@ -3059,28 +3114,11 @@ paint_all( global_focus_t *pFocus, bool async )
 
 				if ( pScreenshotTexture->format() == VK_FORMAT_A2R10G10B10_UNORM_PACK32 )
 				{
-					// Make our own copy of the image to remove the alpha channel.
-					constexpr uint32_t kCompCnt = 3;
-					auto imageData = std::vector<uint16_t>( g_nOutputWidth * g_nOutputHeight * kCompCnt );
-
-					for (uint32_t y = 0; y < g_nOutputHeight; y++)
-					{
-						for (uint32_t x = 0; x < g_nOutputWidth; x++)
-						{
-							uint32_t *pInPixel = (uint32_t *)&mappedData[(y * pScreenshotTexture->rowPitch()) + x * (32 / 8)];
-							uint32_t uInPixel = *pInPixel;
-
-							imageData[y * g_nOutputWidth * kCompCnt + x * kCompCnt + 0] = (uInPixel & (0b1111111111 << 20)) >> 20;
-							imageData[y * g_nOutputWidth * kCompCnt + x * kCompCnt + 1] = (uInPixel & (0b1111111111 << 10)) >> 10;
-							imageData[y * g_nOutputWidth * kCompCnt + x * kCompCnt + 2] = (uInPixel & (0b1111111111 << 0))  >> 0;
-						}
-					}
-
 					assert( HAVE_AVIF );
 #if HAVE_AVIF
 					avifResult avifResult = AVIF_RESULT_OK;
 
-					avifImage *pAvifImage = avifImageCreate( g_nOutputWidth, g_nOutputHeight, 10, AVIF_PIXEL_FORMAT_YUV444 );
+					avifImage *pAvifImage = avifImageCreate( uOutputWidth, uOutputHeight, 10, AVIF_PIXEL_FORMAT_YUV444 );
 					defer( avifImageDestroy( pAvifImage ) );
 					pAvifImage->yuvRange = AVIF_RANGE_FULL;
 					pAvifImage->colorPrimaries = bHDRScreenshot ? AVIF_COLOR_PRIMARIES_BT2020 : AVIF_COLOR_PRIMARIES_BT709;
@@ -3104,20 +3142,24 @@ paint_all( global_focus_t *pFocus, bool async )
 						pAvifImage->clli.maxPALL = maxFALLNits;
 					}
 
-					avifRGBImage rgbAvifImage{};
-					avifRGBImageSetDefaults( &rgbAvifImage, pAvifImage );
-					rgbAvifImage.format = AVIF_RGB_FORMAT_RGB;
-					rgbAvifImage.ignoreAlpha = AVIF_TRUE;
-
-					rgbAvifImage.pixels = (uint8_t *)imageData.data();
-					rgbAvifImage.rowBytes = g_nOutputWidth * kCompCnt * sizeof( uint16_t );
-
-					if ( ( avifResult = avifImageRGBToYUV( pAvifImage, &rgbAvifImage ) ) != AVIF_RESULT_OK ) // Not really! See Matrix Coefficients IDENTITY above.
+					if ( ( avifResult = avifImageAllocatePlanes( pAvifImage, AVIF_PLANES_YUV ) ) != AVIF_RESULT_OK )
 					{
-						xwm_log.errorf( "Failed to convert RGB to YUV: %u", avifResult );
+						xwm_log.errorf( "Failed to allocate avif planes: %u", avifResult );
 						return;
 					}
 
+					// With the IDENTITY matrix and full range, Y is G, U is B and V is R,
+					// as they are, so unpack straight into the planes rather than
+					// going through an RGB image and avifImageRGBToYUV.
+					gamescope::UnpackA2R10G10B10ToPlanes(
+						reinterpret_cast<uint16_t *>( pAvifImage->yuvPlanes[AVIF_CHAN_V] ), pAvifImage->yuvRowBytes[AVIF_CHAN_V],
+						reinterpret_cast<uint16_t *>( pAvifImage->yuvPlanes[AVIF_CHAN_Y] ), pAvifImage->yuvRowBytes[AVIF_CHAN_Y],
+						reinterpret_cast<uint16_t *>( pAvifImage->yuvPlanes[AVIF_CHAN_U] ), pAvifImage->yuvRowBytes[AVIF_CHAN_U],
+						mappedData, pScreenshotTexture->rowPitch(), uOutputWidth, uOutputHeight );
+
+					// Done with the readback, the next screenshot can have it while we encode.
+					pScreenshotTexture = nullptr;
+
 					avifEncoder *pEncoder = avifEncoderCreate();
 					defer( avifEncoderDestroy( pEncoder ) );
 					pEncoder->quality = AVIF_QUALITY_LOSSLESS;
@@ -3155,21 +3197,15 @@ paint_all( global_focus_t *pFocus, bool async )
 				else if (pScreenshotTexture->format() == VK_FORMAT_B8G8R8A8_UNORM)
 				{
 					// Make our own copy of the image to remove the alpha channel.
-					auto imageData = std::vector<uint8_t>(currentOutputWidth * currentOutputHeight * 4);
+					auto imageData = std::vector<uint8_t>(uCurrentOutputWidth * uCurrentOutputHeight * 4);
 					const uint32_t comp = 4;
-					const uint32_t pitch = currentOutputWidth * comp;
-					for (uint32_t y = 0; y < currentOutputHeight; y++)
-					{
-						for (uint32_t x = 0; x < currentOutputWidth; x++)
-						{
-							// BGR...
-							imageData[y * pitch + x * comp + 0] = mappedData[y * pScreenshotTexture->rowPitch() + x * comp + 2];
-							imageData[y * pitch + x * comp + 1] = mappedData[y * pScreenshotTexture->rowPitch() + x * comp + 1];
-							imageData[y * pitch + x * comp + 2] = mappedData[y * pScreenshotTexture->rowPitch() + x * comp + 0];
-							imageData[y * pitch + x * comp + 3] = 255;
-						}
-					}
-					if ( stbi_write_png( oScreenshotInfo->szScreenshotPath.c_str(), currentOutputWidth, currentOutputHeight, 4, imageData.data(), pitch ) )
+					const uint32_t pitch = uCurrentOutputWidth * comp;
+					// BGR...
+					gamescope::SwizzleBGRA8ToRGBA8( imageData.data(), pitch, mappedData, pScreenshotTexture->rowPitch(), uCurrentOutputWidth, uCurrentOutputHeight );
+
+					pScreenshotTexture = nullptr;
+
+					if ( stbi_write_png( oScreenshotInfo->szScreenshotPath.c_str(), uCurrentOutputWidth, uCurrentOutputHeight, 4, imageData.data(), pitch ) )
 					{
 						xwm_log.infof( "Screenshot saved to %s", oScreenshotInfo->szScreenshotPath.c_str() );
 						bScreenshotSuccess = true;
@@ -3181,10 +3217,14 @@ paint_all( global_focus_t *pFocus, bool async )
 				}
 				else if (pScreenshotTexture->format() == VK_FORMAT_G8_B8R8_2PLANE_420_UNORM)
 				{
+					auto imageData = std::vector<uint8_t>( mappedData, mappedData + pScreenshotTexture->totalSize() );
+
+					pScreenshotTexture = nullptr;
+
 					FILE *file = fopen( oScreenshotInfo->szScreenshotPath.c_str(), "wb" );
 					if (file)
 					{
-						fwrite(mappedData, 1, pScreenshotTexture->totalSize(), file );
+						fwrite(imageData.data(), 1, imageData.size(), file );
 						fclose(file);
 
 						bScreenshotSuccess = true;
@@ -3192,7 +3232,7 @@ paint_all( global_focus_t *pFocus, bool async )
 
 #if 0
 						char cmd[4096];
-						sprintf(cmd, "ffmpeg -f rawvideo -pixel_format nv12 -video_size %dx%d -i %s %s_encoded.png", pScreenshotTexture->width(), pScreenshotTexture->height(), oScreenshotInfo->szScreenshotPath.c_str(), oScreenshotInfo->szScreenshotPath.c_str() );
+						sprintf(cmd, "ffmpeg -f rawvideo -pixel_format nv12 -video_size %dx%d -i %s %s_encoded.png", uOutputWidth, uOutputHeight, oScreenshotInfo->szScreenshotPath.c_str(), oScreenshotInfo->szScreenshotPath.c_str() );
 
 						int ret = system(cmd);
 
@@ -3228,7 +3268,15 @@ paint_all( global_focus_t *pFocus, bool async )
 				}
 			});
 
-			screenshotThread.detach();
+			if ( !bQueued )
+			{
+				xwm_log.errorf( "Too many screenshots still being written. Not writing %s.", oScreenshotInfo->szScreenshotPath.c_str() );
+				if ( oScreenshotInfo->bX11PropertyRequested )
+				{
+					XDeleteProperty( root_ctx->dpy, root_ctx->root, root_ctx->atoms.gamescopeScreenShotAtom );
+					XDeleteProperty( root_ctx->dpy, root_ctx->root, root_ctx->atoms.gamescopeDebugScreenShotAtom );
+				}
+			}
 		}
 		else
 		{
@@ -3246,6 +3294,66 @@ paint_all( global_focus_t *pFocus, bool async )
 	gpuvis_trace_printf( "paint_all %i layers", (int)frameInfo.layerCount );
 }
 
+/* Fetch a bunch of props at once
+ *   all the requests go out before we wait on any reply,
+ *   so this is one round-trip rather than one per prop.
+ *   The get_* helpers below read from this until PropertyNotify
+ *   drops the entry.
+ */
+static void
+prefetch_win_props(xwayland_ctx_t *ctx, Window win, std::span<const Atom> props)
+{
+	xcb_connection_t *conn = XGetXCBConnection( ctx->dpy );
+
+	std::vector<xcb_get_property_cookie_t> cookies;
+	cookies.reserve( props.size() );
+	for ( Atom prop : props )
+		cookies.push_back( xcb_get_property( conn, false, win, prop, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT32_MAX / 4 ) );
+
+	auto &cache = ctx->windowPropertyCache[ win ];
+	for ( size_t i = 0; i < props.size(); i++ )
+	{
+		xcb_generic_error_t *error = nullptr;
+		xcb_get_property_reply_t *reply = xcb_get_property_reply( conn, cookies[i], &error );
+		free( error );
+
+		// Window is gone, leave it to the uncached path to deal with.
+		if ( !reply )
+			continue;
+
+		CachedWindowProperty_t &cached = cache[ props[i] ];
+		cached.type = reply->type;
+		cached.format = reply->format;
+		const uint8_t *value = (const uint8_t *)xcb_get_property_value( reply );
+		cached.data.assign( value, value + xcb_get_property_value_length( reply ) );
+		free( reply );
+	}
+}
+
+static const CachedWindowProperty_t *
+get_cached_prop(xwayland_ctx_t *ctx, Window win, Atom prop)
+{
+	auto winIter = ctx->windowPropertyCache.find( win );
+	if ( winIter == ctx->windowPropertyCache.end() )
+		return nullptr;
+
+	auto propIter = winIter->second.find( prop );
+	if ( propIter == winIter->second.end() )
+		return nullptr;
+
+	return &propIter->second;
+}
+
+// Format 32 props are 32-bit on the wire, unlike Xlib's longs.
+static std::span<const uint32_t>
+get_cached_prop_u32s(const CachedWindowProperty_t *cached)
+{
+	if ( cached->format != 32 )
+		return {};
+
+	return std::span<const uint32_t>( (const uint32_t *)cached->data.data(), cached->data.size() / sizeof( uint32_t ) );
+}
+
 /* Get prop from window
  *   not found: default
  *   otherwise the value
@@ -3254,6 +3362,17 @@ __attribute__((__no_sanitize_address__)) // x11 broken, returns format 32 even w
 static unsigned int
 get_prop(xwayland_ctx_t *ctx, Window win, Atom prop, unsigned int def, bool *found = nullptr )
 {
+	if ( const CachedWindowProperty_t *cached = get_cached_prop( ctx, win, prop ) )
+	{
+		std::span<const uint32_t> values = get_cached_prop_u32s( cached );
+		bool bFound = cached->type == XA_CARDINAL && !values.empty();
+		if ( found != nullptr )
+		{
+			*found = bFound;
+		}
+		return bFound ? values[0] : def;
+	}
+
 	Atom actual;
 	int format;
 	unsigned long n, left;
@@ -3284,11 +3403,26 @@ get_prop(xwayland_ctx_t *ctx, Window win, Atom prop, unsigned int def, bool *fou
 __attribute__((__no_sanitize_address__)) // x11 broken :(
 bool get_prop( xwayland_ctx_t *ctx, Window win, Atom prop, std::vector< uint32_t > &vecResult )
 {
+	vecResult.clear();
+
+	if ( const CachedWindowProperty_t *cached = get_cached_prop( ctx, win, prop ) )
+	{
+		// Like Xlib, a prop of the wrong type is found but empty.
+		if ( cached->type == None )
+			return false;
+
+		if ( cached->type == XA_CARDINAL )
+		{
+			std::span<const uint32_t> values = get_cached_prop_u32s( cached );
+			vecResult.assign( values.begin(), values.end() );
+		}
+		return true;
+	}
+
 	Atom actual;
 	int format;
 	unsigned long n, left;
 
-	vecResult.clear();
 	uint64_t *data;
 	int result = XGetWindowProperty(ctx->dpy, win, prop, 0L, ~0UL, false,
 									XA_CARDINAL, &actual, &format,
@@ -4454,6 +4588,23 @@ determine_and_apply_focus( global_focus_t *pFocus )
 	pFocus->ulCurrentFocusSerial = GetFocusSerial();
 }
 
+static Window
+get_transient_for(xwayland_ctx_t *ctx, Window win)
+{
+	if ( const CachedWindowProperty_t *cached = get_cached_prop( ctx, win, XA_WM_TRANSIENT_FOR ) )
+	{
+		std::span<const uint32_t> values = get_cached_prop_u32s( cached );
+		if ( cached->type == XA_WINDOW && !values.empty() )
+			return values[0];
+		return None;
+	}
+
+	Window transientFor = None;
+	if ( XGetTransientForHint( ctx->dpy, win, &transientFor ) )
+		return transientFor;
+	return None;
+}
+
 static void
 get_win_type(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
 {
@@ -4553,15 +4704,34 @@ get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom)
 {
 	assert(atom == XA_WM_NAME || atom == ctx->atoms.netWMNameAtom);
 
-	// Allocates a title we are meant to free,
-	// let's re-use this allocation for w->title :)
-	XTextProperty tp;
-	XGetTextProperty( ctx->dpy, w->xwayland().id, &tp, atom );
+	Atom encoding = None;
+	std::string value;
+	if ( const CachedWindowProperty_t *cached = get_cached_prop( ctx, w->xwayland().id, atom ) )
+	{
+		if ( cached->format == 8 )
+		{
+			encoding = cached->type;
+			value.assign( cached->data.begin(), cached->data.end() );
+		}
+	}
+	else
+	{
+		XTextProperty tp;
+		if ( !XGetTextProperty( ctx->dpy, w->xwayland().id, &tp, atom ) )
+			return;
+
+		encoding = tp.encoding;
+		if ( tp.value )
+		{
+			value.assign( (const char *)tp.value, tp.nitems );
+			XFree( tp.value );
+		}
+	}
 
 	bool is_utf8;
-	if (tp.encoding == ctx->atoms.utf8StringAtom) {
+	if (encoding == ctx->atoms.utf8StringAtom) {
 		is_utf8 = true;
-	} else if (tp.encoding == XA_STRING) {
+	} else if (encoding == XA_STRING) {
 		is_utf8 = false;
 	} else {
 		return;
@@ -4574,9 +4744,10 @@ get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom)
 		return;
 	}
 
-	if (tp.nitems > 0) {
-		// Ride off the allocation from XGetTextProperty.
-		w->title = std::make_shared<std::string>((const char *)tp.value);
+	if (!value.empty()) {
+		// Stop at the first NUL, same as we'd get from the C string.
+		value.resize( strnlen( value.c_str(), value.size() ) );
+		w->title = std::make_shared<std::string>(std::move(value));
 	} else {
 		w->title = NULL;
 	}
@@ -4586,18 +4757,32 @@ get_win_title(xwayland_ctx_t *ctx, steamcompmgr_win_t *w, Atom atom)
 static void
 get_net_wm_state(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
 {
-	Atom type;
-	int format;
-	unsigned long nitems;
-	unsigned long bytesAfter;
-	unsigned char *data;
-	if (XGetWindowProperty(ctx->dpy, w->xwayland().id, ctx->atoms.netWMStateAtom, 0, 2048, false,
-			AnyPropertyType, &type, &format, &nitems, &bytesAfter, &data) != Success) {
-		return;
+	std::vector<Atom> props;
+	if ( const CachedWindowProperty_t *cached = get_cached_prop( ctx, w->xwayland().id, ctx->atoms.netWMStateAtom ) )
+	{
+		std::span<const uint32_t> values = get_cached_prop_u32s( cached );
+		props.assign( values.begin(), values.end() );
+	}
+	else
+	{
+		Atom type;
+		int format;
+		unsigned long nitems;
+		unsigned long bytesAfter;
+		unsigned char *data;
+		if (XGetWindowProperty(ctx->dpy, w->xwayland().id, ctx->atoms.netWMStateAtom, 0, 2048, false,
+				AnyPropertyType, &type, &format, &nitems, &bytesAfter, &data) != Success) {
+			return;
+		}
+
+		if ( data )
+		{
+			props.assign( (Atom *)data, (Atom *)data + nitems );
+			XFree(data);
+		}
 	}
 
-	Atom *props = (Atom *)data;
-	for (size_t i = 0; i < nitems; i++) {
+	for (size_t i = 0; i < props.size(); i++) {
 		if (props[i] == ctx->atoms.netWMStateFullscreenAtom) {
 			w->isFullscreen = true;
 		} else if (props[i] == ctx->atoms.netWMStateSkipTaskbarAtom) {
@@ -4608,8 +4793,6 @@ get_net_wm_state(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
 			xwm_log.debugf("Unhandled initial NET_WM_STATE property: %s", XGetAtomName(ctx->dpy, props[i]));
 		}
 	}
-
-	XFree(data);
 }
 
 static void
@@ -4636,6 +4819,28 @@ map_win(xwayland_ctx_t* ctx, Window id, unsigned long sequence)
 	XFlush(ctx->dpy);
 
 	/* This needs to be here since we don't get PropertyNotify when unmapped */
+	/* Not _NET_WM_ICON, it can be huge and would sit in the cache until the
+	 * window goes away, get_win_icon reads it directly instead. */
+	const Atom props[] =
+	{
+		ctx->atoms.opacityAtom,
+		ctx->atoms.steamAtom,
+		ctx->atoms.netWMNameAtom,
+		XA_WM_NAME,
+		ctx->atoms.steamInputFocusAtom,
+		ctx->atoms.steamStreamingClientAtom,
+		ctx->atoms.steamStreamingClientVideoAtom,
+		ctx->atoms.gameAtom,
+		ctx->atoms.overlayAtom,
+		ctx->atoms.externalOverlayAtom,
+		ctx->atoms.steamGamescopeVROverlayTarget,
+		ctx->atoms.netWMStateAtom,
+		XA_WM_TRANSIENT_FOR,
+		ctx->atoms.winTypeAtom,
+	};
+	ctx->windowPropertyCache.erase( id );
+	prefetch_win_props( ctx, id, props );
+
 	w->opacity = get_prop(ctx, w->xwayland().id, ctx->atoms.opacityAtom, OPAQUE);
 
 	w->isSteamLegacyBigPicture = get_prop(ctx, w->xwayland().id, ctx->atoms.steamAtom, 0);
@@ -4699,15 +4904,7 @@ map_win(xwayland_ctx_t* ctx, Window id, unsigned long sequence)
 		XFree( wmHints );
 	}
 
-	Window transientFor = None;
-	if ( XGetTransientForHint( ctx->dpy, w->xwayland().id, &transientFor ) )
-	{
-		w->xwayland().transientFor = transientFor;
-	}
-	else
-	{
-		w->xwayland().transientFor = None;
-	}
+	w->xwayland().transientFor = get_transient_for( ctx, w->xwayland().id );
 
 	get_win_type( ctx, w );
 
@@ -4731,6 +4928,7 @@ finish_unmap_win(xwayland_ctx_t *ctx, steamcompmgr_win_t *w)
 
 	/* don't care about properties anymore */
 	XSelectInput(ctx->dpy, w->xwayland().id, 0);
+	ctx->windowPropertyCache.erase( w->xwayland().id );
 
 	ctx->clipChanged = true;
 }
@@ -4945,18 +5143,17 @@ add_win(xwayland_ctx_t *ctx, Window id, Window prev, unsigned long sequence)
 	if ( new_win->isExternalOverlay )
 		new_win->appID = 0;
 
-	Window transientFor = None;
-	if ( XGetTransientForHint( ctx->dpy, id, &transientFor ) )
-	{
-		new_win->xwayland().transientFor = transientFor;
-	}
-	else
-	{
-		new_win->xwayland().transientFor = None;
-	}
+	// Not selected for PropertyNotify yet, so don't keep these around
+	// past here, map_win fetches them again.
+	const Atom props[] = { XA_WM_TRANSIENT_FOR, ctx->atoms.winTypeAtom };
+	prefetch_win_props( ctx, id, props );
+
+	new_win->xwayland().transientFor = get_transient_for( ctx, id );
 
 	get_win_type( ctx, new_win );
 
+	ctx->windowPropertyCache.erase( id );
+
 	new_win->title = NULL;
 	new_win->utf8_title = false;
 
@@ -5104,6 +5301,7 @@ finish_destroy_win(xwayland_ctx_t *ctx, Window id, bool gone)
 		{
 			if (gone)
 				finish_unmap_win (ctx, w);
+			ctx->windowPropertyCache.erase( id );
 			
 			{
 				std::unique_lock lock( ctx->list_mutex );
@@ -5670,6 +5868,10 @@ static inline float santitize_float( float f )
 static void
 handle_property_notify(xwayland_ctx_t *ctx, XPropertyEvent *ev)
 {
+	auto cacheIter = ctx->windowPropertyCache.find( ev->window );
+	if ( cacheIter != ctx->windowPropertyCache.end() )
+		cacheIter->second.erase( ev->atom );
+
 	/* check if Trans property was changed */
 	if (ev->atom == ctx->atoms.opacityAtom)
 	{
@@ -6681,7 +6883,22 @@ bool handle_done_commit( steamcompmgr_win_t *w, xwayland_ctx_t *ctx, uint64_t co
 				if ( w == pFocus->focusWindow && !w->isSteamStreamingClient )
 				{
 					if ( !cv_paint_debug_pause_base_plane )
+					{
 						g_HeldCommits[ HELD_COMMIT_BASE ] = w->commit_queue[ j ];
+						gamescope::CFrameTimingRecorder::Get().MarkCommitLatched( w->commit_queue[ j ]->present_time, get_time_in_nanos() );
+
+						// Commits skipped over on the way here never got shown,
+						// so the first input any of them saw is only showing now.
+						uint64_t ulInputTime = 0;
+						for ( uint32_t k = 0; k <= j; k++ )
+						{
+							uint64_t &ulCommitInputTime = w->commit_queue[ k ]->input_time;
+							if ( ulCommitInputTime && ( !ulInputTime || ulCommitInputTime < ulInputTime ) )
+								ulInputTime = ulCommitInputTime;
+							ulCommitInputTime = 0;
+						}
+						gamescope::CFrameTimingRecorder::Get().MarkInputLatched( ulInputTime );
+					}
 					hasRepaint = true;
 
 					focusWindow_engine = w->engineName;
@@ -6945,62 +7162,6 @@ void force_repaint( void )
 	nudge_steamcompmgr();
 }
 
-struct TempUpscaleImage_t
-{
-	gamescope::OwningRc<CVulkanTexture> pTexture;
-	// Timeline of upscale -> release, to be used as acquire for the commit.
-	std::shared_ptr<gamescope::CTimeline> pReleaseTimeline;
-	uint64_t ulLastPoint = 0ul;
-};
-
-static std::vector<TempUpscaleImage_t> g_pUpscaleImages;
-void ClearUpscaleImages()
-{
-	g_pUpscaleImages.clear();
-}
-
-static TempUpscaleImage_t *GetTempUpscaleImage( uint32_t uWidth, uint32_t uHeight, uint32_t uDrmFormat )
-{
-	if ( g_pUpscaleImages.size() )
-	{
-		// Mixing and matching sizes to only do the min required would be nice
-		// but massively complicates caching.
-		if ( g_pUpscaleImages[0].pTexture->width() != uWidth ||
-			 g_pUpscaleImages[0].pTexture->height() != uHeight ||
-			 g_pUpscaleImages[0].pTexture->drmFormat() != uDrmFormat )
-		{
-			g_pUpscaleImages.clear();
-		}
-	}
-
-	for ( TempUpscaleImage_t &image : g_pUpscaleImages )
-	{
-		if ( !image.pTexture->IsInUse() )
-			return &image;
-	}
-
-	if ( g_pUpscaleImages.size() > 8 )
-	{
-		xwm_log.warnf( "No upscale images free!\n" );
-		return {};
-	}
-
-	gamescope::OwningRc<CVulkanTexture> pTexture = new CVulkanTexture();
-
-	std::shared_ptr<gamescope::CTimeline> pTimeline = gamescope::CTimeline::Create();
-	if ( !pTimeline )
-		return nullptr;
-
-	CVulkanTexture::createFlags imageFlags;
-	imageFlags.bSampled = true;
-	imageFlags.bStorage = true;
-	imageFlags.bFlippable = true;
-	pTexture->BInit( g_nOutputWidth, g_nOutputHeight, 1, uDrmFormat, imageFlags );
-	TempUpscaleImage_t &image = g_pUpscaleImages.emplace_back( std::move( pTexture ), std::move( pTimeline ) );
-
-	return &image;
-}
-
 gamescope::ConVar<bool> cv_surface_update_force_only_current_surface( "surface_update_force_only_current_surface", false, "Force updates to apply only to the current surface, ignoring commits for other surfaces." );
 
 void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, ResListEntry_t& reslistentry)
@@ -7088,6 +7249,7 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 		std::move(reslistentry.presentation_feedbacks),
 		reslistentry.present_id,
 		reslistentry.desired_present_time,
+		reslistentry.input_time,
 		reslistentry.fifo );
 
 	int fence = -1;
@@ -7106,6 +7268,7 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 		bool bPreemptiveUpscale = bValidPreemptiveScale && newCommit->ShouldPreemptivelyUpscale();
 
 		bool bKnownReady = false;
+		bool bPooledFence = false;
 
 		std::pair<int32_t, bool> eventFd = gamescope::CAcquireTimelinePoint::k_InvalidEvent;
 
@@ -7130,7 +7293,7 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 			zoomScaleRatio = flOldZoomScale;
 			flOldOverscanScale = flOldOverscanScale;
 
-			TempUpscaleImage_t *pTempImage = GetTempUpscaleImage( g_nOutputWidth, g_nOutputHeight, g_output.uOutputFormat );
+			UpscaleImage_t *pTempImage = vulkan_acquire_upscale_image( g_nOutputWidth, g_nOutputHeight, g_output.uOutputFormat, EUpscaleImageUsage::Preemptive );
 			if ( pTempImage )
 			{
 				const uint64_t ulNextReleasePoint = ++pTempImage->ulLastPoint;
@@ -7180,10 +7343,9 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 		
 		if ( !bPreemptiveUpscale )
 		{
+			// Not upscaling ahead of time any more, don't sit on the images for it.
 			if ( bValidPreemptiveScale )
-			{
-				ClearUpscaleImages();
-			}
+				vulkan_release_idle_upscale_images( EUpscaleImageUsage::Preemptive );
 
 			if ( reslistentry.pAcquirePoint )
 			{
@@ -7203,6 +7365,7 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 		{
 			fence = eventFd.first;
 			bKnownReady = eventFd.second;
+			bPooledFence = fence >= 0;
 		}
 		else
 		{
@@ -7219,7 +7382,7 @@ void update_wayland_res(CommitDoneList_t *doneCommits, steamcompmgr_win_t *w, Re
 
 		gpuvis_trace_printf( "pushing wait for commit %lu win %lx", newCommit->commitID, w->type == steamcompmgr_win_type_t::XWAYLAND ? w->xwayland().id : 0 );
 		{
-			newCommit->SetFence( fence, mango_nudge, doneCommits );
+			newCommit->SetFence( fence, mango_nudge, doneCommits, bPooledFence );
 			if ( bKnownReady )
 				newCommit->Signal();
 			else
@@ -7963,6 +8126,7 @@ void update_edid_prop()
 }
 
 extern bool g_bLaunchMangoapp;
+extern std::vector<std::string> g_vecHeldGamepadMirrors;
 
 extern void ShutdownGamescope();
 
@@ -7975,7 +8139,8 @@ static gamescope::ConVar<std::string> cv_mouse_relative_filter_appids( "mouse_re
 "Comma separated appids to filter out using relative mouse mode for.",
 []( gamescope::ConVar<std::string> &cvar )
 {
-	std::vector<std::string_view> sFilterAppids = gamescope::Split( cvar, "," );
+	std::string sAppids = cvar;
+	std::vector<std::string_view> sFilterAppids = gamescope::Split( sAppids, "," );
 	std::vector<uint32_t> uFilterAppids;
 	uFilterAppids.reserve( sFilterAppids.size() );
 	for ( auto &sFilterAppid : sFilterAppids )
@@ -8050,7 +8215,16 @@ void LaunchNestedChildren( char **ppPrimaryChildArgv )
 
 	if ( ppPrimaryChildArgv && *ppPrimaryChildArgv )
 	{
-		pid_t nPrimaryChildPid = gamescope::Process::SpawnProcessInWatchdog( ppPrimaryChildArgv, false );
+		std::function<void()> fnPreamble;
+		if ( !g_vecHeldGamepadMirrors.empty() )
+		{
+			fnPreamble = []()
+			{
+				gamescope::CHeldGamepads::RestrictChildToMirrors( g_vecHeldGamepadMirrors );
+			};
+		}
+
+		pid_t nPrimaryChildPid = gamescope::Process::SpawnProcessInWatchdog( ppPrimaryChildArgv, false, fnPreamble );
 
 		std::thread waitThread([ nPrimaryChildPid ]()
 		{
@@ -8285,6 +8459,10 @@ steamcompmgr_main(int argc, char **argv)
 	}
 #endif
 
+	// Convar callbacks touch compositor state, so run them here
+	// no matter which thread set the convar.
+	gamescope::SetConVarCallbackThread( nudge_steamcompmgr );
+
 	for (;;)
 	{
 		{
@@ -8299,11 +8477,15 @@ steamcompmgr_main(int argc, char **argv)
 
 		g_SteamCompMgrWaiter.PollEvents();
 
+		gamescope::RunPendingConVarCallbacks();
+
 		bool vblank = false;
 		if ( std::optional<gamescope::VBlankTime> pendingVBlank = GetVBlankTimer().ProcessVBlank() )
 		{
 			g_SteamCompMgrVBlankTime = *pendingVBlank;
 			vblank = true;
+
+			gamescope::CFrameTimingRecorder::Get().BeginFrame();
 		}
 
 		if ( g_bRun == false )
@@ -8551,6 +8733,8 @@ steamcompmgr_main(int argc, char **argv)
 		}
 
 		{
+			gamescope::CScopedFrameStage latchStage{ gamescope::FrameStages::CommitLatch };
+
 			gamescope_xwayland_server_t *server = NULL;
 			for (size_t i = 0; (server = wlserver_get_xwayland_server(i)); i++)
 			{
@@ -8877,6 +9061,7 @@ steamcompmgr_main(int argc, char **argv)
 			hasRepaintNonBasePlane = false;
 			nIgnoredOverlayRepaints = 0;
 
+			if ( gamescope::CScriptManager::MightHaveHooks( "OnPostPaint" ) )
 			{
 				gamescope::CScriptScopedLock script;
 				script.Manager().CallHook( "OnPostPaint" );
@@ -8894,7 +9079,10 @@ steamcompmgr_main(int argc, char **argv)
 
 #if HAVE_PIPEWIRE
 			if ( pipewire_is_streaming() || pipewire_has_consumer() )
+			{
+				gamescope::CScopedFrameStage captureStage{ gamescope::FrameStages::Capture };
 				paint_pipewire();
+			}
 #endif
 		}
 
@@ -0,0 +1,188 @@
+// Checks that explicit sync eventfds get recycled through CSyncobjEventFdPool,
+// so the number of open fds stays flat with commits flowing through.
+//
+// Signals the eventfds by hand, which is what the kernel does on syncobj
+// signal, then does the same with a real syncobj if there is a render node
+// around that supports timelines.
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+#include "SyncobjEventFdPool.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+static constexpr uint32_t k_uCommitCount = 10'000;
+// Commits waiting on their acquire point at any one time,
+// a few clients with a couple of frames queued each.
+static constexpr uint32_t k_uInFlight = 8;
+
+static uint32_t CountOpenFds()
+{
+    DIR *pDir = opendir( "/proc/self/fd" );
+    if ( !pDir )
+        return 0;
+
+    uint32_t uCount = 0;
+    while ( readdir( pDir ) )
+        uCount++;
+    closedir( pDir );
+    return uCount;
+}
+
+static bool IsReadable( int32_t nFd )
+{
+    pollfd pfd = { .fd = nFd, .events = POLLIN };
+    return poll( &pfd, 1, 1000 ) == 1 && ( pfd.revents & POLLIN );
+}
+
+static void test_software_signal()
+{
+    CSyncobjEventFdPool pool;
+
+    // Warm up to steady state first.
+    std::deque<int32_t> nInFlight;
+    for ( uint32_t i = 0; i < k_uInFlight; i++ )
+        nInFlight.push_back( pool.Acquire() );
+
+    const uint32_t uBaselineFds = CountOpenFds();
+    const uint64_t ulBaselineCreated = pool.GetCreatedCount();
+
+    for ( uint32_t i = 0; i < k_uCommitCount; i++ )
+    {
+        int32_t nEventFd = nInFlight.front();
+        nInFlight.pop_front();
+
+        uint64_t ulValue = 1;
+        TEST_CHECK( write( nEventFd, &ulValue, sizeof( ulValue ) ) == sizeof( ulValue ) );
+        TEST_CHECK( IsReadable( nEventFd ) );
+        pool.Release( nEventFd, true );
+
+        int32_t nNewEventFd = pool.Acquire();
+        TEST_CHECK( nNewEventFd >= 0 );
+        // Must come back drained.
+        TEST_CHECK( read( nNewEventFd, &ulValue, sizeof( ulValue ) ) < 0 );
+        nInFlight.push_back( nNewEventFd );
+    }
+
+    TEST_CHECK( CountOpenFds() == uBaselineFds );
+    TEST_CHECK( pool.GetCreatedCount() == ulBaselineCreated );
+
+    for ( int32_t nEventFd : nInFlight )
+        pool.Release( nEventFd, true );
+}
+
+// One that never fired may still be registered with the kernel.
+static void test_unsignalled_not_reused()
+{
+    CSyncobjEventFdPool pool;
+
+    int32_t nEventFd = pool.Acquire();
+    pool.Release( nEventFd, false );
+    TEST_CHECK( pool.GetFreeCount() == 0 );
+    TEST_CHECK( fcntl( nEventFd, F_GETFD ) < 0 );
+}
+
+static void test_free_list_capped()
+{
+    CSyncobjEventFdPool pool;
+
+    std::deque<int32_t> nFds;
+    for ( size_t i = 0; i < CSyncobjEventFdPool::k_zMaxFreeFds * 2; i++ )
+        nFds.push_back( pool.Acquire() );
+    for ( int32_t nEventFd : nFds )
+        pool.Release( nEventFd, true );
+
+    TEST_CHECK( pool.GetFreeCount() == CSyncobjEventFdPool::k_zMaxFreeFds );
+}
+
+static int32_t OpenTimelineCapableRenderNode()
+{
+    for ( int i = 128; i < 192; i++ )
+    {
+        char szPath[ 64 ];
+        snprintf( szPath, sizeof( szPath ), "/dev/dri/renderD%d", i );
+
+        int32_t nFd = open( szPath, O_RDWR | O_CLOEXEC );
+        if ( nFd < 0 )
+            continue;
+
+        uint64_t ulCap = 0;
+        if ( drmGetCap( nFd, DRM_CAP_SYNCOBJ_TIMELINE, &ulCap ) == 0 && ulCap )
+            return nFd;
+
+        close( nFd );
+    }
+
+    return -1;
+}
+
+static void test_syncobj_signal()
+{
+    int32_t nDrmFd = OpenTimelineCapableRenderNode();
+    if ( nDrmFd < 0 )
+    {
+        printf( "No render node with syncobj timelines, skipping syncobj test\n" );
+        return;
+    }
+
+    uint32_t uHandle = 0;
+    if ( drmSyncobjCreate( nDrmFd, 0, &uHandle ) != 0 )
+    {
+        printf( "drmSyncobjCreate failed, skipping syncobj test\n" );
+        close( nDrmFd );
+        return;
+    }
+
+    CSyncobjEventFdPool pool;
+
+    // Warm up.
+    uint64_t ulPoint = 1;
+    int32_t nWarmUpEventFd = pool.Arm( nDrmFd, uHandle, ulPoint );
+    drmSyncobjTimelineSignal( nDrmFd, &uHandle, &ulPoint, 1 );
+    TEST_CHECK( IsReadable( nWarmUpEventFd ) );
+    pool.Release( nWarmUpEventFd, true );
+
+    const uint32_t uBaselineFds = CountOpenFds();
+    const uint64_t ulBaselineCreated = pool.GetCreatedCount();
+
+    for ( uint32_t i = 0; i < k_uCommitCount; i++ )
+    {
+        ulPoint++;
+
+        int32_t nEventFd = pool.Arm( nDrmFd, uHandle, ulPoint );
+        TEST_CHECK( nEventFd >= 0 );
+        if ( nEventFd < 0 )
+            break;
+
+        TEST_CHECK( drmSyncobjTimelineSignal( nDrmFd, &uHandle, &ulPoint, 1 ) == 0 );
+        TEST_CHECK( IsReadable( nEventFd ) );
+        pool.Release( nEventFd, true );
+    }
+
+    TEST_CHECK( CountOpenFds() == uBaselineFds );
+    TEST_CHECK( pool.GetCreatedCount() == ulBaselineCreated );
+
+    drmSyncobjDestroy( nDrmFd, uHandle );
+    close( nDrmFd );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "syncobj_eventfd_tests\n" );
+
+    test_software_signal();
+    test_unsignalled_not_reused();
+    test_free_list_capped();
+    test_syncobj_signal();
+
+    return TestExitCode();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// What the standalone *_tests executables check with.
+//
+// TEST_CHECK reports a failed expression and carries on, so one run shows
+// everything that's wrong. main returns TestExitCode() at the end.
+
+#include <atomic>
+#include <cstdio>
+
+static std::atomic<int> s_nFailures = { 0 };
+
+#define TEST_CHECK( expr ) \
+    do { if ( !( expr ) ) { fprintf( stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, #expr ); s_nFailures++; } } while ( 0 )
+
+static inline int TestExitCode()
+{
+    if ( s_nFailures )
+        fprintf( stderr, "%d failures\n", s_nFailures.load() );
+    return s_nFailures ? 1 : 0;
+}
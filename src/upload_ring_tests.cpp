@@ -0,0 +1,217 @@
+// Checks that CUploadRing keeps up with steady-state uploads without
+// anyone having to wait on the GPU, which is what CVulkanDevice falls back
+// to when it can't grow the upload buffer.
+//
+// The GPU is simulated rather than a Vulkan device: each frame makes
+// a composite submission, with a LUT or cursor upload every few frames,
+// and submissions complete a couple of frames after they are made.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+
+#include "UploadRing.h"
+#include "test_check.h"
+
+using namespace gamescope;
+
+static constexpr uint64_t k_ulInitialSize = 1920 * 1080 * 4;
+static constexpr uint64_t k_ulAlignment = 16;
+
+// Roughly what vulkan_update_luts and a cursor change upload.
+static constexpr uint64_t k_ulLutSize = 4096 * 8 + 17 * 17 * 17 * 8;
+static constexpr uint64_t k_ulCursorSize = 256 * 256 * 4;
+static constexpr uint64_t k_ulConstantsSize = 1024;
+
+struct SimResult_t
+{
+    // Times we'd have to wait for the GPU to free something up
+    // with a buffer that can't grow.
+    uint32_t uStalls = 0;
+    // Times a buffer that can grow would have.
+    uint32_t uGrows = 0;
+    uint64_t ulPeakUsed = 0;
+};
+
+class CSimulatedDevice
+{
+public:
+    CSimulatedDevice( bool bCanGrow )
+        : m_bCanGrow{ bCanGrow }
+    {
+    }
+
+    // Uploads a LUT every uLutInterval frames, and an image of ulImageSize,
+    // eg. a cursor, every uImageInterval frames.
+    SimResult_t Run( uint32_t uFrames, uint32_t uLutInterval, uint32_t uImageInterval, uint64_t ulImageSize, uint32_t uGpuLatency )
+    {
+        SimResult_t result;
+
+        for ( uint32_t i = 0; i < uFrames; i++ )
+        {
+            if ( uLutInterval && i % uLutInterval == 0 )
+            {
+                Upload( k_ulLutSize, result );
+                Submit();
+            }
+
+            if ( uImageInterval && i % uImageInterval == 0 )
+            {
+                Upload( ulImageSize, result );
+                Submit();
+            }
+
+            // The composite, with a few dispatches' worth of constants.
+            for ( uint32_t j = 0; j < 4; j++ )
+                Upload( k_ulConstantsSize, result );
+            Submit();
+
+            // The GPU finishes this frame's work uGpuLatency frames later.
+            m_ulFrameSeqNos.push_back( m_ulSeqNo );
+            if ( m_ulFrameSeqNos.size() > uGpuLatency )
+            {
+                m_ulCompletedSeqNo = m_ulFrameSeqNos.front();
+                m_ulFrameSeqNos.pop_front();
+            }
+
+            // Like vulkan_garbage_collect, once a frame.
+            m_Ring.Retire( m_ulCompletedSeqNo );
+
+            result.ulPeakUsed = std::max( result.ulPeakUsed, m_Ring.GetUsed() );
+        }
+
+        return result;
+    }
+
+    uint64_t GetCapacity() const { return m_Ring.GetCapacity(); }
+
+private:
+    void Upload( uint64_t ulSize, SimResult_t &result )
+    {
+        std::optional<uint64_t> oulOffset = m_Ring.Allocate( ulSize, k_ulAlignment );
+        if ( !oulOffset )
+        {
+            m_Ring.Retire( m_ulCompletedSeqNo );
+            oulOffset = m_Ring.Allocate( ulSize, k_ulAlignment );
+        }
+
+        if ( !oulOffset )
+        {
+            if ( m_bCanGrow )
+            {
+                result.uGrows++;
+                m_Ring.Reset( std::max( m_Ring.GetCapacity() * 2, ulSize * 2 ) );
+            }
+            else
+            {
+                // waitIdle.
+                result.uStalls++;
+                m_ulCompletedSeqNo = m_ulSeqNo;
+                m_ulFrameSeqNos.clear();
+                m_Ring.Retire( m_ulCompletedSeqNo );
+            }
+
+            oulOffset = m_Ring.Allocate( ulSize, k_ulAlignment );
+        }
+
+        TEST_CHECK( oulOffset );
+        if ( oulOffset )
+            TEST_CHECK( *oulOffset + ulSize <= m_Ring.GetCapacity() );
+    }
+
+    void Submit()
+    {
+        m_Ring.Fence( ++m_ulSeqNo );
+    }
+
+    bool m_bCanGrow;
+    CUploadRing m_Ring{ k_ulInitialSize };
+    uint64_t m_ulSeqNo = 0;
+    uint64_t m_ulCompletedSeqNo = 0;
+    std::deque<uint64_t> m_ulFrameSeqNos;
+};
+
+static void test_allocate_and_retire()
+{
+    CUploadRing ring{ 1024 };
+
+    TEST_CHECK( ring.Allocate( 100, 16 ) == 0u );
+    TEST_CHECK( ring.Allocate( 100, 16 ) == 112u );
+    ring.Fence( 1 );
+    TEST_CHECK( !ring.HasUnfenced() );
+
+    // Doesn't fit until 1 retires.
+    TEST_CHECK( !ring.Allocate( 900, 16 ) );
+    ring.Retire( 0 );
+    TEST_CHECK( !ring.Allocate( 900, 16 ) );
+    ring.Retire( 1 );
+    TEST_CHECK( ring.GetUsed() == 0 );
+
+    // Skips to the start rather than wrapping around the end.
+    TEST_CHECK( ring.Allocate( 900, 16 ) == 0u );
+    TEST_CHECK( ring.HasUnfenced() );
+    ring.Fence( 2 );
+
+    // Too big to ever fit.
+    TEST_CHECK( !ring.Allocate( 2048, 16 ) );
+}
+
+static void test_unfenced_stays()
+{
+    CUploadRing ring{ 1024 };
+
+    ring.Allocate( 512, 16 );
+    ring.Fence( 1 );
+    ring.Allocate( 256, 16 );
+
+    // The second allocation is for a submission that hasn't been made yet.
+    ring.Retire( 1 );
+    TEST_CHECK( ring.GetUsed() == 256 );
+    TEST_CHECK( ring.HasUnfenced() );
+    TEST_CHECK( !ring.Allocate( 1024, 16 ) );
+}
+
+static void test_steady_state_no_stalls()
+{
+    // LUT every frame (eg. a colour slider being dragged), cursor every
+    // other frame, and the GPU running three frames behind.
+    CSimulatedDevice device{ false };
+    SimResult_t result = device.Run( 10'000, 1, 2, k_ulCursorSize, 3 );
+
+    TEST_CHECK( result.uStalls == 0 );
+    TEST_CHECK( result.ulPeakUsed < k_ulInitialSize );
+}
+
+static void test_grows_instead_of_stalling()
+{
+    // Half the initial size every frame, with three frames in flight.
+    static constexpr uint64_t k_ulBigImageSize = k_ulInitialSize / 2;
+
+    CSimulatedDevice stalling{ false };
+    SimResult_t stalled = stalling.Run( 100, 0, 1, k_ulBigImageSize, 3 );
+    TEST_CHECK( stalled.uStalls > 0 );
+
+    CSimulatedDevice growing{ true };
+    SimResult_t warmup = growing.Run( 100, 0, 1, k_ulBigImageSize, 3 );
+    TEST_CHECK( warmup.uStalls == 0 );
+    TEST_CHECK( warmup.uGrows > 0 );
+    TEST_CHECK( warmup.uGrows <= 2 );
+
+    // And once it has grown to fit, it stays put.
+    SimResult_t steady = growing.Run( 10'000, 1, 1, k_ulBigImageSize, 3 );
+    TEST_CHECK( steady.uStalls == 0 );
+    TEST_CHECK( steady.uGrows == 0 );
+}
+
+int main( int argc, char **argv )
+{
+    printf( "upload_ring_tests\n" );
+
+    test_allocate_and_retire();
+    test_unfenced_stays();
+    test_steady_state_no_stalls();
+    test_grows_instead_of_stalling();
+
+    return TestExitCode();
+}
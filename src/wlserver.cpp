@@ -67,6 +67,9 @@
 #include "commit.h"
 #include "Timeline.h"
 #include "Utils/NonCopyable.h"
+#include "LockStats.h"
+#include "FrameTiming.h"
+#include "Utils/MpscList.h"
 
 #if HAVE_PIPEWIRE
 #include "pipewire.hpp"
@@ -130,6 +133,10 @@ std::vector<ResListEntry_t>& gamescope_xwayland_server_t::retrieve_commits()
 
 gamescope::ConVar<bool> cv_drm_debug_syncobj_force_wait_on_commit( "drm_debug_syncobj_force_wait_on_commit", false, "Force a wait on DRM sync objects before committing buffers" );
 
+// When the queued input being delivered actually happened, 0 outside of that.
+// Only touched from the Wayland thread.
+static uint64_t s_ulDeliveringInputTime = 0;
+
 std::optional<ResListEntry_t> PrepareCommit( struct wlr_surface *surf, struct wlr_buffer *buf )
 {
 	auto wl_surf = get_wl_surface_info( surf );
@@ -163,17 +170,26 @@ std::optional<ResListEntry_t> PrepareCommit( struct wlr_surface *surf, struct wl
 		wl_surf->present_id,
 		wl_surf->desired_present_time,
 		std::move( pAcquirePoint ),
-		std::move( pReleasePoint )
+		std::move( pReleasePoint ),
+		0
 	};
 	wl_surf->present_id = std::nullopt;
 	wl_surf->desired_present_time = 0;
 	wl_surf->pending_presentation_feedbacks.clear();
 	wl_surf->oCurrentPresentMode = std::nullopt;
 
-	struct wlr_surface *pConstraintSurface = wlserver_surface_to_main_surface( surf );
+	struct wlr_surface *pMainSurface = wlserver_surface_to_main_surface( surf );
+
+	// Input is marked on the main surface of whatever had focus for it,
+	// and X11 windows can commit through either of theirs.
+	if ( wlserver_wl_surface_info *pMainInfo = get_wl_surface_info( pMainSurface ) )
+	{
+		oNewEntry->input_time = pMainInfo->pending_input_time;
+		pMainInfo->pending_input_time = 0;
+	}
 
 	struct wlr_pointer_constraint_v1 *pConstraint = wlserver.GetCursorConstraint();
-	if ( pConstraint && pConstraint->surface == pConstraintSurface )
+	if ( pConstraint && pConstraint->surface == pMainSurface )
 		wlserver_update_cursor_constraint();
 
 	return oNewEntry;
@@ -280,8 +296,24 @@ void gamescope_xwayland_server_t::xwayland_ready_callback(struct wl_listener *li
 	server->on_xwayland_ready(data);
 }
 
-static void bump_input_counter()
+// Input is being delivered to pSurface, so its next commit is the answer to it.
+// Anything else committing, eg. Steam or an overlay, isn't.
+static void wlserver_mark_input( struct wlr_surface *pSurface )
 {
+	if ( !gamescope::cv_frame_timing || !pSurface )
+		return;
+
+	wlserver_wl_surface_info *pInfo = get_wl_surface_info( wlserver_surface_to_main_surface( pSurface ) );
+	if ( !pInfo || pInfo->pending_input_time )
+		return;
+
+	pInfo->pending_input_time = s_ulDeliveringInputTime ? s_ulDeliveringInputTime : get_time_in_nanos();
+}
+
+static void bump_input_counter( struct wlr_surface *pInputSurface )
+{
+	wlserver_mark_input( pInputSurface );
+
 	inputCounter++;
 	nudge_steamcompmgr();
 }
@@ -293,7 +325,7 @@ static void wlserver_handle_modifiers(struct wl_listener *listener, void *data)
 	wlr_seat_set_keyboard( wlserver.wlr.seat, keyboard );
 	wlr_seat_keyboard_notify_modifiers( wlserver.wlr.seat, &keyboard->modifiers );
 
-	bump_input_counter();
+	bump_input_counter( wlserver.kb_focus_surface );
 }
 
 static void wlserver_handle_key(struct wl_listener *listener, void *data)
@@ -340,7 +372,7 @@ static void wlserver_handle_key(struct wl_listener *listener, void *data)
 		wlr_seat_keyboard_notify_key( wlserver.wlr.seat, event->time_msec, event->keycode, event->state );
 	}
 
-	bump_input_counter();
+	bump_input_counter( wlserver.kb_focus_surface );
 }
 
 static void wlserver_perform_rel_pointer_motion(double unaccel_dx, double unaccel_dy)
@@ -392,7 +424,7 @@ static void wlserver_handle_pointer_frame(struct wl_listener *listener, void *da
 {
 	wlr_seat_pointer_notify_frame( wlserver.wlr.seat );
 
-	bump_input_counter();
+	bump_input_counter( wlserver.mouse_focus_surface );
 }
 
 static inline uint32_t TouchClickModeToLinuxButton( gamescope::TouchClickMode eTouchClickMode )
@@ -2145,21 +2177,200 @@ bool wlserver_is_lock_held(void)
 	return true;
 }
 
-void wlserver_lock(void)
+gamescope::ConVar<bool> cv_wlserver_lock_stats( "wlserver_lock_stats", false, "Time how long everything that takes wlserver_lock waits for and holds it. See wlserver_lock_stats_dump." );
+
+// Both protected by waylock.
+static gamescope::CLockStats s_WaylockStats;
+// Whether whoever has it now is being timed, in case the convar changes while they do.
+static bool s_bWaylockTimed = false;
+
+void wlserver_lock( std::source_location location )
 {
+	if ( !cv_wlserver_lock_stats )
+	{
+		pthread_mutex_lock(&waylock);
+		s_bWaylockTimed = false;
+		return;
+	}
+
+	uint64_t ulWaitStart = get_time_in_nanos();
 	pthread_mutex_lock(&waylock);
+	uint64_t ulNow = get_time_in_nanos();
+
+	s_WaylockStats.Acquired( location, ulNow - ulWaitStart, ulNow );
+	s_bWaylockTimed = true;
 }
 
 void wlserver_unlock(bool flush)
 {
     if (flush)
 	    wl_display_flush_clients(wlserver.display);
+	if ( s_bWaylockTimed )
+		s_WaylockStats.Released( get_time_in_nanos() );
 	pthread_mutex_unlock(&waylock);
 }
 
+static gamescope::ConCommand cc_wlserver_lock_stats_dump( "wlserver_lock_stats_dump", "Print how long each place wlserver_lock is taken from waited for it and held it, most waited first. Needs wlserver_lock_stats.",
+[]( std::span<std::string_view> args )
+{
+	// Commands are run from gamescope_private on the Wayland thread,
+	// which is what makes it safe to look at these.
+	assert( wlserver_is_lock_held() );
+
+	std::vector<gamescope::CLockStats::Site_t> sites = s_WaylockStats.GetSites();
+
+	if ( sites.empty() )
+	{
+		console_log.infof( "No wlserver_lock stats yet.%s", cv_wlserver_lock_stats ? "" : " Set wlserver_lock_stats 1 to collect some." );
+		return;
+	}
+
+	console_log.infof( "%-8s %10s %8s %8s %8s   %10s %8s %8s %8s   %s",
+		"count", "wait tot", "p50", "p99", "max", "hold tot", "p50", "p99", "max", "where" );
+	for ( const gamescope::CLockStats::Site_t &site : sites )
+	{
+		// Microseconds throughout.
+		console_log.infof( "%-8lu %10lu %8lu %8lu %8lu   %10lu %8lu %8lu %8lu   %s:%u (%s)",
+			site.Wait.GetCount(),
+			site.Wait.ulTotalNs / 1'000, site.Wait.GetPercentileNs( 50 ) / 1'000, site.Wait.GetPercentileNs( 99 ) / 1'000, site.Wait.ulMaxNs / 1'000,
+			site.Hold.ulTotalNs / 1'000, site.Hold.GetPercentileNs( 50 ) / 1'000, site.Hold.GetPercentileNs( 99 ) / 1'000, site.Hold.ulMaxNs / 1'000,
+			site.pszFile ? site.pszFile : "(everywhere else)", site.uLine, site.pszFunction ? site.pszFunction : "" );
+	}
+});
+
+static gamescope::ConCommand cc_wlserver_lock_stats_reset( "wlserver_lock_stats_reset", "Start wlserver_lock_stats over.",
+[]( std::span<std::string_view> args )
+{
+	assert( wlserver_is_lock_held() );
+	s_WaylockStats.Reset();
+});
+
+static gamescope::CInputQueue s_InputQueue;
+
+static void wlserver_deliver_queued_input()
+{
+	assert( wlserver_is_lock_held() );
+
+	// Only ever used from the Wayland thread.
+	static std::vector<gamescope::QueuedInput_t> s_Inputs;
+	s_InputQueue.Take( s_Inputs );
+
+	for ( const gamescope::QueuedInput_t &input : s_Inputs )
+	{
+		s_ulDeliveringInputTime = input.ulInputTime;
+
+		switch ( input.eType )
+		{
+			case gamescope::QueuedInput_t::Type::MouseMotion:
+				wlserver_mousemotion( input.flX, input.flY, input.uTime );
+				break;
+			case gamescope::QueuedInput_t::Type::MouseWarp:
+				wlserver_mousewarp( input.flX, input.flY, input.uTime, input.bSynthetic );
+				break;
+			case gamescope::QueuedInput_t::Type::MouseButton:
+				wlserver_mousebutton( input.uCode, input.bPressed, input.uTime );
+				break;
+			case gamescope::QueuedInput_t::Type::MouseWheel:
+				wlserver_mousewheel( input.flX, input.flY, input.uTime );
+				break;
+			case gamescope::QueuedInput_t::Type::Key:
+				wlserver_key( input.uCode, input.bPressed, input.uTime );
+				break;
+			case gamescope::QueuedInput_t::Type::LatencyProbe:
+				wlserver_mark_input( wlserver.kb_focus_surface );
+				break;
+		}
+	}
+
+	s_ulDeliveringInputTime = 0;
+}
+
 extern std::mutex g_SteamCompMgrXWaylandServerMutex;
 
 static int g_wlserverNudgePipe[2] = {-1, -1};
+// The write end of g_wlserverNudgePipe, once wlserver_run has made it.
+// Input threads can start pushing before then.
+static std::atomic<int> s_nWlserverNudgeFd = { -1 };
+
+static void wlserver_nudge()
+{
+	int nFd = s_nWlserverNudgeFd.load( std::memory_order_acquire );
+	if ( nFd < 0 )
+		return;
+
+	if ( write( nFd, "\n", 1 ) < 0 && errno != EAGAIN )
+		wl_log.errorf_errno( "wlserver_nudge: write failed" );
+}
+
+void wlserver_queue_input( const gamescope::QueuedInput_t &input )
+{
+	gamescope::QueuedInput_t queuedInput = input;
+	if ( !queuedInput.ulInputTime && gamescope::cv_frame_timing )
+		queuedInput.ulInputTime = get_time_in_nanos();
+
+	// Only the first needs to wake it up, it takes everything there is when it does.
+	if ( s_InputQueue.Push( queuedInput ) )
+		wlserver_nudge();
+}
+
+static gamescope::ConCommand cc_input_latency_probe( "input_latency_probe", "Pretend some input was delivered to the focused app just now, so its next commit counts towards InputToPresent in frame_timing_stats.",
+[]( std::span<std::string_view> args )
+{
+	// Queued like real input, as this can be run from scripts without
+	// wlserver_lock as well as from gamescope_private with it.
+	wlserver_queue_input( gamescope::QueuedInput_t{ .eType = gamescope::QueuedInput_t::Type::LatencyProbe } );
+});
+
+struct ReleasedCommit_t
+{
+	struct wlr_buffer *pBuffer;
+	struct wlr_surface *pSurface;
+	std::vector<struct wl_resource*> presentationFeedbacks;
+};
+
+static gamescope::CMpscList<ReleasedCommit_t> s_ReleasedCommits;
+
+static void wlserver_finish_release_commit( ReleasedCommit_t &commit )
+{
+	assert( wlserver_is_lock_held() );
+
+	if ( !commit.presentationFeedbacks.empty() )
+	{
+		wlserver_presentation_feedback_discard( commit.pSurface, commit.presentationFeedbacks );
+		// presentationFeedbacks cleared by wlserver_presentation_feedback_discard
+	}
+	wlr_buffer_unlock( commit.pBuffer );
+}
+
+static void wlserver_release_queued_commits()
+{
+	s_ReleasedCommits.Drain( []( ReleasedCommit_t commit )
+	{
+		wlserver_finish_release_commit( commit );
+	});
+}
+
+void wlserver_release_commit( struct wlr_buffer *buf, struct wlr_surface *surf, std::vector<struct wl_resource*> presentation_feedbacks )
+{
+	ReleasedCommit_t commit =
+	{
+		.pBuffer = buf,
+		.pSurface = surf,
+		.presentationFeedbacks = std::move( presentation_feedbacks ),
+	};
+
+	// Nobody to hand it off to, before we've started or after we've stopped.
+	if ( !wlserver.bWaylandServerRunning )
+	{
+		wlserver_lock();
+		wlserver_finish_release_commit( commit );
+		wlserver_unlock();
+		return;
+	}
+
+	if ( s_ReleasedCommits.Push( std::move( commit ) ) )
+		wlserver_nudge();
+}
 
 void wlserver_run(void)
 {
@@ -2170,6 +2381,12 @@ void wlserver_run(void)
 		wl_log.errorf_errno( "wlserver: pipe2 failed" );
 		exit( 1 );
 	}
+	s_nWlserverNudgeFd.store( g_wlserverNudgePipe[ 1 ], std::memory_order_release );
+
+	// Whatever was queued before there was a pipe never got its nudge,
+	// and nothing queued after it will send one while it's still waiting,
+	// so take it on the first time round.
+	wlserver_nudge();
 
 	struct pollfd pollfds[2] = {
         {
@@ -2201,10 +2418,19 @@ void wlserver_run(void)
 			break;
 		}
 
-		if ( pollfds[ 0 ].revents & POLLIN ) {
+		if ( pollfds[ 1 ].revents & POLLIN ) {
+			char buf[ 64 ];
+			while ( read( g_wlserverNudgePipe[ 0 ], buf, sizeof( buf ) ) > 0 )
+				continue;
+		}
+
+		if ( pollfds[ 0 ].revents & POLLIN || pollfds[ 1 ].revents & POLLIN ) {
 			// We have wayland stuff to do, do it while locked
 			wlserver_lock();
 
+			wlserver_deliver_queued_input();
+			wlserver_release_queued_commits();
+
 			wl_display_flush_clients(wlserver.display);
 			int ret = wl_event_loop_dispatch(wlserver.event_loop, 0);
 			if (ret < 0) {
@@ -2238,6 +2464,7 @@ void wlserver_run(void)
 	// We need to shutdown Xwayland before disconnecting all clients, otherwise
 	// wlroots will restart it automatically.
 	wlserver_lock();
+	wlserver_release_queued_commits();
 	wlserver.wlr.xwayland_servers.clear();
 	wl_display_destroy_clients(wlserver.display);
 	wl_display_destroy(wlserver.display);
@@ -2354,7 +2581,7 @@ void wlserver_key( uint32_t key, bool press, uint32_t time )
 		wlr_seat_keyboard_notify_key( wlserver.wlr.seat, time, key, press );
 	}
 
-	bump_input_counter();
+	bump_input_counter( wlserver.kb_focus_surface );
 }
 
 struct wlr_surface *wlserver_surface_to_main_surface( struct wlr_surface *pSurface )
@@ -2673,6 +2900,8 @@ void wlserver_mousemotion( double dx, double dy, uint32_t time )
 {
 	assert( wlserver_is_lock_held() );
 
+	wlserver_mark_input( wlserver.mouse_focus_surface );
+
 	dx *= g_mouseSensitivity;
 	dy *= g_mouseSensitivity;
 
@@ -2711,6 +2940,11 @@ void wlserver_mousewarp( double x, double y, uint32_t time, bool bSynthetic )
 	if ( !bSynthetic )
 		wlserver.bCursorHidden = !wlserver.bCursorHasImage;
 
+	// Absolute pointers come through here as synthetic too, unlike
+	// our own warps they are queued from a real device.
+	if ( !bSynthetic || s_ulDeliveringInputTime )
+		wlserver_mark_input( wlserver.mouse_focus_surface );
+
 	wlserver_oncursorevent();
 
 	wlr_seat_pointer_notify_motion( wlserver.wlr.seat, time, wlserver.mouse_surface_cursorx, wlserver.mouse_surface_cursory );
@@ -2728,6 +2962,8 @@ void wlserver_mousebutton( int button, bool press, uint32_t time )
 {
 	assert( wlserver_is_lock_held() );
 
+	wlserver_mark_input( wlserver.mouse_focus_surface );
+
 	wlserver.bCursorHidden = !wlserver.bCursorHasImage;
 
 	wlserver_oncursorevent();
@@ -2740,6 +2976,8 @@ void wlserver_mousewheel( double flX, double flY, uint32_t time )
 {
 	assert( wlserver_is_lock_held() );
 
+	wlserver_mark_input( wlserver.mouse_focus_surface );
+
 	wlr_seat_pointer_notify_axis( wlserver.wlr.seat, time, WL_POINTER_AXIS_HORIZONTAL_SCROLL, flX, flX * WLR_POINTER_AXIS_DISCRETE_STEP, WL_POINTER_AXIS_SOURCE_WHEEL, WL_POINTER_AXIS_RELATIVE_DIRECTION_IDENTICAL );
 	wlr_seat_pointer_notify_axis( wlserver.wlr.seat, time, WL_POINTER_AXIS_VERTICAL_SCROLL, flY, flY * WLR_POINTER_AXIS_DISCRETE_STEP, WL_POINTER_AXIS_SOURCE_WHEEL, WL_POINTER_AXIS_RELATIVE_DIRECTION_IDENTICAL );
 	wlr_seat_pointer_notify_frame( wlserver.wlr.seat );
@@ -2886,7 +3124,7 @@ void wlserver_touchmotion( double x, double y, int touch_id, uint32_t time, bool
 		}
 	}
 
-	bump_input_counter();
+	bump_input_counter( wlserver.mouse_focus_surface );
 }
 
 void wlserver_touchdown( double x, double y, int touch_id, uint32_t time, gamescope::IBackendConnector* connector )
@@ -2941,7 +3179,7 @@ void wlserver_touchdown( double x, double y, int touch_id, uint32_t time, gamesc
 		}
 	}
 
-	bump_input_counter();
+	bump_input_counter( wlserver.mouse_focus_surface );
 }
 
 void wlserver_touchup( int touch_id, uint32_t time )
@@ -2979,7 +3217,7 @@ void wlserver_touchup( int touch_id, uint32_t time )
 		}
 	}
 
-	bump_input_counter();
+	bump_input_counter( wlserver.mouse_focus_surface );
 }
 
 gamescope_xwayland_server_t *wlserver_get_xwayland_server( size_t index )
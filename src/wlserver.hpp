@@ -12,6 +12,7 @@
 #include <list>
 #include <unordered_map>
 #include <optional>
+#include <source_location>
 
 #include "WaylandServer/WaylandDecls.h"
 #include "WaylandServer/WaylandServerLegacy.h"
@@ -21,6 +22,7 @@
 #include "vulkan_include.h"
 
 #include "steamcompmgr_shared.hpp"
+#include "InputQueue.h"
 
 #if HAVE_DRM
 #define HAVE_SESSION 1
@@ -48,6 +50,9 @@ struct ResListEntry_t {
 	uint64_t desired_present_time;
 	std::shared_ptr<gamescope::CAcquireTimelinePoint> pAcquirePoint;
 	std::shared_ptr<gamescope::CReleaseTimelinePoint> pReleasePoint;
+	// CLOCK_MONOTONIC nanos of the first input delivered to the surface
+	// while it had focus since its last commit, 0 if there wasn't any.
+	uint64_t input_time;
 };
 
 struct wlserver_content_override;
@@ -232,10 +237,19 @@ bool wlserver_init( void );
 
 void wlserver_run(void);
 
-void wlserver_lock(void);
+// location is for wlserver_lock_stats, to tell who was waiting for and holding it.
+void wlserver_lock( std::source_location location = std::source_location::current() );
 void wlserver_unlock(bool flush = true);
 bool wlserver_is_lock_held(void);
 
+// For input threads: delivers input on the Wayland thread, with whatever else
+// has been queued, instead of taking wlserver_lock for it here.
+void wlserver_queue_input( const gamescope::QueuedInput_t &input );
+
+// Unlocks buf, and discards whatever presentation feedback never got presented,
+// on the Wayland thread, so dropping a commit never has to wait on wlserver_lock.
+void wlserver_release_commit( struct wlr_buffer *buf, struct wlr_surface *surf, std::vector<struct wl_resource*> presentation_feedbacks );
+
 void wlserver_keyboardfocus( struct wlr_surface *surface, bool bConstrain = true );
 void wlserver_key( uint32_t key, bool press, uint32_t time );
 
@@ -0,0 +1,143 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include <benchmark/benchmark.h>
+
+#include "InputQueue.h"
+#include "LockStats.h"
+
+using namespace gamescope;
+using namespace std::chrono_literals;
+
+// How long the compositor thread waits for wlserver_lock with several
+// input devices each reporting at 1000Hz, when every event takes the lock
+// itself, against queueing it for the Wayland thread to deliver.
+//
+// Stand-ins for the real thing, which needs a wlserver:
+// delivering an event and dispatching Wayland requests are spins of
+// roughly the right length, and the Wayland thread wakes for client
+// traffic every millisecond as well as for queued input.
+//
+// Time reported is the compositor's average wait per acquire.
+
+static constexpr auto k_InputInterval = 1ms;
+static constexpr auto k_DeliverTime = 2us;
+static constexpr auto k_DispatchTime = 20us;
+static constexpr auto k_CompositorHoldTime = 30us;
+static constexpr auto k_FrameInterval = 2ms;
+
+static void Spin( std::chrono::nanoseconds duration )
+{
+    auto end = std::chrono::steady_clock::now() + duration;
+    while ( std::chrono::steady_clock::now() < end )
+        ;
+}
+
+static uint64_t NowNs()
+{
+    return uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+template <bool bQueued>
+static void Benchmark_CompositorWait( benchmark::State &state )
+{
+    const uint32_t uInputDevices = uint32_t( state.range( 0 ) );
+
+    pthread_mutex_t waylock = PTHREAD_MUTEX_INITIALIZER;
+    CInputQueue inputQueue;
+
+    std::atomic<bool> bDone = { false };
+    std::mutex mutNudge;
+    std::condition_variable cvNudge;
+    bool bNudged = false;
+
+    std::thread waylandThread( [&]()
+    {
+        std::vector<QueuedInput_t> inputs;
+        while ( !bDone )
+        {
+            {
+                std::unique_lock lock{ mutNudge };
+                cvNudge.wait_for( lock, 1ms, [&]() { return bNudged; } );
+                bNudged = false;
+            }
+
+            pthread_mutex_lock( &waylock );
+            inputQueue.Take( inputs );
+            for ( size_t i = 0; i < inputs.size(); i++ )
+                Spin( k_DeliverTime );
+            Spin( k_DispatchTime );
+            pthread_mutex_unlock( &waylock );
+        }
+    });
+
+    std::vector<std::thread> inputThreads;
+    for ( uint32_t i = 0; i < uInputDevices; i++ )
+    {
+        inputThreads.emplace_back( [&]()
+        {
+            auto next = std::chrono::steady_clock::now();
+            uint32_t uSequence = 0;
+            while ( !bDone )
+            {
+                next += k_InputInterval;
+                std::this_thread::sleep_until( next );
+
+                if ( bQueued )
+                {
+                    if ( inputQueue.Push( QueuedInput_t{ .eType = QueuedInput_t::Type::MouseMotion, .flX = 1.0, .uTime = ++uSequence } ) )
+                    {
+                        {
+                            std::scoped_lock lock{ mutNudge };
+                            bNudged = true;
+                        }
+                        cvNudge.notify_one();
+                    }
+                }
+                else
+                {
+                    pthread_mutex_lock( &waylock );
+                    Spin( k_DeliverTime );
+                    pthread_mutex_unlock( &waylock );
+                }
+            }
+        });
+    }
+
+    CLockStats::Histogram_t waits;
+    auto nextFrame = std::chrono::steady_clock::now();
+    for ( auto _ : state )
+    {
+        nextFrame += k_FrameInterval;
+        std::this_thread::sleep_until( nextFrame );
+
+        uint64_t ulStart = NowNs();
+        pthread_mutex_lock( &waylock );
+        uint64_t ulWaitNs = NowNs() - ulStart;
+        Spin( k_CompositorHoldTime );
+        pthread_mutex_unlock( &waylock );
+
+        waits.Add( ulWaitNs );
+        state.SetIterationTime( ulWaitNs / 1'000'000'000.0 );
+    }
+
+    bDone = true;
+    cvNudge.notify_one();
+    waylandThread.join();
+    for ( std::thread &thread : inputThreads )
+        thread.join();
+
+    state.counters[ "p99_wait_us" ] = waits.GetPercentileNs( 99 ) / 1'000.0;
+    state.counters[ "max_wait_us" ] = waits.ulMaxNs / 1'000.0;
+}
+
+BENCHMARK( Benchmark_CompositorWait<false> )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Iterations( 1000 )->UseManualTime()->Unit( benchmark::kMicrosecond );
+BENCHMARK( Benchmark_CompositorWait<true> )->Arg( 1 )->Arg( 4 )->Arg( 8 )->Iterations( 1000 )->UseManualTime()->Unit( benchmark::kMicrosecond );
+
+BENCHMARK_MAIN();
@@ -5,6 +5,7 @@
 
 #include <mutex>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include <X11/Xlib.h>
@@ -58,6 +59,15 @@ struct CommitDoneList_t
 	std::vector< CommitDoneEntry_t > listCommitsDone;
 };
 
+// A raw property as it came back from the X server.
+// type is None if the window didn't have it.
+struct CachedWindowProperty_t
+{
+	Atom type = None;
+	uint8_t format = 0;
+	std::vector<uint8_t> data;
+};
+
 struct xwayland_ctx_t final : public gamescope::IWaitable
 {
 	gamescope_xwayland_server_t *xwayland_server;
@@ -94,6 +104,11 @@ struct xwayland_ctx_t final : public gamescope::IWaitable
 
 	bool force_windows_fullscreen = false;
 
+	// Properties fetched in one batch by prefetch_win_props.
+	// Entries are dropped on PropertyNotify, so this is only kept around
+	// for windows we have PropertyChangeMask selected on, ie. mapped ones.
+	std::unordered_map< Window, std::unordered_map< Atom, CachedWindowProperty_t > > windowPropertyCache;
+
 	std::vector< steamcompmgr_win_t* > GetPossibleFocusWindows();
 	void DetermineAndApplyFocus( const std::vector< steamcompmgr_win_t* > &vecPossibleFocusWindows );
 